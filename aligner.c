@@ -226,15 +226,19 @@ void aligner_seg_seq (VBlockP vb, ContextP bitmap_ctx, const char *seq, uint32_t
 
     BitArray *bitmap = buf_get_bitarray (&bitmap_ctx->local);
 
+    // estimated number of seqs in this VB: one per line in FASTQ/SAM, but in FASTA lines are aligned together in chunks of seq_len.
+    // note: seq_len may be 0 - empty sequences are valid in FASTQ
+    uint64_t est_num_seqs = seq_len ? MIN (vb->lines.len, vb->txt_data.len / seq_len + 1) : vb->lines.len;
+
     // allocate bitmaps - provide name only if buffer is not allocated, to avoid re-writing param which would overwrite nbits that overlays it + param must be 0
-    buf_alloc (vb, &bitmap_ctx->local, MAX (bitmap_ctx->local.len + roundup_bits2bytes64 (seq_len), vb->lines.len * (seq_len+5) / 8), CTX_GROWTH, 
+    buf_alloc (vb, &bitmap_ctx->local, MAX (roundup_bits2bytes64 (buf_get_bitarray (&bitmap_ctx->local)->nbits + seq_len), est_num_seqs * (seq_len+5) / 8), CTX_GROWTH, 
                buf_is_allocated (&bitmap_ctx->local) ? NULL : "contexts->local"); 
 
-    buf_alloc (vb, &strand_ctx->local, MAX (nonref_ctx->local.len + sizeof (int64_t), roundup_bits2bytes64 (vb->lines.len)), CTX_GROWTH, 
+    buf_alloc (vb, &strand_ctx->local, MAX (roundup_bits2bytes64 (buf_get_bitarray (&strand_ctx->local)->nbits + 1), roundup_bits2bytes64 (est_num_seqs)), CTX_GROWTH, 
                buf_is_allocated (&strand_ctx->local) ? NULL : "contexts->local"); 
 
-    buf_alloc (vb, &nonref_ctx->local, MAX (nonref_ctx->local.len + seq_len + 3, vb->lines.len * seq_len / 4), CTX_GROWTH, "contexts->local"); 
-    buf_alloc (vb, &gpos_ctx->local,   MAX (nonref_ctx->local.len + sizeof (uint32_t), vb->lines.len * sizeof (uint32_t)), CTX_GROWTH, "contexts->local"); 
+    buf_alloc (vb, &nonref_ctx->local, MAX (nonref_ctx->local.len + seq_len + 3, est_num_seqs * seq_len / 4), CTX_GROWTH, "contexts->local"); 
+    buf_alloc (vb, &gpos_ctx->local,   MAX ((gpos_ctx->local.len + 1) * sizeof (uint32_t), est_num_seqs * sizeof (uint32_t)), CTX_GROWTH, "contexts->local"); 
 
     bool is_forward, is_all_ref;
     PosType gpos = aligner_best_match ((VBlockP)vb, seq, seq_len, &is_forward, &is_all_ref);
@@ -360,7 +364,7 @@ void aligner_reconstruct_seq (VBlockP vb, ContextP bitmap_ctx, uint32_t seq_len,
 
         // first file of a pair ("pair 1") or a non-pair fastq or sam
         if (!is_pair_2) {
-            gpos = NEXTLOCAL (uint32_t, gpos_ctx);
+            gpos = gpos_ctx->last_value.i = NEXTLOCAL (uint32_t, gpos_ctx); // last_value is consumed by fastq_piz_filter for --ref-region
             is_forward = NEXTLOCALBIT (strand_ctx);        
         }
 
@@ -395,6 +399,7 @@ void aligner_reconstruct_seq (VBlockP vb, ContextP bitmap_ctx, uint32_t seq_len,
                     RECONSTRUCT1 (NEXTLOCAL (char, nonref_ctx));
     }
     else {
+        gpos_ctx->last_value.i = NO_GPOS; // all-nonref VB
         RECONSTRUCT (ENT (char, nonref_ctx->local, nonref_ctx->next_local), seq_len);
         nonref_ctx->next_local += seq_len;
     }
@@ -14,6 +14,8 @@
 #include "arch.h"
 #include "txtfile.h"
 #include "codec.h"
+#include "mutex.h"
+#include "txtindex.h"
 
 #define uncomp_size param // for vb->compressed, we store the uncompressed size in param
 
@@ -286,6 +288,65 @@ struct FlagsBgzf bgzf_get_compression_level (const char *filename, const uint8_t
 // PIZ SIDE
 //---------
 
+// A BGZF block that is split between the end of one VB and the beginning of the next is compressed by the compute thread 
+// of whichever of the two VBs completes second: the first one to complete deposits its fragment of the block here, and the 
+// second one compresses the entire block - appending it to the end of its vb->compressed if it is the earlier VB, or to the
+// beginning if it is the later VB - so that the I/O thread just writes vb->compressed to disk. 
+// split_blocks is a ring indexed by the vb_i of the earlier VB: at most num_vbs+1 VB boundaries are in-flight at any time.
+static uint32_t bgzf_compress_one_block (VBlock *vb, struct FlagsBgzf bgzf_flags, const char *in, uint32_t isize, int32_t block_i, int32_t txt_index);
+
+typedef struct {
+    uint32_t vb_i;      // vb_i of the earlier VB of the two sharing the block, or 0 if this entry is empty
+    bool is_tail;       // true if the fragment is the tail of the earlier VB, false if it is the head of the later VB
+    uint32_t len;
+    char data[BGZF_MAX_BLOCK_SIZE];
+} BgzfSplitBlock;
+
+static BgzfSplitBlock *split_blocks = NULL;
+static uint32_t num_split_blocks = 0;
+static Mutex split_blocks_mutex = {};
+
+// PIZ I/O thread: called when starting a new txt file - no compute threads are running 
+static void bgzf_reset_split_blocks (void)
+{
+    for (uint32_t i=0; i < num_split_blocks; i++) split_blocks[i].vb_i = 0;
+}
+
+// PIZ compute thread: called from bgzf_compress_vb for the block shared with the previous VB (is_tail=false) or with the next VB (is_tail=true)
+static void bgzf_compress_split_block (VBlock *vb, bool is_tail, const char *fragment, uint32_t fragment_len)
+{
+    uint32_t vb_i = is_tail ? vb->vblock_i : vb->vblock_i - 1; // vb_i of the earlier VB
+    BgzfSplitBlock *sb = &split_blocks[vb_i % num_split_blocks];
+
+    mutex_lock (split_blocks_mutex);
+
+    bool other_is_here = (sb->vb_i == vb_i && sb->is_tail != is_tail);
+
+    // case: the other VB hasn't completed yet - deposit our fragment, and the other VB will compress the block
+    if (!other_is_here) {
+        *sb = (BgzfSplitBlock){ .vb_i = vb_i, .is_tail = is_tail, .len = fragment_len };
+        memcpy (sb->data, fragment, fragment_len);
+    }
+
+    mutex_unlock (split_blocks_mutex);
+
+    if (!other_is_here) return;
+
+    // case: the other VB has already deposited its fragment - we compress the block. note: no need to lock as no other thread 
+    // will access this entry until it is reused by a subsequent VB, which cannot happen until this VB is written
+    char block[BGZF_MAX_BLOCK_SIZE];
+    uint32_t block_size = sb->len + fragment_len;
+
+    ASSERTE (block_size <= BGZF_MAX_BLOCK_SIZE, "split block of vb_i=%u has size %u, beyond the maximum BGZF block size", vb_i, block_size);
+
+    memcpy (&block[is_tail ? 0 : sb->len], fragment, fragment_len);
+    memcpy (&block[is_tail ? fragment_len : 0], sb->data, sb->len);
+    sb->vb_i = 0; // release entry
+
+    bgzf_compress_one_block (vb, txt_file->bgzf_flags, block, block_size, -1, is_tail ? (int32_t)(vb->txt_data.len - fragment_len) : -(int32_t)(block_size - fragment_len));
+    vb->compressed.uncomp_size += block_size;
+}
+
 bool bgzf_load_isizes (const SectionListEntry *sl_ent) 
 {
     // skip passed all VBs of this component, and read SEC_BGZF - the last section of the component - if it exists
@@ -304,6 +365,9 @@ bool bgzf_load_isizes (const SectionListEntry *sl_ent)
         !txt_file->bgzf_flags.level) // the user can override this behaviour with --bgzf
         txt_file->bgzf_flags.level = BGZF_COMP_LEVEL_DEFAULT;
 
+    txt_file->bgzf_passed_down_one_vb = false;
+    bgzf_reset_split_blocks();
+
     zfile_uncompress_section (evb, header, &txt_file->bgzf_isizes, "txt_file->bgzf_isizes", 0, SEC_BGZF);
     txt_file->bgzf_isizes.len /= 2;
 
@@ -327,9 +391,16 @@ void bgzf_calculate_blocks_one_vb (VBlock *vb, uint32_t vb_txt_data_len)
     // then we don't prescribe blocks, and let the VB compress based on the actual length of data reconstructed
     if (!txt_file->bgzf_isizes.len) return;
 
+    if (vb != evb && !split_blocks) {
+        num_split_blocks = vb_get_pool()->num_vbs + 2;
+        split_blocks = CALLOC (num_split_blocks * sizeof (BgzfSplitBlock));
+        mutex_initialize (split_blocks_mutex);
+    }
+
     // if we have an initial region of txt_data that has a split block with the previous VB - 
     // that will be our first block, with a negative index. the previous VBs final data is now in bzgf_passed_down_len
     int32_t index = -txt_file->bzgf_passed_down_len; // first block should cover passed down data too
+    bool passed_down_one_vb = txt_file->bgzf_passed_down_one_vb;
 
     while (next_isize < txt_file->bgzf_isizes.len) { 
         
@@ -349,6 +420,12 @@ void bgzf_calculate_blocks_one_vb (VBlock *vb, uint32_t vb_txt_data_len)
         next_isize++;
     }
 
+    // if the previous VB passed down only its own tail, and we complete the block - it can be compressed by a compute thread. 
+    // otherwise (the passed down data spans multiple VBs or the txt header) - it is compressed by bgzf_write_to_disk
+    vb->bgzf_split_in_compute = (vb != evb) && passed_down_one_vb && vb->bgzf_blocks.len && FIRSTENT (BgzfBlockPiz, vb->bgzf_blocks)->txt_index < 0;
+
+    txt_file->bgzf_passed_down_one_vb = (vb != evb) && vb->bgzf_blocks.len && index < (int32_t)vb_txt_data_len;
+
     #undef next_isize
 }
 
@@ -375,7 +452,7 @@ static void bgzf_free_compressor (VBlock *vb, struct FlagsBgzf bgzf_flags)
     vb->gzip_compressor = NULL;
 }
 
-static uint32_t bgzf_compress_one_block (VBlock *vb, const char *in, uint32_t isize,
+static uint32_t bgzf_compress_one_block (VBlock *vb, struct FlagsBgzf bgzf_flags, const char *in, uint32_t isize,
                                          int32_t block_i, int32_t txt_index) // for show_bgzf (both may be negative - indicating previous VB)
 {
     START_TIMER;
@@ -392,7 +469,7 @@ static uint32_t bgzf_compress_one_block (VBlock *vb, const char *in, uint32_t is
     uint32_t comp_index = vb->compressed.len;
     int out_size;
 
-    if (txt_file->bgzf_flags.library == BGZF_LIBDEFLATE) { // libdeflate
+    if (bgzf_flags.library == BGZF_LIBDEFLATE) { // libdeflate
 
         out_size = (int)libdeflate_deflate_compress (vb->gzip_compressor, in, isize, AFTERENT (char, vb->compressed), BGZF_MAX_CDATA_SIZE);
 
@@ -408,7 +485,7 @@ static uint32_t bgzf_compress_one_block (VBlock *vb, const char *in, uint32_t is
     else { // zlib
         #define strm ((z_stream *)vb->gzip_compressor)
 
-        ASSERTE0 (deflateInit2 (vb->gzip_compressor, txt_file->bgzf_flags.level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) == Z_OK, 
+        ASSERTE0 (deflateInit2 (vb->gzip_compressor, bgzf_flags.level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) == Z_OK, 
                   "deflateInit2 failed");
 
         strm->next_in   = (uint8_t *)in;
@@ -464,7 +541,7 @@ static void bgzf_compress_vb_no_blocks (VBlock *vb)
         uint32_t block_isize = MIN (BGZF_CREATED_BLOCK_SIZE, vb->txt_data.len - next);
         buf_alloc_more (vb, &vb->compressed, BGZF_MAX_BLOCK_SIZE, 0, uint8_t, 1.5, "compressed");
 
-        bgzf_compress_one_block (vb, ENT (char, vb->txt_data, next), block_isize, block_i++, next);
+        bgzf_compress_one_block (vb, txt_file->bgzf_flags, ENT (char, vb->txt_data, next), block_isize, block_i++, next);
 
         NEXTENT (BgzfBlockPiz, vb->bgzf_blocks) = (BgzfBlockPiz){ .txt_index = next, .txt_size = block_isize };
         next += block_isize;
@@ -475,6 +552,27 @@ static void bgzf_compress_vb_no_blocks (VBlock *vb)
     bgzf_free_compressor (vb, txt_file->bgzf_flags);
 }
 
+// BGZF-compress data into vb->compressed, including an EOF block - used for BGZF files that we create, eg a TBI index 
+void bgzf_compress_buffer (VBlock *vb, const char *data, uint64_t data_len)
+{
+    ASSERTE0 (!vb->compressed.len, "expecting vb->compressed to be free, but its not");
+
+    struct FlagsBgzf bgzf_flags = { .library = BGZF_LIBDEFLATE, .level = BGZF_COMP_LEVEL_DEFAULT };
+
+    buf_alloc (vb, &vb->compressed, data_len/2 + BGZF_MAX_BLOCK_SIZE, 1, "compressed"); // alloc based on estimated size
+    bgzf_alloc_compressor (vb, bgzf_flags);
+
+    for (uint64_t next=0, block_i=0; next < data_len; next += BGZF_CREATED_BLOCK_SIZE, block_i++) {
+        buf_alloc_more (vb, &vb->compressed, BGZF_MAX_BLOCK_SIZE, 0, uint8_t, 1.5, "compressed");
+        bgzf_compress_one_block (vb, bgzf_flags, &data[next], MIN (BGZF_CREATED_BLOCK_SIZE, data_len - next), block_i, next);
+    }
+
+    bgzf_free_compressor (vb, bgzf_flags);
+
+    buf_alloc_more (vb, &vb->compressed, BGZF_EOF_LEN, 0, uint8_t, 1, "compressed");
+    buf_add (&vb->compressed, BGZF_EOF, BGZF_EOF_LEN);
+}
+
 // Called in the Compute Thread for VBs and in I/O thread for the Txt Header.
 // bgzf-compress vb->txt_data into vb->compressed - reconstructing the same-isize BGZF blocks as the original txt file
 // note: data at the beginning and end of txt_data that doesn't fit into a whole BGZF block (i.e. the block is shared
@@ -498,6 +596,11 @@ void bgzf_compress_vb (VBlock *vb)
     bgzf_alloc_compressor (vb, txt_file->bgzf_flags);
 
     ARRAY (BgzfBlockPiz, blocks, vb->bgzf_blocks);
+
+    // the block shared with the previous VB: if the previous VB has already completed, we compress it, otherwise we deposit our head for it
+    if (vb->bgzf_split_in_compute)
+        bgzf_compress_split_block (vb, false, FIRSTENT (char, vb->txt_data), blocks[0].txt_index + blocks[0].txt_size);
+
     for (uint64_t i=0; i < vb->bgzf_blocks.len; i++) {
 
         ASSERTE (blocks[i].txt_index + blocks[i].txt_size <= vb->txt_data.len, 
@@ -505,22 +608,36 @@ void bgzf_compress_vb (VBlock *vb)
                  i, blocks[i].txt_index, blocks[i].txt_size, (uint32_t)vb->txt_data.len);
 
         // case: all the data is from the current VB. if there is any data from the previous VB, the index will be negative 
-        // and we will compress it in bgzf_write_to_disk() instead
+        // and we will compress it in bgzf_compress_split_block() above or in bgzf_write_to_disk() instead
         if (blocks[i].txt_index >= 0) {
-            bgzf_compress_one_block (vb, ENT (char, vb->txt_data, blocks[i].txt_index), blocks[i].txt_size, i, blocks[i].txt_index);
+            bgzf_compress_one_block (vb, txt_file->bgzf_flags, ENT (char, vb->txt_data, blocks[i].txt_index), blocks[i].txt_size, i, blocks[i].txt_index);
             vb->compressed.uncomp_size += blocks[i].txt_size;
         }
     }
 
+    // the block shared with the next VB: if the next VB has already completed, we compress it, otherwise we deposit our tail for it.
+    // note: if the next VB doesn't complete the block, it won't pick up our deposit, and the block is compressed in bgzf_write_to_disk
+    uint32_t last_data_index = blocks[vb->bgzf_blocks.len-1].txt_index + blocks[vb->bgzf_blocks.len-1].txt_size;
+    if (vb != evb && last_data_index < vb->txt_data.len)
+        bgzf_compress_split_block (vb, true, ENT (char, vb->txt_data, last_data_index), vb->txt_data.len - last_data_index);
+
     bgzf_free_compressor (vb, txt_file->bgzf_flags);
 }
 
 // PIZ: Called by I/O thread to complete the work Compute Thread cannot do - see 1,2,3 below
 void bgzf_write_to_disk (VBlock *vb)
 {
+    bool index = txtindex_get_type (txt_file) != TXTINDEX_NONE;
+    if (index) txtindex_add_vb (vb); 
+
     // Step 1. bgzf-compress the BGZF block that is split between end the previous VB(s) (data currently in txt_file->unconsumed_txt)
     //    and the beginning of this VB, and write the compressed data to disk
-    if (txt_file->unconsumed_txt.len) {
+    // case: the block was already compressed by the compute thread of this VB or the previous one (see bgzf_compress_split_block)
+    if (vb->bgzf_split_in_compute) {
+        buf_free (&txt_file->unconsumed_txt);
+    }
+
+    else if (txt_file->unconsumed_txt.len) {
 
         BgzfBlockPiz *first_block = FIRSTENT (BgzfBlockPiz, vb->bgzf_blocks); // this block contains both uncosumed data and the first data of this VB
         int32_t first_data_len = first_block->txt_index + first_block->txt_size; // hopefully the VB has this much, but possibly not...
@@ -539,10 +656,11 @@ void bgzf_write_to_disk (VBlock *vb)
             ASSERTE0 (!evb->compressed.len, "expecting evb->compressed to be empty");
 
             bgzf_alloc_compressor (evb, txt_file->bgzf_flags);
-            bgzf_compress_one_block (evb, block, first_block->txt_size, 0, first_block->txt_index); // compress into evb->compressed
+            bgzf_compress_one_block (evb, txt_file->bgzf_flags, block, first_block->txt_size, 0, first_block->txt_index); // compress into evb->compressed
             bgzf_free_compressor (evb, txt_file->bgzf_flags);
 
             if (!flag.test) file_write (txt_file, evb->compressed.data, evb->compressed.len);
+            if (index) txtindex_add_bgzf_blocks (evb->compressed.data, evb->compressed.len);
 
             txt_file->txt_data_so_far_single += first_block->txt_size;
             txt_file->disk_so_far            += evb->compressed.len;
@@ -563,6 +681,8 @@ void bgzf_write_to_disk (VBlock *vb)
         if (!flag.test) 
             file_write (txt_file, vb->compressed.data, vb->compressed.len);
 
+        if (index) txtindex_add_bgzf_blocks (vb->compressed.data, vb->compressed.len);
+
         txt_file->txt_data_so_far_single += vb->compressed.uncomp_size;
         txt_file->disk_so_far            += vb->compressed.len; // evb->compressed.len;
         buf_free (&vb->compressed);
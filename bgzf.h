@@ -53,5 +53,6 @@ extern struct FlagsBgzf bgzf_get_compression_level (const char *filename, const
 extern bool bgzf_load_isizes (ConstSectionListEntryP sl_ent);
 extern void bgzf_calculate_blocks_one_vb (VBlockP vb, uint32_t vb_txt_data_len);
 extern void bgzf_compress_vb (VBlockP vb);
+extern void bgzf_compress_buffer (VBlockP vb, const char *data, uint64_t data_len);
 extern void bgzf_write_to_disk (VBlockP vb);
 extern void bgzf_write_finalize (FileP file);
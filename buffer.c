@@ -39,6 +39,15 @@ static const unsigned control_size = 2*sizeof (uint64_t) + sizeof(uint16_t); //
 static Mutex overlay_mutex = {}; // used to thread-protect overlay counters (note: not initializing here - different in different OSes)
 static uint64_t abandoned_mem_current = 0;
 static uint64_t abandoned_mem_high_watermark = 0;
+static uint64_t memory_in_use = 0; // heap memory held by regular buffers of all VBs (excluding mmap'ed memory. abandoned memory is included until it is freed) - for --max-memory
+
+#define buf_account_add(bytes) __atomic_add_fetch (&memory_in_use, (uint64_t)(bytes), __ATOMIC_RELAXED)
+#define buf_account_sub(bytes) __atomic_sub_fetch (&memory_in_use, (uint64_t)(bytes), __ATOMIC_RELAXED)
+
+uint64_t buf_get_memory_in_use (void)
+{
+    return __atomic_load_n (&memory_in_use, __ATOMIC_RELAXED);
+}
 
 static void *buf_low_level_realloc (void *p, size_t size, const char *name, const char *func, uint32_t code_line);
 
@@ -261,6 +270,21 @@ static int buf_stats_sort_by_bytes(const void *a, const void *b)
     return ((MemStats*)a)->bytes < ((MemStats*)b)->bytes ? 1 : -1;
 }
 
+// total heap memory currently held by the buffers of one VB (or evb) - same accounting as buf_display_memory_usage, except
+// that mmap'ed buffers are excluded, as their pages are backed by a file and can be reclaimed by the OS
+uint64_t buf_vb_memory_usage (ConstVBlockP vb)
+{
+    const Buffer *buf_list = &vb->buffer_list;
+    uint64_t bytes = 0;
+
+    for (unsigned buf_i=0; buf_i < buf_list->len; buf_i++) {
+        const Buffer *buf = ((Buffer **)buf_list->data)[buf_i];
+        if (buf && buf->memory && buf->type != BUF_MMAP) bytes += buf->size + control_size;
+    }
+
+    return bytes;
+}
+
 void buf_display_memory_usage (bool memory_full, unsigned max_threads, unsigned used_threads)
 {
     #define MAX_MEMORY_STATS 100
@@ -417,7 +441,10 @@ uint64_t buf_alloc_do (VBlock *vb,
 
     // case 1: we have enough memory already
     if (requested_size <= buf->size) {
-        if (!buf->data) buf_init (buf, buf->memory, buf->size, buf->size, func, code_line, name);
+        if (!buf->data) {
+            buf_init (buf, buf->memory, buf->size, buf->size, func, code_line, name);
+            buf_account_add (buf->size + control_size); // memory retained by buf_free is in use again
+        }
         goto finish;
     }
 
@@ -435,6 +462,8 @@ uint64_t buf_alloc_do (VBlock *vb,
 
         uint64_t old_size = buf->size;
 
+        if (!buf->data) buf_account_add (old_size + control_size); // memory retained by buf_free is in use again
+
         // special handling if we have an overlaying buffer
         if (buf->overlayable) {
             mutex_lock (overlay_mutex);
@@ -466,6 +495,7 @@ uint64_t buf_alloc_do (VBlock *vb,
                 __atomic_store_n (&buf->memory, BUFFER_BEING_MODIFIED, __ATOMIC_RELAXED);
                 char *new_memory = (char *)buf_low_level_realloc (old_memory, new_size + control_size, name, func, code_line);
                 buf_init (buf, new_memory, new_size, old_size, func, code_line, name);
+                buf_account_add (new_size - old_size);
             }
             buf->overlayable = true; // renew this, as it was reset by buf_init
             mutex_unlock (overlay_mutex);
@@ -476,6 +506,7 @@ uint64_t buf_alloc_do (VBlock *vb,
             __atomic_store_n (&buf->memory, BUFFER_BEING_MODIFIED, __ATOMIC_RELAXED);
             char *new_memory = (char *)buf_low_level_realloc (old_memory, new_size + control_size, name, func, code_line);
             buf_init (buf, new_memory, new_size, old_size, func, code_line, name);
+            buf_account_add (new_size - old_size);
         }
     }
 
@@ -489,6 +520,7 @@ uint64_t buf_alloc_do (VBlock *vb,
         buf->type = BUF_REGULAR;
 
         buf_init (buf, memory, new_size, 0, func, code_line, name);
+        buf_account_add (new_size + control_size);
         buf_add_to_buffer_list(vb, buf);
     }
 
@@ -538,7 +570,7 @@ void buf_overlay_do (VBlock *vb,
 {
     // if this buffer was used by a previous VB as a regular buffer - we need to "destroy" it first
     if (overlaid_buf->type == BUF_REGULAR && overlaid_buf->data == NULL && overlaid_buf->memory) {
-        buf_low_level_free (overlaid_buf->memory, func, code_line);
+        buf_low_level_free (overlaid_buf->memory, func, code_line); // note: retained memory is not counted in memory_in_use
         overlaid_buf->type = BUF_UNALLOCATED;
     }
     
@@ -579,8 +611,9 @@ bool buf_mmap_do (VBlock *vb, Buffer *buf, const char *filename, const char *fun
     if (!file_exists (filename)) return false; 
 
     // if this buffer was used by a previous VB as a regular buffer - we need to "destroy" it first
-    if (buf->type == BUF_REGULAR && buf->data == NULL && buf->memory) 
-        buf_low_level_free (buf->memory, func, code_line);
+    if (buf->type == BUF_REGULAR && buf->data == NULL && buf->memory) {
+        buf_low_level_free (buf->memory, func, code_line); // note: retained memory is not counted in memory_in_use
+    }
 
     uint64_t file_size = file_get_size (filename);
 
@@ -667,10 +700,14 @@ void buf_free_do (Buffer *buf, const char *func, uint32_t code_line)
             // In Windows, we observe that free() operations are expensive and significantly slow down execution - so we
             // just recycle the same memory
             if (!buf->overlayable) {
+                if (buf->memory) buf_account_sub (buf->size + control_size);
                 buf_low_level_free (buf->memory, func, code_line);
                 buf->memory = NULL;
                 buf->size   = 0;
             }
+#else
+            // the memory is retained for reuse by this buffer - it is not counted in memory_in_use until buf_alloc reuses it
+            if (buf->memory && buf->data) buf_account_sub (buf->size + control_size);
 #endif
             buf->data        = NULL; 
             buf->overlayable = false;
@@ -695,6 +732,7 @@ void buf_free_do (Buffer *buf, const char *func, uint32_t code_line)
             if (! (*overlay_count)) {
                 buf_low_level_free (buf->data - sizeof(uint64_t), func, code_line); // the original buf->memory
                 abandoned_mem_current -= buf->size;
+                buf_account_sub (buf->size + control_size); // abandoned memory remains in memory_in_use until freed here
             }
     
             buf_reset (buf);
@@ -756,7 +794,8 @@ void buf_destroy_do (Buffer *buf, const char *func, uint32_t code_line)
     ASSERTE (overlay_count==1, "cannot destroy buffer %s because it is currently overlaid", buf->name);
 
     switch (buf->type) {
-        case BUF_REGULAR     : buf_low_level_free (buf->memory, func, code_line); break;
+        case BUF_REGULAR     : if (buf->memory && buf->data) buf_account_sub (buf->size + control_size); // retained memory is not counted
+                               buf_low_level_free (buf->memory, func, code_line); break;
         case BUF_OVERLAY     : buf_free (buf);   /* stop overlaying */            break;
         case BUF_MMAP        : buf_free (buf);   /* stop mmap'ing   */            break;
         case BUF_UNALLOCATED :                                                    break;
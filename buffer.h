@@ -159,6 +159,8 @@ typedef struct {
 } MemStats;
 
 extern void buf_display_memory_usage (bool memory_full, unsigned max_threads, unsigned used_threads);
+extern uint64_t buf_vb_memory_usage (ConstVBlockP vb);
+extern uint64_t buf_get_memory_in_use (void);
 
 #define buf_set(buf_p,value) { if ((buf_p)->data) memset ((buf_p)->data, value, (buf_p)->size); }
 #define buf_zero(buf_p) buf_set(buf_p, 0)
@@ -0,0 +1,229 @@
+// ------------------------------------------------------------------
+//   checkpoint.c
+//   Copyright (C) 2020 Divon Lan <divon@genozip.com>
+//   Please see terms and conditions in the files LICENSE.non-commercial.txt and LICENSE.commercial.txt
+
+// Sub-VB positional index: with --checkpoints, ZIP records, every flag.checkpoint_lines lines, the state of all
+// context iterators at the start of that line, along with the POS range of the lines that follow until the next
+// checkpoint. In PIZ with --regions, the compute thread seeks the iterators directly to the first checkpoint whose
+// lines might be included in the regions, and stops reconstructing after the last such segment - rather than
+// reconstructing the entire VB just to filter out most of its lines.
+//
+// The index is stored as the local data (LT_UINT32) of the dict_id_CHECKPOINT context. It consists of a record per
+// checkpoint:
+// header: line_i in VB, min_pos (2 words), max_pos (2 words), num_ctxs
+// num_ctxs x context: dict_id (2 words), b250 words consumed, local entries consumed, last_value (2 words), last_delta (2 words)
+//
+// Limitations: the index is generated only for VBs with a single CHROM (as the RA of a VB provides only its
+// first chrom to PIZ). Singletons are moved to local only at merge time, so for contexts that may have singletons,
+// the local entries consumed are not known at seg time - they are recorded as CP_LOCAL_STONS and PIZ skips one
+// local item for every SNIP_LOOKUP it skips in the b250.
+
+#include "genozip.h"
+#include "checkpoint.h"
+#include "vblock.h"
+#include "context.h"
+#include "dict_id.h"
+#include "flags.h"
+#include "regions.h"
+#include "random_access.h"
+#include "endianness.h"
+#include "codec.h"
+#include "data_types.h"
+
+#define CP_HDR_WORDS   6
+#define CP_CTX_WORDS   8
+#define CP_LOCAL_STONS 0xffffffff
+
+#define CP_REC_WORDS(rec) (CP_HDR_WORDS + (rec)[5] * CP_CTX_WORDS)
+
+static inline void cp_put64 (uint32_t *w, uint64_t value) { w[0] = (uint32_t)value; w[1] = (uint32_t)(value >> 32); }
+static inline uint64_t cp_get64 (const uint32_t *w)        { return (uint64_t)w[0] | ((uint64_t)w[1] << 32); }
+
+// --------------------
+// ZIP stuff
+// --------------------
+
+static inline bool checkpoint_zip_is_ctx_recorded (VBlockP vb, ContextP ctx)
+{
+    return ctx->dict_id.num && ctx->dict_id.num != dict_id_CHECKPOINT &&
+           ctx != vb->ht_matrix_ctx && ctx != vb->runs_ctx && ctx != vb->fgrc_ctx && // haplotype matrix is seeked by line, not by iterator
+           (ctx->b250.len || ctx->local.len || ctx->last_value.i || ctx->last_delta);
+}
+
+// update the POS range of the current checkpoint with the line that was just segmented
+static void checkpoint_zip_add_prev_line (VBlockP vb)
+{
+    Context *chrom_ctx = &vb->contexts[CHROM];
+
+    // case: VB has more than one chrom - we don't index it
+    if (chrom_ctx->b250.len && *FIRSTENT (uint32_t, chrom_ctx->b250) != *LASTENT (uint32_t, chrom_ctx->b250)) {
+        vb->no_checkpoints = true;
+        buf_free (&vb->checkpoints);
+        return;
+    }
+
+    PosType pos = vb->contexts[DTF(pos)].last_value.i;
+    uint32_t *rec = ENT (uint32_t, vb->checkpoints, vb->checkpoints.param);
+
+    if (pos < (PosType)cp_get64 (&rec[1])) cp_put64 (&rec[1], pos);
+    if (pos > (PosType)cp_get64 (&rec[3])) cp_put64 (&rec[3], pos);
+}
+
+// ZIP compute thread: called before segmenting each line
+void checkpoint_zip_line (VBlockP vb)
+{
+    if (vb->no_checkpoints) return;
+
+    if (vb->line_i) checkpoint_zip_add_prev_line (vb);
+
+    if (vb->no_checkpoints || vb->line_i % flag.checkpoint_lines) return;
+
+    uint32_t num_ctxs = 0;
+    if (vb->line_i) // state at the beginning of the VB is the initial state - no need to record contexts
+        for (DidIType did_i=0; did_i < vb->num_contexts; did_i++)
+            if (checkpoint_zip_is_ctx_recorded (vb, &vb->contexts[did_i])) num_ctxs++;
+
+    buf_alloc_more (vb, &vb->checkpoints, CP_HDR_WORDS + num_ctxs * CP_CTX_WORDS, 0, uint32_t, 2, "checkpoints");
+
+    vb->checkpoints.param = vb->checkpoints.len;
+    uint32_t *rec = AFTERENT (uint32_t, vb->checkpoints);
+
+    rec[0] = vb->line_i;
+    cp_put64 (&rec[1], MAX_POS);
+    cp_put64 (&rec[3], 0);
+    rec[5] = num_ctxs;
+
+    uint32_t *w = &rec[CP_HDR_WORDS];
+    for (DidIType did_i=0; did_i < vb->num_contexts && num_ctxs; did_i++) {
+        Context *ctx = &vb->contexts[did_i];
+        if (!checkpoint_zip_is_ctx_recorded (vb, ctx)) continue;
+
+        cp_put64 (&w[0], ctx->dict_id.num);
+        w[2] = (uint32_t)ctx->b250.len;  // at seg time, b250 is an array of uint32 node indices - one per word
+        w[3] = (uint32_t)ctx->local.len; // in units of the ltype (bytes for LT_TEXT)
+        cp_put64 (&w[4], ctx->last_value.i);
+        cp_put64 (&w[6], ctx->last_delta);
+        w += CP_CTX_WORDS;
+    }
+
+    vb->checkpoints.len += CP_REC_WORDS (rec);
+}
+
+// ZIP compute thread: called from seg_finalize - move the checkpoints to the local of the CHECKPOINT context
+void checkpoint_zip_finalize (VBlockP vb)
+{
+    if (vb->no_checkpoints || !vb->checkpoints.len) return;
+
+    checkpoint_zip_add_prev_line (vb); // last line of the VB
+
+    // case: no benefit, as the VB has only one checkpoint, or it has multiple chroms
+    if (vb->no_checkpoints || vb->checkpoints.param == 0) return;
+
+    Context *cp_ctx = ctx_get_ctx (vb, dict_id_CHECKPOINT);
+    cp_ctx->ltype   = LT_UINT32;
+    cp_ctx->no_stons = true;
+
+    // contexts that might have singletons - we know only now what their final ltype is
+    ARRAY (uint32_t, cp, vb->checkpoints);
+    for (uint32_t i=0; i < vb->checkpoints.len; i += CP_REC_WORDS (&cp[i])) {
+        uint32_t *w = &cp[i + CP_HDR_WORDS];
+        for (uint32_t ctx_i=0; ctx_i < cp[i+5]; ctx_i++, w += CP_CTX_WORDS) {
+            Context *ctx = ctx_get_existing_ctx (vb, cp_get64 (&w[0]));
+            if (ctx->ltype == LT_TEXT && !ctx->no_stons) w[3] = CP_LOCAL_STONS;
+        }
+    }
+
+    buf_alloc (vb, &cp_ctx->local, vb->checkpoints.len * sizeof (uint32_t), 1, "contexts->local");
+    cp_ctx->local.len = vb->checkpoints.len;
+
+    ARRAY (uint32_t, local, cp_ctx->local);
+    for (uint32_t i=0; i < vb->checkpoints.len; i++) local[i] = BGEN32 (cp[i]);
+
+    buf_free (&vb->checkpoints);
+}
+
+// --------------------
+// PIZ stuff
+// --------------------
+
+static inline void checkpoint_piz_skip_local_text (Context *ctx)
+{
+    ARRAY (const char, data, ctx->local);
+    while (ctx->next_local < ctx->local.len && data[ctx->next_local] != SNIP_SEP) ctx->next_local++;
+    ctx->next_local++; // skip the separator
+}
+
+static void checkpoint_piz_seek_ctx (VBlockP vb, Context *ctx, const uint32_t *w)
+{
+    uint32_t b250_words = w[2];
+    bool stons = (w[3] == CP_LOCAL_STONS);
+
+    // skip b250 words - one at a time, as they are variable-length and might be WORD_INDEX_ONE_UP
+    if (buf_is_allocated (&ctx->b250) || (stons && ctx->word_list.len))
+        for (uint32_t i=0; i < b250_words; i++) {
+            const char *snip;
+            uint32_t snip_len;
+            ctx_get_next_snip (vb, ctx, ctx->flags.all_the_same, NULL, &snip, &snip_len);
+
+            if (stons && snip && snip_len && snip[0] == SNIP_LOOKUP)
+                checkpoint_piz_skip_local_text (ctx);
+        }
+
+    if (!stons) ctx->next_local = w[3];
+
+    ctx->last_value.i = (int64_t)cp_get64 (&w[4]);
+    ctx->last_delta   = (int64_t)cp_get64 (&w[6]);
+}
+
+// PIZ compute thread: called after the contexts are uncompressed, if --regions. If the VB has checkpoints,
+// seek to the first checkpoint that might contain included lines, and set the range of lines to reconstruct
+void checkpoint_piz_seek (VBlockP vb)
+{
+    if (!flag.regions) return;
+
+    Context *cp_ctx = ctx_get_existing_ctx (vb, dict_id_CHECKPOINT);
+    if (!cp_ctx || !cp_ctx->local.len) return;
+
+    // the haplotype matrix is seeked by line, which we know how to do only for PBWT
+    Context *ht_ctx = ctx_get_existing_ctx (vb, dict_id_FORMAT_GT_HT);
+    if (ht_ctx && ht_ctx->local.len && ht_ctx->lcodec != CODEC_PBWT) return;
+
+    WordIndex chrom;
+    PosType vb_min_pos, vb_max_pos, reg_min_pos, reg_max_pos;
+    random_access_get_ra_info (vb->vblock_i, &chrom, &vb_min_pos, &vb_max_pos);
+
+    if (!regions_get_envelope (chrom, vb_min_pos, vb_max_pos, &reg_min_pos, &reg_max_pos)) return;
+
+    // find the first and last checkpoints whose lines might be included in the regions
+    ARRAY (const uint32_t, cp, cp_ctx->local);
+    const uint32_t *first=NULL, *last=NULL;
+    for (uint32_t i=0; i < cp_ctx->local.len; i += CP_REC_WORDS (&cp[i]))
+        if ((PosType)cp_get64 (&cp[i+1]) <= reg_max_pos && (PosType)cp_get64 (&cp[i+3]) >= reg_min_pos) {
+            if (!first) first = &cp[i];
+            last = &cp[i];
+        }
+
+    // case: no line of the VB is included, even though its range intersects a region
+    if (!first) {
+        vb->first_rep = vb->after_rep = (uint32_t)vb->lines.len;
+        return;
+    }
+
+    const uint32_t *after_last = last + CP_REC_WORDS (last);
+    vb->first_rep = first[0];
+    vb->after_rep = (after_last < AFTERENT (uint32_t, cp_ctx->local)) ? after_last[0] : (uint32_t)vb->lines.len;
+
+    if (!vb->first_rep && vb->after_rep == vb->lines.len) { // all lines are needed
+        vb->after_rep = 0;
+        return;
+    }
+
+    const uint32_t *w = &first[CP_HDR_WORDS];
+    for (uint32_t ctx_i=0; ctx_i < first[5]; ctx_i++, w += CP_CTX_WORDS) {
+        Context *ctx = ctx_get_existing_ctx (vb, cp_get64 (&w[0]));
+        if (ctx) checkpoint_piz_seek_ctx (vb, ctx, w); // ctx might not exist if its sections were skipped
+    }
+
+    if (ht_ctx) ht_ctx->next_local = vb->first_rep * vb->ht_per_line;
+}
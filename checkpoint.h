@@ -0,0 +1,20 @@
+// ------------------------------------------------------------------
+//   checkpoint.h
+//   Copyright (C) 2020 Divon Lan <divon@genozip.com>
+//   Please see terms and conditions in the files LICENSE.non-commercial.txt and LICENSE.commercial.txt
+
+#ifndef CHECKPOINT_INCLUDED
+#define CHECKPOINT_INCLUDED
+
+#include "genozip.h"
+
+#define CHECKPOINT_DEFAULT_LINES 1000
+
+// ZIP
+extern void checkpoint_zip_line (VBlockP vb);
+extern void checkpoint_zip_finalize (VBlockP vb);
+
+// PIZ
+extern void checkpoint_piz_seek (VBlockP vb);
+
+#endif
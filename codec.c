@@ -11,6 +11,7 @@
 #include "zfile.h"
 #include "profiler.h"
 #include "bgzf.h"
+#include "codec_cache.h"
 
 // --------------------------------------
 // memory functions that serve the codecs
@@ -55,8 +56,8 @@ void codec_free_all (VBlock *vb)
         buf_free (&vb->codec_bufs[i]);
 }
 
-static bool codec_compress_error (VBlock *vb, SectionHeader *header, const char *uncompressed, uint32_t *uncompressed_len, LocalGetLineCB callback,
-                                  char *compressed, uint32_t *compressed_len, bool soft_fail) 
+bool codec_compress_error (VBlock *vb, SectionHeader *header, const char *uncompressed, uint32_t *uncompressed_len, LocalGetLineCB callback,
+                           char *compressed, uint32_t *compressed_len, bool soft_fail) 
 {
     ABORT_R ("Error in comp_compress: Unsupported codec: %s", codec_name (header->codec));
 }
@@ -106,8 +107,15 @@ typedef struct {
     double clock;
 } CodecTest;
 
-static int codec_assign_sorter (const CodecTest *t1, const CodecTest *t2)
+// ZSTD decompresses several times faster than the other codecs, so we accept a slightly bigger size in return
+#define ZSTD_SIZE_WEIGHT 0.97
+
+static int codec_assign_sorter (const CodecTest *t1_, const CodecTest *t2_)
 {
+    CodecTest tw1 = *t1_, tw2 = *t2_, *t1 = &tw1, *t2 = &tw2;
+    if (t1->codec == CODEC_ZSTD) t1->size *= ZSTD_SIZE_WEIGHT;
+    if (t2->codec == CODEC_ZSTD) t2->size *= ZSTD_SIZE_WEIGHT;
+
     // in --fast mode - if one if significantly faster with a modest size hit, take it. Otherwise, take the best.
     if (flag.fast) {
         if (t1->clock < t2->clock * 0.90 && t1->size < t2->size * 1.3) return -1; // t1 has 10% or more better time with at most 30% size hit
@@ -160,8 +168,10 @@ Codec codec_assign_best_codec (VBlockP vb,
     bool is_local = (st == SEC_LOCAL);
     bool is_b250  = (st == SEC_B250 );
 
-    CodecTest tests[] = { { CODEC_BZ2 }, { CODEC_NONE }, { CODEC_BSC }, { CODEC_LZMA } };
-    const unsigned num_tests = 4;
+    CodecTest tests[] = { { CODEC_BZ2 }, { CODEC_NONE }, { CODEC_BSC }, { CODEC_LZMA }, { CODEC_ZSTD }, { CODEC_QCTX } };
+    
+    // QCTX is designed for quality scores - we test it only for local sequence data (QUAL and alike)
+    const unsigned num_tests = (is_local && ctx->ltype == LT_SEQUENCE) ? 6 : 5;
 
     Codec non_ctx_codec = CODEC_UNKNOWN; // used for non-b250, non-local sections
 
@@ -193,6 +203,14 @@ Codec codec_assign_best_codec (VBlockP vb,
         goto done;
     }
 
+    // case: codec was selected for this type of data in a previous execution of genozip
+    if (flag.codec_cache && (is_b250 || is_local) && 
+        (zf_codec = codec_cache_get (vb->data_type, ctx, st)) != CODEC_UNKNOWN) {
+        *selected_codec = zf_codec;
+        ctx_commit_codec_to_zf_ctx (vb, ctx, is_local);
+        goto done;
+    }
+
     // measure the compressed size and duration for a small sample of of the local data, for each codec
     for (unsigned t=0; t < num_tests; t++) {
         *selected_codec = tests[t].codec;
@@ -229,7 +247,15 @@ Codec codec_assign_best_codec (VBlockP vb,
     // assign the best codec - the first one in the sorted array - and commit it to zf_ctx
     *selected_codec = tests[0].codec;
 
-    if (is_b250 || is_local) ctx_commit_codec_to_zf_ctx (vb, ctx, is_local);
+    if (is_b250 || is_local) {
+        // case: ZSTD was selected for a section of vb=1 that fits entirely in the sample - train a dictionary for this context
+        if (*selected_codec == CODEC_ZSTD && vb->vblock_i == 1 && data->len == save_data_len * (is_local ? lt_desc[ctx->ltype].width : 1) &&
+            !zfile_get_local_data_callback (vb->data_type, ctx))
+            codec_zstd_train_dict (vb, ctx->dict_id, st, data->data, data->len);
+
+        ctx_commit_codec_to_zf_ctx (vb, ctx, is_local);
+        if (flag.codec_cache) codec_cache_set (vb->data_type, ctx, st, *selected_codec);
+    }
 
 done:
     // roll back
@@ -250,6 +276,8 @@ void codec_show_time (VBlock *vb, const char *name, const char *subname, Codec c
         (strcmp (flag.show_time, "compressor_bsc"   ) && codec==CODEC_BSC ) || 
         (strcmp (flag.show_time, "compressor_acgt"  ) && codec==CODEC_ACGT) || 
         (strcmp (flag.show_time, "compressor_domq"  ) && codec==CODEC_DOMQ) || 
+        (strcmp (flag.show_time, "compressor_qctx"  ) && codec==CODEC_QCTX) || 
+        (strcmp (flag.show_time, "compressor_zstd"  ) && codec==CODEC_ZSTD) || 
         (strcmp (flag.show_time, "compressor_hapmat") && codec==CODEC_HAPM) || 
         (strcmp (flag.show_time, "compressor_bz2"   ) && codec==CODEC_BZ2 )) {
 
@@ -58,7 +58,7 @@ typedef struct {
     { 1, "BZ2",  "+.bz2",  "bzip2 -d -c", codec_bz2_compress,    codec_bz2_uncompress,  NA3,                    NA4                 }, \
     { 1, "LZMA", "+",      NA0,           codec_lzma_compress,   codec_lzma_uncompress, NA3,                    NA4                 }, \
     { 1, "BSC",  "+",      NA0,           codec_bsc_compress,    codec_bsc_uncompress,  NA3,                    codec_bsc_est_size  }, \
-    { 0, "FFU6", "+",      NA0,           NA1,                   NA2,                   NA3,                    NA4                 }, \
+    { 1, "ZSTD", "+",      NA0,           codec_zstd_compress,   codec_zstd_uncompress, NA3,                    codec_zstd_est_size }, \
     { 0, "FFU7", "+",      NA0,           NA1,                   NA2,                   NA3,                    NA4                 }, \
     { 0, "FFU8", "+",      NA0,           NA1,                   NA2,                   NA3,                    NA4                 }, \
     { 0, "FFU9", "+",      NA0,           NA1,                   NA2,                   NA3,                    NA4                 }, \
@@ -68,7 +68,7 @@ typedef struct {
     { 0, "DOMQ", "+",      NA0,           codec_domq_compress,   USE_SUBCODEC,          codec_domq_reconstruct, USE_SUBCODEC,       CODEC_BSC  /* QUAL     */ }, \
     { 0, "GTSH", "+",      NA0,           codec_gtshark_compress, codec_gtshark_uncompress, codec_pbwt_reconstruct, NA4,            }, \
     { 0, "PBWT", "+",      NA0,           codec_pbwt_compress,   codec_pbwt_uncompress, codec_pbwt_reconstruct, codec_none_est_size }, \
-    { 0, "FF16", "+",      NA0,           NA1,                   NA2,                   NA3,                    NA4                 }, \
+    { 1, "QCTX", "+",      NA0,           codec_qctx_compress,   codec_qctx_uncompress, NA3,                    codec_qctx_est_size }, \
     { 0, "FF17", "+",      NA0,           NA1,                   NA2,                   NA3,                    NA4                 }, \
     { 0, "FF18", "+",      NA0,           NA1,                   NA2,                   NA3,                    NA4                 }, \
     { 0, "FF19", "+",      NA0,           NA1,                   NA2,                   NA3,                    NA4                 }, \
@@ -83,14 +83,17 @@ typedef struct {
 extern CodecArgs codec_args[NUM_CODECS];
 
 extern CodecCompress codec_bz2_compress, codec_lzma_compress, codec_domq_compress, codec_hapmat_compress, codec_bsc_compress, 
-                     codec_none_compress, codec_acgt_compress, codec_xcgt_compress, codec_gtshark_compress, codec_pbwt_compress;
+                     codec_none_compress, codec_acgt_compress, codec_xcgt_compress, codec_gtshark_compress, codec_pbwt_compress,
+                     codec_qctx_compress, codec_zstd_compress, codec_compress_error;
 
 extern CodecUncompress codec_bz2_uncompress, codec_lzma_uncompress, codec_acgt_uncompress, codec_xcgt_uncompress,
-                       codec_bsc_uncompress, codec_none_uncompress, codec_gtshark_uncompress, codec_pbwt_uncompress;
+                       codec_bsc_uncompress, codec_none_uncompress, codec_gtshark_uncompress, codec_pbwt_uncompress,
+                       codec_qctx_uncompress, codec_zstd_uncompress;
 
 extern CodecReconstruct codec_hapmat_reconstruct, codec_domq_reconstruct, codec_pbwt_reconstruct;
 
-extern CodecEstSizeFunc codec_none_est_size, codec_bsc_est_size, codec_hapmat_est_size, codec_domq_est_size;
+extern CodecEstSizeFunc codec_none_est_size, codec_bsc_est_size, codec_hapmat_est_size, codec_domq_est_size, codec_qctx_est_size,
+                        codec_zstd_est_size;
 
 // non-codec-specific functions
 extern void codec_initialize (void);
@@ -114,6 +117,11 @@ extern void codec_acgt_reconstruct (VBlockP vb, ContextP ctx, const char *snip,
 // BSC stuff
 extern void codec_bsc_initialize (void);
 
+// ZSTD stuff
+extern void codec_zstd_train_dict (VBlockP vb, DictId dict_id, SectionType st, const char *data, uint64_t data_len);
+extern void codec_zstd_compress_dicts (void);
+extern void codec_zstd_read_dicts (void);
+
 // HATMAP stuff
 extern void codec_hapmat_comp_init (VBlockP vb);
 extern void codec_hapmat_piz_calculate_columns (VBlockP vb);
@@ -0,0 +1,169 @@
+// ------------------------------------------------------------------
+//   codec_cache.c
+//   Copyright (C) 2020 Divon Lan <divon@genozip.com>
+//   Please see terms and conditions in the files LICENSE.non-commercial.txt and LICENSE.commercial.txt
+
+// With --codec-cache, the codecs selected by codec_assign_best_codec are remembered across genozip executions, in a
+// cache file keyed by data type, dict_id, ltype and section type. When compressing many files of the same type, this
+// saves re-testing all codecs for every context of every file. Every CODEC_CACHE_REVALIDATE uses of an entry, the
+// codecs are tested again and the entry is updated, in case the data has changed its nature.
+//
+// The cache file is a text file with one entry per line: data_type dict_id ltype section_type codec uses name
+// (name is for the human reader only)
+
+#include <errno.h>
+#include "genozip.h"
+#include "codec_cache.h"
+#include "codec.h"
+#include "context.h"
+#include "buffer.h"
+#include "file.h"
+#include "flags.h"
+#include "mutex.h"
+#include "strings.h"
+#include "sections.h"
+#include "dict_id.h"
+
+#define CODEC_CACHE_REVALIDATE 64
+#define CODEC_CACHE_HEADER "# genozip codec cache v1\n"
+
+typedef struct {
+    DataType dt;
+    DictId dict_id;
+    LocalType ltype;
+    SectionType st;
+    Codec codec;
+    uint32_t uses;
+} CodecCacheEnt;
+
+static Buffer cache = EMPTY_BUFFER;
+static Mutex cache_mutex = {};
+static bool cache_modified = false;
+static char *cache_filename = NULL;
+
+static char *codec_cache_get_filename (void)
+{
+    if (flag.codec_cache[0]) return (char *)flag.codec_cache; // user specified a file name
+
+#ifdef _WIN32
+    const char *folder = getenv ("APPDATA");
+#else
+    const char *folder = getenv ("HOME");
+#endif
+    ASSINP (folder, "%s: cannot find the default location of the codec cache - please specify a file name: --codec-cache=<filename>", global_cmd);
+
+    char *filename = MALLOC (strlen (folder) + 50);
+    sprintf (filename, "%s/.genozip_codec_cache", folder);
+
+    return filename;
+}
+
+// ZIP: called by main thread, before the first file is compressed
+void codec_cache_load (void)
+{
+    mutex_initialize (cache_mutex);
+
+    static Buffer data = EMPTY_BUFFER;
+
+    cache_filename = codec_cache_get_filename();
+    if (!file_exists (cache_filename)) goto done; // the cache file will be created when we save it
+
+    file_get_file (evb, cache_filename, &data, "codec_cache_data", true);
+
+    if (data.len < strlen (CODEC_CACHE_HEADER) || memcmp (data.data, CODEC_CACHE_HEADER, strlen (CODEC_CACHE_HEADER))) {
+        WARN ("Warning: ignoring %s because it is not a genozip codec cache file", cache_filename);
+        goto done;
+    }
+
+    for (char *line = data.data + strlen (CODEC_CACHE_HEADER); line && *line; line = strchr (line, '\n'), line = line ? line+1 : NULL) {
+        unsigned dt, ltype, st, codec, uses;
+        uint64_t dict_id_num;
+
+        if (sscanf (line, "%u %"PRIx64" %u %u %u %u", &dt, &dict_id_num, &ltype, &st, &codec, &uses) != 6 ||
+            dt >= NUM_DATATYPES || ltype >= NUM_LOCAL_TYPES || st >= NUM_SEC_TYPES || codec >= NUM_CODECS) continue; // skip bad lines
+
+        // skip codecs that codec_assign_best_codec would never select, eg from a corrupt or stale cache file
+        if (!codec_args[codec].is_simple || codec_args[codec].compress == codec_compress_error) continue;
+
+        buf_alloc_more (evb, &cache, 1, 256, CodecCacheEnt, 2, "codec_cache");
+        NEXTENT (CodecCacheEnt, cache) = (CodecCacheEnt){ .dt = dt, .dict_id.num = dict_id_num, .ltype = ltype, .st = st, .codec = codec, .uses = uses };
+    }
+
+done:
+    buf_destroy (&data);
+
+    // allocate now, in the main thread, so that cache is added to evb's buffer_list by the thread that owns evb. 
+    // compute threads only grow it (in codec_cache_set, under cache_mutex)
+    buf_alloc (evb, &cache, (cache.len + 256) * sizeof (CodecCacheEnt), 1, "codec_cache");
+}
+
+static CodecCacheEnt *codec_cache_find (DataType dt, ConstContextP ctx, SectionType st)
+{
+    ARRAY (CodecCacheEnt, ents, cache);
+
+    for (uint64_t i=0; i < cache.len; i++)
+        if (ents[i].dict_id.num == ctx->dict_id.num && ents[i].dt == dt && ents[i].ltype == ctx->ltype && ents[i].st == st)
+            return &ents[i];
+
+    return NULL;
+}
+
+// ZIP compute thread: returns the cached codec, or CODEC_UNKNOWN if there is none, or if it is time to re-validate it
+Codec codec_cache_get (DataType dt, ConstContextP ctx, SectionType st)
+{
+    mutex_lock (cache_mutex);
+
+    CodecCacheEnt *ent = codec_cache_find (dt, ctx, st);
+    Codec codec = CODEC_UNKNOWN;
+
+    if (ent) {
+        ent->uses++;
+        cache_modified = true;
+
+        if (ent->uses % CODEC_CACHE_REVALIDATE) codec = ent->codec;
+    }
+
+    mutex_unlock (cache_mutex);
+
+    return codec;
+}
+
+// ZIP compute thread: called after a codec was selected by testing. note: cache was allocated in codec_cache_load.
+void codec_cache_set (DataType dt, ConstContextP ctx, SectionType st, Codec codec)
+{
+    mutex_lock (cache_mutex);
+
+    CodecCacheEnt *ent = codec_cache_find (dt, ctx, st);
+
+    if (!ent) {
+        buf_alloc_more (evb, &cache, 1, 256, CodecCacheEnt, 2, "codec_cache");
+        ent = &NEXTENT (CodecCacheEnt, cache);
+        *ent = (CodecCacheEnt){ .dt = dt, .dict_id = ctx->dict_id, .ltype = ctx->ltype, .st = st, .uses = 1 };
+    }
+
+    ent->codec = codec;
+    cache_modified = true;
+
+    mutex_unlock (cache_mutex);
+}
+
+// ZIP: called by main thread after all files are compressed
+void codec_cache_save (void)
+{
+    if (!cache_modified) return;
+
+    static Buffer data = EMPTY_BUFFER;
+    buf_alloc (evb, &data, strlen (CODEC_CACHE_HEADER) + cache.len * 80, 1, "codec_cache_data");
+    buf_add (&data, CODEC_CACHE_HEADER, strlen (CODEC_CACHE_HEADER));
+
+    ARRAY (CodecCacheEnt, ents, cache);
+    for (uint64_t i=0; i < cache.len; i++)
+        data.len += sprintf (AFTERENT (char, data), "%u %"PRIx64" %u %u %u %u %.8s\n",
+                             ents[i].dt, ents[i].dict_id.num, ents[i].ltype, ents[i].st, ents[i].codec, ents[i].uses,
+                             dis_dict_id (ents[i].dict_id).s);
+
+    ASSERTW (file_put_data (cache_filename, data.data, data.len), "Warning: failed to write codec cache %s: %s", cache_filename, strerror (errno));
+
+    buf_destroy (&data);
+    buf_destroy (&cache);
+}
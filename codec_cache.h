@@ -0,0 +1,17 @@
+// ------------------------------------------------------------------
+//   codec_cache.h
+//   Copyright (C) 2020 Divon Lan <divon@genozip.com>
+//   Please see terms and conditions in the files LICENSE.non-commercial.txt and LICENSE.commercial.txt
+
+#ifndef CODEC_CACHE_INCLUDED
+#define CODEC_CACHE_INCLUDED
+
+#include "genozip.h"
+#include "sections.h"
+
+extern void codec_cache_load (void);
+extern void codec_cache_save (void);
+extern Codec codec_cache_get (DataType dt, ConstContextP ctx, SectionType st);
+extern void codec_cache_set (DataType dt, ConstContextP ctx, SectionType st, Codec codec);
+
+#endif
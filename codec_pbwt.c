@@ -5,6 +5,16 @@
 
 // The codec implements a modified version of the PBWT algorithm. The permutation logic is loosely based on the logic in
 // Durbin R. Efficient haplotype matching and storage using the positional Burrows-Wheeler transform (PBWT). Bioinformatics. 2014 
+//
+// With --pbwt-partitions, the columns (haplotypes) of the matrix are split into contiguous partitions, each of which is an 
+// independent PBWT stream with its own permutation, runs and fgrc - so that they can be compressed and decompressed in
+// parallel threads. The cost is some compression ratio, as runs can no longer span partitions.
+
+#ifndef _MSC_VER // Microsoft compiler
+#include <pthread.h>
+#else
+#include "compatibility/visual_c_pthread.h"
+#endif
 
 #include "genozip.h"
 #include "codec.h"
@@ -24,6 +34,8 @@ typedef struct {
 } PermEnt;
 
 typedef struct {
+    VBlockP vb;
+    uint32_t start, width; // the columns of ht_matrix covered by this state's partition
     Buffer *runs;       // array of uint32_t - alternating bg ('0') / fg runs
     Buffer *fgrc;       // array PbwtFgRunCount describing the fg runs
     Allele run_allele;  // current allele for which we're constructing a run 
@@ -77,30 +89,61 @@ static void show_runs (const PbwtState *state)
     iprint0 ("\n");
 }
 
-#define SHOW(msg, cmd) do { \
+#define SHOW(msg, s, cmd) do { \
     fprintf (info_stream, msg " %-2u: ", line_i); \
-    for (uint32_t i=0; i < vb->ht_per_line; i++) cmd; \
+    for (uint32_t i=0; i < (s)->width; i++) cmd; \
     iprint0 ("\n"); } while (0) // flush
 
-#define show_line    if (flag.show_alleles) SHOW ("LINE", (htputc (*ENT (Allele, vb->ht_matrix_ctx->local, line_i * vb->ht_per_line + i))))
-#define show_perm(s) if (flag.show_alleles) SHOW ("PERM", (fprintf (info_stream, "%d ", (s)->perm[i].index)));       
+#define show_line(s) if (flag.show_alleles) SHOW ("LINE", (s), (htputc (*ENT (Allele, vb->ht_matrix_ctx->local, line_i * vb->ht_per_line + (s)->start + i))))
+#define show_perm(s) if (flag.show_alleles) SHOW ("PERM", (s), (fprintf (info_stream, "%d ", (s)->perm[i].index)));       
 
-static PbwtState codec_pbwt_initialize_state (VBlockP vb, Buffer *runs, Buffer *fgrc)
+// initializes the states of all partitions. partitions are of near-equal width, and are fully determined by ht_per_line
+// and the number of partitions, so PIZ calculates the same partitions as ZIP did
+static void codec_pbwt_initialize_states (VBlockP vb, PbwtState *states, uint32_t num_parts)
 {
     buf_alloc_more (vb, &vb->codec_bufs[0], 0, vb->ht_per_line * 2, PermEnt, 1, "codec_bufs");
     buf_zero (&vb->codec_bufs[0]); // re-zero every time
     ARRAY (PermEnt, state_data, vb->codec_bufs[0]);
 
-    PbwtState state = {
-        .runs = runs,
-        .fgrc = fgrc,
-        .perm = &state_data[0],               // size: ht_per_line X PermEnt
-        .temp = &state_data[vb->ht_per_line], // size: ht_per_line X PermEnt
-    };
-        
-    return state;
+    for (uint32_t part_i=0, start=0; part_i < num_parts; part_i++) {
+        uint32_t width = vb->ht_per_line / num_parts + (part_i < vb->ht_per_line % num_parts);
+
+        states[part_i] = (PbwtState){
+            .vb    = vb,
+            .start = start,
+            .width = width,
+            .perm  = &state_data[start * 2],         // size: width X PermEnt
+            .temp  = &state_data[start * 2 + width], // size: width X PermEnt
+        };
+
+        start += width;
+    }
 } 
 
+// runs func on each of the partitions - in parallel threads if there is more than one partition
+static void codec_pbwt_run_partitions (PbwtState *states, uint32_t num_parts, void *(*func)(void *))
+{
+    // --show-alleles output is per partition, so we run serially to avoid interleaving it
+    if (num_parts == 1 || flag.show_alleles) {
+        for (uint32_t part_i=0; part_i < num_parts; part_i++)
+            func (&states[part_i]);
+        return;
+    }
+
+    pthread_t threads[MAX_PBWT_PARTITIONS];
+
+    // partition 0 is run by the calling thread
+    for (uint32_t part_i=1; part_i < num_parts; part_i++) {
+        int err = pthread_create (&threads[part_i], NULL, func, &states[part_i]);
+        ASSERTE (!err, "failed to create thread for PBWT partition %u: %s", part_i, strerror (err));
+    }
+
+    func (&states[0]);
+
+    for (uint32_t part_i=1; part_i < num_parts; part_i++)
+        pthread_join (threads[part_i], NULL);
+}
+
 // update the permutation for the next row: we re-sort it to make indices containing the same allele grouped
 // first '0', then '1' etc - but the order within each of these allele groups remains as in the current row's premutation 
 // (this is why we traverse the permuted line rather than the ht_matrix line)
@@ -236,6 +279,36 @@ static void inline codec_pbwt_run_len_encode (PbwtState *state, uint32_t line_le
     }
 }
 
+// compresses one partition of ht_matrix - runs in its own thread if we have more than one partition.
+// note: the partition's runs and fgrc were already first-allocated by the compute thread, so it is safe to grow them here
+static void *codec_pbwt_compress_partition (void *state_)
+{
+    PbwtState *state = (PbwtState *)state_;
+    VBlockP vb = state->vb;
+
+    ARRAY (Allele, ht_data, vb->ht_matrix_ctx->local);
+    
+    uint32_t num_lines = ht_data_len / vb->ht_per_line;
+
+    for (uint32_t line_i=0; line_i < num_lines; line_i++) {
+
+        codec_pbwt_calculate_permutation (state, &ht_data[line_i * vb->ht_per_line + state->start], state->width, line_i==0);
+
+        // grow local if needed (unlikely) to the worst case scenario - all ht foreground, no two consecutive are similar -> 2xlen runs, half of them fg runs
+        buf_alloc_more (vb, state->runs, 2 * state->width, 0, uint32_t, CTX_GROWTH, state->runs->name); 
+        buf_alloc_more (vb, state->fgrc,     state->width, 0, uint32_t, CTX_GROWTH, state->fgrc->name); 
+
+        show_line(state); show_perm(state); 
+        bool backward_permuted_ht_line = line_i % 2; // even rows are forward, odd are backward - better run length encoding 
+
+        codec_pbwt_run_len_encode (state, state->width, backward_permuted_ht_line);
+    }
+  
+    if (flag.show_alleles) show_runs (state);   
+
+    return NULL;
+}
+
 // this function is first called to compress the ht_matrix_ctx, as we set its codec to CODEC_PBWT in codec_gtshark_comp_init.
 // but it creates no compressed data for ht_matrix_ctx - instead it generates one or more PBWT sections (one for each allele
 // in the VB) with CODEC_PBWT. Since these sections have a higher did_i, this function will call again compressing these sections,
@@ -250,31 +323,57 @@ bool codec_pbwt_compress (VBlock *vb,
 {
     START_TIMER;
 
-    PbwtState state = codec_pbwt_initialize_state (vb, &vb->runs_ctx->local, &vb->fgrc_ctx->local); 
+    uint32_t num_parts = MIN (MAX (flag.pbwt_partitions, 1), vb->ht_per_line);
+
+    PbwtState states[MAX_PBWT_PARTITIONS];
+    codec_pbwt_initialize_states (vb, states, num_parts); 
  
-    buf_alloc (vb, &vb->runs_ctx->local, MAX (vb->ht_per_line, vb->ht_matrix_ctx->local.len / 5 ), CTX_GROWTH, "contexts->local"); // initial allocation
-    buf_alloc (vb, &vb->fgrc_ctx->local, MAX (vb->ht_per_line, vb->ht_matrix_ctx->local.len / 30), CTX_GROWTH, "contexts->local");
-        
-    ARRAY (Allele, ht_data, vb->ht_matrix_ctx->local);
-    
-    uint32_t num_lines = ht_data_len / vb->ht_per_line;
+    // with a single partition, we generate the data directly in the contexts. otherwise, each partition first generates
+    // its own data, which we concatenate afterwards.
+    // note: initial allocation is done here, in the compute thread, as only it may add buffers to the vb's buffer_list
+    for (uint32_t part_i=0; part_i < num_parts; part_i++) {
+        PbwtState *state = &states[part_i];
+        state->runs = (num_parts == 1) ? &vb->runs_ctx->local : &vb->pbwt_runs[part_i];
+        state->fgrc = (num_parts == 1) ? &vb->fgrc_ctx->local : &vb->pbwt_fgrc[part_i];
+
+        uint64_t part_matrix_len = vb->ht_matrix_ctx->local.len / num_parts;
+        buf_alloc (vb, state->runs, MAX (state->width, part_matrix_len / 5 ), CTX_GROWTH, num_parts == 1 ? "contexts->local" : "pbwt_runs"); // initial allocation
+        buf_alloc (vb, state->fgrc, MAX (state->width, part_matrix_len / 30), CTX_GROWTH, num_parts == 1 ? "contexts->local" : "pbwt_fgrc");
+    }
 
-    for (uint32_t line_i=0; line_i < num_lines; line_i++) {
+    codec_pbwt_run_partitions (states, num_parts, codec_pbwt_compress_partition);
 
-        codec_pbwt_calculate_permutation (&state, &ht_data[line_i * vb->ht_per_line], vb->ht_per_line, line_i==0);
+    // concatenate the partitions, and add the length of each partition's runs and fgrc to the end of fgrc_ctx.local. 
+    // the number of partitions is transmitted in SectionHeaderCtx.param of the FGRC section
+    if (num_parts > 1) {
+        uint64_t total_runs=0, total_fgrc=0;
+        for (uint32_t part_i=0; part_i < num_parts; part_i++) {
+            total_runs += states[part_i].runs->len;
+            total_fgrc += states[part_i].fgrc->len;
+        }
 
-        // grow local if needed (unlikely) to the worst case scenario - all ht foreground, no two consecutive are similar -> 2xlen runs, half of them fg runs
-        buf_alloc_more (vb, &vb->runs_ctx->local, 2 * vb->ht_per_line, 0, uint32_t, CTX_GROWTH, "contexts->local"); 
-        buf_alloc_more (vb, &vb->fgrc_ctx->local,     vb->ht_per_line, 0, uint32_t, CTX_GROWTH, "contexts->local"); 
+        buf_alloc (vb, &vb->runs_ctx->local, total_runs * sizeof (uint32_t), 1, "contexts->local");
+        buf_alloc (vb, &vb->fgrc_ctx->local, (total_fgrc + num_parts * 2) * sizeof (uint32_t), 1, "contexts->local");
 
-        show_line; show_perm(&state); 
-        bool backward_permuted_ht_line = line_i % 2; // even rows are forward, odd are backward - better run length encoding 
+        for (uint32_t part_i=0; part_i < num_parts; part_i++) {
+            memcpy (AFTERENT (uint32_t, vb->runs_ctx->local), states[part_i].runs->data, states[part_i].runs->len * sizeof (uint32_t));
+            memcpy (AFTERENT (uint32_t, vb->fgrc_ctx->local), states[part_i].fgrc->data, states[part_i].fgrc->len * sizeof (uint32_t));
+            vb->runs_ctx->local.len += states[part_i].runs->len;
+            vb->fgrc_ctx->local.len += states[part_i].fgrc->len;
+        }
 
-        codec_pbwt_run_len_encode (&state, vb->ht_per_line, backward_permuted_ht_line);
+        for (uint32_t part_i=0; part_i < num_parts; part_i++) NEXTENT (uint32_t, vb->fgrc_ctx->local) = states[part_i].runs->len;
+        for (uint32_t part_i=0; part_i < num_parts; part_i++) NEXTENT (uint32_t, vb->fgrc_ctx->local) = states[part_i].fgrc->len;
+
+        for (uint32_t part_i=0; part_i < num_parts; part_i++) {
+            buf_free (&vb->pbwt_runs[part_i]);
+            buf_free (&vb->pbwt_fgrc[part_i]);
+        }
+
+        vb->fgrc_ctx->local_param = true;
+        vb->fgrc_ctx->local.param = num_parts;
     }
-  
-    if (flag.show_alleles) show_runs (&state);   
-    
+
     // add ht_matrix_ctx.len to the end of fgrc_ctx.local (this should really be in the section header, but we don't
     // want to change SectionHeaderCtx (now in genozip v11)
     buf_alloc_more (vb, &vb->fgrc_ctx->local, 2, 0, uint32_t, 1, "contexts->local");
@@ -284,7 +383,7 @@ bool codec_pbwt_compress (VBlock *vb,
     BGEN_u32_buf (&vb->runs_ctx->local, NULL);
     BGEN_u32_buf (&vb->fgrc_ctx->local, NULL);
 
-    buf_free (&vb->codec_bufs[0]); // allocated in codec_pbwt_initialize_state
+    buf_free (&vb->codec_bufs[0]); // allocated in codec_pbwt_initialize_states
 
     // the allele sections are further compressed with the best simple codec 
     // note: this simple codec (not CODEC_PBWT) will be the codec stored in zf_ctx->lcodec
@@ -337,19 +436,19 @@ static inline void pbwt_decode_one_line (VBlockP vb, PbwtState *state, uint32_t
     if (!state->run_allele) state->run_allele = '0'; // first run in VB - always start with background
 
     // de-permute one line onto the ht_matrix
-    Allele *ht_one_line = ENT (Allele, vb->ht_matrix_ctx->local, line_i * vb->ht_per_line);
+    Allele *ht_one_line = ENT (Allele, vb->ht_matrix_ctx->local, line_i * vb->ht_per_line + state->start);
 
-    codec_pbwt_calculate_permutation (state, ht_one_line, vb->ht_per_line, line_i==0);
+    codec_pbwt_calculate_permutation (state, ht_one_line, state->width, line_i==0);
     
     bool backwards = line_i % 2;
 
-    for (uint32_t ht_i=0; ht_i < vb->ht_per_line; ) { 
+    for (uint32_t ht_i=0; ht_i < state->width; ) { 
         uint32_t run_len = *runs;
 
-        uint32_t line_part_of_run = MIN (run_len, vb->ht_per_line - ht_i); // the run could be shared with the next line
+        uint32_t line_part_of_run = MIN (run_len, state->width - ht_i); // the run could be shared with the next line
         
         for (uint32_t i=0; i < line_part_of_run; i++, ht_i++) {
-            uint32_t oriented_ht_i = backwards ? vb->ht_per_line - ht_i - 1 : ht_i;
+            uint32_t oriented_ht_i = backwards ? state->width - ht_i - 1 : ht_i;
             ht_one_line[state->perm[oriented_ht_i].index] = state->perm[oriented_ht_i].allele = state->run_allele;
         }
 
@@ -374,14 +473,27 @@ static inline void pbwt_decode_one_line (VBlockP vb, PbwtState *state, uint32_t
         }
     }
 
-    show_perm(state); show_line; 
+    show_perm(state); show_line(state); 
 
     state->runs->next += runs - start_runs;
     ASSERTE (state->runs->next <= state->runs->len, "state.runs->next=%u is out of range", (uint32_t)state->runs->next);
 }
 
+// decodes one partition of ht_matrix - runs in its own thread if we have more than one partition
+static void *codec_pbwt_uncompress_partition (void *state_)
+{
+    PbwtState *state = (PbwtState *)state_;
+    
+    if (flag.show_alleles) show_runs (state);
+
+    for (uint32_t line_i=0; line_i < state->vb->lines.len; line_i++) 
+        pbwt_decode_one_line (state->vb, state, line_i); 	
+
+    return NULL;
+}
+
 // this function is called for the PBWT_FGRC section - after the PBWT_RUNS was already decompressed
-void codec_pbwt_uncompress (VBlock *vb, Codec codec, uint8_t unused /* param */,
+void codec_pbwt_uncompress (VBlock *vb, Codec codec, uint8_t param /* number of partitions, 0 if file was compressed without --pbwt-partitions */,
                             const char *compressed, uint32_t compressed_len,
                             Buffer *uncompressed_buf, uint64_t uncompressed_len,
                             Codec sub_codec)
@@ -390,6 +502,7 @@ void codec_pbwt_uncompress (VBlock *vb, Codec codec, uint8_t unused /* param */,
 
     uint32_t *rc_data = (uint32_t *)compressed;
     uint32_t rc_data_len = compressed_len / sizeof (PbwtFgRunCount);
+    uint32_t num_parts = MAX (param, 1);
 
     for (uint32_t i=0; i < rc_data_len; i++) 
         rc_data[i] = BGEN32 (rc_data[i]);
@@ -400,15 +513,51 @@ void codec_pbwt_uncompress (VBlock *vb, Codec codec, uint8_t unused /* param */,
     Context *runs_ctx = ctx_get_existing_ctx (vb, dict_id_PBWT_RUNS);
     ASSERTE0 (runs_ctx, "Cannot find context for PBWT_RUNS");
 
-    PbwtState state = codec_pbwt_initialize_state (vb, &runs_ctx->local, &vb->compressed); // background allele is provided to us in param ; this is a subcodec, so vb->compressed.data == compressed
+    ASSERTE (num_parts <= MAX_PBWT_PARTITIONS && num_parts <= vb->ht_per_line, "vb_i=%u: bad number of PBWT partitions=%u (ht_per_line=%u)", 
+             vb->vblock_i, num_parts, vb->ht_per_line);
 
-    if (flag.show_alleles) show_runs (&state);
+    // get the length of each partition's runs and fgrc, stored before the ht_matrix length
+    uint32_t runs_lens[MAX_PBWT_PARTITIONS], fgrc_lens[MAX_PBWT_PARTITIONS];
+    if (num_parts > 1) {
+        rc_data_len -= num_parts * 2;
+        memcpy (runs_lens, &rc_data[rc_data_len],             num_parts * sizeof (uint32_t));
+        memcpy (fgrc_lens, &rc_data[rc_data_len + num_parts], num_parts * sizeof (uint32_t));
+    }
+    else {
+        runs_lens[0] = runs_ctx->local.len;
+        fgrc_lens[0] = rc_data_len;
+    }
+
+    PbwtState states[MAX_PBWT_PARTITIONS];
+    codec_pbwt_initialize_states (vb, states, num_parts);
+
+    // each partition's runs and fgrc are windows into the runs_ctx->local and vb->compressed (this is a subcodec, 
+    // so vb->compressed.data == compressed). these Buffer structs are not allocated, and need not be freed.
+    Buffer runs_windows[MAX_PBWT_PARTITIONS], fgrc_windows[MAX_PBWT_PARTITIONS];
+    uint64_t runs_start=0, fgrc_start=0;
+    
+    for (uint32_t part_i=0; part_i < num_parts; part_i++) {
+        runs_windows[part_i] = (Buffer){ .type = BUF_OVERLAY, .name = "runs_window",
+                                         .data = (char *)ENT (uint32_t, runs_ctx->local, runs_start), 
+                                         .len  = runs_lens[part_i], .size = runs_lens[part_i] * sizeof (uint32_t) };
+
+        fgrc_windows[part_i] = (Buffer){ .type = BUF_OVERLAY, .name = "fgrc_window",
+                                         .data = (char *)&rc_data[fgrc_start], 
+                                         .len  = fgrc_lens[part_i], .size = fgrc_lens[part_i] * sizeof (uint32_t) };
+        
+        states[part_i].runs = &runs_windows[part_i];
+        states[part_i].fgrc = &fgrc_windows[part_i];
+
+        runs_start += runs_lens[part_i];
+        fgrc_start += fgrc_lens[part_i];
+    }
 
-    state.runs->next = state.fgrc->next = 0; 
+    ASSERTE (runs_start == runs_ctx->local.len && fgrc_start == rc_data_len, 
+             "vb_i=%u: PBWT partitions lengths don't add up: runs=%"PRIu64" expected=%"PRIu64" fgrc=%"PRIu64" expected=%u", 
+             vb->vblock_i, runs_start, runs_ctx->local.len, fgrc_start, rc_data_len);
 
-    // generate ht_matrix
-    for (uint32_t line_i=0; line_i < vb->lines.len; line_i++) 
-        pbwt_decode_one_line (vb, &state, line_i); 	
+    // generate ht_matrix - each partition fills its own columns
+    codec_pbwt_run_partitions (states, num_parts, codec_pbwt_uncompress_partition);
 
     buf_free (&vb->codec_bufs[0]); // free state data  
     buf_free (&vb->compressed);    // free PBWT_ALLELES data
@@ -0,0 +1,368 @@
+// ------------------------------------------------------------------
+//   codec_qctx.c
+//   Copyright (C) 2020 Divon Lan <divon@genozip.com>
+//   Please see terms and conditions in the files LICENSE.non-commercial.txt and LICENSE.commercial.txt
+
+// compression algorithm for QUAL values that don't have a dominant value (see codec_domq.c) - an order-2 context model:
+// each quality score is encoded with an adaptive range coder, with a frequency model selected by the previous
+// two quality scores of the read and by the position within the read (scores at the beginning of a read
+// are typically different than at the end).
+//
+// The data is a sequence of reads - each consisting of its length followed by its quality scores. The decoder
+// stops when it has generated uncompressed_len bytes. Quality scores are expected to be in the range 33-95 - other
+// characters are encoded with an escape symbol followed by the raw character.
+// If the coded data is not smaller than the uncompressed data, it is stored as is.
+
+#include "genozip.h"
+#include "codec.h"
+#include "vblock.h"
+#include "buffer.h"
+#include "profiler.h"
+
+#define QCTX_STORED 0
+#define QCTX_CODED  1
+
+// range coder (a carry-less range coder, after Dmitry Subbotin)
+#define RC_TOP (1U << 24)
+#define RC_BOT (1U << 16)
+
+typedef struct {
+    uint32_t low, range, code;
+    uint8_t *next, *after; // output (encoder) or input (decoder)
+    bool overflow;
+} RangeCoder;
+
+// frequency model
+#define QCTX_NUM_SYMS  64                  // symbol i is character 33+i, except for QCTX_ESCAPE
+#define QCTX_ESCAPE    (QCTX_NUM_SYMS-1)   // followed by the raw character
+#define QCTX_INC       24
+#define QCTX_MAX_TOTAL (RC_BOT - QCTX_INC) // total may not exceed RC_BOT
+
+typedef struct {
+    uint16_t freq[QCTX_NUM_SYMS];
+    uint32_t total;
+} QctxModel;
+
+// context: previous score (64) x bucket of the score before it (8) x position bucket (4)
+#define QCTX_NUM_Q2_BUCKETS  8
+#define QCTX_NUM_POS_BUCKETS 4
+#define QCTX_NUM_MODELS (QCTX_NUM_SYMS * QCTX_NUM_Q2_BUCKETS * QCTX_NUM_POS_BUCKETS)
+
+typedef struct {
+    QctxModel models[QCTX_NUM_MODELS];
+    QctxModel same_len; // 2 symbols: read length is the same as the previous read's - yes or no
+} QctxModels;
+
+static inline void rc_enc_init (RangeCoder *rc, uint8_t *out, uint32_t out_len)
+{
+    *rc = (RangeCoder){ .range = 0xffffffff, .next = out, .after = out + out_len };
+}
+
+static inline void rc_enc_normalize (RangeCoder *rc)
+{
+    while ((rc->low ^ (rc->low + rc->range)) < RC_TOP || (rc->range < RC_BOT && ((rc->range = -rc->low & (RC_BOT-1)), true))) {
+        if (rc->next < rc->after) *rc->next++ = rc->low >> 24;
+        else rc->overflow = true;
+
+        rc->low   <<= 8;
+        rc->range <<= 8;
+    }
+}
+
+static inline void rc_encode (RangeCoder *rc, uint32_t cum, uint32_t freq, uint32_t total)
+{
+    rc->range /= total;
+    rc->low   += cum * rc->range;
+    rc->range *= freq;
+    rc_enc_normalize (rc);
+}
+
+static inline void rc_enc_flush (RangeCoder *rc)
+{
+    for (unsigned i=0; i < 4; i++) {
+        if (rc->next < rc->after) *rc->next++ = rc->low >> 24;
+        else rc->overflow = true;
+
+        rc->low <<= 8;
+    }
+}
+
+static inline uint8_t rc_dec_next_byte (RangeCoder *rc)
+{
+    return (rc->next < rc->after) ? *rc->next++ : 0; // beyond the end of the data is read as zeros
+}
+
+static inline void rc_dec_init (RangeCoder *rc, const uint8_t *in, uint32_t in_len)
+{
+    *rc = (RangeCoder){ .range = 0xffffffff, .next = (uint8_t *)in, .after = (uint8_t *)in + in_len };
+
+    for (unsigned i=0; i < 4; i++)
+        rc->code = (rc->code << 8) | rc_dec_next_byte (rc);
+}
+
+static inline uint32_t rc_dec_get_freq (RangeCoder *rc, uint32_t total)
+{
+    rc->range /= total;
+    uint32_t value = (rc->code - rc->low) / rc->range;
+
+    ASSERTE (value < total, "corrupt QCTX data: value=%u >= total=%u", value, total);
+    return value;
+}
+
+static inline void rc_decode (RangeCoder *rc, uint32_t cum, uint32_t freq)
+{
+    rc->low   += cum * rc->range;
+    rc->range *= freq;
+
+    while ((rc->low ^ (rc->low + rc->range)) < RC_TOP || (rc->range < RC_BOT && ((rc->range = -rc->low & (RC_BOT-1)), true))) {
+        rc->code   = (rc->code << 8) | rc_dec_next_byte (rc);
+        rc->low   <<= 8;
+        rc->range <<= 8;
+    }
+}
+
+static void qctx_model_init (QctxModel *m, unsigned num_syms)
+{
+    for (unsigned s=0; s < num_syms; s++) m->freq[s] = 1;
+    m->total = num_syms;
+}
+
+static inline void qctx_model_update (QctxModel *m, unsigned num_syms, unsigned sym)
+{
+    m->freq[sym] += QCTX_INC;
+    m->total     += QCTX_INC;
+
+    if (m->total > QCTX_MAX_TOTAL) {
+        m->total = 0;
+        for (unsigned s=0; s < num_syms; s++) {
+            m->freq[s] = (m->freq[s] + 1) / 2; // remains at least 1
+            m->total  += m->freq[s];
+        }
+    }
+}
+
+static inline void qctx_model_encode (RangeCoder *rc, QctxModel *m, unsigned num_syms, unsigned sym)
+{
+    uint32_t cum = 0;
+    for (unsigned s=0; s < sym; s++) cum += m->freq[s];
+
+    rc_encode (rc, cum, m->freq[sym], m->total);
+    qctx_model_update (m, num_syms, sym);
+}
+
+static inline unsigned qctx_model_decode (RangeCoder *rc, QctxModel *m, unsigned num_syms)
+{
+    uint32_t value = rc_dec_get_freq (rc, m->total);
+
+    uint32_t cum = 0;
+    unsigned sym = 0;
+    while (cum + m->freq[sym] <= value) cum += m->freq[sym++];
+
+    rc_decode (rc, cum, m->freq[sym]);
+    qctx_model_update (m, num_syms, sym);
+
+    return sym;
+}
+
+static inline QctxModel *qctx_get_model (QctxModels *models, unsigned q1, unsigned q2, uint32_t pos)
+{
+    static const uint8_t q2_bucket[QCTX_NUM_SYMS] = {
+        0,0,0,0,0,0,0,0,0,0, 1,1,1,1,1, 2,2,2,2,2, 3,3,3,3,3, 4,4,4,4,4, 5,5,5,5, 6,6,6,6, // scores 0-37
+        7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7 };                               // scores 38+ and escape
+
+    unsigned pos_bucket = (pos < 4) ? 0 : (pos < 16) ? 1 : (pos < 64) ? 2 : 3;
+
+    return &models->models[(q1 * QCTX_NUM_Q2_BUCKETS + q2_bucket[q2]) * QCTX_NUM_POS_BUCKETS + pos_bucket];
+}
+
+static QctxModels *qctx_init_models (VBlockP vb)
+{
+    QctxModels *models = codec_alloc (vb, sizeof (QctxModels), 1);
+
+    for (unsigned i=0; i < QCTX_NUM_MODELS; i++)
+        qctx_model_init (&models->models[i], QCTX_NUM_SYMS);
+
+    qctx_model_init (&models->same_len, 2);
+
+    return models;
+}
+
+//--------------
+// ZIP side
+//--------------
+
+static void qctx_encode_read (RangeCoder *rc, QctxModels *models, const char *qual, uint32_t qual_len, uint32_t *prev_len)
+{
+    // read length
+    bool same_len = (qual_len == *prev_len);
+    qctx_model_encode (rc, &models->same_len, 2, same_len);
+
+    if (!same_len) {
+        for (unsigned i=0; i < 4; i++)
+            rc_encode (rc, (qual_len >> (i*8)) & 0xff, 1, 256);
+        *prev_len = qual_len;
+    }
+
+    // quality scores
+    unsigned q1=0, q2=0;
+    for (uint32_t pos=0; pos < qual_len; pos++) {
+        uint8_t c = (uint8_t)qual[pos];
+        unsigned sym = (c >= 33 && c < 33 + QCTX_ESCAPE) ? c - 33 : QCTX_ESCAPE;
+
+        qctx_model_encode (rc, qctx_get_model (models, q1, q2, pos), QCTX_NUM_SYMS, sym);
+
+        if (sym == QCTX_ESCAPE) rc_encode (rc, c, 1, 256);
+
+        q2 = q1;
+        q1 = sym;
+    }
+}
+
+static void qctx_store (VBlockP vb, const char *uncompressed, uint32_t uncompressed_len, LocalGetLineCB callback, char *compressed)
+{
+    compressed[0] = QCTX_STORED;
+
+    if (uncompressed)
+        memcpy (&compressed[1], uncompressed, uncompressed_len);
+
+    else {
+        uint32_t so_far = 0;
+        for (uint32_t line_i=0; line_i < vb->lines.len && so_far < uncompressed_len; line_i++) {
+            char *qual=0;
+            uint32_t qual_len=0;
+            callback (vb, line_i, &qual, &qual_len, uncompressed_len - so_far);
+
+            if (qual && qual_len) memcpy (&compressed[1 + so_far], qual, qual_len);
+            so_far += qual_len;
+        }
+    }
+}
+
+bool codec_qctx_compress (VBlock *vb, SectionHeader *header,
+                          const char *uncompressed,      // option 1 - compress contiguous data
+                          uint32_t *uncompressed_len,
+                          LocalGetLineCB callback,       // option 2 - compress data one line at a time
+                          char *compressed, uint32_t *compressed_len /* in/out */,
+                          bool soft_fail)
+{
+    START_TIMER;
+
+    if (*compressed_len < *uncompressed_len + 1) {
+        ASSERTE (soft_fail, "compressed_len too small: compress_len=%u < uncompressed_len=%u + 1", *compressed_len, *uncompressed_len);
+        return false;
+    }
+
+    QctxModels *models = qctx_init_models (vb);
+
+    RangeCoder rc;
+    rc_enc_init (&rc, (uint8_t *)&compressed[1], *uncompressed_len); // coded data must be smaller than the stored data
+    compressed[0] = QCTX_CODED;
+
+    uint32_t prev_len = 0;
+
+    // option 1 - compress contiguous data - considered a single read
+    if (uncompressed)
+        qctx_encode_read (&rc, models, uncompressed, *uncompressed_len, &prev_len);
+
+    // option 2 - compress data one line at a time
+    else if (callback) {
+        uint32_t so_far = 0;
+        for (uint32_t line_i=0; line_i < vb->lines.len && so_far < *uncompressed_len && !rc.overflow; line_i++) {
+            char *qual=0;
+            uint32_t qual_len=0;
+
+            // note: get what we need, might be less than what's available if calling from codec_assign_best_codec
+            callback (vb, line_i, &qual, &qual_len, *uncompressed_len - so_far);
+            if (!qual || !qual_len) continue; // this line has no QUAL data
+
+            qctx_encode_read (&rc, models, qual, qual_len, &prev_len);
+            so_far += qual_len;
+        }
+    }
+
+    rc_enc_flush (&rc);
+    codec_free (vb, models);
+
+    // case: data is not compressible by us - store it
+    if (rc.overflow) {
+        qctx_store (vb, uncompressed, *uncompressed_len, callback, compressed);
+        *compressed_len = *uncompressed_len + 1;
+    }
+    else
+        *compressed_len = 1 + (rc.next - (uint8_t *)&compressed[1]);
+
+    COPY_TIMER (compressor_qctx);
+
+    return true;
+}
+
+uint32_t codec_qctx_est_size (Codec codec, uint64_t uncompressed_len)
+{
+    return (uint32_t)uncompressed_len + 1; // the worst case is stored data
+}
+
+//--------------
+// PIZ side
+//--------------
+
+void codec_qctx_uncompress (VBlock *vb, Codec codec, uint8_t param,
+                            const char *compressed, uint32_t compressed_len,
+                            Buffer *uncompressed_buf, uint64_t uncompressed_len,
+                            Codec unused)
+{
+    START_TIMER;
+
+    ASSERTE (compressed_len >= 1, "corrupt QCTX data: compressed_len=%u", compressed_len);
+
+    if (compressed[0] == QCTX_STORED) {
+        ASSERTE (compressed_len - 1 == uncompressed_len, "corrupt QCTX data: stored length=%u but uncompressed_len=%"PRIu64,
+                 compressed_len - 1, uncompressed_len);
+
+        memcpy (uncompressed_buf->data, &compressed[1], uncompressed_len);
+        goto done;
+    }
+
+    QctxModels *models = qctx_init_models (vb);
+
+    RangeCoder rc;
+    rc_dec_init (&rc, (const uint8_t *)&compressed[1], compressed_len - 1);
+
+    uint8_t *next = (uint8_t *)uncompressed_buf->data, *after = next + uncompressed_len;
+    uint32_t qual_len = 0;
+
+    while (next < after) {
+        // read length
+        if (!qctx_model_decode (&rc, &models->same_len, 2)) {
+            qual_len = 0;
+            for (unsigned i=0; i < 4; i++) {
+                uint32_t byte = rc_dec_get_freq (&rc, 256);
+                rc_decode (&rc, byte, 1);
+                qual_len |= byte << (i*8);
+            }
+        }
+
+        ASSERTE (qual_len && qual_len <= after - next, "corrupt QCTX data: qual_len=%u but remaining=%u", qual_len, (uint32_t)(after - next));
+
+        // quality scores
+        unsigned q1=0, q2=0;
+        for (uint32_t pos=0; pos < qual_len; pos++) {
+            unsigned sym = qctx_model_decode (&rc, qctx_get_model (models, q1, q2, pos), QCTX_NUM_SYMS);
+
+            if (sym == QCTX_ESCAPE) {
+                uint32_t c = rc_dec_get_freq (&rc, 256);
+                rc_decode (&rc, c, 1);
+                *next++ = c;
+            }
+            else
+                *next++ = 33 + sym;
+
+            q2 = q1;
+            q1 = sym;
+        }
+    }
+
+    codec_free (vb, models);
+
+done:
+    COPY_TIMER (compressor_qctx);
+}
@@ -0,0 +1,284 @@
+// ------------------------------------------------------------------
+//   codec_zstd.c
+//   Copyright (C) 2020 Divon Lan <divon@genozip.com>
+//   Please see terms and conditions in the files LICENSE.non-commercial.txt and LICENSE.commercial.txt
+
+// ZSTD codec - decompresses several times faster than BZ2, LZMA and BSC, at a similar compression ratio to BZ2.
+//
+// Dictionaries: when ZSTD is selected for a b250 or local section of vb=1 whose data is small (fits in the codec
+// assignment sample), we train a ZSTD dictionary
+// on its data, and use it to compress the same section in all VBs - as small sections compress much better with a
+// dictionary. ZSTD records the ID of the dictionary in the frame header, so the decompressor knows which dictionary to use.
+// All dictionaries are stored in a single global section SEC_ZSTD_DICTS: for each dictionary, zstd_dict_id and
+// dict_len (big endian 32 bit each), followed by the dictionary itself.
+
+#define ZSTD_STATIC_LINKING_ONLY  // for ZSTD_createCCtx_advanced and ZSTD_createDCtx_advanced
+#define ZDICT_STATIC_LINKING_ONLY // for ZDICT_trainFromBuffer_fastCover
+#include "zstd/zstd.h"
+#include "zstd/zdict.h"
+#include "genozip.h"
+#include "codec.h"
+#include "vblock.h"
+#include "buffer.h"
+#include "profiler.h"
+#include "flags.h"
+#include "sections.h"
+#include "endianness.h"
+#include "zfile.h"
+#include "file.h"
+#include "strings.h"
+#include "dict_id.h"
+
+#define ZSTD_LEVEL      15
+#define ZSTD_LEVEL_FAST 3
+
+#define ZSTD_MAX_DICTS               256
+#define ZSTD_DICT_SIZE               (16 << 10)
+#define ZSTD_DICT_SAMPLE_SIZE        512      // data is split into samples of this size for training
+#define ZSTD_DICT_MIN_TRAINING_DATA  (8 << 10)  // not enough samples to train a dictionary below this
+
+typedef struct {
+    DictId dict_id;        // ZIP only
+    SectionType st;        // ZIP only
+    uint32_t zstd_dict_id; // ID recorded in the ZSTD frame header
+    uint32_t dict_len;
+    char *dict;
+} ZstdDict;
+
+// dictionaries are added only by the compute thread of vb=1 while other VBs might be looking them up, so
+// num_dicts is incremented only after the dictionary is fully populated, and dictionaries are never moved
+static ZstdDict dicts[ZSTD_MAX_DICTS];
+static uint32_t num_dicts = 0;
+
+static inline uint32_t codec_zstd_get_num_dicts (void)
+{
+    return __atomic_load_n (&num_dicts, __ATOMIC_ACQUIRE);
+}
+
+static void *codec_zstd_alloc (void *vb, size_t size)
+{
+    return codec_alloc ((VBlock *)vb, size, 1);
+}
+
+static inline ZSTD_customMem codec_zstd_mem (VBlockP vb)
+{
+    return (ZSTD_customMem){ .customAlloc = codec_zstd_alloc, .customFree = codec_free, .opaque = vb };
+}
+
+static const ZstdDict *codec_zstd_get_dict_by_ctx (DictId dict_id, SectionType st)
+{
+    uint32_t n = codec_zstd_get_num_dicts();
+
+    for (uint32_t i=0; i < n; i++)
+        if (dicts[i].dict_id.num == dict_id.num && dicts[i].st == st) return &dicts[i];
+
+    return NULL;
+}
+
+static const ZstdDict *codec_zstd_get_dict_by_id (uint32_t zstd_dict_id)
+{
+    uint32_t n = codec_zstd_get_num_dicts();
+
+    for (uint32_t i=0; i < n; i++)
+        if (dicts[i].zstd_dict_id == zstd_dict_id) return &dicts[i];
+
+    return NULL;
+}
+
+static void codec_zstd_free_dicts (void)
+{
+    for (uint32_t i=0; i < num_dicts; i++)
+        FREE (dicts[i].dict);
+
+    memset (dicts, 0, sizeof (dicts));
+    num_dicts = 0;
+}
+
+//--------------
+// ZIP side
+//--------------
+
+// ZIP compute thread of vb=1: called from codec_assign_best_codec after ZSTD was selected for a b250 or local section.
+// data is the entire section data.
+void codec_zstd_train_dict (VBlockP vb, DictId dict_id, SectionType st, const char *data, uint64_t data_len)
+{
+    if (vb->vblock_i != 1 || data_len < ZSTD_DICT_MIN_TRAINING_DATA ||
+        num_dicts == ZSTD_MAX_DICTS || codec_zstd_get_dict_by_ctx (dict_id, st)) return;
+
+    uint32_t num_samples = (data_len + ZSTD_DICT_SAMPLE_SIZE - 1) / ZSTD_DICT_SAMPLE_SIZE;
+    size_t sample_sizes[num_samples];
+
+    for (uint32_t i=0; i < num_samples; i++)
+        sample_sizes[i] = MIN (ZSTD_DICT_SAMPLE_SIZE, data_len - i * ZSTD_DICT_SAMPLE_SIZE);
+
+    char *dict = MALLOC (ZSTD_DICT_SIZE);
+
+    // small f, as our training data is small (memory is 6 * 2^f)
+    ZDICT_fastCover_params_t params = { .k = 200, .d = 8, .f = 16,
+                                        .zParams = { .compressionLevel = flag.fast ? ZSTD_LEVEL_FAST : ZSTD_LEVEL,
+                                                     .dictID           = num_dicts + 1 } }; // our own IDs, so they are unique within the file
+
+    size_t dict_len = ZDICT_trainFromBuffer_fastCover (dict, ZSTD_DICT_SIZE, data, sample_sizes, num_samples, params);
+
+    // case: not enough data or not enough repetition to train a dictionary - we will compress without one
+    if (ZDICT_isError (dict_len)) {
+        FREE (dict);
+        return;
+    }
+
+    // only the compute thread of vb=1 adds dictionaries, and it is the only writer of num_dicts
+    dicts[num_dicts] = (ZstdDict){ .dict_id = dict_id, .st = st, .zstd_dict_id = params.zParams.dictID, .dict_len = dict_len, .dict = dict };
+    __atomic_store_n (&num_dicts, num_dicts + 1, __ATOMIC_RELEASE);
+}
+
+bool codec_zstd_compress (VBlock *vb, SectionHeader *header,
+                          const char *uncompressed,      // option 1 - compress contiguous data
+                          uint32_t *uncompressed_len,
+                          LocalGetLineCB callback,       // option 2 - compress data one line at a time
+                          char *compressed, uint32_t *compressed_len /* in/out */,
+                          bool soft_fail)
+{
+    START_TIMER;
+
+    // ZSTD one-shot compression requires contiguous data, so we need to copy all the data in case of callback
+    if (callback) {
+        ASSERTE0 (!vb->compressed.len, "expecting vb->compressed to be free, but its not");
+        buf_alloc (vb, &vb->compressed, *uncompressed_len, 1.2, "compressed");
+
+        for (uint32_t line_i=0; line_i < vb->lines.len; line_i++) {
+            char *start1=0;
+            uint32_t len1=0;
+
+            // note: get what we need, might be less than what's available if calling from codec_assign_best_codec
+            callback (vb, line_i, &start1, &len1, *uncompressed_len - vb->compressed.len);
+
+            if (start1 && len1) buf_add (&vb->compressed, start1, len1);
+        }
+
+        uncompressed = vb->compressed.data;
+    }
+
+    // use a dictionary if one was trained for this context (SEC_NONE - we're testing codecs - no dictionary yet)
+    const ZstdDict *dict = NULL;
+    if (header->section_type == SEC_B250 || header->section_type == SEC_LOCAL)
+        dict = codec_zstd_get_dict_by_ctx (((SectionHeaderCtx *)header)->dict_id, header->section_type);
+
+    ZSTD_CCtx *cctx = ZSTD_createCCtx_advanced (codec_zstd_mem (vb));
+    ASSERTE0 (cctx, "ZSTD_createCCtx_advanced failed");
+
+    size_t ret = ZSTD_compress_usingDict (cctx, compressed, *compressed_len, uncompressed, *uncompressed_len,
+                                          dict ? dict->dict : NULL, dict ? dict->dict_len : 0,
+                                          flag.fast ? ZSTD_LEVEL_FAST : ZSTD_LEVEL);
+    ZSTD_freeCCtx (cctx);
+
+    if (callback) buf_free (&vb->compressed);
+
+    bool success = true;
+    if (ZSTD_isError (ret)) {
+        ASSERTE (soft_fail && ZSTD_getErrorCode (ret) == ZSTD_error_dstSize_tooSmall, "ZSTD_compress_usingDict failed: %s", ZSTD_getErrorName (ret));
+        success = false; // compressed_len too small
+    }
+    else
+        *compressed_len = (uint32_t)ret;
+
+    COPY_TIMER (compressor_zstd);
+
+    return success;
+}
+
+uint32_t codec_zstd_est_size (Codec codec, uint64_t uncompressed_len)
+{
+    return (uint32_t)ZSTD_compressBound (uncompressed_len);
+}
+
+// ZIP: called from zip_write_global_area
+void codec_zstd_compress_dicts (void)
+{
+    if (!num_dicts) return;
+
+    static Buffer dicts_buf = EMPTY_BUFFER;
+
+    uint64_t total_len = 0;
+    for (uint32_t i=0; i < num_dicts; i++)
+        total_len += 2 * sizeof (uint32_t) + dicts[i].dict_len;
+
+    buf_alloc (evb, &dicts_buf, total_len, 1, "zstd_dicts");
+
+    for (uint32_t i=0; i < num_dicts; i++) {
+        uint32_t hdr[2] = { BGEN32 (dicts[i].zstd_dict_id), BGEN32 (dicts[i].dict_len) };
+        buf_add (&dicts_buf, hdr, sizeof (hdr));
+        buf_add (&dicts_buf, dicts[i].dict, dicts[i].dict_len);
+    }
+
+    zfile_compress_section_data (evb, SEC_ZSTD_DICTS, &dicts_buf);
+
+    buf_destroy (&dicts_buf);
+    codec_zstd_free_dicts(); // next file will train its own dictionaries
+}
+
+//--------------
+// PIZ side
+//--------------
+
+// PIZ main thread: called from piz_read_global_area
+void codec_zstd_read_dicts (void)
+{
+    codec_zstd_free_dicts(); // in case of a previous file
+
+    if (!sections_get_next_section_of_type (NULL, SEC_ZSTD_DICTS, false, true)) return; // no dictionaries
+
+    static Buffer dicts_buf = EMPTY_BUFFER;
+
+    zfile_read_section (z_file, evb, 0, &evb->z_data, "z_data", SEC_ZSTD_DICTS, NULL);
+
+    SectionHeader *header = (SectionHeader *)evb->z_data.data;
+    zfile_uncompress_section (evb, header, &dicts_buf, "zstd_dicts", 0, SEC_ZSTD_DICTS);
+
+    buf_free (&evb->z_data);
+
+    for (uint64_t offset=0; offset < dicts_buf.len; ) {
+        ASSERTE (num_dicts < ZSTD_MAX_DICTS && offset + 2 * sizeof (uint32_t) <= dicts_buf.len, "corrupt SEC_ZSTD_DICTS section: offset=%"PRIu64, offset);
+
+        const uint32_t *hdr = (const uint32_t *)ENT (char, dicts_buf, offset);
+        ZstdDict *dict = &dicts[num_dicts++];
+        dict->zstd_dict_id = BGEN32 (hdr[0]);
+        dict->dict_len     = BGEN32 (hdr[1]);
+        offset += 2 * sizeof (uint32_t);
+
+        ASSERTE (offset + dict->dict_len <= dicts_buf.len, "corrupt SEC_ZSTD_DICTS section: dict_len=%u", dict->dict_len);
+
+        dict->dict = MALLOC (dict->dict_len);
+        memcpy (dict->dict, ENT (char, dicts_buf, offset), dict->dict_len);
+        offset += dict->dict_len;
+    }
+
+    buf_destroy (&dicts_buf);
+}
+
+void codec_zstd_uncompress (VBlock *vb, Codec codec, uint8_t param,
+                            const char *compressed, uint32_t compressed_len,
+                            Buffer *uncompressed_buf, uint64_t uncompressed_len,
+                            Codec unused)
+{
+    START_TIMER;
+
+    const ZstdDict *dict = NULL;
+    uint32_t zstd_dict_id = ZSTD_getDictID_fromFrame (compressed, compressed_len);
+
+    if (zstd_dict_id) {
+        dict = codec_zstd_get_dict_by_id (zstd_dict_id);
+        ASSERTE (dict, "cannot find ZSTD dictionary %u - SEC_ZSTD_DICTS section is missing or corrupt", zstd_dict_id);
+    }
+
+    ZSTD_DCtx *dctx = ZSTD_createDCtx_advanced (codec_zstd_mem (vb));
+    ASSERTE0 (dctx, "ZSTD_createDCtx_advanced failed");
+
+    size_t ret = ZSTD_decompress_usingDict (dctx, uncompressed_buf->data, uncompressed_len, compressed, compressed_len,
+                                            dict ? dict->dict : NULL, dict ? dict->dict_len : 0);
+    ZSTD_freeDCtx (dctx);
+
+    ASSERTE (!ZSTD_isError (ret), "ZSTD_decompress_usingDict failed: %s", ZSTD_getErrorName (ret));
+    ASSERTE (ret == uncompressed_len, "ZSTD_decompress_usingDict: expecting uncompressed_len=%"PRIu64" but got %u", uncompressed_len, (uint32_t)ret);
+
+    COPY_TIMER (compressor_zstd);
+}
@@ -13,6 +13,215 @@
 #include "strings.h"
 #include "compressor.h"
 #include "zfile.h"
+#include "sections.h"
+#include <pthread.h>
+
+// --------------------------------------------------------------------------------------------------------------------
+// Chunked sections: a local buffer larger than COMP_CHUNK_SIZE (eg QUAL or NONREF in a VB of several hundred MB) is split
+// into chunks that are compressed independently, in parallel threads, and likewise uncompressed in parallel in PIZ.
+// The section data is then a chunk table followed by the compressed chunks. All numbers in the table are big endian:
+// num_chunks, and for each chunk: data_compressed_len. All chunks except for the last are COMP_CHUNK_SIZE bytes uncompressed.
+// --------------------------------------------------------------------------------------------------------------------
+
+#define COMP_CHUNK_SIZE (16 << 20)
+#define COMP_MAX_CHUNK_THREADS 64
+
+typedef struct {
+    uint32_t comp_len;
+    uint32_t offset;  // offset of the compressed chunk within the z_data of the thread that compressed it
+    uint32_t thread_i;
+} CompChunk;
+
+typedef struct {
+    VBlockP vb;       // a non-pool VB providing this thread's codec memory and z_data
+    uint32_t thread_i, num_threads, num_chunks;
+    Codec codec;
+    SectionHeader *header;
+    CompChunk *chunks;
+    const char *uncompressed;
+    uint64_t uncompressed_len;
+    const char *compressed;       // PIZ: start of the first chunk
+    Buffer *uncompressed_buf;     // PIZ
+} CompChunksThread;
+
+#define chunk_uncomp_len(th, chunk_i) ((uint32_t)MIN (COMP_CHUNK_SIZE, (th)->uncompressed_len - (uint64_t)(chunk_i) * COMP_CHUNK_SIZE))
+
+// note: sections with a sub-codec (eg PBWT, GTSHARK) are never chunked, as comp_uncompress_chunks doesn't run sub-codecs
+static inline bool comp_is_chunked (SectionHeader *header, Codec comp_codec, uint32_t data_uncompressed_len)
+{
+    return header->section_type == SEC_LOCAL && data_uncompressed_len > COMP_CHUNK_SIZE && 
+           codec_args[comp_codec].is_simple && !header->sub_codec && global_max_threads > 1;
+}
+
+// runs func in num_threads threads - thread 0 in the calling thread
+static void comp_run_chunk_threads (CompChunksThread *threads, uint32_t num_threads, void *(*func)(void *))
+{
+    pthread_t thread_ids[COMP_MAX_CHUNK_THREADS];
+
+    for (uint32_t thread_i=1; thread_i < num_threads; thread_i++) {
+        int err = pthread_create (&thread_ids[thread_i], NULL, func, &threads[thread_i]);
+        ASSERTE (!err, "failed to create thread for chunk compression %u: %s", thread_i, strerror (err));
+    }
+
+    func (&threads[0]);
+
+    for (uint32_t thread_i=1; thread_i < num_threads; thread_i++)
+        pthread_join (thread_ids[thread_i], NULL);
+}
+
+static void *comp_compress_chunks_thread (void *arg)
+{
+    CompChunksThread *th = (CompChunksThread *)arg;
+    Buffer *z_data = &th->vb->z_data;
+
+    for (uint32_t chunk_i=th->thread_i; chunk_i < th->num_chunks; chunk_i += th->num_threads) {
+        CompChunk *chunk = &th->chunks[chunk_i];
+        const char *uncompressed = &th->uncompressed[(uint64_t)chunk_i * COMP_CHUNK_SIZE];
+        uint32_t uncompressed_len = chunk_uncomp_len (th, chunk_i);
+
+        buf_alloc_more (th->vb, z_data, codec_args[th->codec].est_size (th->codec, uncompressed_len), 0, char, 1.5, "z_data");
+
+        chunk->thread_i = th->thread_i;
+        chunk->offset   = z_data->len;
+        chunk->comp_len = z_data->size - z_data->len;
+
+        bool success = codec_args[th->codec].compress (th->vb, th->header, uncompressed, &uncompressed_len, NULL, 
+                                                       AFTERENT (char, *z_data), &chunk->comp_len, true);
+        codec_free_all (th->vb);
+
+        // if output buffer is too small, increase it, and try again
+        if (!success) {
+            buf_alloc_more (th->vb, z_data, uncompressed_len * 1.5 + 50, 0, char, 1, "z_data");
+            chunk->comp_len = z_data->size - z_data->len;
+
+            codec_args[th->codec].compress (th->vb, th->header, uncompressed, &uncompressed_len, NULL, 
+                                            AFTERENT (char, *z_data), &chunk->comp_len, false);
+            codec_free_all (th->vb);
+        }
+
+        z_data->len += chunk->comp_len;
+    }
+
+    return NULL;
+}
+
+// compresses the data into the chunk table + chunks, placed in z_data after compressed_offset. returns data_compressed_len.
+static uint32_t comp_compress_chunks (VBlockP vb, SectionHeader *header, Codec comp_codec, 
+                                      const char *uncompressed, uint32_t uncompressed_len, LocalGetLineCB callback,
+                                      Buffer *z_data, uint32_t compressed_offset, uint32_t encryption_padding_reserve)
+{
+    // chunks are compressed from contiguous data, so we need to copy all the data in case of callback
+    if (callback) {
+        ASSERTE0 (!vb->compressed.len, "expecting vb->compressed to be free, but its not");
+        buf_alloc (vb, &vb->compressed, uncompressed_len, 1, "compressed");
+
+        for (uint32_t line_i=0; line_i < vb->lines.len; line_i++) {
+            char *start1=0;
+            uint32_t len1=0;        
+            
+            callback (vb, line_i, &start1, &len1, uncompressed_len - vb->compressed.len); 
+
+            if (start1 && len1) buf_add (&vb->compressed, start1, len1);
+        }
+
+        uncompressed = vb->compressed.data;
+    }
+
+    uint32_t num_chunks  = (uncompressed_len + COMP_CHUNK_SIZE - 1) / COMP_CHUNK_SIZE;
+    uint32_t num_threads = MIN (MIN (num_chunks, global_max_threads), COMP_MAX_CHUNK_THREADS);
+
+    CompChunk chunks[num_chunks];
+    CompChunksThread threads[num_threads];
+
+    for (uint32_t thread_i=0; thread_i < num_threads; thread_i++) 
+        threads[thread_i] = (CompChunksThread){ .vb = vb_get_nonpool_vb (vb), .thread_i = thread_i, .num_threads = num_threads, 
+                                                .num_chunks = num_chunks, .codec = comp_codec, .header = header, .chunks = chunks,
+                                                .uncompressed = uncompressed, .uncompressed_len = uncompressed_len };
+
+    comp_run_chunk_threads (threads, num_threads, comp_compress_chunks_thread);
+
+    // assemble chunk table and chunks in z_data
+    uint32_t data_compressed_len = sizeof (uint32_t) * (1 + num_chunks);
+    for (uint32_t chunk_i=0; chunk_i < num_chunks; chunk_i++) 
+        data_compressed_len += chunks[chunk_i].comp_len;
+
+    buf_alloc (vb, z_data, z_data->len + compressed_offset + data_compressed_len + encryption_padding_reserve, 1.5, z_data->name);
+
+    uint32_t *table = (uint32_t *)&z_data->data[z_data->len + compressed_offset];
+    char *next = (char *)&table[1 + num_chunks];
+
+    table[0] = BGEN32 (num_chunks);
+    for (uint32_t chunk_i=0; chunk_i < num_chunks; chunk_i++) {
+        CompChunk *chunk = &chunks[chunk_i];
+        table[1 + chunk_i] = BGEN32 (chunk->comp_len);
+
+        memcpy (next, ENT (char, threads[chunk->thread_i].vb->z_data, chunk->offset), chunk->comp_len);
+        next += chunk->comp_len;
+    }
+
+    for (uint32_t thread_i=0; thread_i < num_threads; thread_i++) 
+        vb_destroy_vb (&threads[thread_i].vb);
+
+    if (callback) buf_free (&vb->compressed);
+
+    return data_compressed_len;
+}
+
+static void *comp_uncompress_chunks_thread (void *arg)
+{
+    CompChunksThread *th = (CompChunksThread *)arg;
+
+    for (uint32_t chunk_i=th->thread_i; chunk_i < th->num_chunks; chunk_i += th->num_threads) {
+        // an overlay of the chunk's part of the uncompressed data
+        Buffer chunk_buf = { .type = BUF_OVERLAY, 
+                             .data = th->uncompressed_buf->data + (uint64_t)chunk_i * COMP_CHUNK_SIZE, 
+                             .len  = chunk_uncomp_len (th, chunk_i) };
+        chunk_buf.size = chunk_buf.len;
+
+        codec_args[th->codec].uncompress (th->vb, th->codec, 0, &th->compressed[th->chunks[chunk_i].offset], th->chunks[chunk_i].comp_len,
+                                          &chunk_buf, chunk_buf.len, CODEC_UNKNOWN);
+        codec_free_all (th->vb);
+    }
+
+    return NULL;
+}
+
+void comp_uncompress_chunks (VBlockP vb, Codec codec,
+                             const char *compressed, uint32_t compressed_len,
+                             Buffer *uncompressed_data, uint64_t uncompressed_len)
+{
+    const uint32_t *table = (const uint32_t *)compressed;
+    uint32_t num_chunks = BGEN32 (table[0]);
+
+    ASSERTE (num_chunks == (uncompressed_len + COMP_CHUNK_SIZE - 1) / COMP_CHUNK_SIZE, 
+             "bad num_chunks=%u for uncompressed_len=%"PRIu64, num_chunks, uncompressed_len);
+
+    ASSERTE (codec_args[codec].is_simple && codec_args[codec].uncompress, "chunked section has codec %s that is not a simple codec", codec_name (codec));
+
+    CompChunk chunks[num_chunks];
+    uint32_t offset = sizeof (uint32_t) * (1 + num_chunks);
+
+    for (uint32_t chunk_i=0; chunk_i < num_chunks; chunk_i++) {
+        chunks[chunk_i] = (CompChunk){ .comp_len = BGEN32 (table[1 + chunk_i]), .offset = offset };
+        offset += chunks[chunk_i].comp_len;
+    }
+
+    ASSERTE (offset == compressed_len, "chunk table of a chunked section has a total length of %u, but compressed_len=%u", offset, compressed_len);
+
+    uint32_t num_threads = MIN (MIN (num_chunks, global_max_threads), COMP_MAX_CHUNK_THREADS);
+    CompChunksThread threads[num_threads];
+
+    for (uint32_t thread_i=0; thread_i < num_threads; thread_i++) 
+        threads[thread_i] = (CompChunksThread){ .vb = vb_get_nonpool_vb (vb), .thread_i = thread_i, .num_threads = num_threads, 
+                                                .num_chunks = num_chunks, .codec = codec, .chunks = chunks, 
+                                                .compressed = compressed, .uncompressed_buf = uncompressed_data, 
+                                                .uncompressed_len = uncompressed_len };
+
+    comp_run_chunk_threads (threads, num_threads, comp_uncompress_chunks_thread);
+
+    for (uint32_t thread_i=0; thread_i < num_threads; thread_i++) 
+        vb_destroy_vb (&threads[thread_i].vb);
+}
 
 // compresses data - either a contiguous block or one line at a time. If both are NULL that there is no data to compress.
 // returns data_compressed_len
@@ -66,6 +275,14 @@ uint32_t comp_compress (VBlock *vb, Buffer *z_data, bool is_z_file_buf,
         
         data_compressed_len = z_data->size - z_data->len - compressed_offset - encryption_padding_reserve; // actual memory available - usually more than we asked for in the alloc, because z_data is pre-allocated
 
+        // case: large local - compress in chunks, in parallel
+        if (comp_is_chunked (header, comp_codec, data_uncompressed_len)) {
+            header->flags.ctx.chunked = true;
+            data_compressed_len = comp_compress_chunks (vb, header, comp_codec, uncompressed_data, data_uncompressed_len, callback, 
+                                                        z_data, compressed_offset, encryption_padding_reserve);
+            goto compressed;
+        }
+
         bool success = 
             codec_args[comp_codec].compress (vb, header, uncompressed_data, &data_uncompressed_len,
                                              callback,  
@@ -90,6 +307,7 @@ uint32_t comp_compress (VBlock *vb, Buffer *z_data, bool is_z_file_buf,
             codec_free_all (vb); // just in case
         }
     
+    compressed:
         // update uncompressed length - complex codecs (like domqual, pbwt) might change it
         header->data_uncompressed_len = BGEN32 (data_uncompressed_len);
         
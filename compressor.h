@@ -18,4 +18,8 @@ extern void comp_uncompress (VBlockP vb, Codec codec, Codec sub_codec, uint8_t p
                              const char *compressed_data, uint32_t compressed_data_len,
                              Buffer *uncompressed_data, uint64_t uncompressed_len);
 
+extern void comp_uncompress_chunks (VBlockP vb, Codec codec,
+                                    const char *compressed, uint32_t compressed_len,
+                                    Buffer *uncompressed_data, uint64_t uncompressed_len);
+
 #endif
@@ -120,7 +120,14 @@ static inline LastValueType container_reconstruct_do (VBlock *vb, Context *ctx,
     // for containers, new_value is the some of all its items, all repeats last_value (either int or float)
     LastValueType new_value = {};
 
-    for (uint32_t rep_i=0; rep_i < con->repeats; rep_i++) {
+    // the top level container might be reconstructed only partially, if seeked to a checkpoint (see checkpoint_piz_seek)
+    uint32_t first_rep = 0, after_rep = con->repeats;
+    if (con->is_toplevel && vb->after_rep) {
+        first_rep = vb->first_rep;
+        after_rep = MIN (vb->after_rep, con->repeats);
+    }
+
+    for (uint32_t rep_i=first_rep; rep_i < after_rep; rep_i++) {
 
         // case this is the top-level snip
         if (con->is_toplevel) {
@@ -28,6 +28,7 @@
 #include "zip.h"
 #include "piz.h"
 #include "reconstruct.h"
+#include "random_access.h"
 
 #define INITIAL_NUM_NODES 10000
 
@@ -1074,6 +1075,60 @@ void ctx_compress_dictionaries (void)
 static const SectionListEntry *dict_sl = NULL; 
 static ReadChromeType read_chrom_policy;
 static Context *dict_ctx;
+static Buffer needed_dict_ids = EMPTY_BUFFER; // with --regions: sorted dict_ids of contexts that have a B250 or LOCAL section in an included VB
+static bool is_lazy_dicts = false;
+
+static int ctx_sort_dict_ids (const void *a, const void *b)
+{
+    uint64_t dict_id_a = *(uint64_t *)a, dict_id_b = *(uint64_t *)b;
+    return (dict_id_a > dict_id_b) ? 1 : (dict_id_a < dict_id_b) ? -1 : 0;
+}
+
+// PIZ I/O thread: with --regions, we need the full dictionary only for contexts that have a B250 or LOCAL section 
+// in at least one VB that is included. Of other dictionaries, we read only the first fragment - as it contains
+// word_index=0, which is needed for contexts whose b250 section was dropped because all its words were word 0 (see zip_generate_b250_section)
+static void ctx_dict_find_needed_dict_ids (void)
+{
+    buf_free (&needed_dict_ids);
+
+    Buffer intersection_matrix = EMPTY_BUFFER;
+    uint32_t vb_i = 0;
+    bool vb_is_included = false;
+
+    ARRAY (const SectionListEntry, sl, z_file->section_list_buf);
+    for (uint64_t i=0; i < sl_len; i++) {
+        if (sl[i].section_type != SEC_B250 && sl[i].section_type != SEC_LOCAL) continue;
+
+        if (sl[i].vblock_i != vb_i) {
+            vb_i = sl[i].vblock_i;
+            vb_is_included = random_access_is_vb_included (vb_i, &intersection_matrix);
+            buf_destroy (&intersection_matrix);
+        }
+
+        if (vb_is_included) {
+            buf_alloc_more (evb, &needed_dict_ids, 1, 100, uint64_t, 2, "needed_dict_ids");
+            NEXTENT (uint64_t, needed_dict_ids) = sl[i].dict_id.num;
+        }
+    }
+
+    if (!needed_dict_ids.len) return;
+
+    // sort and remove duplicates
+    ARRAY (uint64_t, ids, needed_dict_ids);
+    qsort (ids, ids_len, sizeof (uint64_t), ctx_sort_dict_ids);
+
+    uint64_t new_len = 1;
+    for (uint64_t i=1; i < ids_len; i++)
+        if (ids[i] != ids[new_len-1]) ids[new_len++] = ids[i];
+
+    needed_dict_ids.len = new_len;
+}
+
+static inline bool ctx_dict_is_needed (DictId dict_id)
+{
+    return !is_lazy_dicts || 
+           (needed_dict_ids.len && bsearch (&dict_id.num, needed_dict_ids.data, needed_dict_ids.len, sizeof (uint64_t), ctx_sort_dict_ids));
+}
 
 static void ctx_dict_read_one_vb (VBlockP vb)
 {
@@ -1088,6 +1143,10 @@ static void ctx_dict_read_one_vb (VBlockP vb)
     if (read_chrom_policy == DICTREAD_EXCEPT_CHROM && is_chrom) goto done;
 
     if (piz_is_skip_sectionz (SEC_DICT, dict_sl->dict_id)) goto done;
+
+    // case: dictionary not needed by any included VB - read only its first fragment (fragments of a dictionary are consecutive in v9+)
+    bool is_needed = ctx_dict_is_needed (dict_sl->dict_id);
+    if (!is_needed && dict_ctx && dict_ctx->dict_id.num == dict_sl->dict_id.num) goto done;
     
     zfile_read_section (z_file, vb, dict_sl->vblock_i, &vb->z_data, "z_data", SEC_DICT, dict_sl);    
     SectionHeaderDictionary *header = (SectionHeaderDictionary *)vb->z_data.data;
@@ -1102,7 +1161,10 @@ static void ctx_dict_read_one_vb (VBlockP vb)
         // in v9+ same-dict fragments are consecutive in the file, and all but the last are FRAGMENT_SIZE or a bit less, allowing pre-allocation
         if (z_file->genozip_version >= 9) {
             unsigned num_fragments=0; 
-            for (const SectionListEntry *sl=dict_sl; sl->dict_id.num == dict_ctx->dict_id.num; sl++) num_fragments++;
+            if (is_needed)
+                for (const SectionListEntry *sl=dict_sl; sl->dict_id.num == dict_ctx->dict_id.num; sl++) num_fragments++;
+            else
+                num_fragments = 1; // we read only the first fragment
 
             // get size: for multi-fragment dictionaries, first fragment will be at or slightly less than FRAGMENT_SIZE, which is a power of 2.
             // this allows us to calculate the FRAGMENT_SIZE with which this file was compressed and hence an upper bound on the size
@@ -1187,6 +1249,11 @@ void ctx_read_all_dictionaries (ReadChromeType read_chrom)
     read_chrom_policy = read_chrom;
     dict_ctx = NULL;
 
+    // with --regions, piz_read_global_area reads the CHROM dictionary first, to determine the included VBs, and then 
+    // the remaining dictionaries - fully only if needed by an included VB. Not possible in v8, in which fragments are not consecutive.
+    is_lazy_dicts = read_chrom == DICTREAD_EXCEPT_CHROM && flag.regions && z_file->ra_buf.len && z_file->genozip_version >= 9;
+    if (is_lazy_dicts) ctx_dict_find_needed_dict_ids();
+
     dispatcher_fan_out_task (NULL, PROGRESS_NONE, "Reading dictionaries...", 
                              flag.test, 
                              z_file->genozip_version == 8, // For v8 files, we read all fragments in the I/O thread as was the case in v8. This is because they are very small, and also we can't easily calculate the totel size of each dictionary.
@@ -1194,6 +1261,8 @@ void ctx_read_all_dictionaries (ReadChromeType read_chrom)
                              ctx_dict_uncompress_one_vb, 
                              NULL);
 
+    buf_free (&needed_dict_ids);
+
     // build word lists in z_file->contexts with dictionary data 
     if (!(flag.show_headers && exe_type == EXE_GENOCAT))
         ctx_dict_build_word_lists();
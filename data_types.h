@@ -26,7 +26,8 @@
 #define MAX_NUM_SPECIAL MAX ((int)NUM_GNRIC_SPECIAL, \
                         MAX ((int)NUM_VCF_SPECIAL, \
                         MAX ((int)NUM_SAM_SPECIAL, \
-                             (int)NUM_FASTA_SPECIAL)))
+                        MAX ((int)NUM_FASTQ_SPECIAL, \
+                             (int)NUM_FASTA_SPECIAL))))
 
 typedef SPECIAL_RECONSTRUCTOR ((*PizSpecialReconstructor));
 typedef TRANSLATOR_FUNC ((*PizTranslator));
@@ -93,12 +94,12 @@ typedef struct DataTypeProperties {
 /*    name         is_bin bin_type has_ra ht sizeof_vb      sizeof_zip_dataline   txt_headr 1st  is_header_done       unconsumed        inspect_txt_header,     zip_initialize        zip_finalize      zip_read_one_vb        zip_dts_flag          seg_initialize        seg_txt_line        seg_finalize,       compress                  piz_initialize         piz_finalize         piz_read_one_vb        is_skip_secetion           reconstruct_seq            container_filter       container_cb          num_special        special        num_trans        translators        release_vb           destroy_vb           cleanup_memory          show_sections_line stat_dict_types                 */ \
     { "REFERENCE", false, DT_NONE, RA,    1, fasta_vb_size, fasta_vb_zip_dl_size, HDR_NONE, -1,  NULL,                fasta_unconsumed, NULL,                   ref_make_ref_init,    NULL,             NULL,                  NULL,                 fasta_seg_initialize, fasta_seg_txt_line, NULL,               ref_make_create_range,    NULL,                  NULL,                NULL,                  NULL,                      NULL,                      NULL,                  NULL,                 0,                 {},            0,               {},                fasta_vb_release_vb, NULL,                NULL,                   "Lines",           { "FIELD", "DESC",   "ERROR!" } }, \
     { "VCF",       false, DT_NONE, RA,    1, vcf_vb_size,   vcf_vb_zip_dl_size,   HDR_MUST, '#', NULL,                NULL,             vcf_inspect_txt_header, NULL,                 NULL,             NULL,                  NULL,                 vcf_seg_initialize,   vcf_seg_txt_line,   vcf_seg_finalize,   NULL,                     NULL,                  NULL,                NULL,                  vcf_piz_is_skip_section,   NULL,                      vcf_piz_filter,        vcf_piz_container_cb, NUM_VCF_SPECIAL,   VCF_SPECIAL,   0,               {},                vcf_vb_release_vb,   vcf_vb_destroy_vb,   vcf_vb_cleanup_memory,  "Variants",        { "FIELD", "INFO",   "FORMAT" } }, \
-    { "SAM",       false, DT_BAM,  RA,    1, sam_vb_size,   sam_vb_zip_dl_size,   HDR_OK,   '@', NULL,                NULL,             sam_header_inspect,     NULL,                 sam_header_finalize, NULL,               sam_zip_dts_flag,     sam_seg_initialize,   sam_seg_txt_line,   sam_seg_finalize,   NULL,                     NULL,                  sam_header_finalize, NULL,                  sam_piz_is_skip_section,   sam_reconstruct_seq,       sam_piz_sam2fq_filter, NULL,                 NUM_SAM_SPECIAL,   SAM_SPECIAL,   NUM_SAM_TRANS,   SAM_TRANSLATORS,   sam_vb_release_vb,   sam_vb_destroy_vb,   NULL,                   "Alignment lines", { "FIELD", "QNAME",  "OPTION" } }, \
-    { "FASTQ",     false, DT_NONE, NO_RA, 4, fastq_vb_size, fastq_vb_zip_dl_size, HDR_NONE, -1,  NULL,                fastq_unconsumed, NULL,                   fastq_zip_initialize, NULL,             fastq_zip_read_one_vb, fastq_zip_dts_flag,   fastq_seg_initialize, fastq_seg_txt_line, fastq_seg_finalize, NULL,                     fastq_piz_initialize,  NULL,                fastq_piz_read_one_vb, fastq_piz_is_skip_section, fastq_reconstruct_seq,     fastq_piz_filter,      NULL,                 0,                 {},            0,               {},                fastq_vb_release_vb, fastq_vb_destroy_vb, NULL,                   "Entries",         { "FIELD", "DESC",   "ERROR!" } }, \
-    { "FASTA",     false, DT_NONE, RA,    1, fasta_vb_size, fasta_vb_zip_dl_size, HDR_NONE, -1,  NULL,                fasta_unconsumed, NULL,                   NULL,                 NULL,             NULL,                  NULL,                 fasta_seg_initialize, fasta_seg_txt_line, fasta_seg_finalize, NULL,                     fasta_piz_initialize,  NULL,                fasta_piz_read_one_vb, fasta_piz_is_skip_section, NULL,                      fasta_piz_filter,      NULL,                 NUM_FASTA_SPECIAL, FASTA_SPECIAL, 0,               {},                fasta_vb_release_vb, fasta_vb_destroy_vb, NULL,                   "Lines",           { "FIELD", "DESC",   "ERROR!" } }, \
+    { "SAM",       false, DT_BAM,  RA,    1, sam_vb_size,   sam_vb_zip_dl_size,   HDR_OK,   '@', NULL,                NULL,             sam_header_inspect,     NULL,                 sam_header_finalize, NULL,               sam_zip_dts_flag,     sam_seg_initialize,   sam_seg_txt_line,   sam_seg_finalize,   NULL,                     NULL,                  sam_header_finalize, NULL,                  sam_piz_is_skip_section,   sam_reconstruct_seq,       sam_piz_sam2fq_filter, sam_piz_container_cb, NUM_SAM_SPECIAL,   SAM_SPECIAL,   NUM_SAM_TRANS,   SAM_TRANSLATORS,   sam_vb_release_vb,   sam_vb_destroy_vb,   NULL,                   "Alignment lines", { "FIELD", "QNAME",  "OPTION" } }, \
+    { "FASTQ",     false, DT_NONE, NO_RA, 4, fastq_vb_size, fastq_vb_zip_dl_size, HDR_NONE, -1,  NULL,                fastq_unconsumed, NULL,                   fastq_zip_initialize, NULL,             fastq_zip_read_one_vb, fastq_zip_dts_flag,   fastq_seg_initialize, fastq_seg_txt_line, fastq_seg_finalize, NULL,                     fastq_piz_initialize,  NULL,                fastq_piz_read_one_vb, fastq_piz_is_skip_section, fastq_reconstruct_seq,     fastq_piz_filter,      NULL,                 NUM_FASTQ_SPECIAL, FASTQ_SPECIAL, 0,               {},                fastq_vb_release_vb, fastq_vb_destroy_vb, NULL,                   "Entries",         { "FIELD", "DESC",   "ERROR!" } }, \
+    { "FASTA",     false, DT_NONE, RA,    1, fasta_vb_size, fasta_vb_zip_dl_size, HDR_NONE, -1,  NULL,                fasta_unconsumed, NULL,                   NULL,                 NULL,             NULL,                  NULL,                 fasta_seg_initialize, fasta_seg_txt_line, fasta_seg_finalize, NULL,                     fasta_piz_initialize,  NULL,                fasta_piz_read_one_vb, fasta_piz_is_skip_section, fasta_reconstruct_seq,     fasta_piz_filter,      NULL,                 NUM_FASTA_SPECIAL, FASTA_SPECIAL, 0,               {},                fasta_vb_release_vb, fasta_vb_destroy_vb, NULL,                   "Lines",           { "FIELD", "DESC",   "ERROR!" } }, \
     { "GVF",       false, DT_NONE, RA,    1, 0,             0,                    HDR_OK,   '#', NULL,                NULL,             NULL,                   NULL,                 NULL,             NULL,                  NULL,                 gff3_seg_initialize,  gff3_seg_txt_line,  gff3_seg_finalize,  NULL,                     NULL,                  NULL,                NULL,                  NULL,                      NULL,                      NULL,                  NULL,                 0,                 {},            0,               {},                NULL,                NULL,                NULL,                   "Sequences",       { "FIELD", "ATTRS",  "ITEMS"  } }, \
     { "23ANDME",   false, DT_NONE, RA,    1, 0,             0,                    HDR_MUST, '#', NULL,                NULL,             me23_header_inspect,    NULL,                 NULL,             NULL,                  NULL,                 me23_seg_initialize,  me23_seg_txt_line,  me23_seg_finalize,  NULL,                     NULL,                  NULL,                NULL,                  NULL,                      NULL,                      NULL,                  NULL,                 0,                 {},            NUM_ME23_TRANS,  ME23_TRANSLATORS,  NULL,                NULL,                NULL,                   "SNPs",            { "FIELD", "ERROR!", "ERROR!" } }, \
-    { "BAM",       true,  DT_NONE, RA,    0, sam_vb_size,   sam_vb_zip_dl_size,   HDR_MUST, -1,  bam_is_header_done,  bam_unconsumed,   sam_header_inspect,     NULL,                 sam_header_finalize, NULL,               sam_zip_dts_flag,     bam_seg_initialize,   bam_seg_txt_line,   sam_seg_finalize,   NULL,                     NULL,                  sam_header_finalize, NULL,                  NULL,                      NULL,                      sam_piz_sam2fq_filter, NULL,                 NUM_SAM_SPECIAL,   SAM_SPECIAL,   NUM_SAM_TRANS,   SAM_TRANSLATORS,   sam_vb_release_vb,   sam_vb_destroy_vb,   NULL,                   "Alignment lines", { "FIELD", "QNAME",  "OPTION" } }, \
+    { "BAM",       true,  DT_NONE, RA,    0, sam_vb_size,   sam_vb_zip_dl_size,   HDR_MUST, -1,  bam_is_header_done,  bam_unconsumed,   sam_header_inspect,     NULL,                 sam_header_finalize, NULL,               sam_zip_dts_flag,     bam_seg_initialize,   bam_seg_txt_line,   sam_seg_finalize,   NULL,                     NULL,                  sam_header_finalize, NULL,                  NULL,                      NULL,                      sam_piz_sam2fq_filter, sam_piz_container_cb, NUM_SAM_SPECIAL,   SAM_SPECIAL,   NUM_SAM_TRANS,   SAM_TRANSLATORS,   sam_vb_release_vb,   sam_vb_destroy_vb,   NULL,                   "Alignment lines", { "FIELD", "QNAME",  "OPTION" } }, \
     { "BCF",       false, DT_NONE, RA,    1, vcf_vb_size,   vcf_vb_zip_dl_size,   HDR_MUST, '#', NULL,                NULL,             vcf_inspect_txt_header, NULL,                 NULL,             NULL,                  NULL,                 vcf_seg_initialize,   vcf_seg_txt_line,   vcf_seg_finalize,   NULL,                     NULL,                  NULL,                NULL,                  vcf_piz_is_skip_section,   NULL,                      vcf_piz_filter,        NULL,                 NUM_VCF_SPECIAL,   VCF_SPECIAL,   0,               {},                vcf_vb_release_vb,   vcf_vb_destroy_vb,   vcf_vb_cleanup_memory,  "Variants",        { "FIELD", "INFO",   "FORMAT" } }, \
     { "GENERIC",   true,  DT_GENERIC, NO_RA, 0, 0,          0,                    HDR_NONE, -1,  NULL,                generic_unconsumed, NULL,                 NULL,                 NULL,             NULL,                  NULL,                 NULL,                 NULL,               generic_seg_finalize,NULL,                    NULL,                  NULL,                NULL,                  NULL,                      NULL,                      NULL,                  NULL,                 NUM_GNRIC_SPECIAL, GNRIC_SPECIAL, 0,               {},                NULL,                NULL,                NULL,                   "N/A",             { "FIELD", "ERROR!", "ERROR!" } }, \
     { "PHYLIP",    false, DT_NONE, NO_RA, 1, 0,             phy_vb_zip_dl_size,   HDR_MUST, -1,  phy_is_header_done,  NULL,             phy_header_inspect,     NULL,                 NULL,             NULL,                  NULL,                 phy_seg_initialize,   phy_seg_txt_line,   phy_seg_finalize,   NULL,                     NULL,                  NULL,                NULL,                  NULL,                      NULL,                      NULL,                  NULL,                 0,                 {},            0,               {},                NULL,                NULL,                NULL,                   "Sequences",       { "FIELD", "ERROR!", "ERROR!" } }, \
@@ -132,9 +133,10 @@ typedef enum { SAM_RNAME, SAM_QNAME, SAM_FLAG, SAM_POS, SAM_MAPQ, SAM_CIGAR, SAM
                SAM_TOPLEVEL, SAM_TOP2BAM, SAM_TOP2FQ, 
                SAM_E2_Z, SAM_2NONREF, SAM_N2ONREFX, SAM_2GPOS, SAM_S2TRAND, // E2 data - we put them in primary fields bc they need to be sequential - merging VBs dictionaries doesn't necessarily make sequentials ones in ZF
                SAM_U2_Z, SAM_D2OMQRUN,                                      // U2 data - same reason
+               SAM_MATE,                                                    // line delta to the mate, for fields copied from it
                NUM_SAM_FIELDS } SamFields;
 typedef enum { FASTQ_CONTIG /* copied from reference */, FASTQ_DESC, FASTQ_E1L, FASTQ_SQBITMAP, FASTQ_NONREF, FASTQ_NONREF_X, FASTQ_GPOS, FASTQ_STRAND, FASTQ_E2L, FASTQ_QUAL, FASTQ_DOMQRUNS, FASTQ_TOPLEVEL, NUM_FASTQ_FIELDS } FastqFields;
-typedef enum { FASTA_CONTIG, FASTA_LINEMETA, FASTA_EOL, FASTA_DESC, FASTA_COMMENT, FASTA_NONREF, FASTA_NONREF_X, FASTA_TOPLEVEL, NUM_FASTA_FIELDS } FastaFields;
+typedef enum { FASTA_CONTIG, FASTA_LINEMETA, FASTA_EOL, FASTA_DESC, FASTA_COMMENT, FASTA_SQBITMAP, FASTA_NONREF, FASTA_NONREF_X, FASTA_GPOS, FASTA_STRAND, FASTA_TOPLEVEL, NUM_FASTA_FIELDS } FastaFields;
 typedef enum { GFF3_SEQID, GFF3_SOURCE, GFF3_TYPE, GFF3_START, GFF3_END, GFF3_SCORE, GFF3_STRAND, GFF3_PHASE, GFF3_ATTRS, GFF3_EOL, GFF3_TOPLEVEL, NUM_GFF3_FIELDS } Gff3Fields;
 typedef enum { ME23_CHROM, ME23_POS, ME23_ID, ME23_GENOTYPE, ME23_EOL, ME23_TOPLEVEL, ME23_TOP2VCF, NUM_ME23_FIELDS } Me23Fields;  
 typedef enum { GNRIC_DATA, GNRIC_TOPLEVEL, NUM_GNRIC_FIELDS } GenericFields;
@@ -165,12 +167,12 @@ typedef struct DataTypeFields {
 /* num_fields        pos         info        nonref        eol        toplevel names (including extend fields) - max 8 characters - 2 first chars must be unique within each data type (for dict_id_to_did_i_map) */ \
   {NUM_REF_FIELDS,   -1,         -1,         -1,           1,         -1,             { "CONTIG", }, }, \
   {NUM_VCF_FIELDS,   VCF_POS,    VCF_INFO,   -1,           VCF_EOL,   VCF_TOPLEVEL,   { "CHROM", "POS", "ID", "REF+ALT", "QUAL", "FILTER", "INFO", "FORMAT", "SAMPLES", "EOL", TOPLEVEL } }, \
-  {NUM_SAM_FIELDS,   SAM_POS,    -1,         SAM_NONREF,   SAM_EOL,   SAM_TOPLEVEL,   { "RNAME", "QNAME", "FLAG", "POS", "MAPQ", "CIGAR", "RNEXT", "PNEXT", "TLEN", "OPTIONAL", "SQBITMAP", "NONREF", "NONREF_X", "GPOS", "STRAND", "QUAL", "DOMQRUNS", "EOL", "BAM_BIN", TOPLEVEL, "TOP2BAM", "TOP2FQ", "E2:Z", "2NONREF", "N2ONREFX", "2GPOS", "S2TRAND", "U2:Z", "D2OMQRUN" } }, \
+  {NUM_SAM_FIELDS,   SAM_POS,    -1,         SAM_NONREF,   SAM_EOL,   SAM_TOPLEVEL,   { "RNAME", "QNAME", "FLAG", "POS", "MAPQ", "CIGAR", "RNEXT", "PNEXT", "TLEN", "OPTIONAL", "SQBITMAP", "NONREF", "NONREF_X", "GPOS", "STRAND", "QUAL", "DOMQRUNS", "EOL", "BAM_BIN", TOPLEVEL, "TOP2BAM", "TOP2FQ", "E2:Z", "2NONREF", "N2ONREFX", "2GPOS", "S2TRAND", "U2:Z", "D2OMQRUN", "MATE" } }, \
   {NUM_FASTQ_FIELDS, -1,         -1,         FASTQ_NONREF, FASTQ_E1L, FASTQ_TOPLEVEL, { "CONTIG", "DESC", "E1L", "SQBITMAP", "NONREF", "NONREF_X", "GPOS", "STRAND", "E2L", "QUAL", "DOMQRUNS", TOPLEVEL } }, \
-  {NUM_FASTA_FIELDS, -1,         -1,         FASTA_NONREF, FASTA_EOL, FASTA_TOPLEVEL, { "CONTIG", "LINEMETA", "EOL", "DESC", "COMMENT", "NONREF", "NONREF_X", TOPLEVEL } }, \
+  {NUM_FASTA_FIELDS, -1,         -1,         FASTA_NONREF, FASTA_EOL, FASTA_TOPLEVEL, { "CONTIG", "LINEMETA", "EOL", "DESC", "COMMENT", "SQBITMAP", "NONREF", "NONREF_X", "GPOS", "STRAND", TOPLEVEL } }, \
   {NUM_GFF3_FIELDS,  GFF3_START, GFF3_ATTRS, -1,           GFF3_EOL,  GFF3_TOPLEVEL,  { "SEQID", "SOURCE", "TYPE", "START", "END", "SCORE", "STRAND", "PHASE", "ATTRS", "EOL", TOPLEVEL } }, \
   {NUM_ME23_FIELDS,  ME23_POS,   -1,         -1,           ME23_EOL,  ME23_TOPLEVEL,  { "CHROM", "POS", "ID", "GENOTYPE", "EOL", TOPLEVEL, "TOP2VCF" } }, \
-  {NUM_SAM_FIELDS,   SAM_POS,    -1,         SAM_NONREF,   SAM_EOL,   SAM_TOP2BAM,    { "RNAME", "QNAME", "FLAG", "POS", "MAPQ", "CIGAR", "RNEXT", "PNEXT", "TLEN", "OPTIONAL", "SQBITMAP", "NONREF", "NONREF_X", "GPOS", "STRAND", "QUAL", "DOMQRUNS", "EOL", "BAM_BIN", TOPLEVEL, "TOP2BAM", "TOP2FQ", "E2:Z", "2NONREF", "N2ONREFX", "2GPOS", "S2TRAND", "U2:Z", "D2OMQRUN" } }, \
+  {NUM_SAM_FIELDS,   SAM_POS,    -1,         SAM_NONREF,   SAM_EOL,   SAM_TOP2BAM,    { "RNAME", "QNAME", "FLAG", "POS", "MAPQ", "CIGAR", "RNEXT", "PNEXT", "TLEN", "OPTIONAL", "SQBITMAP", "NONREF", "NONREF_X", "GPOS", "STRAND", "QUAL", "DOMQRUNS", "EOL", "BAM_BIN", TOPLEVEL, "TOP2BAM", "TOP2FQ", "E2:Z", "2NONREF", "N2ONREFX", "2GPOS", "S2TRAND", "U2:Z", "D2OMQRUN", "MATE" } }, \
   {NUM_VCF_FIELDS,   VCF_POS,    VCF_INFO,   -1,           VCF_EOL,   VCF_TOPLEVEL,   { "CHROM", "POS", "ID", "REF+ALT", "QUAL", "FILTER", "INFO", "FORMAT", "SAMPLES", "EOL", TOPLEVEL } }, \
   {NUM_GNRIC_FIELDS, -1,        -1,          -1,           -1,        GNRIC_TOPLEVEL, { "DATA", TOPLEVEL } }, \
   {NUM_PHY_FIELDS,   -1,         -1,         -1,           PHY_EOL,   PHY_TOPLEVEL,   { "ID", "SEQ", "EOL", TOPLEVEL, "TOP2FA" } }, \
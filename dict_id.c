@@ -59,7 +59,7 @@ uint64_t dict_id_ATTR_ID=0, dict_id_ATTR_Variant_seq=0, dict_id_ATTR_Reference_s
          dict_id_ENSTid=0; // private genozip dict
 
 // our stuff used in multiple data types
-uint64_t dict_id_WindowsEOL=0;         
+uint64_t dict_id_WindowsEOL=0, dict_id_CHECKPOINT=0, dict_id_GREPINDEX=0, dict_id_KMERSKETCH=0;         
 
 DictId dict_id_make (const char *str, unsigned str_len, DictIdType dict_id_type) 
 { /*
@@ -126,6 +126,9 @@ void dict_id_initialize (DataType data_type)
     }
 
     dict_id_WindowsEOL = dict_id_make ("#", 1, DTYPE_1).num; 
+    dict_id_CHECKPOINT = dict_id_make ("#CHKPNT", 7, DTYPE_1).num; // sub-VB positional index (see checkpoint.c)
+    dict_id_GREPINDEX  = dict_id_make ("#GRPIDX", 7, DTYPE_1).num; // per-VB grep filter (see grepindex.c)
+    dict_id_KMERSKETCH = dict_id_make ("#KMRSKT", 7, DTYPE_1).num; // per-VB minimizer sketch (see seqsearch.c)
 
     switch (data_type) { 
     case DT_VCF:
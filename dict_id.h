@@ -39,7 +39,7 @@ extern uint64_t dict_id_fields[MAX_NUM_FIELDS_PER_DATA_TYPE],
                 dict_id_FORMAT_AD, dict_id_FORMAT_ADF, dict_id_FORMAT_ADR, dict_id_FORMAT_ADALL, 
                 dict_id_FORMAT_GQ, dict_id_FORMAT_DS,
                 dict_id_INFO_AC,  dict_id_INFO_AF, dict_id_INFO_AN, dict_id_INFO_DP, dict_id_INFO_VQSLOD, // some VCF INFO subfields
-                dict_id_INFO_DP4, dict_id_INFO_SF, dict_id_INFO_END, dict_id_INFO_SVLEN, dict_id_WindowsEOL,
+                dict_id_INFO_DP4, dict_id_INFO_SF, dict_id_INFO_END, dict_id_INFO_SVLEN, dict_id_WindowsEOL, dict_id_CHECKPOINT, dict_id_GREPINDEX, dict_id_KMERSKETCH,
                 dict_id_INFO_BaseCounts,
                 
                 // tags from VEP (Varient Effect Predictor) and similar tools
@@ -300,9 +300,20 @@ VBlock *dispatcher_get_processed_vb (Dispatcher dispatcher, bool *is_final)
 bool dispatcher_has_free_thread (Dispatcher dispatcher)
 {
     DispatcherData *dd = (DispatcherData *)dispatcher;
+
+    // --max-memory: when at the budget, don't hand out new VBs until a running VB completes and releases its memory.
+    // if no VB is running, memory will not go down by waiting, so we let the VB through
+    if (flag.max_memory && dd->num_running_compute_threads && buf_get_memory_in_use() >= flag.max_memory)
+        return false;
+
     return dd->num_running_compute_threads < MAX(1, dd->max_threads);
 }
 
+unsigned dispatcher_get_num_running_threads (Dispatcher dispatcher)
+{
+    return ((DispatcherData *)dispatcher)->num_running_compute_threads;
+}
+
 VBlock *dispatcher_get_next_vb (Dispatcher dispatcher)
 {
     DispatcherData *dd = (DispatcherData *)dispatcher;
@@ -24,6 +24,7 @@ extern VBlockP dispatcher_generate_next_vb (Dispatcher dispatcher, uint32_t vb_i
 extern bool dispatcher_has_processed_vb (Dispatcher dispatcher, bool *is_final);                                  
 extern VBlockP dispatcher_get_processed_vb (Dispatcher dispatcher, bool *is_final);
 extern bool dispatcher_has_free_thread (Dispatcher dispatcher);
+extern unsigned dispatcher_get_num_running_threads (Dispatcher dispatcher);
 extern VBlockP dispatcher_get_next_vb (Dispatcher dispatcher);
 extern void dispatcher_recycle_vbs (Dispatcher dispatcher);
 extern void dispatcher_abandon_next_vb (Dispatcher dispatcher);
@@ -16,10 +16,15 @@
 #include "stats.h"
 #include "reconstruct.h"
 #include "vblock.h"
+#include "aligner.h"
 
 #define dict_id_is_fasta_desc_sf dict_id_is_type_1
 #define dict_id_fasta_desc_sf dict_id_type_1
 
+// when compressing with a reference, each contig is aligned in chunks of this length. Shorter chunks lose less to indels, 
+// at the cost of one GPOS and STRAND entry per chunk
+#define FASTA_ALIGN_CHUNK_LEN 1000
+
 typedef struct {
     uint32_t seq_data_start, seq_len; // regular fasta and make-reference: start & length within vb->txt_data
 } ZipDataLineFASTA;
@@ -38,6 +43,10 @@ typedef struct VBlockFASTA {
     uint32_t std_line_len;         // ZIP: determined by first non-first-line seq line in VB 
     WordIndex std_line_node_index; // ZIP: node index for non-first lines, with same length as std_line_len
 
+    // aligning to a reference
+    Buffer aligned_seq;            // ZIP: sequence of the current contig, without EOLs. PIZ: bases of the current chunk
+    uint32_t aligned_seq_next;     // PIZ: next base in aligned_seq to be consumed by a seq line
+
 } VBlockFASTA;
 
 #define DATA_LINE(i) ENT (ZipDataLineFASTA, vb->lines, (i))
@@ -47,11 +56,18 @@ unsigned fasta_vb_zip_dl_size (void) { return sizeof (ZipDataLineFASTA); }
 
 void fasta_vb_release_vb (VBlockFASTA *vb)
 {
-    memset ((char *)vb + sizeof (VBlock), 0, sizeof (VBlockFASTA) - sizeof (VBlock)); // zero all data unique to VBlockFASTA
+    vb->contig_grepped_out = false;
+    vb->last_line = FASTA_LINE_SEQ;
+    vb->lines_this_contig = vb->std_line_len = vb->aligned_seq_next = 0;
+    vb->std_line_node_index = 0;
+    buf_free (&vb->aligned_seq);
     vb->contexts[FASTA_NONREF].local.len = 0; // len might be is used even though buffer is not allocated (in make-ref)
 }
 
-void fasta_vb_destroy_vb (VBlockFASTA *vb) {}
+void fasta_vb_destroy_vb (VBlockFASTA *vb)
+{
+    buf_destroy (&vb->aligned_seq);
+}
 
 // used by ref_make_create_range
 void fasta_get_data_line (VBlockP vb_, uint32_t line_i, uint32_t *seq_data_start, uint32_t *seq_len)
@@ -171,11 +187,23 @@ void fasta_seg_initialize (VBlockFASTA *vb)
             vb->contexts[FASTA_NONREF].ltype  = LT_SEQUENCE;
         }
   
-        if (flag.reference == REF_EXTERNAL || flag.reference == REF_EXT_STORE) 
-            vb->contexts[FASTA_NONREF].no_callback = true; // override callback if we are segmenting to a reference
+        // case: compressing with a reference - contigs are aligned to it in chunks, see fasta_seg_seq_line
+        if (flag.ref_use_aligner) {
+            vb->contexts[FASTA_NONREF].no_callback = true; // override callback - NONREF.local is populated by the aligner
+
+            vb->contexts[FASTA_SQBITMAP].ltype        = LT_BITMAP;
+            vb->contexts[FASTA_SQBITMAP].local_always = true;
+            vb->contexts[FASTA_STRAND  ].ltype        = LT_BITMAP;
+            vb->contexts[FASTA_GPOS    ].ltype        = LT_UINT32;
+            vb->contexts[FASTA_GPOS    ].flags.store  = STORE_INT;
+
+            // in --stats, consolidate stats into FASTA_SQBITMAP
+            stats_set_consolidation ((VBlockP)vb, FASTA_SQBITMAP, 4, FASTA_NONREF, FASTA_NONREF_X, FASTA_GPOS, FASTA_STRAND);
+        }
 
         // in --stats, consolidate stats into FASTA_NONREF
-        stats_set_consolidation ((VBlockP)vb, FASTA_NONREF, 1, FASTA_NONREF_X);
+        else
+            stats_set_consolidation ((VBlockP)vb, FASTA_NONREF, 1, FASTA_NONREF_X);
     }
     else { // make-reference
         vb->contexts[FASTA_CONTIG].no_vb1_sort = true; // keep contigs in the order of the reference, i.e. in the order they would appear in BAM header created with this reference
@@ -268,7 +296,7 @@ static void fasta_seg_seq_line_do (VBlockFASTA *vb, uint32_t line_len, bool is_f
 
     else { // not cached
         char special_snip[100]; unsigned special_snip_len;
-        seg_prepare_snip_other (SNIP_OTHER_LOOKUP, (DictId)dict_id_fields[FASTA_NONREF], 
+        seg_prepare_snip_other (SNIP_OTHER_LOOKUP, (DictId)dict_id_fields[flag.ref_use_aligner ? FASTA_SQBITMAP : FASTA_NONREF], 
                                 true, (int32_t)line_len, &special_snip[3], &special_snip_len);
 
         special_snip[0] = SNIP_SPECIAL;
@@ -283,10 +311,36 @@ static void fasta_seg_seq_line_do (VBlockFASTA *vb, uint32_t line_len, bool is_f
         }
     }
 
-    seq_ctx->txt_len   += line_len;
-    seq_ctx->local.len += line_len;
+    seq_ctx->txt_len += line_len;
+    
+    if (!flag.ref_use_aligner) seq_ctx->local.len += line_len; // data is fetched by fasta_zip_seq callback
 } 
 
+// ZIP with a reference: align the entire contig, in chunks of FASTA_ALIGN_CHUNK_LEN, each chunk getting its own GPOS, STRAND and
+// a SQBITMAP b250 entry containing its length. Lines are then reconstructed from the chunks by fasta_reconstruct_seq.
+// note: this works because when compressing with a reference, fasta_unconsumed ensures that a contig is never split between VBs
+static void fasta_seg_align_contig (VBlockFASTA *vb, const ZipDataLineFASTA *dl, uint32_t num_lines)
+{
+    // gather the contig sequence, without the EOLs
+    vb->aligned_seq.len = 0;
+    for (uint32_t i=0; i < num_lines; i++) {
+        buf_alloc_more (vb, &vb->aligned_seq, dl[i].seq_len, 0, char, CTX_GROWTH, "aligned_seq");
+        buf_add (&vb->aligned_seq, ENT (char, vb->txt_data, dl[i].seq_data_start), dl[i].seq_len);
+    }
+
+    Context *bitmap_ctx = &vb->contexts[FASTA_SQBITMAP];
+
+    for (uint32_t start=0; start < vb->aligned_seq.len; start += FASTA_ALIGN_CHUNK_LEN) {
+        uint32_t chunk_len = MIN (FASTA_ALIGN_CHUNK_LEN, vb->aligned_seq.len - start);
+
+        char chunk_len_str[20];
+        unsigned chunk_len_str_len = str_int (chunk_len, chunk_len_str);
+        seg_by_ctx (vb, chunk_len_str, chunk_len_str_len, bitmap_ctx, 0);
+
+        aligner_seg_seq ((VBlockP)vb, bitmap_ctx, ENT (char, vb->aligned_seq, start), chunk_len);
+    }
+}
+
 static void fasta_seg_seq_line (VBlockFASTA *vb, const char *line_start, uint32_t line_len, bool is_last_line_in_contig, bool *has_13)
 {
     vb->lines_this_contig++;
@@ -302,6 +356,9 @@ static void fasta_seg_seq_line (VBlockFASTA *vb, const char *line_start, uint32_
 
         ZipDataLineFASTA *dl = DATA_LINE (vb->line_i - vb->lines_this_contig + 1);
 
+        if (flag.ref_use_aligner) 
+            fasta_seg_align_contig (vb, dl, vb->lines_this_contig);
+
         for (int32_t i=0; i < vb->lines_this_contig; i++) {
             fasta_seg_seq_line_do (vb, dl[i].seq_len, i==0);
             SEG_EOL (FASTA_EOL, true); 
@@ -373,7 +430,8 @@ bool fasta_piz_is_skip_section (VBlockP vb, SectionType st, DictId dict_id)
 
     // note that flags_update_piz_one_file rewrites --header-only as flag.header_only_fast
     if (flag.header_only_fast && 
-        (dict_id.num == dict_id_fields[FASTA_NONREF] || dict_id.num == dict_id_fields[FASTA_NONREF_X] || dict_id.num == dict_id_fields[FASTA_COMMENT]))
+        (dict_id.num == dict_id_fields[FASTA_NONREF] || dict_id.num == dict_id_fields[FASTA_NONREF_X] || dict_id.num == dict_id_fields[FASTA_COMMENT] ||
+         dict_id.num == dict_id_fields[FASTA_SQBITMAP] || dict_id.num == dict_id_fields[FASTA_GPOS] || dict_id.num == dict_id_fields[FASTA_STRAND]))
         return true;
 
     // when grepping by I/O thread - skipping all sections but DESC
@@ -445,6 +503,41 @@ SPECIAL_RECONSTRUCTOR (fasta_piz_special_SEQ)
     return false; // no new value
 }
 
+// PIZ of a FASTA compressed with a reference: called for a seq line with the line length. The line's bases are taken from the
+// current aligned chunk, reconstructing the next chunk (its length is in the SQBITMAP b250) when the current one is exhausted.
+void fasta_reconstruct_seq (VBlockP vb_, ContextP bitmap_ctx, const char *line_len_str, unsigned line_len_str_len)
+{
+    VBlockFASTA *vb = (VBlockFASTA *)vb_;
+
+    int64_t line_len;
+    ASSERTE (str_get_int (line_len_str, line_len_str_len, &line_len), "could not parse integer \"%.*s\"", line_len_str_len, line_len_str);
+
+    while (line_len) {
+        // case: current chunk is exhausted - reconstruct the next one at the end of txt_data, move it to aligned_seq, and roll back
+        if (vb->aligned_seq_next == vb->aligned_seq.len) {
+            const char *snip; unsigned snip_len;
+            LOAD_SNIP (FASTA_SQBITMAP);
+
+            int64_t chunk_len;
+            ASSERTE (str_get_int (snip, snip_len, &chunk_len), "vb=%u: could not parse chunk length \"%.*s\"", vb->vblock_i, snip_len, snip);
+
+            // note: txt_data cannot be extended mid-reconstruction, but there is room: the chunk's bases are yet to be reconstructed
+            aligner_reconstruct_seq (vb_, bitmap_ctx, chunk_len, false);
+
+            vb->txt_data.len -= chunk_len;
+            buf_alloc (vb, &vb->aligned_seq, chunk_len, 1, "aligned_seq");
+            memcpy (vb->aligned_seq.data, AFTERENT (char, vb->txt_data), chunk_len);
+            vb->aligned_seq.len  = chunk_len;
+            vb->aligned_seq_next = 0;
+        }
+
+        uint32_t take = MIN (line_len, vb->aligned_seq.len - vb->aligned_seq_next);
+        RECONSTRUCT (ENT (char, vb->aligned_seq, vb->aligned_seq_next), take);
+        vb->aligned_seq_next += take;
+        line_len -= take;
+    }
+}
+
 SPECIAL_RECONSTRUCTOR (fasta_piz_special_COMMENT)
 {
     VBlockFASTA *fasta_vb = (VBlockFASTA *)vb;
@@ -28,6 +28,7 @@ extern void fasta_reconstruct_vb(); // no parameter - implicit casting of VBlock
 extern bool fasta_piz_is_skip_section (VBlockP vb, SectionType st, DictId dict_id);
 extern bool fasta_piz_initialize_contig_grepped_out (VBlockP vb, bool does_vb_have_any_desc, bool last_desc_in_this_vb_matches_grep);
 extern bool fasta_piz_is_grepped_out_due_to_regions (VBlockP vb, const char *line_start);
+extern void fasta_reconstruct_seq (VBlockP vb, ContextP bitmap_ctx, const char *line_len_str, unsigned line_len_str_len);
 
 CONTAINER_FILTER_FUNC (fasta_piz_filter);
 
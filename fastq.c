@@ -6,6 +6,7 @@
 #include "fastq.h"
 #include "vblock.h"
 #include "seg.h"
+#include "tokenizer.h"
 #include "context.h"
 #include "file.h"
 #include "strings.h"
@@ -20,6 +21,9 @@
 #include "codec.h"
 #include "aligner.h"
 #include "stats.h"
+#include "grepindex.h"
+#include "seqsearch.h"
+#include "crypt.h"
 
 #define dict_id_is_fastq_desc_sf dict_id_is_type_1
 #define dict_id_fastq_desc_sf dict_id_type_1
@@ -36,9 +40,13 @@ typedef struct VBlockFASTQ {
     // pairing stuff - used if we are the 2nd file in the pair 
     uint32_t pair_vb_i;      // the equivalent vb_i in the first file, or 0 if this is the first file
     uint32_t pair_num_lines; // number of lines in the equivalent vb in the first file
+    uint32_t pair_scanned_len, pair_scanned_txt_lines; // ZIP: how much of txt_data fastq_txtfile_have_enough_lines already scanned
     char *optimized_desc;    // base of desc in flag.optimize_DESC 
     uint32_t optimized_desc_len;
     Buffer genobwa_show_line; // genobwa only: bitmap - 1 if line survived the filter
+    Buffer grep_index;       // ZIP: summary of the DESC lines (with --grep-index). PIZ: the uncompressed summary (with --grep), see grepindex.c
+    Buffer kmer_sketch;      // ZIP: minimizers of the reads (with --kmer-index). PIZ: the uncompressed sketch (with --kmer), see seqsearch.c
+    Buffer gpos_local;       // PIZ: GPOS local data, uncompressed by the I/O thread with --ref-region
 
 } VBlockFASTQ;
 
@@ -49,14 +57,20 @@ unsigned fastq_vb_zip_dl_size (void) { return sizeof (ZipDataLineFASTQ); }
 
 void fastq_vb_release_vb (VBlockFASTQ *vb)
 {
-    vb->pair_num_lines = vb->pair_vb_i = vb->optimized_desc_len = 0;
+    vb->pair_num_lines = vb->pair_vb_i = vb->optimized_desc_len = vb->pair_scanned_len = vb->pair_scanned_txt_lines = 0;
     FREE (vb->optimized_desc);
     buf_free (&vb->genobwa_show_line);
+    buf_free (&vb->grep_index);
+    buf_free (&vb->kmer_sketch);
+    buf_free (&vb->gpos_local);
 }
 
 void fastq_vb_destroy_vb (VBlockFASTQ *vb)
 {
     buf_destroy (&vb->genobwa_show_line);
+    buf_destroy (&vb->grep_index);
+    buf_destroy (&vb->kmer_sketch);
+    buf_destroy (&vb->gpos_local);
 }
 
 //------------------
@@ -122,25 +136,34 @@ out_of_data:
     return -1; // cannot find end-of-line in the data starting first_i
 }
 // called by txtfile_read_vblock when reading the 2nd file in a fastq pair - counts the number of fastq "lines" (each being 4 textual lines),
-// comparing to the number of lines in the first file of the pair
+// comparing to the number of lines in the first file of the pair. Scanning continues from where the previous call stopped, as
+// txt_data only grows between calls.
 // returns true if we have at least as much as needed, and sets unconsumed_len to the amount of excess characters read
-// returns false is we don't yet have pair_1_num_lines lines - we need to read more
-bool fastq_txtfile_have_enough_lines (VBlockP vb_, uint32_t *unconsumed_len)
+// returns false is we don't yet have pair_1_num_lines lines - we need to read more - and sets more_needed to an estimate of the 
+// number of bytes needed
+bool fastq_txtfile_have_enough_lines (VBlockP vb_, uint32_t *unconsumed_len, uint64_t *more_needed)
 {
-
     VBlockFASTQ *vb = (VBlockFASTQ *)vb_;
 
-    const char *next  = FIRSTENT (const char, vb->txt_data);
+    const char *next  = ENT (const char, vb->txt_data, vb->pair_scanned_len);
     const char *after = AFTERENT (const char, vb->txt_data);
-
-    uint32_t line_i; for (line_i=0; line_i < vb->pair_num_lines * 4; line_i++) {
-        while (*next != '\n' && next < after) next++; 
-        if (next >= after) 
+    uint32_t needed_txt_lines = vb->pair_num_lines * 4;
+
+    for (; vb->pair_scanned_txt_lines < needed_txt_lines; vb->pair_scanned_txt_lines++) {
+        const char *nl = memchr (next, '\n', after - next);
+        if (!nl) {
+            // estimate the remaining data based on the average line length so far, with a small margin
+            uint32_t lines_so_far = vb->pair_scanned_txt_lines;
+            *more_needed = lines_so_far ? (uint64_t)((double)vb->pair_scanned_len / lines_so_far * (needed_txt_lines - lines_so_far) * 1.05) + 1000
+                                        : vb->txt_data.len;
             return false;
-        next++; // skip newline
+        }
+
+        next = nl + 1; // skip newline
+        vb->pair_scanned_len = next - vb->txt_data.data;
     }
 
-    vb->lines.len = line_i/4;
+    vb->lines.len = vb->pair_num_lines;
     *unconsumed_len = after - next;
     return true;
 }
@@ -230,6 +253,9 @@ void fastq_seg_initialize (VBlockFASTQ *vb)
 
     vb->contexts[FASTQ_TOPLEVEL].no_stons = true; // keep in b250 so it can be eliminated as all_the_same
 
+    if (flag.grep_index) grepindex_zip_initialize ((VBlockP)vb, &vb->grep_index);
+    if (flag.kmer_index) seqsearch_zip_initialize ((VBlockP)vb, &vb->kmer_sketch);
+
     Context *gpos_ctx     = &vb->contexts[FASTQ_GPOS];
     Context *strand_ctx   = &vb->contexts[FASTQ_STRAND];
     Context *sqbitmap_ctx = &vb->contexts[FASTQ_SQBITMAP];
@@ -268,6 +294,9 @@ void fastq_seg_initialize (VBlockFASTQ *vb)
 
 void fastq_seg_finalize (VBlockP vb)
 {
+    if (flag.grep_index) grepindex_zip_finalize (vb, &((VBlockFASTQ *)vb)->grep_index);
+    if (flag.kmer_index) seqsearch_zip_finalize (vb, &((VBlockFASTQ *)vb)->kmer_sketch);
+
     // for qual data - select domqual compression if possible, or fallback 
     if (!codec_domq_comp_init (vb, FASTQ_QUAL, fastq_zip_qual)) 
         vb->contexts[FASTQ_QUAL].ltype  = LT_SEQUENCE; // might be overridden by codec_domq_compress
@@ -294,7 +323,113 @@ void fastq_seg_finalize (VBlockP vb)
 }
 
 
-// ZIP/PIZ I/O thread: called ahead of zip or piz a pair 2 vb - to read data we need from the previous pair 1 file
+// ZIP with --pair: the R1 sections needed for compressing R2 - DESC and its components (b250) and GPOS and STRAND (local) - are
+// kept in memory as R1 VBs are written, so that R2 VBs can take them without seeking back and re-reading z_file. Data of
+// R1 VBs already consumed by R2 VBs is released as R2 progresses.
+typedef struct {
+    uint32_t vblock_i, num_lines;
+    uint32_t first_section, num_sections; // index into pair_1_sections
+    uint64_t data_start;                  // offset into pair_1_data
+} Pair1Vb;
+
+static Buffer pair_1_vbs      = EMPTY_BUFFER; // array of Pair1Vb - one per R1 VB
+static Buffer pair_1_sections = EMPTY_BUFFER; // array of uint32_t - offset of each section relative to data_start of its VB
+static Buffer pair_1_data     = EMPTY_BUFFER; // the sections as they were written to z_file, but with the headers decrypted (if --password)
+static uint32_t pair_1_next_vb = 0;           // next Pair1Vb to be consumed by R2
+
+static inline bool fastq_is_pair_1_section (DictId dict_id, SectionType st)
+{
+    return ((dict_id_is_type_1 (dict_id) || dict_id.num == dict_id_fields[FASTQ_DESC]) && st == SEC_B250) ||
+           ((dict_id.num == dict_id_fields[FASTQ_GPOS] || dict_id.num == dict_id_fields[FASTQ_STRAND]) && st == SEC_LOCAL);
+}
+
+// ZIP I/O thread: called for each R1 VB, in order, just before it is written to z_file
+void fastq_zip_save_pair_1_data (VBlockP vb)
+{
+    ARRAY (const SectionListEntry, sl, vb->section_list_buf); // offsets are still relative to vb->z_data
+
+    buf_alloc_more (evb, &pair_1_vbs, 1, 64, Pair1Vb, 2, "pair_1_vbs");
+    Pair1Vb *p = &NEXTENT (Pair1Vb, pair_1_vbs);
+    *p = (Pair1Vb){ .vblock_i      = vb->vblock_i, 
+                    .num_lines     = vb->lines.len,
+                    .first_section = pair_1_sections.len, 
+                    .data_start    = pair_1_data.len };
+
+    for (uint64_t i=0; i < vb->section_list_buf.len; i++) {
+        if (!fastq_is_pair_1_section (sl[i].dict_id, sl[i].section_type)) continue;
+
+        uint64_t section_len = ((i+1 < vb->section_list_buf.len) ? sl[i+1].offset : vb->z_data.len) - sl[i].offset;
+
+        buf_alloc_more (evb, &pair_1_sections, 1, 256, uint32_t, 2, "pair_1_sections");
+        NEXTENT (uint32_t, pair_1_sections) = pair_1_data.len - p->data_start;
+
+        buf_alloc_more (evb, &pair_1_data, section_len, 0, char, 2, "pair_1_data");
+        buf_add (&pair_1_data, ENT (char, vb->z_data, sl[i].offset), section_len);
+
+        // if encrypted - decrypt the header now, as zfile_read_section does when reading from disk. the body is decrypted 
+        // by zfile_uncompress_section, with the R1 vblock_i from the header
+        uint32_t header_len = st_header_size (sl[i].section_type);
+        if (crypt_get_encrypted_len (&header_len, NULL))
+            crypt_do (evb, (uint8_t *)AFTERENT (char, pair_1_data) - section_len, header_len, vb->vblock_i, sl[i].section_type, true);
+
+        p->num_sections++;
+    }
+}
+
+// ZIP I/O thread: releases the data of R1 VBs already consumed by R2 VBs. To keep the copying proportional to the total
+// data, we do so only once at least half of pair_1_data is consumed
+static void fastq_zip_trim_pair_1_data (void)
+{
+    uint64_t consumed = (pair_1_next_vb < pair_1_vbs.len) ? ENT (Pair1Vb, pair_1_vbs, pair_1_next_vb)->data_start : pair_1_data.len;
+    if (!consumed || consumed < pair_1_data.len / 2) return;
+
+    static Buffer remaining = EMPTY_BUFFER;
+    if (consumed < pair_1_data.len) 
+        buf_copy (evb, &remaining, &pair_1_data, 1, consumed, 0, "pair_1_data");
+
+    buf_destroy (&pair_1_data); // free the memory (buf_free might keep it for reuse)
+    if (remaining.len) buf_move (evb, &pair_1_data, evb, &remaining);
+
+    for (uint64_t vb_i=pair_1_next_vb; vb_i < pair_1_vbs.len; vb_i++)
+        ENT (Pair1Vb, pair_1_vbs, vb_i)->data_start -= consumed;
+}
+
+// ZIP I/O thread: called ahead of reading a R2 vb - copies the sections of the equivalent R1 vb into vb->z_data, 
+// to be decompressed in fastq_seg_initialize. returns false if there isn't an equivalent R1 vb
+bool fastq_zip_get_pair_1_data (VBlockP vb_)
+{
+    VBlockFASTQ *vb = (VBlockFASTQ *)vb_;
+
+    if (pair_1_next_vb == pair_1_vbs.len) return false; // we're done
+
+    const Pair1Vb *p = ENT (Pair1Vb, pair_1_vbs, pair_1_next_vb++);
+    uint64_t data_len = ((pair_1_next_vb < pair_1_vbs.len) ? (p+1)->data_start : pair_1_data.len) - p->data_start;
+
+    vb->pair_vb_i      = p->vblock_i;
+    vb->pair_num_lines = p->num_lines;
+
+    buf_alloc (vb, &vb->z_data, data_len, 1, "z_data");
+    buf_add (&vb->z_data, ENT (char, pair_1_data, p->data_start), data_len);
+
+    buf_alloc (vb, &vb->z_section_headers, MAX ((MAX_DICTS * 2 + 50), p->num_sections) * sizeof(uint32_t), 0, "z_section_headers"); 
+    memcpy (vb->z_section_headers.data, ENT (uint32_t, pair_1_sections, p->first_section), p->num_sections * sizeof (uint32_t));
+    vb->z_section_headers.len = p->num_sections;
+
+    fastq_zip_trim_pair_1_data();
+
+    return true;
+}
+
+// ZIP: called after the R2 file of a pair is compressed
+void fastq_zip_free_pair_1_data (void)
+{
+    buf_free (&pair_1_vbs);
+    buf_free (&pair_1_sections);
+    buf_free (&pair_1_data);
+    pair_1_next_vb = 0;
+}
+
+// PIZ I/O thread: called ahead of piz a pair 2 vb - to read data we need from the previous pair 1 file
 // returns true if successful, false if there isn't a vb with vb_i in the previous file
 bool fastq_read_pair_1_data (VBlockP vb_, uint32_t first_vb_i_of_pair_1, uint32_t last_vb_i_of_pair_1)
 {
@@ -320,8 +455,7 @@ bool fastq_read_pair_1_data (VBlockP vb_, uint32_t first_vb_i_of_pair_1, uint32_
 
     while (sl->section_type == SEC_B250 || sl->section_type == SEC_LOCAL) {
         
-        if (((dict_id_is_type_1 (sl->dict_id) || sl->dict_id.num == dict_id_fields[FASTQ_DESC]) && sl->section_type == SEC_B250) ||
-            ((sl->dict_id.num == dict_id_fields[FASTQ_GPOS] || sl->dict_id.num == dict_id_fields[FASTQ_STRAND]) && sl->section_type == SEC_LOCAL)) { // these are local sections
+        if (fastq_is_pair_1_section (sl->dict_id, sl->section_type)) {
             
             NEXTENT (uint32_t, vb->z_section_headers) = vb->z_data.len; 
             int32_t ret = zfile_read_section (z_file, vb, vb->pair_vb_i, &vb->z_data, "data", sl->section_type, sl); // returns 0 if section is skipped
@@ -347,7 +481,12 @@ bool fastq_piz_read_one_vb (VBlockP vb_, ConstSectionListEntryP sl)
     if (i_am_pair_2) 
         sections_get_prev_component_vb_i (sl, &prev_file_first_vb_i, &prev_file_last_vb_i);
 
-    if (flag.grep) {
+    // if the file was compressed with --grep-index, skip this VB if its index proves that it has no matching lines. Otherwise,
+    // all its data is read as usual, and fastq_piz_filter filters its lines in the compute thread 
+    GrepIndexResult grep_index = flag.grep ? grepindex_piz_test (vb_, &vb->grep_index) : GI_NO_INDEX;
+    if (grep_index == GI_NO_MATCH) return false;
+
+    if (flag.grep && grep_index == GI_NO_INDEX) {
         // in case of this is a paired fastq file, get just the pair_1 data that is needed to resolve the grep
         if (i_am_pair_2) {
             vb->grep_stages = GS_TEST; // tell piz_is_skip_section to skip decompressing sections not needed for determining the grep
@@ -358,6 +497,10 @@ bool fastq_piz_read_one_vb (VBlockP vb_, ConstSectionListEntryP sl)
         if (!piz_test_grep (vb_)) return false; // also updates vb->grep_stages
     }
 
+    // with --kmer or --ref-region, skip this VB if its k-mer sketch or GPOS data prove that it has no matching reads
+    if ((flag.kmer || flag.ref_region) && !seqsearch_piz_is_vb_included (vb_, &vb->kmer_sketch, &vb->gpos_local, i_am_pair_2)) 
+        return false;
+
     // in case of this is a paired fastq file, get all the pair_1 data not already fetched for the grep above
     if (i_am_pair_2) 
         fastq_read_pair_1_data (vb_, prev_file_first_vb_i, prev_file_last_vb_i);
@@ -410,9 +553,11 @@ const char *fastq_seg_txt_line (VBlockFASTQ *vb, const char *line_start, uint32_
         vb->vb_data_size -= unoptimized_len - field_len;
     }
 
+    if (flag.grep_index) grepindex_zip_add_line (&vb->grep_index, field_start, field_len, *has_13);
+
     // we segment it using / | : and " " as separators. 
     SegCompoundArg arg = { .slash = true, .pipe = true, .dot = true, .colon = true, .whitespace = true };
-    seg_compound_field ((VBlockP)vb, &vb->contexts[FASTQ_DESC], field_start, field_len, arg, unoptimized_len, 0);
+    tokenizer_seg ((VBlockP)vb, &vb->contexts[FASTQ_DESC], field_start, field_len, arg, unoptimized_len, 0);
     SEG_EOL (FASTQ_E1L, true);
 
     // SEQ - just get the whole line
@@ -420,6 +565,8 @@ const char *fastq_seg_txt_line (VBlockFASTQ *vb, const char *line_start, uint32_
     dl->seq_data_start = next_field - vb->txt_data.data;
     next_field = seg_get_next_item (vb, next_field, &len, true, false, false, &dl->seq_len, &separator, has_13, "SEQ");
 
+    if (flag.kmer_index) seqsearch_zip_add_seq (&vb->kmer_sketch, seq_start, dl->seq_len);
+
     // case: compressing without a reference - all data goes to "nonref", and we have no bitmap
     if (flag.ref_use_aligner) 
         aligner_seg_seq ((VBlockP)vb, &vb->contexts[FASTQ_SQBITMAP], seq_start, dl->seq_len);
@@ -490,6 +637,8 @@ void fastq_zip_qual (VBlock *vb, uint32_t vb_line_i,
 void fastq_piz_initialize (void)
 {
     if (flag.genobwa) fastq_genobwa_initialize();
+
+    if (flag.kmer || flag.ref_region) seqsearch_piz_initialize();
 }
 
 // returns true if section is to be skipped reading / uncompressing
@@ -497,6 +646,14 @@ bool fastq_piz_is_skip_section (VBlockP vb, SectionType st, DictId dict_id)
 {
     if (!vb) return false; // we don't skip reading any SEC_DICT sections
 
+    // the grep index is needed only by the I/O thread when grepping - once it uncompressed it, the compute thread doesn't need it again
+    if (dict_id.num == dict_id_GREPINDEX) 
+        return !flag.grep || ((VBlockFASTQ *)vb)->grep_index.len;
+
+    // likewise, the k-mer sketch is needed only by the I/O thread with --kmer
+    if (dict_id.num == dict_id_KMERSKETCH) 
+        return !flag.kmer || ((VBlockFASTQ *)vb)->kmer_sketch.len;
+
     // note that flags_update_piz_one_file rewrites --header-only as flag.header_only_fast: skip all items but DESC and E1L
     if (flag.header_only_fast && 
         (dict_id.num == dict_id_fields[FASTQ_E2L]      || dict_id.num == dict_id_fields[FASTQ_SQBITMAP] || 
@@ -562,6 +719,12 @@ CONTAINER_FILTER_FUNC (fastq_piz_filter)
                     vb->dont_show_curr_line = true; // container_reconstruct_do will rollback the line
             }
 
+            // case: --kmer or --ref-region: check if the read is included after SEQ (note: SEQ is at the end of txt_data before its EOL)
+            if ((flag.kmer || flag.ref_region) && item == 3 && 
+                !seqsearch_piz_is_read_included (ENT (char, vb->txt_data, vb->txt_data.len - vb->seq_len), vb->seq_len, 
+                                                 vb->contexts[FASTQ_GPOS].last_value.i))
+                vb->dont_show_curr_line = true; // container_reconstruct_do will rollback the line
+
             // case: --genobwa: check if line is included after SEQ 
             if (  flag.genobwa && item == 4 && // 2nd EOL
                   !fastq_genobwa_is_seq_included (ENT (char, vb->txt_data, vb->txt_data.len - vb->seq_len), vb->seq_len)) {
@@ -11,7 +11,7 @@
 
 // Txtfile stuff
 extern int32_t fastq_unconsumed (VBlockP vb, uint32_t first_i, int32_t *i);
-extern bool fastq_txtfile_have_enough_lines (VBlockP vb, uint32_t *unconsumed_len);
+extern bool fastq_txtfile_have_enough_lines (VBlockP vb, uint32_t *unconsumed_len, uint64_t *more_needed);
 
 // ZIP Stuff
 extern void fastq_zip_initialize (void);
@@ -41,11 +41,19 @@ extern unsigned fastq_vb_zip_dl_size (void);
 
 // file pairing (--pair) stuff
 extern bool fastq_read_pair_1_data (VBlockP vb, uint32_t first_vb_i_of_pair_1, uint32_t last_vb_i_of_pair_1);
+extern void fastq_zip_save_pair_1_data (VBlockP vb);
+extern bool fastq_zip_get_pair_1_data (VBlockP vb);
+extern void fastq_zip_free_pair_1_data (void);
 extern uint32_t fastq_get_pair_vb_i (VBlockP vb);
 
 // --genobwa stuff
 extern WordIndex fastq_get_genobwa_chrom (void);
 
+// Special
+#define FASTQ_SPECIAL { tokenizer_piz_special_READNAME }
+SPECIAL (FASTQ, 0, READNAME, tokenizer_piz_special_READNAME); // DESC that matches the layout of the VB's read names
+#define NUM_FASTQ_SPECIAL 1
+
 #define FASTQ_DICT_ID_ALIASES 
 
 #define FASTQ_LOCAL_GET_LINE_CALLBACKS  \
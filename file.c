@@ -16,6 +16,7 @@
 #include "genozip.h"
 #include "context.h"
 #include "file.h"
+#include "txtindex.h"
 #include "stream.h"
 #include "url.h"
 #include "vblock.h"
@@ -23,12 +24,15 @@
 #include "codec.h"
 #include "mutex.h"
 #include "bgzf.h"
+#include "mgzip.h"
+#include "xz.h"
+#include "pkzip.h"
 
 // globals
 File *z_file   = NULL;
 File *txt_file = NULL;
 
-static StreamP input_decompressor  = NULL; // bcftools or xz, unzip or samtools - only one at a time
+static StreamP input_decompressor  = NULL; // bcftools or samtools - only one at a time
 static StreamP output_compressor   = NULL; // samtools (for cram), bcftools
 
 static FileType stdin_type = UNKNOWN_FILE_TYPE; // set by the --input command line option
@@ -381,9 +385,7 @@ static bool file_open_txt_read (File *file)
             uint8_t block[BGZF_MAX_BLOCK_SIZE]; 
             uint32_t block_size;
 
-            // we can't use libc read buffer unfortunately, because when reading the test bgzf block, if it turns out to be GZIP 
-            // we will do gzdopen discarding the internal FILE buffer. We also cannot use setvbuf after the file is already partly read (?).
-            // TO DO: this doesn't work over a pipe - so we can't pipe-in non-BGZF GZIP files (bug 243)
+            // note: we read all gzip data with fread - large reads, so we don't need the libc read buffer
             setvbuf (file->file, 0, _IONBF, 0); 
 
             int32_t bgzf_uncompressed_size = bgzf_read_block (file, block, &block_size, true);
@@ -411,15 +413,11 @@ static bool file_open_txt_read (File *file)
                 ABORTINP0 ("No input data");
             }
 
-            // case: this is a non-BGZF gzip format - open with zlib and hack back the read bytes 
+            // case: this is a non-BGZF gzip format - we will decompress it with mgzip, starting with the bytes already read 
             // (note: we cannot re-read the bytes from the file as the file might be piped in)
             else if (bgzf_uncompressed_size == BGZF_BLOCK_GZIP_NOT_BGZIP) {
-                
-                ASSERTE0 (!file->redirected, "genozip can't read gzip data from a pipe - piped data must be either plain or in BGZF format - i.e. compressed with bgzip, htslib etc");
-
                 file->codec = CODEC_GZ;
-                file->file  = gzdopen (fileno((FILE *)file->file), READ); // we're abandoning the FILE structure (and leaking it, if libc implementation dynamically allocates it) and working only with the fd
-                gzinject (file->file, block, block_size); // a hack - adds a 18 bytes of compressed data to the in stream, which will be consumed next, instead of reading from disk
+                mgzip_open (file, block, block_size); 
             } 
 
             // case: this is not GZIP format at all. treat as a plain file, and put the data read in vb->compressed 
@@ -430,7 +428,7 @@ static bool file_open_txt_read (File *file)
                 buf_add (&evb->compressed, block, block_size);
             }
 
-            // Notes 1. We currently only support plain and BGZF data piped in - see bug 243
+            // Notes 1. Plain, BGZF and gzip data can be piped in - gzip is read by mgzip with fread (previously bug 243)
             // 2. On Windows, we can't pipe binary files, bc Windows converts \n to \r\n
             // 3. The codec at this point is what the user declared in -i (we haven't tested for gz yet)
 #ifdef _WIN32 
@@ -455,28 +453,18 @@ static bool file_open_txt_read (File *file)
                 file->file = BZ2_bzopen (file->name, READ);  // for local files we decompress ourselves   
             break;
 
+        // xz and zip are decompressed in-process by xz.c and pkzip.c, reading with fread (so they can be piped in too)
         case CODEC_XZ:
-            input_decompressor = stream_create (0, DEFAULT_PIPE_SIZE, DEFAULT_PIPE_SIZE, 0, 0, 
-                                                file->is_remote ? file->name : NULL,     // url
-                                                file->redirected,
-                                                "To uncompress an .xz file", "xz",       // reason, exec_name
-                                                file->is_remote ? SKIP_ARG : file->name, // local file name 
-                                                "--threads=8", "--decompress", "--keep", "--stdout", 
-                                                flag.quiet ? "--quiet" : SKIP_ARG, 
-                                                NULL);            
-            file->file = stream_from_stream_stdout (input_decompressor);
-            break;
-
         case CODEC_ZIP:
-            input_decompressor = stream_create (0, DEFAULT_PIPE_SIZE, DEFAULT_PIPE_SIZE, 0, 0, 
-                                                file->is_remote ? file->name : NULL,     // url
-                                                file->redirected,
-                                                "To uncompress a .zip file", "unzip",    // reason, exec_name
-                                                "-p", // must be before file name
-                                                file->is_remote ? SKIP_ARG : file->name, // local file name 
-                                                flag.quiet ? "--quiet" : SKIP_ARG, 
-                                                NULL);            
-            file->file = stream_from_stream_stdout (input_decompressor);
+            file->file = file->is_remote  ? url_open (NULL, file->name)  : 
+                         file->redirected ? fdopen (STDIN_FILENO,  "rb") :
+                                            fopen (file->name, READ);
+            ASSERTE (file->file, "failed to open %s: %s", file->name, strerror (errno));
+
+            setvbuf (file->file, 0, _IONBF, 0); // we read in large chunks - we don't need the libc read buffer
+
+            if (file->codec == CODEC_XZ) xz_open (file);
+            else                         pkzip_open (file);
             break;
 
         case CODEC_BCF: {
@@ -785,6 +773,12 @@ static void file_index_txt (const File *file)
 {
     RETURNW (file->name,, "%s: cannot create an index file when output goes to stdout", global_cmd);
 
+    // BAM and BGZF-compressed VCF: index was built while writing the file - see txtindex.c
+    if (txtindex_get_type (file) != TXTINDEX_NONE) {
+        txtindex_finalize (file);
+        return;
+    }
+
     switch (file->data_type) {
         case DT_SAM:
         case DT_BAM: 
@@ -823,10 +817,16 @@ void file_close (File **file_p,
         if (file->mode == WRITE && file->supertype == TXT_FILE && file->codec == CODEC_BGZF)
             bgzf_write_finalize (file);         
 
-        if (file->mode == READ && (file->codec == CODEC_GZ))
-            ASSERTW (!gzclose_r((gzFile)file->file), "%s: warning: failed to close file: %s", global_cmd, file_printname (file));
+        if (file->mode == READ && file->codec == CODEC_GZ)
+            mgzip_close(); // file->file is closed below
+
+        if (file->mode == READ && file->codec == CODEC_XZ)
+            xz_close();
+
+        if (file->mode == READ && file->codec == CODEC_ZIP)
+            pkzip_close();
 
-        else if (file->mode == READ && file->codec == CODEC_BZ2)
+        if (file->mode == READ && file->codec == CODEC_BZ2)
             BZ2_bzclose((BZFILE *)file->file);
         
         else if (file->mode == READ && file_is_read_via_ext_decompressor (file)) 
@@ -993,8 +993,8 @@ bool file_seek (File *file, int64_t offset,
 
 uint64_t file_tell (File *file)
 {
-    if (command == ZIP && file == txt_file && file->codec == CODEC_GZ)
-        return gzconsumed64 ((gzFile)txt_file->file); 
+    if (command == ZIP && file == txt_file && (file->codec == CODEC_GZ || file->codec == CODEC_XZ || file->codec == CODEC_ZIP))
+        return txt_file->disk_so_far; // compressed bytes consumed, set by mgzip_read, xz_read and pkzip_read
     
     if (command == ZIP && file == txt_file && file->codec == CODEC_BZ2)
         return BZ2_consumed ((BZFILE *)txt_file->file); 
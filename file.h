@@ -249,10 +249,10 @@ extern FileMode READ, WRITE, WRITEREAD; // this are pointers to static strings -
 // ---------------------------
 
 #define file_is_read_via_ext_decompressor(file) \
-  (file->codec == CODEC_XZ || file->codec == CODEC_ZIP || file->codec == CODEC_BCF || file->codec == CODEC_CRAM)
+  (file->codec == CODEC_BCF || file->codec == CODEC_CRAM)
 
 #define file_is_read_via_int_decompressor(file) \
-  (file->codec == CODEC_GZ || file->codec == CODEC_BGZF || file->codec == CODEC_BZ2)
+  (file->codec == CODEC_GZ || file->codec == CODEC_BGZF || file->codec == CODEC_BZ2 || file->codec == CODEC_XZ || file->codec == CODEC_ZIP)
 
 #define file_is_written_via_ext_compressor(file) (file->codec == CODEC_BCF || file->codec == CODEC_GZ)
 
@@ -328,6 +328,7 @@ typedef struct File {
     struct FlagsBgzf bgzf_flags;       // correspond to SectionHeader.flags in SEC_BGZF
     uint8_t bgzf_signature[3];         // PIZ: 3 LSB of size of source BGZF-compressed file, as passed in SectionHeaderTxtHeader.codec_info
     int32_t bzgf_passed_down_len;      // PIZ: bytes at the end of the VB too small for one bgzf block passed to the next block
+    bool bgzf_passed_down_one_vb;      // PIZ: the passed down bytes are the tail of a single VB, that has BGZF blocks of its own
 
     // Z_FILE: stats data
     Buffer stats_buf, STATS_buf;       // Strings to be outputted in case of --stats or --STATS (generated during ZIP, stored in SEC_STATS)
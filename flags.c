@@ -20,6 +20,7 @@
 #include "fastq.h"
 #include "stream.h"
 #include "bgzf.h"
+#include "checkpoint.h"
 
 // flags - default values (all others are 0)
 Flags flag = { .out_dt = DT_NONE, 
@@ -46,6 +47,16 @@ static void flags_set_bgzf (const char *level_str)
     flag.bgzf = (int)level_64;
 }
 
+// parses an integer option argument, which must consist of an integer in [min_val,max_val] and nothing else
+static int flags_get_int_arg (const char *option, const char *arg, int min_val, int max_val)
+{
+    int64_t value;
+    ASSINP (str_get_int_range (arg, strlen (arg), min_val, max_val, &value), 
+            "invalid argument of --%s: \"%s\". Expecting an integer between %d and %d", option, arg, min_val, max_val);
+
+    return (int)value;
+}
+
 void flags_init_from_command_line (int argc, char **argv)
 {
     // process command line options
@@ -104,6 +115,7 @@ void flags_init_from_command_line (int argc, char **argv)
         #define _p  {"password",      required_argument, 0, 'p'                    }
         #define _B  {"vblock",        required_argument, 0, 'B'                    }
         #define _r  {"regions",       required_argument, 0, 'r'                    }
+        #define _R  {"regions-file",  required_argument, 0, 'R'                    }
         #define _s  {"samples",       required_argument, 0, 's'                    }
         #define _il {"interleaved",   no_argument,       &flag.interleave,       1 }
         #define _e  {"reference",     required_argument, 0, 'e'                    }
@@ -120,6 +132,7 @@ void flags_init_from_command_line (int argc, char **argv)
         #define _1  {"header-one",    no_argument,       &flag.header_one,       1 }
         #define _GT {"GT-only",       no_argument,       &flag.gt_only,          1 }
         #define _Gt {"gt-only",       no_argument,       &flag.gt_only,          1 }
+        #define _ac {"allele-counts", no_argument,       &flag.allele_counts,    1 }
         #define _ds {"downsample",    required_argument, 0, 9                      }
         #define _PG {"no-PG",         no_argument,       &flag.no_pg,            1 }
         #define _pg {"no-pg",         no_argument,       &flag.no_pg,            1 }
@@ -163,12 +176,22 @@ void flags_init_from_command_line (int argc, char **argv)
         #define _dp {"debug-progress",no_argument,       &flag.debug_progress,   1 }  
         #define _dh {"show-hash",     no_argument,       &flag.show_hash,        1 }  
         #define _bw {"genobwa",       required_argument, 0, 11                     }  
+        #define _pw {"pbwt-partitions", required_argument, 0, 12                   }  
+        #define _cp {"checkpoints",   optional_argument, 0, 13                     }  
+        #define _CC {"codec-cache",   optional_argument, 0, 14                     }  
+        #define _gx {"grep-index",    no_argument,       &flag.grep_index,       1 }  
+        #define _kx {"kmer-index",    no_argument,       &flag.kmer_index,       1 }  
+        #define _km {"kmer",          required_argument, 0, 15                     }  
+        #define _rr {"ref-region",    required_argument, 0, 16                     }  
+        #define _cm {"component",     required_argument, 0, 17                     }  
+        #define _jb {"jobs",          required_argument, 0, 18                     }  
+        #define _mm {"max-memory",    required_argument, 0, 19                     }  
         #define _00 {0, 0, 0, 0                                                    }
 
         typedef const struct option Option;
-        static Option genozip_lo[]    = { _i, _I, _c, _d, _f, _h,    _l, _L1, _L2, _q, _Q, _t, _DL, _V, _z, _zb, _zB, _zs, _zS, _zq, _zQ, _za, _zA, _zf, _zF, _zc, _zC, _zv, _zV, _zy, _zY, _m, _th, _u, _o, _p, _e, _E,                                          _ss, _SS, _sd, _sT, _sb, _lc, _lC, _s2, _s7, _S7, _S9, _sa, _st, _sm, _sh, _si, _Si, _Sh, _sr, _sv,     _B, _xt, _dm, _dp,      _dh,_dS, _9, _99, _9s, _9P, _9G, _9g, _9V, _9Q, _9f, _9Z, _9D, _pe, _fa, _bs,              _rg, _sR,      _sC, _hC, _rA, _rS, _me, _mf, _mF,     _s5, _sM, _sA, _sc, _sI, _gt, _cn,           _bw,     _00 };
-        static Option genounzip_lo[]  = {         _c,     _f, _h, _x,    _L1, _L2, _q, _Q, _t, _DL, _V, _z, _zb, _zB, _zs, _zS, _zq, _zQ, _za, _zA, _zf, _zF, _zc, _zC, _zv, _zV, _zy, _zY, _m, _th, _u, _o, _p, _e,                                              _ss, _SS, _sd, _sT, _sb, _lc, _lC, _s2, _s7, _S7, _S9, _sa, _st, _sm, _sh, _si, _Si, _Sh, _sr, _sv,         _xt, _dm, _dp,                                                                                                      _sR,      _sC, _hC, _rA, _rS,                    _s5, _sM, _sA,      _sI,      _cn, _pg, _PG,          _00 };
-        static Option genocat_lo[]    = {         _c,     _f, _h, _x,    _L1, _L2, _q, _Q,          _V, _z, _zb, _zB, _zs, _zS, _zq, _zQ, _za, _zA, _zf, _zF, _zc, _zC, _zv, _zV, _zy, _zY,     _th,     _o, _p,         _il, _r, _s, _G, _1, _H0, _H1, _Gt, _GT, _ss, _SS, _sd, _sT, _sb, _lc, _lC, _s2, _s7, _S7, _S9, _sa, _st, _sm, _sh, _si, _Si, _Sh, _sr, _sv, _ov,    _xt, _dm, _dp, _ds,                                                                                   _fs, _g,      _sR,      _sC, _hC, _rA, _rS,                    _s5, _sM, _sA,      _sI,      _cn, _pg, _PG, _bw,     _00 };
+        static Option genozip_lo[]    = { _i, _I, _c, _d, _f, _h,    _l, _L1, _L2, _q, _Q, _t, _DL, _V, _z, _zb, _zB, _zs, _zS, _zq, _zQ, _za, _zA, _zf, _zF, _zc, _zC, _zv, _zV, _zy, _zY, _m, _th, _u, _o, _p, _e, _E,                                          _ss, _SS, _sd, _sT, _sb, _lc, _lC, _s2, _s7, _S7, _S9, _sa, _st, _sm, _sh, _si, _Si, _Sh, _sr, _sv,     _B, _xt, _dm, _dp,      _dh,_dS, _9, _99, _9s, _9P, _9G, _9g, _9V, _9Q, _9f, _9Z, _9D, _pe, _fa, _bs,              _rg, _sR,      _sC, _hC, _rA, _rS, _me, _mf, _mF,     _s5, _sM, _sA, _sc, _sI, _gt, _cn,           _bw, _pw, _cp, _CC, _gx, _kx, _jb, _mm, _00 };
+        static Option genounzip_lo[]  = {         _c,     _f, _h, _x,    _L1, _L2, _q, _Q, _t, _DL, _V, _z, _zb, _zB, _zs, _zS, _zq, _zQ, _za, _zA, _zf, _zF, _zc, _zC, _zv, _zV, _zy, _zY, _m, _th, _u, _o, _p, _e,                                              _ss, _SS, _sd, _sT, _sb, _lc, _lC, _s2, _s7, _S7, _S9, _sa, _st, _sm, _sh, _si, _Si, _Sh, _sr, _sv,         _xt, _dm, _dp,                                                                                                      _sR,      _sC, _hC, _rA, _rS,                    _s5, _sM, _sA,      _sI,      _cn, _pg, _PG, _cm,     _00 };
+        static Option genocat_lo[]    = {         _c,     _f, _h, _x,    _L1, _L2, _q, _Q,          _V, _z, _zb, _zB, _zs, _zS, _zq, _zQ, _za, _zA, _zf, _zF, _zc, _zC, _zv, _zV, _zy, _zY,     _th,     _o, _p,         _il, _r, _R, _s, _G, _1, _H0, _H1, _Gt, _GT, _ac, _ss, _SS, _sd, _sT, _sb, _lc, _lC, _s2, _s7, _S7, _S9, _sa, _st, _sm, _sh, _si, _Si, _Sh, _sr, _sv, _ov,    _xt, _dm, _dp, _ds,                                                                                   _fs, _g,      _sR,      _sC, _hC, _rA, _rS,                    _s5, _sM, _sA,      _sI,      _cn, _pg, _PG, _bw, _km, _rr, _cm, _00 };
         static Option genols_lo[]     = {                 _f, _h,        _L1, _L2, _q,              _V,                                                                                              _u,     _p, _e,                                                                                                          _st, _sm,                                       _dm,                                                                                                                                                                      _sM,                                         _b, _00 };
         static Option *long_options[] = { genozip_lo, genounzip_lo, genols_lo, genocat_lo }; // same order as ExeType
 
@@ -177,7 +200,7 @@ void flags_init_from_command_line (int argc, char **argv)
             "i:I:cdfhlLqQt^Vzm@:o:p:B:9wWFe:E:2z:u", // genozip (note: includes some genounzip options to be used in combination with -d)
             "cz:fhLqQt^V@:uo:p:me:wWx",              // genounzip
             "hLVp:qfub",                             // genols
-            "z:hLV@:p:qQ1r:s:H1Go:fg:e:E:wWx"        // genocat
+            "z:hLV@:p:qQ1r:R:s:H1Go:fg:e:E:wWx"        // genocat
         };
 
         int option_index = -1;
@@ -219,6 +242,7 @@ verify_command:
             case 'x' : flag.index_txt     = 1       ; break;
             case 'b' : flag.bytes         = 1       ; break;         
             case 'r' : flag.regions       = 1       ; regions_add     (optarg); break;
+            case 'R' : flag.regions       = 1       ; regions_add_by_file (optarg); break;
             case 's' : flag.samples       = 1       ; vcf_samples_add (optarg); break;
             case 'e' : flag.reference     = REF_EXTERNAL  ; ref_set_reference (optarg); break;
             case 'E' : flag.reference     = REF_EXT_STORE ; ref_set_reference (optarg); break;
@@ -235,6 +259,18 @@ verify_command:
             case 7   : flag.dump_section  = optarg  ; break;
             case 'B' : flag.vblock        = optarg  ; break;
             case 11  : flag.genobwa       = optarg  ; break;
+            case 12  : flag.pbwt_partitions = flags_get_int_arg ("pbwt-partitions", optarg, 1, MAX_PBWT_PARTITIONS); break;
+            case 13  : flag.checkpoint_lines = optarg ? flags_get_int_arg ("checkpoints", optarg, 1, 1000000000) : CHECKPOINT_DEFAULT_LINES; break;
+            case 14  : flag.codec_cache   = optarg ? optarg : ""; break; // with or without a filename
+            case 15  : flag.kmer          = optarg  ; break;
+            case 16  : flag.ref_region    = optarg  ; break;
+            case 17  : flag.component     = optarg  ; break;
+            case 18  : flag.jobs          = atoi (optarg); 
+                       ASSINP (flag.jobs >= 1, "--jobs requires an integer value of at least 1, but \"%s\" was given", optarg);
+                       break;
+            case 19  : flag.max_memory    = (uint64_t)(atof (optarg) * (double)(1 << 30)); // in GB, fractions allowed
+                       ASSINP (flag.max_memory >= (1 << 20), "--max-memory requires a number of gigabytes, eg 2 or 0.5, but \"%s\" was given", optarg);
+                       break;
             case 'z' : flags_set_bgzf (optarg)      ; break;
             case 4   : flag.show_mutex    = optarg ? optarg : (char*)1; break;
             case 2   : if (optarg) flag.dict_id_show_one_b250 = dict_id_make (optarg, strlen (optarg), DTYPE_PLAIN); 
@@ -307,6 +343,10 @@ static void flags_test_conflicts (void)
     CONFLICT (flag.to_stdout,   flag.out_filename, OT("stdout", "c"), OT("output", "o"));
     CONFLICT (flag.to_stdout,   flag.unbind, OT("stdout", "c"), OT("unbind", "u"));
     CONFLICT (flag.unbind,      flag.out_filename, OT("unbind",  "u"), OT("output", "o"));
+    CONFLICT (flag.unbind,      flag.component, OT("unbind",  "u"), "--component");
+    CONFLICT (flag.component,   flag.interleave, "--component", "--interleave");
+    CONFLICT (flag.jobs > 1,    flag.out_filename, "--jobs", OT("output", "o"));
+    CONFLICT (flag.jobs > 1,    flag.pair,       "--jobs", OT("pair", "2"));
     CONFLICT (flag.to_stdout,   flag.replace, OT("stdout", "c"), OT("replace", "^"));
     CONFLICT (flag.to_stdout,   flag.index_txt, OT("stdout", "c"), OT("index", "x"));
     CONFLICT (flag.one_vb,      flag.interleave, "--interleave", "--one-vb");
@@ -318,7 +358,13 @@ static void flags_test_conflicts (void)
     CONFLICT (flag.test,        flag.optimize, OT("test", "t"), OT("optimize", "9"));
     CONFLICT (flag.md5,         flag.optimize, OT("md5", "m"), OT("optimize", "9"));
     CONFLICT (flag.samples,     flag.drop_genotypes, OT("samples", "s"), OT("drop-genotypes", "G"));
+    CONFLICT (flag.allele_counts, flag.drop_genotypes, "--allele-counts", OT("drop-genotypes", "G"));
+    CONFLICT (flag.allele_counts, flag.gt_only,     "--allele-counts", "--GT-only");
     CONFLICT (option_best,      flag.fast, "--best", OT("fast", "F"));
+    CONFLICT (flag.kmer,        flag.interleave,     "--kmer", "--interleave");
+    CONFLICT (flag.ref_region,  flag.interleave,     "--ref-region", "--interleave");
+    CONFLICT (flag.kmer,        flag.header_only,    "--kmer", "--header-only");
+    CONFLICT (flag.ref_region,  flag.header_only,    "--ref-region", "--header-only");
     CONFLICT (flag.genobwa,     flag.test,           "--genobwa", OT("test", "t"));
     CONFLICT (flag.genobwa,     flag.xthreads,       "--genobwa", "--xthreads");
     CONFLICT (flag.genobwa,     flag.fast,           "--genobwa", OT("fast", "F"));
@@ -522,8 +568,8 @@ void flags_update_piz_one_file (void)
     // note: this does not account for changes to the data done at the compression stage with --optimize
     flag.data_modified = !flag.reconstruct_as_src || // translating to another data
                          flag.header_one || flag.no_header || flag.header_only || flag.header_only_fast || flag.grep || 
-                         flag.regions || flag.samples || flag.drop_genotypes || flag.gt_only || flag.sequential || 
-                         flag.one_vb || flag.downsample || flag.interleave || flag.genobwa;
+                         flag.regions || flag.samples || flag.drop_genotypes || flag.gt_only || flag.allele_counts || flag.sequential || 
+                         flag.one_vb || flag.downsample || flag.interleave || flag.genobwa || flag.kmer || flag.ref_region;
 
     bool is_paired_fastq = fastq_piz_is_paired(); // also updates z_file->z_flags in case of backward compatability issues
     
@@ -531,6 +577,17 @@ void flags_update_piz_one_file (void)
     ASSINP (!flag.interleave || is_paired_fastq, 
             "--interleave is not supported for %s because it only works on FASTQ data that was compressed with --pair", z_name);
 
+    // --allele-counts is computed from the haplotype matrix of VCF files
+    ASSINP (!flag.allele_counts || (z_file->data_type == DT_VCF && flag.out_dt == DT_VCF), 
+            "--allele-counts is supported only for VCF files, outputted as VCF, but %s has %s data", z_name, dt_name (z_file->data_type));
+
+    // --kmer and --ref-region filter FASTQ reads by their sequence
+    ASSINP (!(flag.kmer || flag.ref_region) || z_file->data_type == DT_FASTQ, 
+            "%s is supported only for FASTQ files, but %s has %s data", flag.kmer ? "--kmer" : "--ref-region", z_name, dt_name (z_file->data_type));
+
+    ASSINP (!flag.ref_region || z_file->z_flags.aligner, 
+            "--ref-region requires a file compressed with --reference or --REFERENCE, but %s was not", z_name);
+
     // if using --genobwa in PIZ, z_file must be a FASTQ file with a single component or two paired components
     if (flag.genobwa) {
         ASSINP (z_file->data_type == DT_FASTQ, "genobwa accepts genozip files only if they contain FASTQ data, but %s is has %s data",
@@ -12,6 +12,10 @@ typedef struct {
     
     // genozip options that affect the compressed file
     int gtshark, fast, make_reference, multifasta, md5;
+    int pbwt_partitions; // VCF: number of independent PBWT column partitions, each compressed by its own thread (0 = not set, i.e. 1)
+    int checkpoint_lines; // VCF: store a sub-VB positional index every this number of lines (0 = no index)
+    int grep_index; // FASTQ: store a per-VB filter of the description lines, for genocat --grep
+    int kmer_index; // FASTQ: store a per-VB sketch of the minimizers of the reads, for genocat --kmer
     char *vblock;
     
     // ZIP: data modifying options
@@ -29,11 +33,14 @@ typedef struct {
     
     int out_dt; // used to indicate the desired dt of the output txt - consumed by file_open, and thereafter equal to txt_file->data_type
     char *unbind;
+    char *component; // PIZ: reconstruct only this component of a bound file - its number (1-based) or its original file name
 
     // PIZ: data-modifying genocat options for showing only a subset of the file 
     int header_one, header_only_fast, no_header, header_only, // how to handle the txt header
-        regions, samples, drop_genotypes, gt_only, sequential, no_pg, interleave;
+        regions, samples, drop_genotypes, gt_only, sequential, no_pg, interleave, 
+        allele_counts; // VCF: output per-variant AN/AC/AF and genotype counts computed from the haplotype matrix, instead of the VCF lines
     char *grep;
+    char *kmer, *ref_region; // FASTQ: show only reads containing this sequence (or its reverse complement) / aligned to this reference interval
     uint32_t one_vb, downsample;
 
     // genols options
@@ -48,6 +55,9 @@ typedef struct {
         test,        // implies md5
         index_txt;   // create an index
     char *threads_str, *out_filename;
+    const char *codec_cache; // ZIP: use a persistent cache of codec decisions - in this file, or in the default location if ""
+    int jobs;    // ZIP: number of worker processes compressing files concurrently, taking files from a common queue
+    uint64_t max_memory; // ZIP: memory budget in bytes (--max-memory) - vblock_memory is adapted to stay within it
 
     enum { REF_NONE,      // ZIP (except SAM) and PIZ when user didn't specify an external reference
            REF_INTERNAL,  // ZIP SAM only: use did not specify an external reference - reference is calculated from file(s) data
@@ -98,6 +108,7 @@ typedef struct {
     #define VBLOCK_MEMORY_MAKE_REF (1    << 20) // VB memory with --make-reference - reference data 
     #define VBLOCK_MEMORY_REFHASH  (16   << 20) // VB memory with --make-reference - refhash data (overridable with --vblock)
     #define VBLOCK_MEMORY_GENERIC  (16   << 20) // VB memory for the generic data type
+    #define VBLOCK_MEMORY_MIN_ADAPT (1   << 20) // VB memory - min when adapted while compressing (see zip_adapt_vblock_memory)
     uint64_t vblock_memory;
 } Flags;
 
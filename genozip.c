@@ -10,6 +10,8 @@
 #ifndef _WIN32
 #include <execinfo.h>
 #include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
 #endif
 #include <getopt.h>
 
@@ -31,6 +33,7 @@
 #include "stats.h"
 #include "arch.h"
 #include "license.h"
+#include "codec_cache.h"
 #include "vcf.h"
 #include "dict_id.h"
 #include "reference.h"
@@ -38,6 +41,7 @@
 #include "context.h"
 #include "random_access.h"
 #include "codec.h"
+#include "progress.h"
 
 // globals - set it main() and never change
 const char *global_cmd = NULL; 
@@ -368,7 +372,7 @@ static void main_genounzip (const char *z_filename, const char *txt_filename, bo
         flag.out_dt = DT_SAM;
 
     // if this is a bound file, and we don't have --unbind or --force, we ask the user
-    if (z_file->num_components >= 2 && !flag.unbind && !flag.force && !flag.out_filename)
+    if (z_file->num_components >= 2 && !flag.unbind && !flag.component && !flag.force && !flag.out_filename)
         main_ask_about_unbind();
 
     // case: reference not loaded yet bc --reference wasn't specified, and we got the ref name from zfile_read_genozip_header()   
@@ -385,7 +389,7 @@ static void main_genounzip (const char *z_filename, const char *txt_filename, bo
     flags_update_piz_one_file ();
     
     // set txt_filename from genozip file name (inc. extensions if translating or --bgzf)
-    if (!txt_filename && !flag.to_stdout && !flag.unbind) 
+    if (!txt_filename && !flag.to_stdout && !flag.unbind && !flag.component) 
         txt_filename = txtfile_piz_get_filename (z_filename, "", true);
 
     // open output txt file (except if unbinding or outputting to stdout)
@@ -393,7 +397,7 @@ static void main_genounzip (const char *z_filename, const char *txt_filename, bo
         ASSERTE0 (!txt_file, "txt_file is unexpectedly already open"); // note: in bound mode, we expect it to be open for 2nd+ file
         txt_file = file_open (txt_filename, WRITE, TXT_FILE, flag.out_dt);
     }
-    else if (flag.unbind) {
+    else if (flag.unbind || flag.component) {
         // do nothing - the component files will be opened by txtfile_genozip_to_txt_header()
     }
     else {
@@ -478,7 +482,7 @@ static void main_genozip_open_z_file_write (char **z_filename)
         FREE (basename);
     }
 
-    z_file = file_open (*z_filename, flag.pair ? WRITEREAD : WRITE, Z_FILE, z_data_type);
+    z_file = file_open (*z_filename, WRITE, Z_FILE, z_data_type); // note: with --pair too - R2 gets the R1 data it needs from memory, not z_file
 }
 
 static void main_genozip (const char *txt_filename, 
@@ -627,9 +631,86 @@ static void main_load_reference (const char *filename, bool is_first_file, bool
     if (!old_ref_use_aligner && flag.ref_use_aligner) 
         refhash_load_standalone();
 
+    // keep the reference in the mmap'ed caches rather than in the heap, so it doesn't consume the memory budget
+    if (flag.max_memory)
+        ref_reload_from_cache (is_last_z_file);
+
     RESTORE_VALUE (txt_file);
 }
 
+// --jobs: compress the files in flag.jobs worker processes. Each worker takes the next file from a queue shared by all workers, 
+// and keeps its VB pool, reference and vblock_memory from one file to the next. Each file is compressed to its own genozip file.
+static void main_genozip_jobs (char **filenames, unsigned num_files, char *exec_name)
+{
+#ifndef _WIN32
+    unsigned num_jobs = MIN ((unsigned)flag.jobs, num_files);
+
+    for (unsigned file_i=0; file_i < num_files; file_i++)
+        ASSINP0 (strcmp (filenames[file_i], "-"), "--jobs cannot be used when compressing from stdin");
+
+    // load the reference (and refhash if needed) once, before forking, so that workers share it
+    if (flag.reference == REF_EXTERNAL || flag.reference == REF_EXT_STORE) {
+        for (unsigned file_i=0; file_i < num_files; file_i++) {
+            DataType dt = main_get_file_dt (filenames[file_i]);
+            if (dt == DT_FASTQ || dt == DT_FASTA) flag.ref_use_aligner = true;
+        }
+
+        if (!ref_is_reference_loaded())
+            ref_load_external_reference (false, false); // also loads refhash if needed
+
+        ref_create_cache_join();
+        refhash_create_cache_join();
+
+        if (flag.max_memory) ref_reload_from_cache (false);
+    }
+
+    // the work queue: index of the next file to be compressed, in memory shared by all workers
+    uint32_t *next_file_i = mmap (NULL, sizeof (uint32_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    ASSERTE (next_file_i != MAP_FAILED, "mmap failed: %s", strerror (errno));
+    *next_file_i = 0;
+
+    global_max_threads = MAX (1, global_max_threads / num_jobs); // divide the threads between the workers
+    flag.max_memory /= num_jobs;                                  // ...and the memory budget
+    ASSINP (!flag.max_memory || flag.max_memory >= (1 << 20), "--max-memory is divided between the %u jobs, leaving %s per job, below the minimum of 1MB. Please use a larger --max-memory or fewer --jobs",
+            num_jobs, str_size (flag.max_memory).s);
+    fflush (info_stream); 
+
+    pid_t pids[num_jobs];
+    for (unsigned job_i=0; job_i < num_jobs; job_i++) {
+        pids[job_i] = fork();
+        ASSERTE (pids[job_i] >= 0, "fork failed: %s", strerror (errno));
+
+        if (pids[job_i]) continue; // parent
+
+        // worker
+        progress_set_one_line();
+
+        uint32_t file_i;
+        while ((file_i = __atomic_fetch_add (next_file_i, 1, __ATOMIC_RELAXED)) < num_files) {
+            main_load_reference (filenames[file_i], false, false);
+            main_genozip (filenames[file_i], NULL, NULL, file_i, false, exec_name);
+        }
+
+        ref_create_cache_join();
+        refhash_create_cache_join();
+        exit (0);
+    }
+
+    bool failed = false;
+    for (unsigned job_i=0; job_i < num_jobs; job_i++) {
+        int status;
+        waitpid (pids[job_i], &status, 0);
+        failed |= !WIFEXITED (status) || WEXITSTATUS (status);
+    }
+
+    munmap (next_file_i, sizeof (uint32_t));
+
+    ASSINP0 (!failed, "Error: some files failed to compress - see errors above");
+#else
+    ABORTINP0 ("--jobs is not supported on Windows");
+#endif
+}
+
 void TEST() {
 }
 
@@ -723,7 +804,13 @@ int main (int argc, char **argv)
     // ask the user to register if she doesn't already have a license (note: only genozip requires registration - unzip,cat,ls do not)
     if (command == ZIP) license_get(); 
 
-    for (unsigned file_i=0, z_file_i=0; file_i < MAX (num_files, 1); file_i++) {
+    if (command == ZIP && flag.codec_cache) codec_cache_load();
+
+    // case: --jobs - files are compressed by worker processes, instead of in the loop below
+    bool by_jobs = (command == ZIP && flag.jobs > 1 && num_files > 1);
+    if (by_jobs) main_genozip_jobs (&argv[optind], num_files, argv[0]);
+
+    for (unsigned file_i=0, z_file_i=0; !by_jobs && file_i < MAX (num_files, 1); file_i++) {
         char *next_input_file = optind < argc ? argv[optind++] : NULL;  // NULL means stdin
         
         if (next_input_file && !strcmp (next_input_file, "-")) next_input_file = NULL; // "-" is stdin too
@@ -762,5 +849,7 @@ int main (int argc, char **argv)
     ref_create_cache_join();
     refhash_create_cache_join();
 
+    if (command == ZIP && flag.codec_cache) codec_cache_save();
+
     return 0;
 }
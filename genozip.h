@@ -31,6 +31,8 @@
 
 #define DEFAULT_MAX_THREADS 8 // used if num_cores is not discoverable and the user didn't specifiy --threads
 
+#define MAX_PBWT_PARTITIONS 16 // maximum number of independent PBWT column partitions (and threads) within a single VB (--pbwt-partitions)
+
 // ------------------------------------------------------------------------------------------------------------------------
 // pointers used in header files - so we don't need to include the whole .h (and avoid cyclicity and save compilation time)
 // ------------------------------------------------------------------------------------------------------------------------
@@ -101,13 +103,14 @@ extern FileP z_file, txt_file;
 // If making any changes, update arrays in 1. codec.h 2. txtfile_estimate_txt_data_size
 typedef enum __attribute__ ((__packed__)) { // 1 byte
     CODEC_UNKNOWN=0, 
-    CODEC_NONE=1, CODEC_GZ=2, CODEC_BZ2=3, CODEC_LZMA=4, CODEC_BSC=5, // internal compressors
+    CODEC_NONE=1, CODEC_GZ=2, CODEC_BZ2=3, CODEC_LZMA=4, CODEC_BSC=5, CODEC_ZSTD=6 /* introduced v12 */, // internal compressors
     
     CODEC_ACGT    = 10, CODEC_XCGT = 11, // compress sequence data - slightly better compression LZMA, 20X faster (these compress NONREF and NONREF_X respectively)
     CODEC_HAPM    = 12, // compress a VCF haplotype matrix - transpose, then sort lines, then bz2. 
     CODEC_DOMQ    = 13, // compress SAM/FASTQ quality scores, if dominated by a single character
     CODEC_GTSHARK = 14, // compress VCF haplotype matrix with gtshark
     CODEC_PBWT    = 15, // compress VCF haplotype matrix with pbwt
+    CODEC_QCTX    = 16, // compress SAM/FASTQ quality scores with an order-2 context model (introduced v12)
     
     // external compressors (used by executing an external application)
     CODEC_BGZF=20, CODEC_XZ=21, CODEC_BCF=22, 
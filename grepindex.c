@@ -0,0 +1,281 @@
+// ------------------------------------------------------------------
+//   grepindex.c
+//   Copyright (C) 2020 Divon Lan <divon@genozip.com>
+//   Please see terms and conditions in the files LICENSE.non-commercial.txt and LICENSE.commercial.txt
+
+// Per-VB grep filter: with --grep-index, ZIP summarizes the FASTQ description lines of each VB, so that genocat --grep
+// can skip VBs that provably don't contain the grepped string, without decompressing or reconstructing their DESC data.
+// The summary consists of:
+// 1. A Bloom filter (2 hashes) of all the 4-grams of the lines (including the EOL). A VB is skipped if any 4-gram of the
+//    grepped string is absent. The filter is folded in half as long it remains sparse, so VBs with few distinct 4-grams
+//    get a small filter.
+// 2. For each numeric token (maximal run of digits) index in the line, the min and max of its value across the VB. 4-grams
+//    cannot tell read names apart, as every VB has all combinations of digits, but min/max can: a run of digits in the
+//    grepped string that is preceded and followed by non-digits must match an entire token, and one that is only
+//    preceded by a non-digit must match the beginning of a token.
+//
+// The summary is stored as the local data (LT_UINT32) of the dict_id_GREPINDEX context:
+// bloom_bits_log2, num_tokens, num_tokens x (min (2 words), max (2 words)), bloom filter (2^bloom_bits_log2 / 32 words)
+//
+// In PIZ, the I/O thread uncompresses only this section of the VB. VBs that might match are handed to the compute thread
+// in their entirety, and their lines are filtered by fastq_piz_filter during reconstruction.
+
+#include "genozip.h"
+#include "grepindex.h"
+#include "vblock.h"
+#include "context.h"
+#include "dict_id.h"
+#include "flags.h"
+#include "buffer.h"
+#include "zfile.h"
+#include "sections.h"
+#include "endianness.h"
+#include "bit_array.h"
+
+#define GI_NGRAM          4
+#define GI_MAX_BITS_LOG2  19  // 64KB before folding
+#define GI_MIN_BITS_LOG2  10
+#define GI_MAX_TOKENS     16  // numeric tokens beyond this are all accounted for in the last one
+#define GI_MAX_DIGITS     18  // longer numbers don't fit in the index - their token is marked as "any value"
+#define GI_HDR_WORDS      2
+#define GI_TOKEN_WORDS    4
+
+typedef struct {
+    uint64_t min[GI_MAX_TOKENS], max[GI_MAX_TOKENS];
+    uint32_t num_tokens;
+    uint64_t bloom[(1 << GI_MAX_BITS_LOG2) / 64];
+} GrepIndexZip;
+
+static inline void gi_hash (const char *s, uint32_t *h1, uint32_t *h2)
+{
+    uint32_t x;
+    memcpy (&x, s, GI_NGRAM);
+    *h1 = (uint32_t)(((uint64_t)x * 0x9E3779B97F4A7C15ULL) >> 32);
+    *h2 = (uint32_t)(((uint64_t)x * 0xC2B2AE3D27D4EB4FULL) >> 32);
+}
+
+static inline bool gi_is_digit (char c) { return c >= '0' && c <= '9'; }
+
+// --------------------
+// ZIP stuff
+// --------------------
+
+// ZIP compute thread: called from fastq_seg_initialize
+void grepindex_zip_initialize (VBlockP vb, Buffer *gi)
+{
+    buf_alloc (vb, gi, sizeof (GrepIndexZip), 1, "grep_index");
+    memset (gi->data, 0, sizeof (GrepIndexZip));
+
+    GrepIndexZip *gz = (GrepIndexZip *)gi->data;
+    for (unsigned t=0; t < GI_MAX_TOKENS; t++) gz->min[t] = (uint64_t)-1;
+}
+
+static inline void grepindex_zip_add_ngrams (GrepIndexZip *gz, const char *s, uint32_t len)
+{
+    const uint32_t mask = (1 << GI_MAX_BITS_LOG2) - 1;
+
+    for (uint32_t i=0; i + GI_NGRAM <= len; i++) {
+        uint32_t h1, h2;
+        gi_hash (&s[i], &h1, &h2);
+        gz->bloom[(h1 & mask) >> 6] |= 1ULL << (h1 & 63);
+        gz->bloom[(h2 & mask) >> 6] |= 1ULL << (h2 & 63);
+    }
+}
+
+// ZIP compute thread: called for each description line, as it is reconstructed by PIZ (i.e. after --optimize-DESC), without its EOL
+void grepindex_zip_add_line (Buffer *gi, const char *line, uint32_t line_len, bool has_13)
+{
+    GrepIndexZip *gz = (GrepIndexZip *)gi->data;
+
+    // 4-grams of the line, and those that include the EOL
+    grepindex_zip_add_ngrams (gz, line, line_len);
+
+    char tail[GI_NGRAM - 1 + 2];
+    uint32_t tail_len = MIN (line_len, GI_NGRAM - 1);
+    memcpy (tail, &line[line_len - tail_len], tail_len);
+    if (has_13) tail[tail_len++] = '\r';
+    tail[tail_len++] = '\n';
+    grepindex_zip_add_ngrams (gz, tail, tail_len);
+
+    // numeric tokens
+    unsigned token_i = 0;
+    for (uint32_t i=0; i < line_len; i++) {
+        if (!gi_is_digit (line[i])) continue;
+
+        uint32_t start = i;
+        uint64_t value = 0;
+        for (; i < line_len && gi_is_digit (line[i]); i++)
+            if (i - start < GI_MAX_DIGITS) value = value * 10 + (line[i] - '0');
+
+        unsigned t = MIN (token_i, GI_MAX_TOKENS-1);
+        if (i - start > GI_MAX_DIGITS) { // too long - this token can have any value
+            gz->min[t] = 0;
+            gz->max[t] = (uint64_t)-1;
+        }
+        else {
+            if (value < gz->min[t]) gz->min[t] = value;
+            if (value > gz->max[t]) gz->max[t] = value;
+        }
+
+        token_i++;
+        gz->num_tokens = MAX (gz->num_tokens, t+1);
+    }
+}
+
+// ZIP compute thread: called from fastq_seg_finalize - fold the Bloom filter, and move the index to the local of the GREPINDEX context
+void grepindex_zip_finalize (VBlockP vb, Buffer *gi)
+{
+    GrepIndexZip *gz = (GrepIndexZip *)gi->data;
+    if (!vb->lines.len) return;
+
+    // fold the filter in half (bit i is OR'ed into bit i mod nbits/2) as long as it remains at most 25% full after folding
+    uint32_t bits_log2 = GI_MAX_BITS_LOG2;
+    BitArray bloom = { .type = BITARR_REGULAR, .words = gz->bloom, .nbits = 1 << bits_log2, .nwords = (1 << bits_log2) / 64 };
+
+    while (bits_log2 > GI_MIN_BITS_LOG2 && bit_array_num_bits_set (&bloom) <= (1ULL << bits_log2) / 8) {
+        bits_log2--;
+        bloom.nbits  /= 2;
+        bloom.nwords /= 2;
+        for (uint32_t w=0; w < bloom.nwords; w++) gz->bloom[w] |= gz->bloom[w + bloom.nwords];
+    }
+
+    Context *gi_ctx = ctx_get_ctx (vb, dict_id_GREPINDEX);
+    gi_ctx->ltype    = LT_UINT32;
+    gi_ctx->no_stons = true;
+
+    uint32_t len = GI_HDR_WORDS + gz->num_tokens * GI_TOKEN_WORDS + bloom.nwords * 2;
+    buf_alloc (vb, &gi_ctx->local, len * sizeof (uint32_t), 1, "contexts->local");
+    gi_ctx->local.len = len;
+
+    uint32_t *w = FIRSTENT (uint32_t, gi_ctx->local);
+    *w++ = BGEN32 (bits_log2);
+    *w++ = BGEN32 (gz->num_tokens);
+
+    for (unsigned t=0; t < gz->num_tokens; t++) {
+        *w++ = BGEN32 ((uint32_t)gz->min[t]); *w++ = BGEN32 ((uint32_t)(gz->min[t] >> 32));
+        *w++ = BGEN32 ((uint32_t)gz->max[t]); *w++ = BGEN32 ((uint32_t)(gz->max[t] >> 32));
+    }
+
+    for (uint32_t i=0; i < bloom.nwords; i++) {
+        *w++ = BGEN32 ((uint32_t)gz->bloom[i]); *w++ = BGEN32 ((uint32_t)(gz->bloom[i] >> 32));
+    }
+
+    buf_free (gi);
+}
+
+// --------------------
+// PIZ stuff
+// --------------------
+
+typedef struct {
+    uint64_t value;
+    uint32_t num_digits;
+    bool is_prefix;         // the run of digits is followed by the end of the grepped string, so it might be the beginning of a longer token
+} GrepNumber;
+
+static struct {
+    const char *grep;       // the string for which the query was prepared
+    uint32_t num_ngrams, num_numbers;
+    uint32_t *h1, *h2;      // hashes of the 4-grams of the grepped string
+    GrepNumber *numbers;    // runs of digits of the grepped string that are preceded by a non-digit
+} query = {};
+
+// PIZ I/O thread: prepare the 4-grams and numbers of flag.grep, once
+static void grepindex_piz_prepare_query (void)
+{
+    if (query.grep == flag.grep) return;
+
+    FREE (query.h1); FREE (query.h2); FREE (query.numbers);
+    memset (&query, 0, sizeof (query));
+    query.grep = flag.grep;
+
+    uint32_t len = strlen (flag.grep);
+
+    if (len >= GI_NGRAM) {
+        query.h1 = MALLOC ((len - GI_NGRAM + 1) * sizeof (uint32_t));
+        query.h2 = MALLOC ((len - GI_NGRAM + 1) * sizeof (uint32_t));
+
+        for (query.num_ngrams=0; query.num_ngrams + GI_NGRAM <= len; query.num_ngrams++)
+            gi_hash (&flag.grep[query.num_ngrams], &query.h1[query.num_ngrams], &query.h2[query.num_ngrams]);
+    }
+
+    query.numbers = MALLOC ((len / 2 + 1) * sizeof (GrepNumber));
+
+    for (uint32_t i=1; i < len; i++) { // note: a run at the start of the string might be the end of a longer token - it can't be used
+        if (!gi_is_digit (flag.grep[i]) || gi_is_digit (flag.grep[i-1])) continue;
+
+        uint32_t start = i;
+        uint64_t value = 0;
+        for (; i < len && gi_is_digit (flag.grep[i]); i++)
+            if (i - start < GI_MAX_DIGITS) value = value * 10 + (flag.grep[i] - '0');
+
+        if (i - start <= GI_MAX_DIGITS)
+            query.numbers[query.num_numbers++] = (GrepNumber){ .value = value, .num_digits = i - start, .is_prefix = (i == len) };
+    }
+}
+
+static inline uint64_t gi_get64 (const uint32_t *w) { return (uint64_t)BGEN32 (w[0]) | ((uint64_t)BGEN32 (w[1]) << 32); }
+
+// true if the number might be one of the tokens, given their ranges
+static bool grepindex_piz_is_number_possible (const GrepNumber *num, const uint32_t *tokens, uint32_t num_tokens)
+{
+    for (uint32_t t=0; t < num_tokens; t++) {
+        uint64_t min = gi_get64 (&tokens[t * GI_TOKEN_WORDS]), max = gi_get64 (&tokens[t * GI_TOKEN_WORDS + 2]);
+
+        if (!num->is_prefix) {
+            if (num->value >= min && num->value <= max) return true;
+            continue;
+        }
+
+        // prefix: the token is value followed by k more digits, i.e. in the range [value*10^k, (value+1)*10^k - 1]
+        uint64_t p10 = 1;
+        for (uint32_t k=0; num->num_digits + k <= GI_MAX_DIGITS; k++, p10 *= 10)
+            if (num->value * p10 <= max && (num->value + 1) * p10 - 1 >= min) return true;
+    }
+
+    return false;
+}
+
+// PIZ I/O thread: called from fastq_piz_read_one_vb with --grep, after the sections of the VB were read.
+// Returns GI_NO_MATCH if the VB has a grep index, and it proves that no line of the VB contains flag.grep
+GrepIndexResult grepindex_piz_test (VBlockP vb, Buffer *gi)
+{
+    ARRAY (const unsigned, section_index, vb->z_section_headers);
+
+    SectionHeaderCtx *header = NULL;
+    for (uint32_t section_i=1; section_i < vb->z_section_headers.len; section_i++) {
+        SectionHeaderCtx *h = (SectionHeaderCtx *)ENT (char, vb->z_data, section_index[section_i]);
+        if (h->h.section_type == SEC_LOCAL && h->dict_id.num == dict_id_GREPINDEX) {
+            header = h;
+            break;
+        }
+    }
+
+    if (!header) return GI_NO_INDEX; // file compressed without --grep-index
+
+    zfile_uncompress_section (vb, header, gi, "grep_index", vb->vblock_i, SEC_LOCAL);
+    gi->len /= sizeof (uint32_t);
+
+    grepindex_piz_prepare_query();
+
+    ARRAY (const uint32_t, w, *gi);
+    uint32_t bits_log2  = BGEN32 (w[0]);
+    uint32_t num_tokens = BGEN32 (w[1]);
+    const uint32_t *tokens = &w[GI_HDR_WORDS];
+    const uint32_t *bloom  = &tokens[num_tokens * GI_TOKEN_WORDS]; // 64-bit words, each stored as two 32-bit words, low first
+    uint32_t mask = (1 << bits_log2) - 1;
+
+    ASSERTE (bits_log2 <= GI_MAX_BITS_LOG2 && num_tokens <= GI_MAX_TOKENS &&
+             gi->len == GI_HDR_WORDS + num_tokens * GI_TOKEN_WORDS + (1 << bits_log2) / 32,
+             "vb_i=%u: invalid grep index", vb->vblock_i);
+
+    #define GI_BIT_IS_SET(h) ((BGEN32 (bloom[((h) & mask) >> 5]) >> ((h) & 31)) & 1)
+
+    for (uint32_t i=0; i < query.num_ngrams; i++)
+        if (!GI_BIT_IS_SET (query.h1[i]) || !GI_BIT_IS_SET (query.h2[i])) return GI_NO_MATCH;
+
+    for (uint32_t i=0; i < query.num_numbers; i++)
+        if (!grepindex_piz_is_number_possible (&query.numbers[i], tokens, num_tokens)) return GI_NO_MATCH;
+
+    return GI_MAYBE;
+}
@@ -0,0 +1,21 @@
+// ------------------------------------------------------------------
+//   grepindex.h
+//   Copyright (C) 2020 Divon Lan <divon@genozip.com>
+//   Please see terms and conditions in the files LICENSE.non-commercial.txt and LICENSE.commercial.txt
+
+#ifndef GREPINDEX_INCLUDED
+#define GREPINDEX_INCLUDED
+
+#include "genozip.h"
+
+typedef enum { GI_NO_INDEX, GI_NO_MATCH, GI_MAYBE } GrepIndexResult;
+
+// ZIP
+extern void grepindex_zip_initialize (VBlockP vb, BufferP gi);
+extern void grepindex_zip_add_line (BufferP gi, const char *line, uint32_t line_len, bool has_13);
+extern void grepindex_zip_finalize (VBlockP vb, BufferP gi);
+
+// PIZ
+extern GrepIndexResult grepindex_piz_test (VBlockP vb, BufferP gi);
+
+#endif
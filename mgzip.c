@@ -0,0 +1,337 @@
+// ------------------------------------------------------------------
+//   mgzip.c
+//   Copyright (C) 2020 Divon Lan <divon@genozip.com>
+//   Please see terms and conditions in the files LICENSE.non-commercial.txt and LICENSE.commercial.txt
+
+// ZIP: reading a txt file compressed with (non-BGZF) gzip. Such files usually consist of many gzip members (eg files that were
+// concatenated or compressed in chunks). In each round, we read a large chunk of compressed data, identify candidate member
+// starts by the gzip header signature, and decompress all candidate members in parallel with libdeflate - the output size
+// of each member is known from the ISIZE in its trailer. A candidate member is confirmed if decompressing it consumes exactly
+// the data up to the next candidate, and its CRC32 and ISIZE match. When this fails - the file has a single member, a member
+// is larger than a chunk, or a candidate was a false positive - we decompress the one member starting at that point with zlib
+// (streaming), and resume the parallel decompression after it. Since we read with plain fread, this works with pipes too.
+
+#include <errno.h>
+#include <pthread.h>
+#include "zlib/zlib.h"
+#include "libdeflate/libdeflate.h"
+#include "genozip.h"
+#include "mgzip.h"
+#include "file.h"
+#include "buffer.h"
+#include "vblock.h"
+#include "codec.h"
+#include "endianness.h"
+#include "strings.h"
+
+#define MGZIP_CHUNK_SIZE  (4 << 20) // compressed bytes per thread in each round
+#define MGZIP_MAX_THREADS 64
+#define MGZIP_STREAM_OUT  (1 << 20) // zlib output per call when streaming
+#define MGZIP_MAX_RATIO   1032      // maximum compression ratio of deflate
+
+typedef struct {
+    uint64_t start, len;            // compressed member, relative to the first unconsumed byte of mg.in
+    uint64_t out_offset;            // decompressed member in mg.out
+    uint32_t isize;                 // uncompressed size, from the member's trailer
+    bool is_ok;                     // decompressed and verified
+} MgzipMember;
+
+typedef struct {
+    VBlockP vb;                     // memory of the decompressor (and of zlib for thread 0)
+    struct libdeflate_decompressor *decompressor;
+    uint32_t thread_i;
+} MgzipThread;
+
+static struct {
+    FILE *fp;
+    Buffer in;                      // compressed data read from the file. in.param is the first byte not decompressed yet
+    Buffer out;                     // decompressed data. out.param is the first byte not yet passed to the caller
+    Buffer members;                 // MgzipMember of the current round
+    bool in_eof, is_streaming;
+    z_stream strm;                  // used when streaming a member
+    uint64_t consumed;              // compressed bytes decompressed so far
+    double comp_ratio;              // compressed / uncompressed in the last round - to estimate disk_so_far
+    uint32_t num_threads;
+    MgzipThread threads[MGZIP_MAX_THREADS];
+} mg;
+
+static void *mgzip_zalloc (void *vb, unsigned items, unsigned size)
+{
+    return codec_alloc ((VBlockP)vb, items * size, 1);
+}
+
+// called by file_open_txt_read after it detected a gzip file that is not BGZF. first_bytes were already read from the file.
+void mgzip_open (File *file, const uint8_t *first_bytes, uint32_t first_bytes_len)
+{
+    memset (&mg, 0, sizeof (mg));
+    mg.fp          = (FILE *)file->file;
+    mg.num_threads = MAX (1, MIN (global_max_threads, MGZIP_MAX_THREADS));
+
+    for (uint32_t thread_i=0; thread_i < mg.num_threads; thread_i++) {
+        MgzipThread *th = &mg.threads[thread_i];
+        th->thread_i     = thread_i;
+        th->vb           = vb_get_nonpool_vb (evb);
+        th->decompressor = libdeflate_alloc_decompressor (th->vb);
+    }
+
+    buf_alloc (evb, &mg.in, first_bytes_len + mg.num_threads * MGZIP_CHUNK_SIZE, 1, "mgzip_in");
+    buf_add (&mg.in, first_bytes, first_bytes_len);
+}
+
+void mgzip_close (void)
+{
+    if (mg.strm.state) inflateEnd (&mg.strm);
+
+    for (uint32_t thread_i=0; thread_i < mg.num_threads; thread_i++) {
+        libdeflate_free_decompressor (&mg.threads[thread_i].decompressor);
+        vb_destroy_vb (&mg.threads[thread_i].vb);
+    }
+
+    buf_destroy (&mg.in);
+    buf_destroy (&mg.out);
+    buf_destroy (&mg.members);
+    mg.num_threads = 0;
+}
+
+// reads compressed data until mg.in has at least min_len unconsumed bytes, or EOF
+static void mgzip_read_input (uint64_t min_len)
+{
+    // discard consumed data
+    if (mg.in.param) {
+        memmove (mg.in.data, mg.in.data + mg.in.param, mg.in.len - mg.in.param);
+        mg.in.len  -= mg.in.param;
+        mg.in.param = 0;
+    }
+
+    if (mg.in_eof || mg.in.len >= min_len) return;
+
+    buf_alloc (evb, &mg.in, min_len, 1, "mgzip_in");
+
+    while (mg.in.len < min_len) {
+        size_t bytes = fread (AFTERENT (char, mg.in), 1, min_len - mg.in.len, mg.fp);
+        ASSERTE (!ferror (mg.fp), "failed to read %s: %s", txt_name, strerror (errno));
+
+        if (!bytes) {
+            mg.in_eof = true;
+            break;
+        }
+        mg.in.len += bytes;
+    }
+}
+
+static inline bool mgzip_is_header (const uint8_t *h)
+{
+    return h[0] == 0x1f && h[1] == 0x8b && h[2] == 8 /* deflate */ && !(h[3] & 0xe0) /* reserved FLG bits */;
+}
+
+// a stricter test for candidate member starts, to reduce false positives in the compressed data: XFL and OS must have values
+// that gzip implementations actually use. A member with an unusual header is just not decompressed in parallel.
+static inline bool mgzip_is_candidate (const uint8_t *h)
+{
+    return mgzip_is_header (h) && (h[8] == 0 || h[8] == 2 || h[8] == 4) /* XFL */ && (h[9] <= 13 || h[9] == 255) /* OS */;
+}
+
+// returns the length of the gzip header, or 0 if its not a valid header followed by room for a trailer
+static uint32_t mgzip_header_len (const uint8_t *h, uint64_t len)
+{
+    if (len < 18 || !mgzip_is_header (h)) return 0;
+
+    uint8_t flg = h[3];
+    uint64_t i = 10;
+
+    if (flg & 4) i += 2 + (i + 2 <= len ? (h[i] | (h[i+1] << 8)) : 0); // FEXTRA
+    if (flg & 8)  { while (i < len && h[i]) i++; i++; }                  // FNAME
+    if (flg & 16) { while (i < len && h[i]) i++; i++; }                  // FCOMMENT
+    if (flg & 2) i += 2;                                                 // FHCRC
+
+    return (i + 8 <= len) ? i : 0;
+}
+
+static bool mgzip_decompress_member (struct libdeflate_decompressor *decompressor, MgzipMember *m)
+{
+    const uint8_t *member = (const uint8_t *)mg.in.data + mg.in.param + m->start;
+    uint32_t header_len = mgzip_header_len (member, m->len);
+    if (!header_len || m->isize > m->len * MGZIP_MAX_RATIO) return false;
+
+    uint64_t deflate_len = m->len - header_len - 8;
+    char *out = ENT (char, mg.out, m->out_offset);
+    size_t in_used, out_len;
+
+    if (libdeflate_deflate_decompress_ex (decompressor, member + header_len, deflate_len, out, m->isize, &in_used, &out_len) != LIBDEFLATE_SUCCESS ||
+        in_used != deflate_len || out_len != m->isize) return false;
+
+    uint32_t crc32;
+    memcpy (&crc32, member + m->len - 8, sizeof (uint32_t));
+
+    return libdeflate_crc32 (0, out, out_len) == LTEN32 (crc32);
+}
+
+static void *mgzip_decompress_thread (void *arg)
+{
+    MgzipThread *th = (MgzipThread *)arg;
+    ARRAY (MgzipMember, members, mg.members);
+
+    for (uint64_t i=th->thread_i; i < mg.members.len; i += mg.num_threads)
+        members[i].is_ok = mgzip_decompress_member (th->decompressor, &members[i]);
+
+    return NULL;
+}
+
+static void mgzip_add_member (uint64_t start, uint64_t len)
+{
+    const uint8_t *member = (const uint8_t *)mg.in.data + mg.in.param + start;
+    uint32_t isize = 0;
+    if (len >= 18) memcpy (&isize, member + len - 4, sizeof (uint32_t));
+    isize = LTEN32 (isize);
+
+    // a false positive candidate might result in a nonsensical isize - we don't allocate memory for it
+    if (isize > len * MGZIP_MAX_RATIO) isize = 0;
+
+    MgzipMember *prev = mg.members.len ? LASTENT (MgzipMember, mg.members) : NULL;
+
+    buf_alloc_more (evb, &mg.members, 1, 256, MgzipMember, 2, "mgzip_members");
+    NEXTENT (MgzipMember, mg.members) = (MgzipMember){ .start = start, .len = len, .isize = isize,
+                                                       .out_offset = prev ? prev->out_offset + prev->isize : 0 };
+}
+
+// decompress all the complete members in a chunk of compressed data in parallel
+static void mgzip_decompress_round (void)
+{
+    mgzip_read_input (mg.num_threads * MGZIP_CHUNK_SIZE);
+
+    const uint8_t *in = (const uint8_t *)mg.in.data; // mgzip_read_input set in.param=0
+    uint64_t in_len = mg.in.len;
+    if (!in_len) return; // EOF
+
+    // case: data following the last gzip member is not gzip - ignore it, like gzip does with trailing garbage
+    if (in_len < 10 || !mgzip_is_header (in)) {
+        ASSINP (mg.consumed, "%s is not a valid gzip file", txt_name);
+        mg.in.param = mg.in.len;
+        mg.in_eof   = true;
+        return;
+    }
+
+    // identify candidate member starts
+    mg.members.len = 0;
+    uint64_t start = 0;
+    for (const uint8_t *c = in + 1, *after = in + in_len - 10; c < after && (c = memchr (c, 0x1f, after - c)); c++)
+        if (mgzip_is_candidate (c)) {
+            mgzip_add_member (start, c - in - start);
+            start = c - in;
+        }
+
+    if (mg.in_eof) mgzip_add_member (start, in_len - start); // the last member is complete only if we reached EOF
+
+    // case: no complete member in the chunk - stream the member
+    if (!mg.members.len) {
+        mg.is_streaming = true;
+        return;
+    }
+
+    MgzipMember *last = LASTENT (MgzipMember, mg.members);
+    buf_alloc (evb, &mg.out, last->out_offset + last->isize, 1.1, "mgzip_out");
+
+    // decompress in parallel - thread 0 is the I/O thread
+    pthread_t thread_ids[MGZIP_MAX_THREADS];
+    uint32_t num_threads = MIN (mg.num_threads, mg.members.len);
+
+    for (uint32_t thread_i=1; thread_i < num_threads; thread_i++) {
+        int err = pthread_create (&thread_ids[thread_i], NULL, mgzip_decompress_thread, &mg.threads[thread_i]);
+        ASSERTE (!err, "failed to create thread for gzip decompression: %s", strerror (err));
+    }
+
+    mgzip_decompress_thread (&mg.threads[0]);
+
+    for (uint32_t thread_i=1; thread_i < num_threads; thread_i++)
+        pthread_join (thread_ids[thread_i], NULL);
+
+    // accept all members up to the first one that failed. We will stream the failed one, and re-try the ones following it in the next round
+    ARRAY (MgzipMember, members, mg.members);
+    uint64_t i=0;
+    for (; i < mg.members.len && members[i].is_ok; i++) {}
+
+    uint64_t in_used = (i < mg.members.len) ? members[i].start : (last->start + last->len); // not including an incomplete last member
+    mg.out.len   = (i < mg.members.len) ? members[i].out_offset : (last->out_offset + last->isize);
+    mg.out.param = 0;
+    mg.in.param  = in_used;
+    mg.consumed += in_used;
+
+    if (mg.out.len) mg.comp_ratio = (double)in_used / (double)mg.out.len;
+
+    if (i < mg.members.len) mg.is_streaming = true;
+}
+
+// decompress (part of) a single member with zlib
+static void mgzip_stream (void)
+{
+    if (!mg.strm.state) {
+        mg.strm = (z_stream){ .zalloc = mgzip_zalloc, .zfree = codec_free, .opaque = mg.threads[0].vb };
+        ASSERTE0 (inflateInit2 (&mg.strm, 16 + MAX_WBITS) == Z_OK, "inflateInit2 failed"); // 16: gzip header
+    }
+
+    buf_alloc (evb, &mg.out, MGZIP_STREAM_OUT, 1, "mgzip_out");
+    mg.out.len = mg.out.param = 0;
+
+    while (!mg.out.len) {
+        if (mg.in.param == mg.in.len) {
+            mgzip_read_input (MGZIP_CHUNK_SIZE);
+            ASSINP (mg.in.len, "%s: unexpected end of file - gzip data is truncated", txt_name);
+        }
+
+        uint32_t avail_in = MIN (mg.in.len - mg.in.param, 1 << 30);
+        mg.strm.next_in   = (Bytef *)ENT (char, mg.in, mg.in.param);
+        mg.strm.avail_in  = avail_in;
+        mg.strm.next_out  = (Bytef *)mg.out.data;
+        mg.strm.avail_out = mg.out.size;
+
+        int ret = inflate (&mg.strm, Z_NO_FLUSH);
+        ASSINP (ret == Z_OK || ret == Z_STREAM_END || ret == Z_BUF_ERROR, "%s: failed to decompress gzip data: %s",
+                txt_name, mg.strm.msg ? mg.strm.msg : "");
+
+        uint32_t in_used = avail_in - mg.strm.avail_in;
+        mg.in.param += in_used;
+        mg.consumed += in_used;
+        mg.out.len   = mg.out.size - mg.strm.avail_out;
+
+        if (mg.out.len) mg.comp_ratio = (double)in_used / (double)mg.out.len;
+
+        // end of member - the next member (if any) will be decompressed in parallel again
+        if (ret == Z_STREAM_END) {
+            inflateEnd (&mg.strm);
+            mg.strm.state   = NULL;
+            mg.is_streaming = false;
+            break;
+        }
+    }
+}
+
+// ZIP I/O thread: replaces gzfread. returns the number of bytes read, 0 if EOF.
+uint32_t mgzip_read (File *file, char *data, uint32_t max_bytes)
+{
+    uint32_t bytes_read = 0;
+
+    while (bytes_read < max_bytes) {
+        if (mg.out.param == mg.out.len) {
+            if (mg.is_streaming)
+                mgzip_stream();
+
+            else if (mg.in_eof && mg.in.param == mg.in.len)
+                break; // EOF
+
+            else
+                mgzip_decompress_round();
+
+            continue;
+        }
+
+        uint32_t len = MIN (max_bytes - bytes_read, mg.out.len - mg.out.param);
+        memcpy (&data[bytes_read], ENT (char, mg.out, mg.out.param), len);
+        mg.out.param += len;
+        bytes_read   += len;
+    }
+
+    // compressed bytes consumed, not including compressed bytes of data decompressed but not yet passed to the caller
+    file->disk_so_far = mg.consumed - (uint64_t)((double)(mg.out.len - mg.out.param) * mg.comp_ratio);
+
+    return bytes_read;
+}
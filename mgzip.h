@@ -0,0 +1,15 @@
+// ------------------------------------------------------------------
+//   mgzip.h
+//   Copyright (C) 2020 Divon Lan <divon@genozip.com>
+//   Please see terms and conditions in the files LICENSE.non-commercial.txt and LICENSE.commercial.txt
+
+#ifndef MGZIP_INCLUDED
+#define MGZIP_INCLUDED
+
+#include "genozip.h"
+
+extern void mgzip_open (FileP file, const uint8_t *first_bytes, uint32_t first_bytes_len);
+extern uint32_t mgzip_read (FileP file, char *data, uint32_t max_bytes);
+extern void mgzip_close (void);
+
+#endif
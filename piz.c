@@ -27,6 +27,8 @@
 #include "bgzf.h"
 #include "flags.h"
 #include "reconstruct.h"
+#include "checkpoint.h"
+#include "txtindex.h"
 
 // called by I/O thread in fast_piz_read_one_vb, in case of --grep, to decompress and reconstruct the desc line, to 
 // see if this vb is included. 
@@ -214,9 +216,16 @@ static void piz_uncompress_one_vb (VBlock *vb)
     // genocat flags that with which we needn't reconstruct
     if (exe_type == EXE_GENOCAT && flag.genocat_info_only) goto done;
 
+    // with --regions: if this VB has checkpoints, reconstruct only the lines that might be included
+    checkpoint_piz_seek (vb);
+
     // reconstruct from top level snip
     reconstruct_from_ctx (vb, trans.toplevel, 0, true);
 
+    // with --index: collect the coordinates of the records, for the BAI / TBI index created while writing
+    if (txtindex_get_type (txt_file) != TXTINDEX_NONE)
+        txtindex_piz_vb (vb);
+
     // compress txt_data into BGZF blocks (in vb->compressed) if applicable
     if (txt_file->codec == CODEC_BGZF) 
         bgzf_compress_vb (vb);
@@ -269,7 +278,11 @@ static DataType piz_read_global_area (Digest *original_file_digest) // out
     // if the user wants to see only the header, we can skip the dictionaries, regions and random access
     if (!flag.header_only) {
         
-        ctx_read_all_dictionaries (DICTREAD_ALL); // read all CHROM/RNAME dictionaries - needed for regions_make_chregs()
+        // with --regions, we read the CHROM dictionary first, so we can determine which VBs are included, and then
+        // the other dictionaries - fully only if needed by an included VB (see ctx_dict_find_needed_dict_ids)
+        bool lazy_dicts = flag.regions && !flag.reading_reference && !flag.show_dict && !flag.show_one_dict && !flag.list_chroms;
+
+        ctx_read_all_dictionaries (lazy_dicts ? DICTREAD_CHROM_ONLY : DICTREAD_ALL); // read CHROM/RNAME dictionary - needed for regions_make_chregs()
 
         // update chrom node indices using the CHROM dictionary, for the user-specified regions (in case -r/-R were specified)
         regions_make_chregs();
@@ -288,6 +301,8 @@ static DataType piz_read_global_area (Digest *original_file_digest) // out
         random_access_load_ra_section (SEC_REF_RAND_ACC, &ref_stored_ra, "ref_stored_ra", 
                                        flag.show_ref_index && !flag.reading_reference ? "Reference random-access index contents (result of --show-index)" : NULL);
 
+        if (lazy_dicts) ctx_read_all_dictionaries (DICTREAD_EXCEPT_CHROM);
+
         if ((flag.reference == REF_STORED || flag.reference == REF_EXTERNAL) && 
             !flag.reading_reference &&
             !(flag.show_headers && exe_type == EXE_GENOCAT))
@@ -336,6 +351,9 @@ static DataType piz_read_global_area (Digest *original_file_digest) // out
 
         // read dict_id aliases, if there are any
         dict_id_read_aliases();
+
+        // read ZSTD dictionaries, if there are any
+        codec_zstd_read_dicts();
     }
     
     file_seek (z_file, 0, SEEK_SET, false);
@@ -452,6 +470,35 @@ bool piz_dispatch_one_vb (Dispatcher dispatcher, ConstSectionListEntryP sl_ent,
     return false;
 }
 
+// --component: find the SEC_TXT_HEADER of the requested component - by its number (1-based) or its original file name 
+// (as shown by genols). Other components are not read - the section list takes us directly to the component's sections.
+static ConstSectionListEntryP piz_get_component_txt_header (uint32_t *component_i) // out
+{
+    char *after;
+    unsigned long requested_i = strtoul (flag.component, &after, 10);
+    bool by_number = !*after && requested_i >= 1;
+
+    ConstSectionListEntryP sl_ent = NULL;
+    for (*component_i=0; sections_get_next_section_of_type (&sl_ent, SEC_TXT_HEADER, false, false); (*component_i)++) {
+        
+        if (by_number) {
+            if (*component_i + 1 == requested_i) return sl_ent;
+        }
+        else {
+            zfile_read_section_header (evb, sl_ent->offset, sl_ent->vblock_i, SEC_TXT_HEADER);
+            SectionHeaderTxtHeader *header = FIRSTENT (SectionHeaderTxtHeader, evb->compressed);
+            bool found = !strncmp (header->txt_filename, flag.component, TXT_FILENAME_LEN);
+            buf_free (&evb->compressed);
+
+            if (found) return sl_ent;
+        }
+    }
+
+    ASSINP (false, "Error: %s has no component \"%s\" - it has %u component%s. Use genols %s to list them", 
+            z_name, flag.component, z_file->num_components, z_file->num_components==1 ? "" : "s", z_name);
+    return NULL;
+}
+
 // called once per txt_file created: i.e. if concatenating - a single call, if unbinding there will be multiple calls to this function
 void piz_one_file (uint32_t component_i /* 0 if not unbinding */, bool is_last_z_file)
 {
@@ -475,6 +522,14 @@ void piz_one_file (uint32_t component_i /* 0 if not unbinding */, bool is_last_z
 
         sl_ent = sl_ent_leaf_2 = NULL; // reset
 
+        // case: --component - start from the requested component's txt header, rather than the first one
+        if (flag.component) {
+            ConstSectionListEntryP txt_header_sl = piz_get_component_txt_header (&component_i);
+
+            // rewind - the dispatcher loop will read the txt header. If it is the first section, we rewind to NULL, which means "start of list"
+            sl_ent = (txt_header_sl > FIRSTENT (const SectionListEntry, z_file->section_list_buf)) ? txt_header_sl - 1 : NULL; 
+        }
+
         ASSINP (!flag.test || !digest_is_zero (original_file_digest), 
                 "Error testing %s: --test cannot be used with this file, as it was not compressed (in genozip v8) with --md5 or --test", z_name);
 
@@ -534,7 +589,7 @@ void piz_one_file (uint32_t component_i /* 0 if not unbinding */, bool is_last_z
 
             // case SEC_TXT_HEADER when concatenating or first TXT_HEADER when unbinding: proceed with this component 
             // note: this never happens in the 2nd leaf when interleaving, because we skipped the header
-            else if (another_header && (!flag.unbind || first_component_this_txtfile)) {
+            else if (another_header && (!(flag.unbind || flag.component) || first_component_this_txtfile)) {
 
                 txtfile_genozip_to_txt_header (sl_ent,  
                                                first_component_this_txtfile ? &original_file_digest : NULL); // NULL means skip txt header (2nd+ component if concatenating)
@@ -556,9 +611,9 @@ void piz_one_file (uint32_t component_i /* 0 if not unbinding */, bool is_last_z
                 }
             }
 
-            // case: we're done (concatenating: no more VBs in the entire file ; unbinding: no more VBs in our component)
+            // case: we're done (concatenating: no more VBs in the entire file ; unbinding or --component: no more VBs in our component)
             else { 
-                no_more_headers = !another_header;
+                no_more_headers = !another_header || flag.component; // with --component, we don't continue to the next component
 
                 sl_ent--; // re-read in next call to this function if unbinding
                 dispatcher_set_input_exhausted (dispatcher, true);
@@ -0,0 +1,307 @@
+// ------------------------------------------------------------------
+//   pkzip.c
+//   Copyright (C) 2020 Divon Lan <divon@genozip.com>
+//   Please see terms and conditions in the files LICENSE.non-commercial.txt and LICENSE.commercial.txt
+
+// ZIP: reading a txt file in a .zip archive. Like "unzip -p", we output the contents of all members of the archive, in the
+// order of their local file headers, until the central directory. A member with known sizes (the common case) is decompressed
+// in one go with libdeflate. A member whose sizes appear only after its data (in a data descriptor, as written by a zip
+// that streams its output), or that is too big to hold in memory, is decompressed with zlib (streaming). Only the stored and
+// deflate methods are supported. Since we read with plain fread, this works with pipes too.
+
+#include <errno.h>
+#include "zlib/zlib.h"
+#include "libdeflate/libdeflate.h"
+#include "genozip.h"
+#include "pkzip.h"
+#include "file.h"
+#include "buffer.h"
+#include "vblock.h"
+#include "codec.h"
+#include "endianness.h"
+#include "strings.h"
+
+#define PKZIP_READ_SIZE     (4 << 20)
+#define PKZIP_STREAM_OUT    (1 << 20)   // zlib output per call when streaming
+#define PKZIP_MAX_IN_MEM    (256 << 20) // members with a larger uncompressed size are streamed
+#define PKZIP_HEADER_LEN    30
+#define PKZIP_LOCAL_HEADER  0x04034b50
+#define PKZIP_DATA_DESC     0x08074b50
+
+#define PKZIP_METHOD_STORED  0
+#define PKZIP_METHOD_DEFLATE 8
+
+#define PKZIP_FLAG_ENCRYPTED 1
+#define PKZIP_FLAG_DATA_DESC 8
+
+#define PZ_IN     ((const uint8_t *)pz.in.data + pz.in.param)
+#define PZ_AVAIL  (pz.in.len - pz.in.param)
+
+static struct {
+    FILE *fp;
+    Buffer in;                      // compressed data read from the file. in.param is the first byte not decompressed yet
+    Buffer out;                     // decompressed data. out.param is the first byte not yet passed to the caller
+    bool in_eof, is_streaming, is_done;
+    z_stream strm;                  // used when streaming a deflate member
+    uint16_t flags, method;         // of the current member
+    bool is_zip64;                  // current member has a zip64 extra field
+    uint32_t crc32;                 // of the current member, from its local header
+    uint32_t stream_crc32;          // running CRC32 of the member being streamed
+    uint64_t stream_remaining;      // compressed bytes of a stored member being streamed, not yet consumed
+    uint64_t consumed;              // compressed bytes decompressed so far
+    uint32_t num_members;
+    double comp_ratio;              // compressed / uncompressed of the last output - to estimate disk_so_far
+    VBlockP vb;                     // memory of libdeflate and zlib
+    struct libdeflate_decompressor *decompressor;
+} pz;
+
+static inline uint16_t pkzip_le16 (const uint8_t *p) { uint16_t v; memcpy (&v, p, 2); return LTEN16 (v); }
+static inline uint32_t pkzip_le32 (const uint8_t *p) { uint32_t v; memcpy (&v, p, 4); return LTEN32 (v); }
+static inline uint64_t pkzip_le64 (const uint8_t *p) { uint64_t v; memcpy (&v, p, 8); return LTEN64 (v); }
+
+static void *pkzip_zalloc (void *vb, unsigned items, unsigned size)
+{
+    return codec_alloc ((VBlockP)vb, items * size, 1);
+}
+
+// called by file_open_txt_read for a .zip file
+void pkzip_open (File *file)
+{
+    memset (&pz, 0, sizeof (pz));
+    pz.fp           = (FILE *)file->file;
+    pz.vb           = vb_get_nonpool_vb (evb);
+    pz.decompressor = libdeflate_alloc_decompressor (pz.vb);
+
+    buf_alloc (evb, &pz.in, PKZIP_READ_SIZE, 1, "pkzip_in");
+}
+
+void pkzip_close (void)
+{
+    if (pz.strm.state) inflateEnd (&pz.strm);
+
+    libdeflate_free_decompressor (&pz.decompressor);
+    vb_destroy_vb (&pz.vb);
+
+    buf_destroy (&pz.in);
+    buf_destroy (&pz.out);
+}
+
+// reads compressed data until pz.in has at least min_len unconsumed bytes, or EOF. returns true if it has.
+static bool pkzip_read_input (uint64_t min_len)
+{
+    if (PZ_AVAIL >= min_len) return true;
+
+    // discard consumed data
+    if (pz.in.param) {
+        memmove (pz.in.data, pz.in.data + pz.in.param, pz.in.len - pz.in.param);
+        pz.in.len  -= pz.in.param;
+        pz.in.param = 0;
+    }
+
+    if (pz.in_eof) return false;
+
+    buf_alloc (evb, &pz.in, MAX (min_len, PKZIP_READ_SIZE), 1, "pkzip_in");
+
+    while (pz.in.len < min_len) {
+        size_t bytes = fread (AFTERENT (char, pz.in), 1, pz.in.size - pz.in.len, pz.fp);
+        ASSERTE (!ferror (pz.fp), "failed to read %s: %s", txt_name, strerror (errno));
+
+        if (!bytes) {
+            pz.in_eof = true;
+            return false;
+        }
+        pz.in.len += bytes;
+    }
+
+    return true;
+}
+
+static inline void pkzip_assert_input (uint64_t min_len)
+{
+    ASSINP (pkzip_read_input (min_len), "%s: unexpected end of file - zip data is truncated", txt_name);
+}
+
+static inline void pkzip_consume (uint64_t len)
+{
+    pz.in.param += len;
+    pz.consumed += len;
+}
+
+// after the data of a streamed member: verify its CRC32, which is either in the local header or in the data descriptor that follows the data
+static void pkzip_stream_end (void)
+{
+    if (pz.flags & PKZIP_FLAG_DATA_DESC) {
+        pkzip_assert_input (4);
+        if (pkzip_le32 (PZ_IN) == PKZIP_DATA_DESC) pkzip_consume (4); // the signature is optional
+
+        uint32_t desc_len = pz.is_zip64 ? 20 : 12; // CRC32, compressed size, uncompressed size
+        pkzip_assert_input (desc_len);
+        pz.crc32 = pkzip_le32 (PZ_IN);
+        pkzip_consume (desc_len);
+    }
+
+    ASSINP (pz.stream_crc32 == pz.crc32, "%s: failed to decompress zip data - bad CRC32", txt_name);
+
+    pz.is_streaming = false;
+}
+
+// reads the local file header of the next member, and decompresses the member if its sizes are known and it is not too big
+static void pkzip_next_member (void)
+{
+    // case: end of the local file entries - we ignore the central directory that follows them
+    if (!pkzip_read_input (4) || pkzip_le32 (PZ_IN) != PKZIP_LOCAL_HEADER) {
+        ASSINP (pz.num_members, "%s is not a valid zip file", txt_name);
+        pz.is_done = true;
+        return;
+    }
+
+    pkzip_assert_input (PKZIP_HEADER_LEN);
+    uint16_t name_len   = pkzip_le16 (PZ_IN + 26);
+    uint16_t extra_len  = pkzip_le16 (PZ_IN + 28);
+    uint32_t header_len = PKZIP_HEADER_LEN + name_len + extra_len;
+    pkzip_assert_input (header_len);
+
+    const uint8_t *h = PZ_IN;
+    pz.flags  = pkzip_le16 (h + 6);
+    pz.method = pkzip_le16 (h + 8);
+    pz.crc32  = pkzip_le32 (h + 14);
+    uint64_t comp_len   = pkzip_le32 (h + 18);
+    uint64_t uncomp_len = pkzip_le32 (h + 22);
+
+    // zip64 extra field: sizes that don't fit 32 bits
+    pz.is_zip64 = false;
+    for (uint32_t i=PKZIP_HEADER_LEN + name_len; i + 4 <= header_len; i += 4 + pkzip_le16 (h + i + 2)) {
+        if (pkzip_le16 (h + i) != 0x0001) continue;
+
+        pz.is_zip64 = true;
+        uint32_t j = i + 4;
+        if (uncomp_len == 0xffffffff && j + 8 <= header_len) { uncomp_len = pkzip_le64 (h + j); j += 8; }
+        if (comp_len   == 0xffffffff && j + 8 <= header_len) { comp_len   = pkzip_le64 (h + j); }
+        break;
+    }
+
+    ASSINP (!(pz.flags & PKZIP_FLAG_ENCRYPTED), "%s: encrypted zip files are not supported", txt_name);
+    ASSINP (pz.method == PKZIP_METHOD_DEFLATE || pz.method == PKZIP_METHOD_STORED,
+            "%s: zip compression method %u is not supported, only deflate. Please unzip the file first", txt_name, pz.method);
+    ASSINP (pz.method == PKZIP_METHOD_DEFLATE || !(pz.flags & PKZIP_FLAG_DATA_DESC),
+            "%s: zip files with stored (uncompressed) members of unknown size are not supported. Please unzip the file first", txt_name);
+
+    pkzip_consume (header_len);
+    pz.num_members++;
+
+    // case: sizes are not known or the member is too big - stream it
+    if ((pz.flags & PKZIP_FLAG_DATA_DESC) || uncomp_len > PKZIP_MAX_IN_MEM || comp_len > PKZIP_MAX_IN_MEM) {
+        pz.is_streaming     = true;
+        pz.stream_crc32     = 0;
+        pz.stream_remaining = comp_len; // used only for stored members
+        return;
+    }
+
+    pkzip_assert_input (comp_len);
+    buf_alloc (evb, &pz.out, uncomp_len, 1.1, "pkzip_out");
+
+    if (pz.method == PKZIP_METHOD_DEFLATE) {
+        size_t in_used, out_len;
+        ASSINP (libdeflate_deflate_decompress_ex (pz.decompressor, PZ_IN, comp_len, pz.out.data, uncomp_len, &in_used, &out_len) == LIBDEFLATE_SUCCESS &&
+                in_used == comp_len && out_len == uncomp_len, "%s: failed to decompress zip data - the file is corrupt", txt_name);
+    }
+    else {
+        ASSINP (comp_len == uncomp_len, "%s: invalid zip data - bad sizes of a stored member", txt_name);
+        memcpy (pz.out.data, PZ_IN, comp_len);
+    }
+
+    ASSINP (libdeflate_crc32 (0, pz.out.data, uncomp_len) == pz.crc32, "%s: failed to decompress zip data - bad CRC32", txt_name);
+
+    pz.out.len   = uncomp_len;
+    pz.out.param = 0;
+    pkzip_consume (comp_len);
+
+    if (uncomp_len) pz.comp_ratio = (double)comp_len / (double)uncomp_len;
+}
+
+// decompress (part of) a member with zlib, or copy (part of) a stored member
+static void pkzip_stream (void)
+{
+    buf_alloc (evb, &pz.out, PKZIP_STREAM_OUT, 1, "pkzip_out");
+    pz.out.len = pz.out.param = 0;
+
+    if (pz.method == PKZIP_METHOD_STORED) {
+        if (pz.stream_remaining) {
+            pkzip_assert_input (1);
+            uint64_t len = MIN (MIN (pz.stream_remaining, PZ_AVAIL), PKZIP_STREAM_OUT);
+            memcpy (pz.out.data, PZ_IN, len);
+            pz.out.len = len;
+            pz.stream_crc32 = libdeflate_crc32 (pz.stream_crc32, pz.out.data, len);
+            pz.stream_remaining -= len;
+            pz.comp_ratio = 1;
+            pkzip_consume (len);
+        }
+
+        if (!pz.stream_remaining) pkzip_stream_end();
+        return;
+    }
+
+    if (!pz.strm.state) {
+        pz.strm = (z_stream){ .zalloc = pkzip_zalloc, .zfree = codec_free, .opaque = pz.vb };
+        ASSERTE0 (inflateInit2 (&pz.strm, -MAX_WBITS) == Z_OK, "inflateInit2 failed"); // negative: raw deflate, no header
+    }
+
+    while (!pz.out.len) {
+        if (!PZ_AVAIL) pkzip_assert_input (1);
+
+        uint32_t avail_in = MIN (PZ_AVAIL, 1 << 30);
+        pz.strm.next_in   = (Bytef *)PZ_IN;
+        pz.strm.avail_in  = avail_in;
+        pz.strm.next_out  = (Bytef *)pz.out.data;
+        pz.strm.avail_out = pz.out.size;
+
+        int ret = inflate (&pz.strm, Z_NO_FLUSH);
+        ASSINP (ret == Z_OK || ret == Z_STREAM_END || ret == Z_BUF_ERROR, "%s: failed to decompress zip data: %s",
+                txt_name, pz.strm.msg ? pz.strm.msg : "");
+
+        uint32_t in_used = avail_in - pz.strm.avail_in;
+        pkzip_consume (in_used);
+        pz.out.len = pz.out.size - pz.strm.avail_out;
+        pz.stream_crc32 = libdeflate_crc32 (pz.stream_crc32, pz.out.data, pz.out.len);
+
+        if (pz.out.len) pz.comp_ratio = (double)in_used / (double)pz.out.len;
+
+        if (ret == Z_STREAM_END) {
+            inflateEnd (&pz.strm);
+            pz.strm.state = NULL;
+            pkzip_stream_end();
+            break;
+        }
+    }
+}
+
+// ZIP I/O thread: returns the number of bytes read, 0 if EOF.
+uint32_t pkzip_read (File *file, char *data, uint32_t max_bytes)
+{
+    uint32_t bytes_read = 0;
+
+    while (bytes_read < max_bytes) {
+        if (pz.out.param == pz.out.len) {
+            if (pz.is_streaming)
+                pkzip_stream();
+
+            else if (pz.is_done)
+                break; // EOF
+
+            else
+                pkzip_next_member();
+
+            continue;
+        }
+
+        uint32_t len = MIN (max_bytes - bytes_read, pz.out.len - pz.out.param);
+        memcpy (&data[bytes_read], ENT (char, pz.out, pz.out.param), len);
+        pz.out.param += len;
+        bytes_read   += len;
+    }
+
+    // compressed bytes consumed, not including compressed bytes of data decompressed but not yet passed to the caller
+    file->disk_so_far = pz.consumed - (uint64_t)((double)(pz.out.len - pz.out.param) * pz.comp_ratio);
+
+    return bytes_read;
+}
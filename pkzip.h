@@ -0,0 +1,15 @@
+// ------------------------------------------------------------------
+//   pkzip.h
+//   Copyright (C) 2020 Divon Lan <divon@genozip.com>
+//   Please see terms and conditions in the files LICENSE.non-commercial.txt and LICENSE.commercial.txt
+
+#ifndef PKZIP_INCLUDED
+#define PKZIP_INCLUDED
+
+#include "genozip.h"
+
+extern void pkzip_open (FileP file);
+extern uint32_t pkzip_read (FileP file, char *data, uint32_t max_bytes);
+extern void pkzip_close (void);
+
+#endif
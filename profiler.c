@@ -18,6 +18,8 @@ void profiler_add (ProfilerRec *dst, const ProfilerRec *src)
     ADD(compressor_lzma);
     ADD(compressor_bsc);
     ADD(compressor_domq);
+    ADD(compressor_qctx);
+    ADD(compressor_zstd);
     ADD(compressor_actg);
     ADD(compressor_pbwt);
     ADD(compressor_hapmat);
@@ -111,6 +113,8 @@ void profiler_print_report (const ProfilerRec *p, unsigned max_threads, unsigned
         PRINT (compressor_lzma, 2);
         PRINT (compressor_bsc,  2);
         PRINT (compressor_domq, 2);
+        PRINT (compressor_qctx, 2);
+        PRINT (compressor_zstd, 2);
         PRINT (compressor_actg, 2);
         PRINT (compressor_hapmat, 2);
         PRINT (compressor_pbwt, 2);
@@ -149,6 +153,8 @@ void profiler_print_report (const ProfilerRec *p, unsigned max_threads, unsigned
         PRINT (compressor_lzma, 1);
         PRINT (compressor_bsc,  1);
         PRINT (compressor_domq, 1);
+        PRINT (compressor_qctx, 1);
+        PRINT (compressor_zstd, 1);
         PRINT (compressor_actg, 1);
         PRINT (compressor_hapmat, 1);
         PRINT (compressor_pbwt, 1);
@@ -19,6 +19,7 @@ static double last_percent=0;
 static unsigned last_seconds_so_far=0;
 static const char *component_name=NULL;
 static unsigned last_len=0; // so we know how many characters to erase on next update
+static bool one_line=false; // show each component on a single line, printed when it is finalized (for concurrent processes sharing the terminal)
 
 static void progress_human_time (unsigned secs, char *str /* out */)
 {
@@ -49,6 +50,11 @@ static const char *progress_ellapsed_time (bool ever)
     return time_str;
 }
 
+void progress_set_one_line (void)
+{
+    one_line = true;
+}
+
 void progress_new_component (const char *new_component_name, 
                              const char *status,
                              int new_test_mode) // true, false or -1 for unchanged
@@ -66,10 +72,10 @@ void progress_new_component (const char *new_component_name,
             test_mode = new_test_mode;
 
         // if !show_progress - we don't show the advancing %, but we still show the filename, done status, compression ratios etc
-        show_progress  = !flag.quiet && !!isatty(2);
+        show_progress  = !flag.quiet && !one_line && !!isatty(2);
         component_name = new_component_name; 
 
-        if (!flag.quiet) {
+        if (!flag.quiet && !one_line) {
             if (test_mode) 
                 iprintf ("testing: %s%s --test %s : ", global_cmd, strstr (global_cmd, "genozip") ? " --decompress" : "", new_component_name);
             else
@@ -129,7 +135,7 @@ void progress_update (uint64_t sofar, uint64_t total, bool done)
 
 void progress_update_status (const char *status)
 {
-    if (flag.quiet) return;
+    if (flag.quiet || one_line) return;
 
     static const char *eraser = "\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b";
     static const char *spaces = "                                                                                ";
@@ -148,7 +154,12 @@ void progress_update_status (const char *status)
 
 void progress_finalize_component (const char *status)
 {
-    if (!flag.quiet) {
+    if (flag.quiet) {}
+    
+    else if (one_line) // a single write, so lines of concurrent processes don't get mixed
+        iprintf ("%s %s : %s\n", global_cmd, component_name ? component_name : "", status);
+
+    else {
         progress_update_status (status);
         iprint0 ("\n");
     }
@@ -9,6 +9,7 @@
 #include "genozip.h"
 #include "digest.h"
 
+extern void progress_set_one_line (void);
 extern void progress_new_component (const char *component_name, const char *status, int test_mode);
 extern void progress_update (uint64_t sofar, uint64_t total, bool done);
 extern void progress_update_status (const char *status);
@@ -255,12 +255,17 @@ bool random_access_is_vb_included (uint32_t vb_i,
     // case: an entire VB without RA data while some other VBs do have. For example - a sorted SAM where unaligned reads are pushed to the end of the file
     if (!ra) return false; // don't include this VB
 
+    // count the ra's of this VB - the rows of the matrix. note: with --regions-file, there might be many regions (columns)
+    const RAEntry *after_ra = AFTERENT (const RAEntry, z_file->ra_buf);
+    unsigned num_ras = 0;
+    for (const RAEntry *r=ra; r < after_ra && r->vblock_i == vb_i; r++) num_ras++;
+
     unsigned num_regions = regions_max_num_chregs();
-    buf_alloc (evb, region_ra_intersection_matrix, z_file->ra_buf.len * num_regions, 1, "region_ra_intersection_matrix");
+    buf_alloc (evb, region_ra_intersection_matrix, num_ras * num_regions, 1, "region_ra_intersection_matrix");
     buf_zero (region_ra_intersection_matrix);
 
     bool vb_is_included = false;
-    for (unsigned ra_i=0; ra->vblock_i == vb_i; ra_i++, ra++) {
+    for (unsigned ra_i=0; ra_i < num_ras; ra_i++, ra++) {
         if (regions_get_ra_intersection (ra->chrom_index, ra->min_pos, ra->max_pos,
                                          &region_ra_intersection_matrix->data[ra_i * num_regions]))  // the matrix row for this ra
             vb_is_included = true; 
@@ -619,6 +619,20 @@ void ref_create_cache_join (void)
     ref_creating_cache = false;
 }
 
+// --max-memory: we prefer the genome and refhash mmap'ed from their cache files over the heap, as their pages are backed by
+// the files and can be reclaimed by the OS. If they were just loaded into the heap while creating the caches, reload them from the caches.
+void ref_reload_from_cache (bool is_last_z_file)
+{
+    ref_create_cache_join();
+    refhash_create_cache_join();
+
+    bool genome_reloadable = genome_cache.type == BUF_REGULAR && file_exists (ref_get_cache_fn());
+    if (!genome_reloadable && !refhash_is_reloadable_from_cache()) return; // already mmap'ed, or caches could not be created
+
+    ref_destroy_reference(); // also destroys refhash
+    ref_load_external_reference (false, is_last_z_file);
+}
+
 
 // ------------------------------------
 // ZIP side
@@ -80,6 +80,7 @@ extern bool ref_mmap_cached_reference (void);
 extern void ref_create_cache_in_background (void);
 extern void ref_create_cache_join (void);
 extern void ref_remove_cache (void);
+extern void ref_reload_from_cache (bool is_last_z_file);
 
 // contigs stuff
 typedef enum { WI_REF_CONTIG, WI_ZFILE_CHROM } GetWordIndexType;
@@ -113,8 +114,9 @@ extern void ref_alt_chroms_compress (void);
 
 #define ref_is_idx_in_range(range,idx) ((idx) < (range)->ref.nbits / 2)
 
-#define ref_get_nucleotide(range,idx)  acgt_decode[(bit_array_get (&(range)->ref, (idx) * 2 + 1) << 1) | \
-                                                    bit_array_get (&(range)->ref, (idx) * 2)]
+#define ref_get_acgt(range,idx)        ((bit_array_get (&(range)->ref, (idx) * 2 + 1) << 1) | \
+                                         bit_array_get (&(range)->ref, (idx) * 2)) // 2-bit: A=0 C=1 G=2 T=3
+#define ref_get_nucleotide(range,idx)  acgt_decode[ref_get_acgt ((range), (idx))]
 
 // display
 typedef struct { char s[300]; } RangeStr;
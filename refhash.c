@@ -247,6 +247,12 @@ void refhash_remove_cache (void)
     file_remove (refhash_get_cache_fn(), true);
 }
 
+// true if refhash was loaded into the heap, and its cache now exists and can be mmap'ed instead
+bool refhash_is_reloadable_from_cache (void)
+{
+    return refhash_buf.type == BUF_REGULAR && !refhash_creating_cache && file_exists (refhash_get_cache_fn());
+}
+
 // thread entry for creating refhash cache
 static void *refhash_create_cache (void *unused_arg)
 {
@@ -35,6 +35,7 @@ extern void refhash_calc_one_range (const Range *r, const Range *next_r);
 extern void refhash_load_standalone (void);
 extern void refhash_create_cache_join (void);
 extern void refhash_remove_cache (void);
+extern bool refhash_is_reloadable_from_cache (void);
 
 // globals
 extern const char complement[256];
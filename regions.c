@@ -30,6 +30,7 @@ static Buffer *chregs = NULL;     // one entry per chrom
 static uint32_t num_chroms;
 
 static bool is_negative_regions = false; // true if the user used ^ to negate the regions
+static const char *regions_filename = NULL; // set if the user used --regions-file
 
 // returns true if this is valid pos range string 
 static bool regions_parse_pos (const char *str, Region *reg) 
@@ -97,6 +98,9 @@ void regions_add (const char *region_str)
     bool is_conflicting_negation = (regions_buf.len && (is_negative_regions != is_negated));
     ASSINP0 (!is_conflicting_negation, "Error: inconsistent negation - all regions listed must either be negated or not");
 
+    // checked here and in regions_add_by_file, so it is caught regardless of the order of the options
+    ASSINP (!is_negated || !regions_filename, "Error: --regions-file %s cannot be combined with negated regions", regions_filename);
+
     is_negative_regions = is_negated;
 
     // make a copy of the string and leave the original one for error message. 
@@ -163,6 +167,83 @@ void regions_add (const char *region_str)
     }
 }
 
+// called from main when parsing the command line to add the regions listed in a BED file (--regions-file). 
+// BED intervals are 0-based and half-open - we convert them to 1-based closed regions
+void regions_add_by_file (const char *bed_filename)
+{
+    ASSINP (!is_negative_regions, "Error: --regions-file %s cannot be combined with negated regions", bed_filename);
+    regions_filename = bed_filename;
+
+    Buffer bed_buf = EMPTY_BUFFER;
+    file_get_file (evb, bed_filename, &bed_buf, "bed_buf", true);
+
+    // make a copy of the data that we don't free, as chrom fields in regions will be pointing to it
+    char *next_line = MALLOC (bed_buf.len + 1);
+    memcpy (next_line, bed_buf.data, bed_buf.len + 1); // including the string terminator
+    buf_destroy (&bed_buf);
+
+    for (uint32_t line_i=1; *next_line; line_i++) {
+        char *line = next_line;
+        char *newline = strchr (line, '\n');
+        if (newline) {
+            *newline = 0;
+            next_line = newline + 1;
+        }
+        else
+            next_line = line + strlen (line);
+
+        unsigned line_len = strlen (line);
+        if (line_len && line[line_len-1] == '\r') line[--line_len] = 0; // Windows line ending
+
+        // skip empty, comment and UCSC header lines
+        if (!line_len || line[0] == '#' || !strncmp (line, "track", 5) || !strncmp (line, "browser", 7)) continue;
+
+        char *after;
+        char *chrom = strtok_r (line, " \t", &after);
+        char *start = strtok_r (NULL, " \t", &after);
+        char *end   = strtok_r (NULL, " \t", &after);
+
+        PosType start_pos, end_pos;
+        ASSINP (chrom && start && end && str_get_int (start, strlen (start), &start_pos) && str_get_int (end, strlen (end), &end_pos) && 
+                start_pos >= 0 && end_pos >= start_pos && end_pos <= MAX_POS,
+                "Error: invalid line %u in %s - expecting a BED line: chrom, start, end", line_i, bed_filename);
+
+        buf_alloc_more (evb, &regions_buf, 1, 1000, Region, 2, "regions_buf");
+        NEXTENT (Region, regions_buf) = (Region){ .chrom     = chrom, 
+                                                  .start_pos = start_pos + 1, 
+                                                  .end_pos   = MAX (end_pos, start_pos + 1) }; // a zero-length interval (eg an insertion point) is taken as the base following it
+    }
+}
+
+static int regions_sort_by_start_pos (const void *a, const void *b)
+{
+    PosType start_a = ((const Chreg *)a)->start_pos, start_b = ((const Chreg *)b)->start_pos;
+    return (start_a > start_b) - (start_a < start_b);
+}
+
+// sort the chregs of each chrom, and merge overlapping and adjacent chregs - so that each site is covered by at
+// most one chreg, and regions_is_site_included can use a binary search. This matters with --regions-file, that
+// might have many (possibly overlapping) regions
+static void regions_sort_and_merge_chregs (void)
+{
+    for (unsigned chr_i=0; chr_i < num_chroms; chr_i++) {
+        Buffer *chregs_buf = &chregs[chr_i];
+        if (chregs_buf->len < 2) continue;
+
+        qsort (chregs_buf->data, chregs_buf->len, sizeof (Chreg), regions_sort_by_start_pos);
+
+        ARRAY (Chreg, chreg, *chregs_buf);
+        uint64_t last_i = 0;
+        for (uint64_t i=1; i < chregs_buf->len; i++) 
+            if (chreg[i].start_pos <= chreg[last_i].end_pos + 1) // overlapping or adjacent
+                chreg[last_i].end_pos = MAX (chreg[last_i].end_pos, chreg[i].end_pos);
+            else
+                chreg[++last_i] = chreg[i];
+
+        chregs_buf->len = last_i + 1;
+    }
+}
+
 // convert the list of regions as parsed from --regions, to an array of chregs - one for each chromosome.
 // 1. convert the chrom string to a chrom word index
 // 2. for "all chrom" regions - include them in all chregs
@@ -201,6 +282,8 @@ void regions_make_chregs (void)
         }
     }
 
+    regions_sort_and_merge_chregs();
+
     //regions_display("After regions_make_chregs");
 }
 
@@ -269,6 +352,8 @@ void regions_transform_negative_to_positive_complement()
 
     FREE (neg_chregs);
 
+    regions_sort_and_merge_chregs();
+
     //regions_display("After regions_transform_negative_to_positive_complement"); 
 }
 
@@ -324,19 +409,48 @@ bool regions_get_range_intersection (WordIndex chrom_word_index, PosType min_pos
     return true;
 }
 
-// PIZ: check if a (chrom,pos) that comes from a specific line, is included in any positive region of
-// a specific ra (i.e. chromosome)
-bool regions_is_site_included (WordIndex chrom_word_index, PosType pos)
+// PIZ: used by checkpoint_piz_seek: the smallest range containing all the parts of the regions that intersect with [min_pos,max_pos] 
+// of a chrom. returns false if no region intersects
+bool regions_get_envelope (WordIndex chrom_word_index, PosType min_pos, PosType max_pos,
+                           PosType *envelope_min_pos, PosType *envelope_max_pos) // out
 {
     ASSERTE (chrom_word_index >= 0 && chrom_word_index < num_chroms, "chrom_word_index=%d out of range", chrom_word_index);
 
-    // it sufficient that the site is included in one (positive) region
     Buffer *chregs_buf = &chregs[chrom_word_index];
+
+    bool intersection_found = false;
     for (unsigned chreg_i=0; chreg_i < chregs_buf->len; chreg_i++) {
         Chreg *chreg = ENT (Chreg, *chregs_buf, chreg_i);
-        if (pos >= chreg->start_pos && pos <= chreg->end_pos) return true;
+
+        if (chreg->start_pos <= max_pos && chreg->end_pos >= min_pos) { 
+            PosType start = MAX (min_pos, chreg->start_pos);
+            PosType end   = MIN (max_pos, chreg->end_pos);
+
+            *envelope_min_pos = intersection_found ? MIN (*envelope_min_pos, start) : start;
+            *envelope_max_pos = intersection_found ? MAX (*envelope_max_pos, end)   : end;
+            intersection_found = true;
+        }
     }
-    return false;
+    return intersection_found;
+}
+
+// PIZ: check if a (chrom,pos) that comes from a specific line, is included in any positive region of
+// a specific ra (i.e. chromosome)
+bool regions_is_site_included (WordIndex chrom_word_index, PosType pos)
+{
+    ASSERTE (chrom_word_index >= 0 && chrom_word_index < num_chroms, "chrom_word_index=%d out of range", chrom_word_index);
+
+    // chregs are sorted and non-overlapping (see regions_sort_and_merge_chregs) - binary search for the last chreg 
+    // starting at or before pos. the site is included if this chreg also ends at or after pos
+    ARRAY (const Chreg, chreg, chregs[chrom_word_index]);
+    int64_t low=0, high=(int64_t)chreg_len - 1, found=-1;
+    while (low <= high) {
+        int64_t mid = (low + high) / 2;
+        if (chreg[mid].start_pos <= pos) { found = mid; low = mid + 1; }
+        else high = mid - 1;
+    }
+
+    return found >= 0 && pos <= chreg[found].end_pos;
 }
 
 // PIZ: check if a range (chrom,start_pos,end_pos) overlaps with an included region. used when loading reference ranges.
@@ -9,10 +9,12 @@
 #include "genozip.h"
 
 extern void regions_add (const char *reg_str);
+extern void regions_add_by_file (const char *bed_filename);
 extern void regions_make_chregs (void);
 extern void regions_transform_negative_to_positive_complement(void);
 extern bool regions_get_ra_intersection (WordIndex chrom_node_index, PosType min_pos, PosType max_pos, char *intersection_one_ra);
 extern bool regions_get_range_intersection (WordIndex chrom_word_index, PosType min_pos, PosType max_pos, PosType *intersect_min_pos, PosType *intersect_max_pos);
+extern bool regions_get_envelope (WordIndex chrom_word_index, PosType min_pos, PosType max_pos, PosType *envelope_min_pos, PosType *envelope_max_pos);
 extern unsigned regions_max_num_chregs(void);
 extern void regions_display(const char *title);
 extern bool regions_is_site_included (WordIndex chrom_word_index, PosType pos);
@@ -43,6 +43,8 @@ extern void bam_read_vblock (VBlockP vb);
 extern void bam_seg_initialize (VBlockP vb);
 extern const char *bam_seg_txt_line (VBlockP vb_, const char *field_start_line, uint32_t remaining_txt_len, bool *has_special_eol);
 
+CONTAINER_CALLBACK (sam_piz_container_cb);
+
 // SAM-to-FASTQ stuff
 CONTAINER_FILTER_FUNC (sam_piz_sam2fq_filter);
 
@@ -54,7 +56,9 @@ extern unsigned sam_vb_zip_dl_size (void);
 
 // Special - used for SAM & BAM
 #define SAM_SPECIAL { sam_piz_special_CIGAR, sam_piz_special_TLEN, sam_piz_special_BD_BI, sam_piz_special_AS, \
-                      sam_piz_special_MD, bam_piz_special_FLOAT, bam_piz_special_BIN, sam_piz_special_XA_POS }
+                      sam_piz_special_MD, bam_piz_special_FLOAT, bam_piz_special_BIN, sam_piz_special_XA_POS, \
+                      sam_piz_special_PNEXT_MATE, sam_piz_special_TLEN_MATE, sam_piz_special_MQ_MATE, sam_piz_special_MC_MATE, \
+                      tokenizer_piz_special_READNAME }
 SPECIAL (SAM, 0, CIGAR, sam_piz_special_CIGAR);
 SPECIAL (SAM, 1, TLEN,  sam_piz_special_TLEN);
 SPECIAL (SAM, 2, BDBI,  sam_piz_special_BD_BI);
@@ -63,7 +67,12 @@ SPECIAL (SAM, 4, MD,    sam_piz_special_MD);
 SPECIAL (SAM, 5, FLOAT, bam_piz_special_FLOAT); // used in BAM to represent float optional values
 SPECIAL (SAM, 6, BIN,   bam_piz_special_BIN);   
 SPECIAL (SAM, 7, XA_POS, sam_piz_special_XA_POS);   
-#define NUM_SAM_SPECIAL 8
+SPECIAL (SAM, 8, PNEXT_MATE, sam_piz_special_PNEXT_MATE); // copy from the mate: PNEXT is the mate's POS
+SPECIAL (SAM, 9, TLEN_MATE,  sam_piz_special_TLEN_MATE);  // TLEN is the negative of the mate's TLEN
+SPECIAL (SAM, 10, MQ_MATE,   sam_piz_special_MQ_MATE);    // MQ:i is the mate's MAPQ
+SPECIAL (SAM, 11, MC_MATE,   sam_piz_special_MC_MATE);    // MC:Z is the mate's CIGAR
+SPECIAL (SAM, 12, READNAME,  tokenizer_piz_special_READNAME); // QNAME that matches the layout of the VB's read names
+#define NUM_SAM_SPECIAL 13
 
 // SAM field types 
 #define DTYPE_QNAME    DTYPE_1
@@ -26,7 +26,31 @@ bool sam_piz_is_skip_section (VBlockP vb, SectionType st, DictId dict_id)
     return false;
 }
 
-// PIZ: SEQ reconstruction 
+// the characters "=ACMGRSVTWYHKDBN" are mapped to BAM 0->15, in this matrix we add 0x80 as a validity bit. All other characters are 0x00 - invalid
+static const uint8_t sam2bam_seq_map[256] = { ['=']=0x80, ['A']=0x81, ['C']=0x82, ['M']=0x83, ['G']=0x84, ['R']=0x85, ['S']=0x86, ['V']=0x87, 
+                                              ['T']=0x88, ['W']=0x89, ['Y']=0x8a, ['H']=0x8b, ['K']=0x8c, ['D']=0x8d, ['B']=0x8e, ['N']=0x8f };
+
+// translate one SAM ASCII sequence character to BAM's 4-bit code - invalid characters are converted to 'N' 
+static inline uint8_t sam_piz_bam_base (char c)
+{
+    static bool invalid_char_warning_shown = false; // we show this warning up to once per execution
+
+    uint8_t base = sam2bam_seq_map[(uint8_t)c];
+    if (base) return base & 0x0f;
+
+    if (!invalid_char_warning_shown) {
+        WARN ("Warning when converting SAM sequence data to BAM: invalid character encodered, it will be converted as 'N': '%c' (ASCII %u)", c, (uint8_t)c);
+        invalid_char_warning_shown = true;
+    }
+    return 0x0f;
+}
+
+// BAM output: write a base directly in BAM's 4-bit packed format. bam_seq must be zeroed before
+#define RECONSTRUCT_BAM_BASE(bam_seq, seq_i, base4) (bam_seq)[(seq_i) >> 1] |= ((seq_i) & 1) ? (base4) : ((base4) << 4)
+
+// PIZ: SEQ reconstruction. When outputting BAM, the sequence is reconstructed directly in BAM's 4-bit format - reference 
+// bases are converted straight from their 2-bit representation - rather than being reconstructed textually and translated
+// by sam_piz_sam2bam_SEQ. We set bitmap_ctx->semaphore to tell the translator that there is nothing left to do.
 void sam_reconstruct_seq (VBlock *vb_, Context *bitmap_ctx, const char *unused, unsigned unused2)
 {
 #define ROUNDUP_TO_NEAREST_4(x) ((uint32_t)(x) + 3) & ~((uint32_t)0x3)
@@ -44,6 +68,8 @@ void sam_reconstruct_seq (VBlock *vb_, Context *bitmap_ctx, const char *unused,
     const PosType pos        = vb->contexts[SAM_POS].last_value.i;
     const Range *range       = NULL;
     unsigned seq_consumed=0, ref_consumed=0;
+    bool to_bam              = (flag.out_dt == DT_BAM);
+    uint8_t *bam_seq         = (uint8_t *)AFTERENT (char, vb->txt_data);
 
     // case: unaligned sequence - pos is 0 
     if (!pos || (vb->chrom_name_len==1 && vb->chrom_name[0]=='*')) {
@@ -54,7 +80,17 @@ void sam_reconstruct_seq (VBlock *vb_, Context *bitmap_ctx, const char *unused,
         }
         // case: no reference was used - in this case, the sequence is not encoded in the bitmap at all. we just copy it from NONREF
         else {
-            RECONSTRUCT (nonref, vb->seq_len); 
+            if (to_bam) {
+                memset (bam_seq, 0, (vb->seq_len+1)/2);
+                for (uint32_t i=0; i < vb->seq_len; i++)
+                    RECONSTRUCT_BAM_BASE (bam_seq, i, sam_piz_bam_base (nonref[i]));
+                
+                vb->txt_data.len += (vb->seq_len+1)/2;
+                bitmap_ctx->semaphore = true;
+            }
+            else
+                RECONSTRUCT (nonref, vb->seq_len); 
+            
             nonref_ctx->next_local += ROUNDUP_TO_NEAREST_4 (vb->seq_len);
         }
         return;
@@ -69,6 +105,8 @@ void sam_reconstruct_seq (VBlock *vb_, Context *bitmap_ctx, const char *unused,
 
     const char *next_cigar = vb->last_cigar; // don't change vb->last_cigar as we may still need it, eg if we have an E2 optional field
     range = vb->ref_consumed ? ref_piz_get_range (vb_, pos, vb->ref_consumed) : NULL;
+
+    if (to_bam) memset (bam_seq, 0, (vb->seq_len+1)/2);
     
     while (seq_consumed < vb->seq_len || ref_consumed < vb->ref_consumed) {
         
@@ -94,10 +132,16 @@ void sam_reconstruct_seq (VBlock *vb_, Context *bitmap_ctx, const char *unused,
                                vb->line_i, vb->vblock_i, (uint32_t)(vb->first_line + vb->lines.len - 1), (uint32_t)vb->lines.len, range->chrom, range->chrom_name_len, range->chrom_name, pos + ref_consumed, range->first_pos, range->last_pos, vb->last_cigar, pos, ref_consumed, seq_consumed);
                     }
 
-                    char ref = ref_get_nucleotide (range, idx);
-                    RECONSTRUCT1 (ref); 
+                    if (to_bam) 
+                        RECONSTRUCT_BAM_BASE (bam_seq, seq_consumed, 1 << ref_get_acgt (range, idx)); // A,C,G,T -> 1,2,4,8
+                    else {
+                        char ref = ref_get_nucleotide (range, idx);
+                        RECONSTRUCT1 (ref); 
+                    }
                 }
             }
+            else if (to_bam)
+                RECONSTRUCT_BAM_BASE (bam_seq, seq_consumed, sam_piz_bam_base (*nonref++));
             else 
                 RECONSTRUCT1 (*nonref++);
 
@@ -114,6 +158,11 @@ void sam_reconstruct_seq (VBlock *vb_, Context *bitmap_ctx, const char *unused,
     ASSERTE (ref_consumed == vb->ref_consumed, "expecting ref_consumed(%u) == vb->ref_consumed(%u)", ref_consumed, vb->ref_consumed);
 
     bitmap_ctx->last_value.i = bitmap_ctx->next_local; // for SEQ, we use last_value for storing the beginning of the sequence
+
+    if (to_bam) {
+        vb->txt_data.len += (vb->seq_len+1)/2;
+        bitmap_ctx->semaphore = true;
+    }
     
     nonref_ctx->next_local += ROUNDUP_TO_NEAREST_4 (nonref - nonref_start);
 }
@@ -126,6 +175,14 @@ SPECIAL_RECONSTRUCTOR (sam_piz_special_CIGAR)
     // calculate seq_len (= l_seq, unless l_seq=0), ref_consumed and (if bam) vb->textual_cigar
     sam_analyze_cigar (vb_sam, snip, snip_len, &vb->seq_len, &vb_sam->ref_consumed, NULL); 
 
+    // textual CIGAR, in case the mate of this line copies it to its MC:Z
+    vb_sam->piz_cigar     = (snip[0] == '-') ? snip + 1 : snip; // eg "-151M" or "-151*"
+    vb_sam->piz_cigar_len = (snip[0] == '-') ? snip_len - 1 : snip_len;
+    if (vb_sam->piz_cigar[vb_sam->piz_cigar_len-1] == '*') { // eg "151*" is reconstructed as "*"
+        vb_sam->piz_cigar    += vb_sam->piz_cigar_len - 1;
+        vb_sam->piz_cigar_len = 1;
+    }
+
     if (flag.out_dt == DT_SAM) {
         if (snip[snip_len-1] == '*') // eg "151*" - zip added the "151" to indicate seq_len - we don't reconstruct it, just the '*'
             RECONSTRUCT1 ('*');
@@ -198,6 +255,80 @@ SPECIAL_RECONSTRUCTOR (sam_piz_special_TLEN)
     return true; // new value
 }
 
+// ----------------------------------------------------------------------------------------------
+// Mates - fields copied from the mate of the line, which appears earlier in the VB - see sam_seg_mate_find
+// ----------------------------------------------------------------------------------------------
+
+// called after each line is reconstructed - record the values that a later mate might copy 
+CONTAINER_CALLBACK (sam_piz_container_cb)
+{
+    VBlockSAMP vb_sam = (VBlockSAMP)vb;
+
+    if (dict_id.num != dict_id_fields[SAM_TOPLEVEL] && dict_id.num != dict_id_fields[SAM_TOP2BAM]) return;
+
+    buf_alloc (vb, &vb_sam->mate_history, (rep+1) * sizeof (SamMateHistory), 2, "mate_history");
+    vb_sam->mate_history.len = MAX (vb_sam->mate_history.len, rep+1);
+
+    *ENT (SamMateHistory, vb_sam->mate_history, rep) = (SamMateHistory){ 
+        .pos       = vb->contexts[SAM_POS].last_value.i,
+        .tlen      = vb->contexts[SAM_TLEN].last_value.i,
+        .mapq      = vb->contexts[SAM_MAPQ].last_value.i,
+        .cigar     = vb_sam->piz_cigar,
+        .cigar_len = vb_sam->piz_cigar_len
+    };
+}
+
+// get the values of the mate of the current line - the line delta to it is in SAM_MATE.local, once per line
+static const SamMateHistory *sam_piz_get_mate (VBlockP vb)
+{
+    VBlockSAMP vb_sam = (VBlockSAMP)vb;
+
+    if (vb_sam->mate_for_line_i != vb->line_i) {
+        uint32_t delta = reconstruct_from_local_int (vb, &vb->contexts[SAM_MATE], 0, false);
+        vb_sam->mate_line_i     = vb->line_i - vb->first_line - delta;
+        vb_sam->mate_for_line_i = vb->line_i;
+    }
+
+    ASSERTE (vb_sam->mate_line_i < vb_sam->mate_history.len, "vb_i=%u line_i=%u: mate line %u was not reconstructed", 
+             vb->vblock_i, vb->line_i, vb_sam->mate_line_i);
+
+    return ENT (SamMateHistory, vb_sam->mate_history, vb_sam->mate_line_i);
+}
+
+SPECIAL_RECONSTRUCTOR (sam_piz_special_PNEXT_MATE)
+{
+    new_value->i = sam_piz_get_mate (vb)->pos;
+    ctx->last_delta = new_value->i - vb->contexts[SAM_POS].last_value.i; // needed by sam_piz_special_TLEN
+
+    if (reconstruct) { RECONSTRUCT_INT (new_value->i) };
+
+    return true; // new value
+}
+
+SPECIAL_RECONSTRUCTOR (sam_piz_special_TLEN_MATE)
+{
+    new_value->i = -sam_piz_get_mate (vb)->tlen;
+    if (reconstruct) { RECONSTRUCT_INT (new_value->i) };
+
+    return true; // new value
+}
+
+SPECIAL_RECONSTRUCTOR (sam_piz_special_MQ_MATE)
+{
+    new_value->i = sam_piz_get_mate (vb)->mapq;
+    if (reconstruct) { RECONSTRUCT_INT (new_value->i) };
+
+    return true; // new value
+}
+
+SPECIAL_RECONSTRUCTOR (sam_piz_special_MC_MATE)
+{
+    const SamMateHistory *mate = sam_piz_get_mate (vb);
+    if (reconstruct) RECONSTRUCT (mate->cigar, mate->cigar_len);
+
+    return false; // no new value
+}
+
 SPECIAL_RECONSTRUCTOR (sam_piz_special_AS)
 {
     new_value->i = vb->seq_len - atoi (snip);
@@ -330,15 +461,16 @@ done:
 //-----------------------------------------------------------------
 
 // translate SAM ASCII sequence characters to BAM's 4-bit characters:
+// note: used only if sam_reconstruct_seq didn't already reconstruct the sequence in BAM format (eg with our aligner)
 TRANSLATOR_FUNC (sam_piz_sam2bam_SEQ)
 {
-    // the characters "=ACMGRSVTWYHKDBN" are mapped to BAM 0->15, in this matrix we add 0x80 as a validity bit. All other characters are 0x00 - invalid
-    static const uint8_t sam2bam_seq_map[256] = { ['=']=0x80, ['A']=0x81, ['C']=0x82, ['M']=0x83, ['G']=0x84, ['R']=0x85, ['S']=0x86, ['V']=0x87, 
-                                                  ['T']=0x88, ['W']=0x89, ['Y']=0x8a, ['H']=0x8b, ['K']=0x8c, ['D']=0x8d, ['B']=0x8e, ['N']=0x8f };
-    
+    // case: sam_reconstruct_seq already reconstructed the sequence in BAM format
+    if (ctx->semaphore) {
+        ctx->semaphore = false;
+        return 0;
+    }
+
     if (vb->dont_show_curr_line) return 0; // sequence was not reconstructed - nothing to translate
-    
-    static bool invalid_char_warning_shown = false; // we show this warning up to once per executipn
 
     BAMAlignmentFixed *alignment = (BAMAlignmentFixed *)ENT (char, vb->txt_data, vb->line_start);
     uint32_t l_seq = LTEN32 (alignment->l_seq);
@@ -349,22 +481,12 @@ TRANSLATOR_FUNC (sam_piz_sam2bam_SEQ)
         return 0;
     }
 
-    // if l_seq is odd, 0 the next byte that will be half of our last result byte
-    if (l_seq % 2) *AFTERENT (char, vb->txt_data) = 0; 
-
     uint8_t *seq_before=(uint8_t *)reconstructed, *seq_after=(uint8_t *)reconstructed; 
     for (uint32_t i=0; i < (l_seq+1)/2; i++, seq_after++, seq_before += 2) {
-        uint8_t base[2] = { sam2bam_seq_map[(uint8_t)seq_before[0]], sam2bam_seq_map[(uint8_t)seq_before[1]] };
-        
-        // check for invalid characters - issue warning (only once per execution), and make then into an 'N'
-        for (unsigned b=0; b < 2; b++)
-            if (!base[b] && !invalid_char_warning_shown && !(b==1 && (i+1)*2 > l_seq)) {
-                WARN ("Warning when converting SAM sequence data to BAM: invalid character encodered, it will be converted as 'N': '%c' (ASCII %u)", base[b], base[b]);
-                invalid_char_warning_shown = true;
-                base[b] = 0x0f;
-            }
+        uint8_t base0 = sam_piz_bam_base (seq_before[0]);
+        uint8_t base1 = ((i+1)*2 > l_seq) ? 0 : sam_piz_bam_base (seq_before[1]); // if l_seq is odd, the last low nibble is 0
 
-        *seq_after = (base[0] << 4) | (base[1] & 0x0f);
+        *seq_after = (base0 << 4) | base1;
     }
 
     vb->txt_data.len = vb->txt_data.len - l_seq + (l_seq+1)/2;
@@ -18,8 +18,26 @@ typedef struct {
     uint32_t qual_data_start, u2_data_start, bdbi_data_start[2]; // start within vb->txt_data
     uint32_t qual_data_len, u2_data_len; // length within vb->txt_data
     uint32_t seq_len;        // actual sequence length determined from any or or of: CIGAR, SEQ, QUAL. If more than one contains the length, they must all agree
+    uint32_t qname_index, qname_len; // QNAME within vb->txt_data - for finding the mate of a later line
+    uint32_t mate_hash_next; // next line (+1) in the same vb->mate_hash bucket, 0 if none
+    uint32_t cigar_index, cigar_len; // textual CIGAR within vb->mate_cigars
+    PosType pos;             // values that the mate of this line might copy
+    int32_t tlen;
+    uint8_t mapq;
+    bool has_mate;           // a later line has already been paired with this line
 } ZipDataLineSAM;
 
+// PIZ: values of a line that its mate, appearing later in the VB, might copy
+typedef struct {
+    PosType pos;
+    int32_t tlen;
+    uint8_t mapq;
+    uint32_t cigar_len;
+    const char *cigar;       // points into the CIGAR dictionary or local
+} SamMateHistory;
+
+#define NO_MATE ((uint32_t)-1)
+
 typedef struct VBlockSAM {
     VBLOCK_COMMON_FIELDS
     const char *last_cigar;        // ZIP/PIZ: last CIGAR
@@ -29,6 +47,16 @@ typedef struct VBlockSAM {
     uint32_t ref_consumed;         // ZIP/PIZ: how many bp of reference are consumed according to the last_cigar
     uint32_t ref_and_seq_consumed; // ZIP: how many bp in the last seq consumes both ref and seq, according to CIGAR
     Buffer bd_bi_line;             // ZIP: interlaced BD and BI data for one line
+    Buffer seps;                   // ZIP: Seg of SAM: offsets in txt_data of all tabs and newlines of the VB, see sam_seg_find_seps
+    uint32_t next_sep;             // ZIP: Seg of SAM: next entry in seps
+    Buffer mate_hash;              // ZIP: hash table of QNAME -> line_i+1 of the lines whose mate was not found yet
+    Buffer mate_cigars;            // ZIP: textual CIGARs of the lines of the VB
+    uint32_t mate_line_i;          // ZIP: line_i of the mate of the current line or NO_MATE. PIZ: rep of the mate of line mate_for_line_i
+    bool mate_delta_segged;        // ZIP: the line delta to the mate of the current line was already added to SAM_MATE.local
+    uint32_t mate_for_line_i;      // PIZ: vb->line_i for which mate_line_i is valid (0 if none - vb->line_i is 1-based in PIZ)
+    Buffer mate_history;           // PIZ: SamMateHistory of each line
+    const char *piz_cigar;         // PIZ: textual CIGAR of the current line
+    uint32_t piz_cigar_len;
 } VBlockSAM;
 
 // fixed-field part of a BAM alignment, see https://samtools.github.io/hts-specs/SAMv1.pdf
@@ -79,5 +107,8 @@ extern const char *bam_get_one_optional (VBlockSAM *vb, const char *next_field,
 extern uint16_t bam_reg2bin (int32_t first_pos, int32_t last_pos);
 extern void bam_seg_bin (VBlockSAM *vb, uint16_t bin, uint16_t flag, PosType this_pos);
 extern void sam_seg_verify_pos (VBlockP vb, PosType this_pos);
+extern void sam_seg_mate_find (VBlockSAM *vb, ZipDataLineSAM *dl, const char *qname, unsigned qname_len, uint16_t sam_flag);
+extern void sam_seg_mate_add_cigar (VBlockSAM *vb, ZipDataLineSAM *dl, const char *cigar, unsigned cigar_len);
+extern void sam_seg_pnext_field (VBlockSAM *vb, const char *pnext_str, unsigned pnext_len, PosType pnext, unsigned add_bytes);
 
 #endif
@@ -3,9 +3,13 @@
 //   Copyright (C) 2020 Divon Lan <divon@genozip.com>
 //   Please see terms and conditions in the files LICENSE.non-commercial.txt and LICENSE.commercial.txt
 
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 #include "sam_private.h"
 #include "reference.h"
 #include "seg.h"
+#include "tokenizer.h"
 #include "context.h"
 #include "file.h"
 #include "random_access.h"
@@ -127,6 +131,86 @@ bool sam_zip_dts_flag (void)
 // Seg stuff
 // ----------------------
 
+// Pre-pass over the entire VB, finding all the tabs and newlines, so that sam_seg_txt_line can get its fields with
+// offset arithmetic rather than scanning each line byte by byte
+static void sam_seg_find_seps (VBlockSAM *vb)
+{
+    ARRAY (const char, txt, vb->txt_data);
+
+    // on average, a SAM line has 11 mandatory fields and a handful of optional ones
+    buf_alloc (vb, &vb->seps, MAX (vb->lines.len, 1) * 20 * sizeof (uint32_t), 1, "seps");
+    vb->next_sep = 0;
+
+    uint64_t i=0;
+
+#ifdef __AVX2__
+    const __m256i tab = _mm256_set1_epi8 ('\t');
+    const __m256i nl  = _mm256_set1_epi8 ('\n');
+
+    for (; i + 32 <= txt_len; i += 32) {
+        __m256i data = _mm256_loadu_si256 ((const __m256i *)&txt[i]);
+        uint32_t mask = _mm256_movemask_epi8 (_mm256_or_si256 (_mm256_cmpeq_epi8 (data, tab), _mm256_cmpeq_epi8 (data, nl)));
+        if (!mask) continue;
+
+        buf_alloc_more (vb, &vb->seps, 32, 0, uint32_t, 1.5, "seps");
+        uint32_t *next = AFTERENT (uint32_t, vb->seps);
+
+        for (; mask; mask &= mask - 1)
+            *next++ = i + __builtin_ctz (mask);
+
+        vb->seps.len = next - FIRSTENT (uint32_t, vb->seps);
+    }
+#endif
+
+    // remaining bytes (or all bytes, if no AVX2)
+    for (; i < txt_len; i++)
+        if (txt[i] == '\t' || txt[i] == '\n') {
+            buf_alloc_more (vb, &vb->seps, 1, 0, uint32_t, 1.5, "seps");
+            NEXTENT (uint32_t, vb->seps) = i;
+        }
+}
+
+// same as seg_get_next_item, but using the separators found by sam_seg_find_seps
+static const char *sam_seg_get_next_item (VBlockSAM *vb, const char *str, int32_t *str_len, bool allow_newline, 
+                                          unsigned *len, char *separator, bool *has_13, const char *item_name)
+{
+    const char *sep = (vb->next_sep < vb->seps.len) ? ENT (const char, vb->txt_data, *ENT (uint32_t, vb->seps, vb->next_sep)) : NULL;
+
+    // case: no separator left (missing newline at the end of the data) or we are not in sync - revert to scanning
+    if (!sep || sep < str || sep - str >= *str_len) {
+        vb->seps.len = vb->next_sep = 0; 
+        return seg_get_next_item (vb, str, str_len, allow_newline, true, false, len, separator, has_13, item_name);
+    }
+
+    ASSSEG (*sep == '\t' || allow_newline, str, "while segmenting %s: expecting a TAB after \"%.*s\"", 
+            item_name, MIN ((int)(sep - str), 1000), str);
+
+    vb->next_sep++;
+    *len       = sep - str;
+    *separator = *sep;
+    *str_len  -= *len + 1;
+
+    // check for Windows-style '\r\n' end of line 
+    if (*sep == '\n' && *len && sep[-1] == '\r') {
+        (*len)--;
+        *has_13 = true;
+    }
+
+    return sep + 1; // beyond the separator
+}
+
+#define SAM_GET_NEXT_ITEM(item_name) do \
+    { field_start = next_field; \
+      next_field = sam_seg_get_next_item (vb, field_start, &len, false, &field_len, &separator, NULL, (item_name)); } while(0)
+
+#define SAM_SEG_NEXT_ITEM(f) do \
+    { SAM_GET_NEXT_ITEM (DTF(names)[f]); \
+      seg_by_did_i (vb, field_start, field_len, f, field_len+1); } while(0)
+
+#define SAM_GET_MAYBE_LAST_ITEM(item_name) do \
+    { field_start = next_field; \
+      next_field = sam_seg_get_next_item (vb, field_start, &len, true, &field_len, &separator, has_13, (item_name)); } while(0)
+
 void sam_seg_initialize (VBlock *vb)
 {
     START_TIMER;
@@ -159,6 +243,8 @@ void sam_seg_initialize (VBlock *vb)
 
     codec_acgt_comp_init (vb);
 
+    if (vb->data_type == DT_SAM) sam_seg_find_seps ((VBlockSAM *)vb);
+
     COPY_TIMER (seg_initialize);
 }
 
@@ -175,6 +261,7 @@ void sam_seg_finalize (VBlockP vb)
     SmallContainer top_level_sam = { 
         .repeats   = vb->lines.len,
         .is_toplevel = true,
+        .callback  = true, // sam_piz_container_cb records the values that later mates might copy
         .nitems_lo = 13,
         .items     = { { .dict_id = (DictId)dict_id_fields[SAM_QNAME],    .seperator = "\t" },
                        { .dict_id = (DictId)dict_id_fields[SAM_FLAG],     .seperator = "\t" },
@@ -199,6 +286,7 @@ void sam_seg_finalize (VBlockP vb)
     SmallContainer top_level_bam = { 
         .repeats   = vb->lines.len,
         .is_toplevel = true,
+        .callback  = true,
         .nitems_lo = 13,
         .items     = { { .dict_id = (DictId)dict_id_fields[SAM_RNAME],    .seperator = { CI_TRANS_NOR                    }, SAM2BAM_RNAME    }, // Translate - output word_index instead of string
                        { .dict_id = (DictId)dict_id_fields[SAM_POS],      .seperator = { CI_TRANS_NOR | CI_TRANS_MOVE, 1 }, SAM2BAM_POS      }, // Translate - output little endian POS-1
@@ -258,10 +346,111 @@ void sam_seg_verify_pos (VBlock *vb, PosType this_pos)
             this_pos, vb->chrom_name_len, vb->chrom_name, max_pos, vb->vblock_i, vb->line_i, vb->chrom_node_index);
 }
 
-// TLEN - 3 cases: 
+// ----------------------------------------------------------------------------------------------
+// Mates: in a coordinate-sorted file, the mate of a read usually appears later in the same VB.
+// We find it by QNAME, and seg the fields that are redundant with the mate's (PNEXT, TLEN, MQ:i and MC:Z)
+// as a copy of the mate's values. The line delta to the mate is stored in SAM_MATE.local, once per line
+// with at least one copied field. Copying is only used after verifying that the values are indeed equal,
+// so pairing with the wrong line (eg a secondary alignment) only costs compression, not correctness.
+// ----------------------------------------------------------------------------------------------
+
+static inline uint32_t sam_seg_mate_hash (const char *qname, unsigned qname_len, uint32_t hash_len)
+{
+    uint32_t hash = 2166136261; // FNV-1a
+    for (unsigned i=0; i < qname_len; i++) hash = (hash ^ (uint8_t)qname[i]) * 16777619;
+    return hash & (hash_len - 1);
+}
+
+// called after QNAME and FLAG are known - sets vb->mate_line_i to the earlier line with the same QNAME, if there is one
+void sam_seg_mate_find (VBlockSAM *vb, ZipDataLineSAM *dl, const char *qname, unsigned qname_len, uint16_t sam_flag)
+{
+    vb->mate_line_i       = NO_MATE;
+    vb->mate_delta_segged = false;
+
+    dl->qname_index    = qname - vb->txt_data.data;
+    dl->qname_len      = qname_len;
+    dl->mate_hash_next = 0;
+    dl->has_mate       = false;
+
+    if (sam_flag & (0x100 | 0x800)) return; // secondary and supplementary alignments are not paired
+
+    if (!vb->mate_hash.len) {
+        uint64_t hash_len = 1024;
+        while (hash_len < vb->lines.len * 2) hash_len *= 2;
+
+        buf_alloc (vb, &vb->mate_hash, hash_len * sizeof (uint32_t), 1, "mate_hash");
+        vb->mate_hash.len = hash_len;
+        buf_zero (&vb->mate_hash);
+    }
+
+    uint32_t *bucket = ENT (uint32_t, vb->mate_hash, sam_seg_mate_hash (qname, qname_len, vb->mate_hash.len));
+
+    // with --checkpoints, PIZ might start reconstructing the VB at a checkpoint - so the mate must be after it
+    uint32_t first_line_i = flag.checkpoint_lines ? (vb->line_i - vb->line_i % flag.checkpoint_lines) : 0;
+
+    for (uint32_t line_i_p1 = *bucket; line_i_p1; line_i_p1 = DATA_LINE (line_i_p1-1)->mate_hash_next) {
+        ZipDataLineSAM *mate_dl = DATA_LINE (line_i_p1-1);
+
+        if (!mate_dl->has_mate && line_i_p1-1 >= first_line_i && mate_dl->qname_len == qname_len && 
+            !memcmp (ENT (char, vb->txt_data, mate_dl->qname_index), qname, qname_len)) {
+            mate_dl->has_mate = true;
+            vb->mate_line_i = line_i_p1-1;
+            return;
+        }
+    }
+
+    // mate not found - add this line to the hash table, so its mate can find it
+    dl->mate_hash_next = *bucket;
+    *bucket = vb->line_i + 1;
+}
+
+void sam_seg_mate_add_cigar (VBlockSAM *vb, ZipDataLineSAM *dl, const char *cigar, unsigned cigar_len)
+{
+    dl->cigar_index = vb->mate_cigars.len;
+    dl->cigar_len   = cigar_len;
+
+    buf_alloc_more (vb, &vb->mate_cigars, cigar_len, vb->lines.len * 8, char, 2, "mate_cigars");
+    buf_add (&vb->mate_cigars, cigar, cigar_len);
+}
+
+// returns the data line of the mate of the current line, and stores the line delta to it (once per line)
+static ZipDataLineSAM *sam_seg_mate_use (VBlockSAM *vb)
+{
+    if (!vb->mate_delta_segged) {
+        Context *ctx = &vb->contexts[SAM_MATE];
+        ctx->ltype = LT_UINT32;
+
+        buf_alloc_more (vb, &ctx->local, 1, vb->lines.len / 2, uint32_t, CTX_GROWTH, "contexts->local");
+        NEXTENT (uint32_t, ctx->local) = BGEN32 (vb->line_i - vb->mate_line_i);
+        vb->mate_delta_segged = true;
+    }
+
+    return DATA_LINE (vb->mate_line_i);
+}
+
+void sam_seg_pnext_field (VBlockSAM *vb, const char *pnext_str, unsigned pnext_len, PosType pnext, unsigned add_bytes)
+{
+    if (pnext_str && !str_get_int (pnext_str, pnext_len, &pnext)) pnext = 0; // not a valid integer - seg normally
+
+    if (vb->mate_line_i != NO_MATE && pnext && pnext == DATA_LINE (vb->mate_line_i)->pos) {
+        sam_seg_mate_use (vb);
+
+        Context *ctx = &vb->contexts[SAM_PNEXT];
+        ctx->last_value.i = pnext;
+        ctx->last_delta   = pnext - vb->contexts[SAM_POS].last_value.i; // same as sam_piz_special_PNEXT_MATE, needed for TLEN
+
+        const char special[2] = { SNIP_SPECIAL, SAM_SPECIAL_PNEXT_MATE };
+        seg_by_ctx (vb, special, 2, ctx, add_bytes);
+    }
+    else
+        seg_pos_field ((VBlockP)vb, SAM_PNEXT, SAM_POS, false, pnext_str, pnext_len, pnext, add_bytes);
+}
+
+// TLEN - 4 cases: 
 // 1. if a non-zero value that is the negative of the previous line - a SNIP_DELTA & "-" (= value negation)
-// 2. else, tlen>0 and pnext_pos_delta>0 and seq_len>0 tlen is stored as SNIP_SPECIAL & tlen-pnext_pos_delta-seq_len
-// 3. else, stored as is
+// 2. else, if a non-zero value that is the negative of the mate's TLEN - SNIP_SPECIAL & SAM_SPECIAL_TLEN_MATE
+// 3. else, tlen>0 and pnext_pos_delta>0 and seq_len>0 tlen is stored as SNIP_SPECIAL & tlen-pnext_pos_delta-seq_len
+// 4. else, stored as is
 void sam_seg_tlen_field (VBlockSAM *vb, 
                          const char *tlen, unsigned tlen_len, // option 1
                          int64_t tlen_value, // option 2
@@ -283,7 +472,13 @@ void sam_seg_tlen_field (VBlockSAM *vb,
         char snip_delta[2] = { SNIP_SELF_DELTA, '-' };
         seg_by_ctx (vb, snip_delta, 2, ctx, add_bytes);
     }
-    // case 2:
+    // case 2: TLEN is the negative of the mate's TLEN (if the mate is the previous line, case 1 already covers it)
+    else if (tlen_value && vb->mate_line_i != NO_MATE && tlen_value == -DATA_LINE (vb->mate_line_i)->tlen) {
+        sam_seg_mate_use (vb);
+        const char special[2] = { SNIP_SPECIAL, SAM_SPECIAL_TLEN_MATE };
+        seg_by_ctx (vb, special, 2, ctx, add_bytes);
+    }
+    // case 3:
     else if (tlen_value > 0 && pnext_pos_delta > 0 && cigar_seq_len > 0) {
         char tlen_by_calc[30] = { SNIP_SPECIAL, SAM_SPECIAL_TLEN };
         unsigned tlen_by_calc_len = str_int (tlen_value - pnext_pos_delta - (int64_t)cigar_seq_len, &tlen_by_calc[2]);
@@ -301,6 +496,7 @@ void sam_seg_tlen_field (VBlockSAM *vb,
     }
 
     ctx->last_value.i = tlen_value;
+    DATA_LINE (vb->line_i)->tlen = tlen_value;
 }
 
 // Creates a bitmap from seq data - exactly one bit per base that is mapped to the reference (e.g. not for INSERT bases)
@@ -901,6 +1097,28 @@ static void sam_seg_array_field (VBlock *vb, DictId dict_id, const char *value,
 
 // process an optional subfield, that looks something like MX:Z:abcdefg. We use "MX" for the field name, and
 // the data is abcdefg. The full name "MX:Z:" is stored as part of the OPTIONAL dictionary entry
+static bool sam_seg_is_mate_mapq (VBlockSAM *vb, const char *value, unsigned value_len)
+{
+    int64_t mq;
+    if (vb->mate_line_i == NO_MATE || !str_get_int (value, value_len, &mq) || mq != DATA_LINE (vb->mate_line_i)->mapq)
+        return false;
+
+    sam_seg_mate_use (vb);
+    return true;
+}
+
+static bool sam_seg_is_mate_cigar (VBlockSAM *vb, const char *value, unsigned value_len)
+{
+    if (vb->mate_line_i == NO_MATE) return false;
+
+    ZipDataLineSAM *mate_dl = DATA_LINE (vb->mate_line_i);
+    if (mate_dl->cigar_len != value_len || memcmp (ENT (char, vb->mate_cigars, mate_dl->cigar_index), value, value_len))
+        return false;
+
+    sam_seg_mate_use (vb);
+    return true;
+}
+
 static DictId sam_seg_optional_field (VBlockSAM *vb, ZipDataLineSAM *dl, bool is_bam, 
                                       const char *tag, char bam_type, const char *value, unsigned value_len)
 {
@@ -916,6 +1134,18 @@ static DictId sam_seg_optional_field (VBlockSAM *vb, ZipDataLineSAM *dl, bool is
     else if (dict_id.num == dict_id_OPTION_XA) 
         sam_seg_XA_field (vb, value, value_len);
 
+    // MQ:i is normally the MAPQ of the mate
+    else if (dict_id.num == dict_id_OPTION_MQ && sam_seg_is_mate_mapq (vb, value, value_len)) {
+        const char special[2] = { SNIP_SPECIAL, SAM_SPECIAL_MQ_MATE };
+        seg_by_dict_id (vb, special, 2, dict_id, add_bytes); 
+    }
+
+    // MC:Z is normally the CIGAR of the mate
+    else if (dict_id.num == dict_id_OPTION_MC && sam_seg_is_mate_cigar (vb, value, value_len)) {
+        const char special[2] = { SNIP_SPECIAL, SAM_SPECIAL_MC_MATE };
+        seg_by_dict_id (vb, special, 2, dict_id_OPTION_CIGAR, add_bytes); 
+    }
+
     // fields containing CIGAR format data - aliases of dict_id_OPTION_CIGAR (not the main CIGAR field that all snips have SNIP_SPECIAL)
     else if (dict_id.num == dict_id_OPTION_MC || dict_id.num == dict_id_OPTION_OC) 
         seg_by_dict_id (vb, value, value_len, dict_id_OPTION_CIGAR, add_bytes); 
@@ -1022,7 +1252,7 @@ const char *sam_get_one_optional (VBlockSAM *vb, const char *next_field, int32_t
     const char *field_start;
 
     char separator;
-    GET_MAYBE_LAST_ITEM ("OPTIONAL-subfield"); 
+    SAM_GET_MAYBE_LAST_ITEM ("OPTIONAL-subfield"); 
 
     ASSSEG0 (field_len, field_start, "line invalidly ends with a tab");
 
@@ -1177,42 +1407,51 @@ const char *sam_seg_txt_line (VBlock *vb_, const char *field_start_line, uint32_
     // QNAME - We break down the QNAME into subfields separated by / and/or : - these are vendor-defined strings. Examples:
     // Illumina: <instrument>:<run number>:<flowcell ID>:<lane>:<tile>:<x-pos>:<y-pos> for example "A00488:61:HMLGNDSXX:4:1101:15374:1031" see here: https://help.basespace.illumina.com/articles/descriptive/fastq-files/
     // PacBio BAM: {movieName}/{holeNumber}/{qStart}_{qEnd} see here: https://pacbiofileformats.readthedocs.io/en/3.0/BAM.html
-    GET_NEXT_ITEM ("QNAME");
+    SAM_GET_NEXT_ITEM ("QNAME");
     SegCompoundArg arg = { .slash = true, .pipe = true, .dot = true, .colon = true };
-    seg_compound_field ((VBlockP)vb, &vb->contexts[SAM_QNAME], field_start, field_len, arg, 0, 1 /* \n */);
+    tokenizer_seg ((VBlockP)vb, &vb->contexts[SAM_QNAME], field_start, field_len, arg, 0, 1 /* \n */);
+
+    const char *qname = field_start;
+    unsigned qname_len = field_len;
 
-    SEG_NEXT_ITEM (SAM_FLAG);
+    SAM_SEG_NEXT_ITEM (SAM_FLAG);
     int64_t flag;
     ASSSEG (str_get_int (field_start, field_len, &flag), field_start, "invalid FLAG field: %.*s", field_len, field_start);
 
-    GET_NEXT_ITEM ("RNAME");
+    sam_seg_mate_find (vb, dl, qname, qname_len, (uint16_t)flag);
+
+    SAM_GET_NEXT_ITEM ("RNAME");
     seg_chrom_field (vb_, field_start, field_len);
 
     // note: pos can have a value even if RNAME="*" - this happens if a SAM with a RNAME that is not in the header is converted to BAM with samtools
-    GET_NEXT_ITEM ("POS");
+    SAM_GET_NEXT_ITEM ("POS");
     PosType this_pos = seg_pos_field (vb_, SAM_POS, SAM_POS, false, field_start, field_len, 0, field_len+1);
     sam_seg_verify_pos (vb_, this_pos);
+    dl->pos = this_pos;
     
     random_access_update_pos (vb_, SAM_POS);
 
-    SEG_NEXT_ITEM (SAM_MAPQ);
+    SAM_SEG_NEXT_ITEM (SAM_MAPQ);
+    int64_t mapq;
+    if (str_get_int (field_start, field_len, &mapq)) dl->mapq = (uint8_t)mapq;
 
     // CIGAR - we wait to get more info from SEQ and QUAL
-    GET_NEXT_ITEM ("CIGAR");
+    SAM_GET_NEXT_ITEM ("CIGAR");
     sam_analyze_cigar (vb, field_start, field_len, &dl->seq_len, &vb->ref_consumed, &vb->ref_and_seq_consumed);
+    sam_seg_mate_add_cigar (vb, dl, field_start, field_len);
     vb->last_cigar = field_start;
     unsigned last_cigar_len = field_len;
     ((char *)vb->last_cigar)[field_len] = 0; // nul-terminate CIGAR string
 
-    SEG_NEXT_ITEM (SAM_RNEXT);
+    SAM_SEG_NEXT_ITEM (SAM_RNEXT);
     
-    GET_NEXT_ITEM ("PNEXT");
-    seg_pos_field (vb_, SAM_PNEXT, SAM_POS, false, field_start, field_len, 0, field_len+1);
+    SAM_GET_NEXT_ITEM ("PNEXT");
+    sam_seg_pnext_field (vb, field_start, field_len, 0, field_len+1);
 
-    GET_NEXT_ITEM ("TLEN");
+    SAM_GET_NEXT_ITEM ("TLEN");
     sam_seg_tlen_field (vb, field_start, field_len, 0, vb->contexts[SAM_PNEXT].last_delta, dl->seq_len);
 
-    GET_NEXT_ITEM ("SEQ");
+    SAM_GET_NEXT_ITEM ("SEQ");
 
     ASSSEG (dl->seq_len == field_len || vb->last_cigar[0] == '*' || field_start[0] == '*', field_start, 
             "seq_len implied by CIGAR=%s is %u, but actual SEQ length is %u, SEQ=%.*s", 
@@ -1223,7 +1462,7 @@ const char *sam_seg_txt_line (VBlock *vb_, const char *field_start_line, uint32_
     const char *seq = field_start;
     uint32_t seq_data_len = field_len;
 
-    GET_MAYBE_LAST_ITEM ("QUAL");
+    SAM_GET_MAYBE_LAST_ITEM ("QUAL");
     sam_seg_qual_field (vb, dl, field_start, field_len, field_len + 1); 
 
     // finally we can seg CIGAR now
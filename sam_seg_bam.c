@@ -13,6 +13,7 @@
 #include "endianness.h"
 #include "sam_private.h"
 #include "seg.h"
+#include "tokenizer.h"
 #include "strings.h"
 #include "random_access.h"
 #include "dict_id.h"
@@ -343,6 +344,10 @@ const char *bam_seg_txt_line (VBlock *vb_, const char *alignment /* BAM terminol
 
     // *** segment fixed-length fields ***
 
+    sam_seg_mate_find (vb, dl, next_field, l_read_name-1, sam_flag); // QNAME is right after the fixed-length fields
+    dl->pos  = this_pos;
+    dl->mapq = mapq;
+
     bam_seg_ref_id (vb_, SAM_RNAME, ref_id, -1); // ref_id (RNAME)
 
     // note: pos can have a value even if ref_id=-1 (RNAME="*") - this happens if a SAM with a RNAME that is not in the header is converted to BAM with samtools
@@ -357,13 +362,13 @@ const char *bam_seg_txt_line (VBlock *vb_, const char *alignment /* BAM terminol
     
     bam_seg_ref_id (vb_, SAM_RNEXT, next_ref_id, ref_id); // RNEXT
 
-    seg_pos_field (vb_, SAM_PNEXT, SAM_POS, false, 0, 0, next_pos, sizeof (uint32_t)); // PNEXT
+    sam_seg_pnext_field (vb, 0, 0, next_pos, sizeof (uint32_t)); // PNEXT
 
     sam_seg_tlen_field (vb, 0, 0, (int64_t)tlen, vb->contexts[SAM_PNEXT].last_delta, dl->seq_len); // TLEN
 
     SegCompoundArg arg = { .slash = true, .pipe = true, .dot = true, .colon = true };
-    seg_compound_field ((VBlockP)vb, &vb->contexts[SAM_QNAME], next_field, // QNAME
-                        l_read_name-1, arg, 0, 2 /* account for \0 and l_read_name */); 
+    tokenizer_seg ((VBlockP)vb, &vb->contexts[SAM_QNAME], next_field, // QNAME
+                   l_read_name-1, arg, 0, 2 /* account for \0 and l_read_name */); 
     next_field += l_read_name; // inc. \0
 
     // *** ingest & segment variable-length fields ***
@@ -371,6 +376,7 @@ const char *bam_seg_txt_line (VBlock *vb_, const char *alignment /* BAM terminol
     // CIGAR
     bam_rewrite_cigar (vb, n_cigar_op, (uint32_t*)next_field); // re-write BAM format CIGAR as SAM textual format in vb->textual_cigar
     sam_analyze_cigar (vb, vb->textual_cigar.data, vb->textual_cigar.len, &dl->seq_len, &vb->ref_consumed, &vb->ref_and_seq_consumed);
+    sam_seg_mate_add_cigar (vb, dl, vb->textual_cigar.data, vb->textual_cigar.len);
     next_field += n_cigar_op * sizeof (uint32_t);
 
     // Segment BIN after we've gathered bin, flags, pos and vb->ref_confumed (and before sam_seg_seq_field which ruins vb->ref_consumed)
@@ -30,7 +30,17 @@ void sam_vb_release_vb (VBlockSAM *vb)
 {
     vb->last_cigar = NULL;
     vb->ref_consumed = vb->ref_and_seq_consumed = 0;
+    vb->next_sep = 0;
+    vb->mate_line_i = NO_MATE;
+    vb->mate_delta_segged = false;
+    vb->mate_for_line_i = 0;
+    vb->piz_cigar = NULL;
+    vb->piz_cigar_len = 0;
     buf_free (&vb->bd_bi_line);
+    buf_free (&vb->seps);
+    buf_free (&vb->mate_hash);
+    buf_free (&vb->mate_cigars);
+    buf_free (&vb->mate_history);
     buf_free (&vb->textual_cigar);
     buf_free (&vb->textual_seq);
     buf_free (&vb->textual_opt);
@@ -39,6 +49,10 @@ void sam_vb_release_vb (VBlockSAM *vb)
 void sam_vb_destroy_vb (VBlockSAM *vb)
 {
     buf_destroy (&vb->bd_bi_line);
+    buf_destroy (&vb->seps);
+    buf_destroy (&vb->mate_hash);
+    buf_destroy (&vb->mate_cigars);
+    buf_destroy (&vb->mate_history);
     buf_destroy (&vb->textual_cigar);
     buf_destroy (&vb->textual_seq);
     buf_destroy (&vb->textual_opt);
@@ -29,6 +29,7 @@ typedef enum __attribute__ ((__packed__)) { // 1 byte
     SEC_REF_ALT_CHROMS  = 13,
     SEC_STATS           = 14,
     SEC_BGZF            = 15, // optionally appears per component (txt header) and contains the uncompressed sizes of the source file bgzf block
+    SEC_ZSTD_DICTS      = 16, // optionally appears once per z_file and contains the ZSTD dictionaries trained on vb=1 (introduced v12)
 
     NUM_SEC_TYPES // fake section for counting
 } SectionType;
@@ -51,6 +52,7 @@ typedef enum __attribute__ ((__packed__)) { // 1 byte
     {"SEC_REF_ALT_CHROMS",  sizeof (SectionHeader)              }, \
     {"SEC_STATS",           sizeof (SectionHeader)              }, \
     {"SEC_BGZF",            sizeof (SectionHeader)              }, \
+    {"SEC_ZSTD_DICTS",      sizeof (SectionHeader)              }, \
 }
 
 // Section headers - big endian
@@ -96,6 +98,7 @@ typedef union SectionFlags {
         uint8_t all_the_same     : 1; // the b250 data contains only one element, and should be used to reconstruct any number of snips from this context
         #define ctxs_dot_is_0    ctx_specific // used in dict_id_FORMAT_GT_SHARK_GT between 10.0.3 and 10.0.8
         uint8_t ctx_specific     : 1; // flag specific a context (introduced 10.0.3)
+        uint8_t chunked          : 1; // SEC_LOCAL: data consists of independently compressed chunks, preceded by a chunk table (see compressor.c; introduced v12)
     } ctx;
     
 } SectionFlags;
@@ -0,0 +1,356 @@
+// ------------------------------------------------------------------
+//   seqsearch.c
+//   Copyright (C) 2020 Divon Lan <divon@genozip.com>
+//   Please see terms and conditions in the files LICENSE.non-commercial.txt and LICENSE.commercial.txt
+
+// Sequence search in FASTQ: genocat --kmer shows only reads that contain a sequence (or its reverse complement), and
+// genocat --ref-region shows only reads that were aligned (when compressed with --reference) to an interval of the reference.
+// In both cases, the I/O thread decides for each VB if it might have any such reads, by uncompressing a single small
+// section of the VB, and skipped VBs are not read further, uncompressed or reconstructed. Reads of the included VBs are
+// filtered by fastq_piz_filter during reconstruction.
+//
+// --kmer: with --kmer-index, ZIP stores for each VB a sketch of the minimizers of its reads: for every window of SS_W
+// consecutive SS_M-mers of a read (all-ACGT), the SS_M-mer with the minimal hash, in canonical form (the smaller of the
+// SS_M-mer and its reverse complement). A read containing the requested sequence contains each of its windows, and hence
+// each of their minimizers, in either orientation - so a VB is skipped if any minimizer of the requested sequence is absent.
+// This requires the requested sequence to be at least SS_M+SS_W-1 bases - shorter sequences can't skip VBs. The sketch
+// is a 1-hash Bloom filter, sized by the VB data, and folded in half as long it remains sparse. It is stored as the local data
+// (LT_UINT32) of the dict_id_KMERSKETCH context: bits_log2, m, w, bloom filter (2^bits_log2 / 32 words)
+//
+// --ref-region: the reads' GPOS (position in the reference genome) is already in the file, so no index is needed - the
+// I/O thread uncompresses the GPOS local section of the VB and tests if any read overlaps the requested interval. This is
+// not possible for the 2nd file of a --pair, whose GPOS is mostly stored as a delta vs the 1st file - these VBs are
+// filtered by read only.
+
+#include "genozip.h"
+#include "seqsearch.h"
+#include "vblock.h"
+#include "context.h"
+#include "dict_id.h"
+#include "flags.h"
+#include "buffer.h"
+#include "zfile.h"
+#include "file.h"
+#include "sections.h"
+#include "endianness.h"
+#include "bit_array.h"
+#include "reference.h"
+#include "refhash.h"
+#include "strings.h"
+
+#define SS_M              15  // minimizer length in bases - must be at most 31
+#define SS_W              16  // number of consecutive m-mers in a window - must be at most SS_MAX_W
+#define SS_MAX_W          32
+#define SS_MIN_BITS_LOG2  10
+#define SS_MAX_BITS_LOG2  27  // 16MB before folding
+#define SS_HDR_WORDS      3
+
+// 1 + 2-bit code of the base, or 0 if not an upper-case A,C,G,T
+static const uint8_t ss_base[256] = { ['A']=1, ['C']=2, ['G']=3, ['T']=4 };
+
+static inline uint32_t ss_hash (uint64_t mmer)
+{
+    return (uint32_t)((mmer * 0x9E3779B97F4A7C15ULL) >> 32);
+}
+
+// runs code for the minimizer (hash) of each window of w m-mers, skipping repeats of the same minimizer in consecutive windows
+#define SS_FOREACH_MINIMIZER(seq, seq_len, m, w, code) {                            \
+    const uint64_t mmask = (1ULL << (2*(m))) - 1;                                   \
+    uint64_t fwd=0, rev=0;                                                          \
+    uint32_t ring[SS_MAX_W], num_bases=0, num_mmers=0, last_min=0;                  \
+    for (uint32_t i=0; i < (seq_len); i++) {                                        \
+        uint8_t b = ss_base[(uint8_t)(seq)[i]];                                     \
+        if (!b) { num_bases = num_mmers = 0; continue; } /* new run */              \
+        b--;                                                                        \
+        fwd = ((fwd << 2) | b) & mmask;                                             \
+        rev = (rev >> 2) | ((uint64_t)(3-b) << (2*((m)-1)));                        \
+        if (++num_bases < (m)) continue;                                            \
+        ring[num_mmers % (w)] = ss_hash (MIN (fwd, rev));                           \
+        if (++num_mmers < (w)) continue;                                            \
+        uint32_t minimizer = ring[0];                                               \
+        for (uint32_t r=1; r < (w); r++)                                            \
+            if (ring[r] < minimizer) minimizer = ring[r];                           \
+        if (num_mmers == (w) || minimizer != last_min) { code; }                    \
+        last_min = minimizer;                                                       \
+    }                                                                               \
+}
+
+// --------------------
+// ZIP stuff
+// --------------------
+
+typedef struct {
+    uint32_t bits_log2;
+    uint64_t bloom[];
+} KmerSketchZip;
+
+// ZIP compute thread: called from fastq_seg_initialize. We expect about one minimizer per (SS_W+1)/2 bases, and we
+// allocate about 8 bits per minimizer, so that the filter is at most ~12% full (before folding)
+void seqsearch_zip_initialize (VBlockP vb, Buffer *sketch)
+{
+    uint64_t expected_minimizers = vb->txt_data.len / (SS_W + 1); // ~half of the FASTQ data are bases
+
+    uint32_t bits_log2 = SS_MIN_BITS_LOG2;
+    while (bits_log2 < SS_MAX_BITS_LOG2 && (1ULL << bits_log2) < expected_minimizers * 8) bits_log2++;
+
+    uint64_t size = sizeof (KmerSketchZip) + (1ULL << bits_log2) / 8;
+    buf_alloc (vb, sketch, size, 1, "kmer_sketch");
+    memset (sketch->data, 0, size);
+
+    ((KmerSketchZip *)sketch->data)->bits_log2 = bits_log2;
+}
+
+// ZIP compute thread: called for the SEQ of each read
+void seqsearch_zip_add_seq (Buffer *sketch, const char *seq, uint32_t seq_len)
+{
+    KmerSketchZip *ks = (KmerSketchZip *)sketch->data;
+    const uint32_t mask = (uint32_t)((1ULL << ks->bits_log2) - 1);
+
+    SS_FOREACH_MINIMIZER (seq, seq_len, SS_M, SS_W, {
+        uint32_t h = minimizer & mask;
+        ks->bloom[h >> 6] |= 1ULL << (h & 63);
+    });
+}
+
+// ZIP compute thread: called from fastq_seg_finalize - fold the Bloom filter, and move the sketch to the local of the KMERSKETCH context
+void seqsearch_zip_finalize (VBlockP vb, Buffer *sketch)
+{
+    KmerSketchZip *ks = (KmerSketchZip *)sketch->data;
+    if (!vb->lines.len) return;
+
+    // fold the filter in half (bit i is OR'ed into bit i mod nbits/2) as long as it remains at most 25% full after folding
+    BitArray bloom = { .type = BITARR_REGULAR, .words = ks->bloom, .nbits = 1ULL << ks->bits_log2, .nwords = (1ULL << ks->bits_log2) / 64 };
+
+    while (ks->bits_log2 > SS_MIN_BITS_LOG2 && bit_array_num_bits_set (&bloom) <= bloom.nbits / 8) {
+        ks->bits_log2--;
+        bloom.nbits  /= 2;
+        bloom.nwords /= 2;
+        for (uint64_t w=0; w < bloom.nwords; w++) ks->bloom[w] |= ks->bloom[w + bloom.nwords];
+    }
+
+    Context *ks_ctx = ctx_get_ctx (vb, dict_id_KMERSKETCH);
+    ks_ctx->ltype    = LT_UINT32;
+    ks_ctx->no_stons = true;
+
+    uint64_t len = SS_HDR_WORDS + bloom.nwords * 2;
+    buf_alloc (vb, &ks_ctx->local, len * sizeof (uint32_t), 1, "contexts->local");
+    ks_ctx->local.len = len;
+
+    uint32_t *w = FIRSTENT (uint32_t, ks_ctx->local);
+    *w++ = BGEN32 (ks->bits_log2);
+    *w++ = BGEN32 (SS_M);
+    *w++ = BGEN32 (SS_W);
+
+    for (uint64_t i=0; i < bloom.nwords; i++) {
+        *w++ = BGEN32 ((uint32_t)ks->bloom[i]); *w++ = BGEN32 ((uint32_t)(ks->bloom[i] >> 32));
+    }
+
+    buf_free (sketch);
+}
+
+// --------------------
+// PIZ stuff
+// --------------------
+
+typedef struct { PosType start, end; } GposRange; // both inclusive
+
+static struct {
+    char *kmer, *kmer_revcomp;    // the requested sequence (upper case) and its reverse complement
+    uint32_t kmer_len;
+    uint32_t m, w;                // the minimizer parameters for which minimizers was calculated
+    uint32_t num_minimizers;
+    uint32_t *minimizers;
+    Buffer gpos_ranges;           // GposRange - the parts of the reference covered by --ref-region
+    uint32_t max_seq_len;         // longest read in the file
+} query = { .gpos_ranges = EMPTY_BUFFER };
+
+static void seqsearch_piz_prepare_kmer (void)
+{
+    query.kmer_len     = strlen (flag.kmer);
+    query.kmer         = MALLOC (query.kmer_len + 1);
+    query.kmer_revcomp = MALLOC (query.kmer_len + 1);
+
+    for (uint32_t i=0; i < query.kmer_len; i++) {
+        char c = flag.kmer[i];
+        if (c >= 'a' && c <= 'z') c -= 32;
+
+        ASSINP (ss_base[(uint8_t)c], "Error: --kmer expects a sequence of A,C,G,T but \"%s\" has '%c'", flag.kmer, flag.kmer[i]);
+
+        query.kmer[i] = c;
+        query.kmer_revcomp[query.kmer_len-1 - i] = "TGCA"[ss_base[(uint8_t)c] - 1];
+    }
+    query.kmer[query.kmer_len] = query.kmer_revcomp[query.kmer_len] = 0;
+}
+
+// the minimizers of the requested sequence, with the parameters of the sketch
+static void seqsearch_piz_prepare_minimizers (uint32_t m, uint32_t w)
+{
+    if (query.minimizers && query.m == m && query.w == w) return; // already prepared
+
+    FREE (query.minimizers);
+    query.minimizers     = MALLOC ((query.kmer_len + 1) * sizeof (uint32_t));
+    query.num_minimizers = 0;
+    query.m = m;
+    query.w = w;
+
+    SS_FOREACH_MINIMIZER (query.kmer, query.kmer_len, m, w, { query.minimizers[query.num_minimizers++] = minimizer; });
+}
+
+// converts --ref-region <contig>[:<start>-<end>] to ranges of GPOS. A contig might consist of several ranges in the reference
+static void seqsearch_piz_prepare_ref_region (void)
+{
+    char *region = MALLOC (strlen (flag.ref_region) + 1);
+    strcpy (region, flag.ref_region);
+
+    PosType start_pos = 1, end_pos = MAX_POS;
+
+    char *colon = strrchr (region, ':');
+    if (colon) {
+        *colon = 0;
+        char *dash = strchr (colon+1, '-');
+        ASSINP (dash && str_get_int (colon+1, dash - (colon+1), &start_pos) &&
+                (!dash[1] || str_get_int (dash+1, strlen (dash+1), &end_pos)) && start_pos <= end_pos,
+                "Error: invalid --ref-region \"%s\". Expecting <contig>[:<start>-<end>]", flag.ref_region);
+    }
+
+    ConstBufferP contig_dict, contigs;
+    ref_contigs_get (&contig_dict, &contigs);
+
+    buf_free (&query.gpos_ranges);
+    ARRAY (const RefContig, rc, *contigs);
+    bool found = false;
+
+    for (uint64_t i=0; i < contigs->len; i++) {
+        if (strcmp (ENT (const char, *contig_dict, rc[i].char_index), region)) continue;
+        found = true;
+
+        PosType start = MAX (start_pos, rc[i].min_pos);
+        PosType end   = MIN (end_pos,   rc[i].max_pos);
+        if (start > end) continue;
+
+        buf_alloc_more (evb, &query.gpos_ranges, 1, 8, GposRange, 2, "query.gpos_ranges");
+        NEXTENT (GposRange, query.gpos_ranges) = (GposRange){ .start = rc[i].gpos + start - rc[i].min_pos,
+                                                              .end   = rc[i].gpos + end   - rc[i].min_pos };
+    }
+
+    ASSINP (found, "Error: contig \"%s\" of --ref-region was not found in the reference", region);
+    FREE (region);
+
+    // the longest read in the file - the SQBITMAP dictionary consists of LOOKUP snips with the read length
+    Context *bitmap_ctx = &z_file->contexts[FASTQ_SQBITMAP];
+    ARRAY (const CtxWord, word, bitmap_ctx->word_list);
+
+    query.max_seq_len = 0;
+    for (uint64_t i=0; i < bitmap_ctx->word_list.len; i++) {
+        const char *snip = ENT (const char, bitmap_ctx->dict, word[i].char_index);
+        int64_t seq_len;
+        if (word[i].snip_len > 1 && snip[0] == SNIP_LOOKUP && str_get_int (&snip[1], word[i].snip_len - 1, &seq_len))
+            query.max_seq_len = MAX (query.max_seq_len, (uint32_t)seq_len);
+    }
+}
+
+// PIZ I/O thread: called from fastq_piz_initialize, after the dictionaries and reference contigs are loaded
+void seqsearch_piz_initialize (void)
+{
+    if (flag.kmer && !query.kmer) seqsearch_piz_prepare_kmer();
+
+    if (flag.ref_region) seqsearch_piz_prepare_ref_region();
+}
+
+static inline bool seqsearch_piz_is_overlapping (PosType gpos, uint32_t seq_len)
+{
+    ARRAY (const GposRange, range, query.gpos_ranges);
+
+    for (uint64_t i=0; i < query.gpos_ranges.len; i++)
+        if (gpos <= range[i].end && gpos + seq_len - 1 >= range[i].start) return true;
+
+    return false;
+}
+
+static SectionHeaderCtx *seqsearch_piz_get_local_header (VBlockP vb, uint64_t dict_id_num)
+{
+    ARRAY (const unsigned, section_index, vb->z_section_headers);
+
+    for (uint32_t section_i=1; section_i < vb->z_section_headers.len; section_i++) {
+        SectionHeaderCtx *header = (SectionHeaderCtx *)ENT (char, vb->z_data, section_index[section_i]);
+        if (header->h.section_type == SEC_LOCAL && header->dict_id.num == dict_id_num) return header;
+    }
+
+    return NULL;
+}
+
+// true unless the VB has a sketch, and a minimizer of the requested sequence is missing from it
+static bool seqsearch_piz_test_sketch (VBlockP vb, Buffer *sketch)
+{
+    SectionHeaderCtx *header = seqsearch_piz_get_local_header (vb, dict_id_KMERSKETCH);
+    if (!header) return true; // file compressed without --kmer-index
+
+    zfile_uncompress_section (vb, header, sketch, "kmer_sketch", vb->vblock_i, SEC_LOCAL);
+    sketch->len /= sizeof (uint32_t);
+
+    ARRAY (const uint32_t, w, *sketch);
+    uint32_t bits_log2 = BGEN32 (w[0]);
+    const uint32_t *bloom = &w[SS_HDR_WORDS]; // 64-bit words, each stored as two 32-bit words, low first
+    uint32_t mask = (uint32_t)((1ULL << bits_log2) - 1);
+
+    ASSERTE (bits_log2 <= SS_MAX_BITS_LOG2 && BGEN32 (w[1]) <= 31 && BGEN32 (w[2]) <= SS_MAX_W &&
+             sketch->len == SS_HDR_WORDS + (1ULL << bits_log2) / 32, "vb_i=%u: invalid k-mer sketch", vb->vblock_i);
+
+    seqsearch_piz_prepare_minimizers (BGEN32 (w[1]), BGEN32 (w[2]));
+
+    for (uint32_t i=0; i < query.num_minimizers; i++) {
+        uint32_t h = query.minimizers[i] & mask;
+        if (!((BGEN32 (bloom[h >> 5]) >> (h & 31)) & 1)) return false;
+    }
+
+    return true;
+}
+
+// true if any read of the VB is aligned to a GPOS that might overlap the requested region
+static bool seqsearch_piz_test_gpos (VBlockP vb, Buffer *gpos_buf)
+{
+    SectionHeaderCtx *header = seqsearch_piz_get_local_header (vb, dict_id_fields[FASTQ_GPOS]);
+    if (!header) return true; // can't tell
+
+    zfile_uncompress_section (vb, header, gpos_buf, "gpos_local", vb->vblock_i, SEC_LOCAL);
+    gpos_buf->len /= sizeof (uint32_t);
+
+    ARRAY (const uint32_t, gpos, *gpos_buf);
+    for (uint64_t i=0; i < gpos_buf->len; i++) {
+        PosType g = (PosType)BGEN32 (gpos[i]);
+        if (g != NO_GPOS && seqsearch_piz_is_overlapping (g, query.max_seq_len)) return true;
+    }
+
+    return false;
+}
+
+// PIZ I/O thread: called from fastq_piz_read_one_vb with --kmer or --ref-region, after the sections of the VB were read.
+// Returns false if this VB provably has no reads that would survive seqsearch_piz_is_read_included
+bool seqsearch_piz_is_vb_included (VBlockP vb, Buffer *sketch, Buffer *gpos, bool is_pair_2)
+{
+    if (flag.kmer && !seqsearch_piz_test_sketch (vb, sketch)) return false;
+
+    if (flag.ref_region && !is_pair_2 && !seqsearch_piz_test_gpos (vb, gpos)) return false;
+
+    return true;
+}
+
+static inline bool seqsearch_piz_is_substr (const char *seq, uint32_t seq_len, const char *kmer)
+{
+    for (const char *s=seq, *last=seq + seq_len - query.kmer_len; s <= last; s++)
+        if (*s == kmer[0] && !memcmp (s, kmer, query.kmer_len)) return true;
+
+    return false;
+}
+
+// PIZ compute thread: called from fastq_piz_filter after the SEQ of a read is reconstructed. gpos is NO_GPOS if the read is not aligned.
+bool seqsearch_piz_is_read_included (const char *seq, uint32_t seq_len, PosType gpos)
+{
+    if (flag.ref_region && (gpos == NO_GPOS || !seqsearch_piz_is_overlapping (gpos, seq_len))) return false;
+
+    if (flag.kmer && (seq_len < query.kmer_len ||
+                      (!seqsearch_piz_is_substr (seq, seq_len, query.kmer) && !seqsearch_piz_is_substr (seq, seq_len, query.kmer_revcomp))))
+        return false;
+
+    return true;
+}
@@ -0,0 +1,21 @@
+// ------------------------------------------------------------------
+//   seqsearch.h
+//   Copyright (C) 2020 Divon Lan <divon@genozip.com>
+//   Please see terms and conditions in the files LICENSE.non-commercial.txt and LICENSE.commercial.txt
+
+#ifndef SEQSEARCH_INCLUDED
+#define SEQSEARCH_INCLUDED
+
+#include "genozip.h"
+
+// ZIP
+extern void seqsearch_zip_initialize (VBlockP vb, BufferP sketch);
+extern void seqsearch_zip_add_seq (BufferP sketch, const char *seq, uint32_t seq_len);
+extern void seqsearch_zip_finalize (VBlockP vb, BufferP sketch);
+
+// PIZ
+extern void seqsearch_piz_initialize (void);
+extern bool seqsearch_piz_is_vb_included (VBlockP vb, BufferP sketch, BufferP gpos, bool is_pair_2);
+extern bool seqsearch_piz_is_read_included (const char *seq, uint32_t seq_len, PosType gpos);
+
+#endif
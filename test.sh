@@ -153,6 +153,15 @@ test_multi_bound() # $1=filename $2=REPLACE (optional)
     fi
 
     $genozip $arg1 $file1 $file2 -ft -o $output || exit 1 # test as bound
+
+    # extract a single component, by number and by name - not for BGZF files, as we compare the re-compressed output to the source
+    if [[ $1 != *.bam && $1 != *.gz ]]; then
+        $genounzip $arg1 $output --component=2 -fo $OUTDIR/component2.$1 || exit 1
+        cmp_2_files $file2 $OUTDIR/component2.$1
+        $genounzip $arg1 $output --component=copy1.$1 -fo $OUTDIR/component1.$1 || exit 1
+        cmp_2_files $file1 $OUTDIR/component1.$1
+    fi
+
     local output2=$OUTDIR/output2.genozip
     cp -f $output $output2
     $genounzip $arg1 $output $output2 -u -t || exit 1 # test unbind 2x2
@@ -426,6 +435,82 @@ batch_misc_cases()
     # Test binding SAM files with lots of contigs (no reference)
     echo "binding SAM files with lots of contigs (no reference)"
     test_multi_bound test.human-unsorted.sam
+
+    # Test a local section larger than a compression chunk (16MB) with a simple codec - it is compressed in chunks, in parallel
+    echo "generic file with a local section larger than a compression chunk"
+    local big_generic=$OUTDIR/big-local.generic
+    awk 'BEGIN { srand(1); for (i=1; i <= 2500000; i++) printf "%d\t%08x\n", i, int(rand() * 2147483647) }' > $big_generic || exit 1
+    test_standard "NOPREFIX --vblock 64 --threads 4" " " $big_generic
+    rm -f $big_generic
+
+    # Test a VB whose haplotype matrix is larger than a compression chunk (16MB) - PBWT sections have a sub-codec, so they are
+    # never chunked, but must still round-trip
+    echo "VCF with a haplotype matrix larger than a compression chunk"
+    local big_vcf=$OUTDIR/big-ht.vcf
+    awk 'BEGIN { srand(1); num_samples=2000; 
+                 print "##fileformat=VCFv4.2"; 
+                 printf "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT"; 
+                 for (s=1; s <= num_samples; s++) printf "\tS%d", s; 
+                 printf "\n";
+                 for (l=1; l <= 6000; l++) { 
+                     printf "1\t%d\t.\tA\tG\t.\tPASS\t.\tGT", l*10;
+                     for (s=1; s <= num_samples; s++) printf "\t%d|%d", (rand() < 0.1), (rand() < 0.1);
+                     printf "\n";
+                 } }' > $big_vcf || exit 1
+    test_standard "NOPREFIX --vblock 100" " " $big_vcf
+    rm -f $big_vcf
+
+    # Test that --grep on a multi-VB FASTQ compressed with --grep-index outputs the same reads as without the index: a read
+    # name found in one VB only, a numeric prefix of read names, and a string that doesn't occur
+    echo "FASTQ with --grep-index"
+    local grep_fq=$OUTDIR/grep-index.fq
+    awk 'BEGIN { srand(1);
+                 for (i=1; i <= 30000; i++) {
+                     printf "@rd%07d:lane1\n", i;
+                     for (b=1; b <= 100; b++) printf "%s", substr("ACGT", int(rand()*4)+1, 1);
+                     printf "\n+\n";
+                     for (b=1; b <= 100; b++) printf "%c", 33 + int(rand()*40);
+                     printf "\n";
+                 } }' > $grep_fq || exit 1
+
+    local grep_str grep_lines
+    for grep_str in rd0012345: rd00123 rd0099999:; do
+        $genozip $arg1 $grep_fq --vblock 1 -fo $output || exit 1
+        grep_lines=`$genocat $output --grep $grep_str $arg1 | wc -l`
+        test_count_genocat_lines "$grep_fq --vblock 1 --grep-index" "--grep $grep_str" $grep_lines
+    done
+
+    test_count_genocat_lines "$grep_fq --vblock 1 --grep-index" "--grep rd0012345:" 4
+    test_count_genocat_lines "$grep_fq --vblock 1 --grep-index" "--grep rd00123" 400
+    test_count_genocat_lines "$grep_fq --vblock 1 --grep-index" "--grep rd0099999:" 0
+    rm -f $grep_fq
+
+    # Test --kmer with and without --kmer-index on a multi-VB FASTQ: one read contains the kmer, and another read, in a
+    # different VB, contains its reverse complement
+    echo "FASTQ with --kmer-index"
+    local kmer_fq=$OUTDIR/kmer-index.fq
+    local kmer=GATTACAGGCTTCAAGTCCGTAACTGGATCCTAGCATGCA
+    local kmer_revcomp=`echo $kmer | rev | tr ACGT TGCA`
+    local kmer_absent=CCCCGGGGAAAATTTTCCCCGGGGAAAATTTTCCCCGGGG
+    awk -v kmer=$kmer -v kmer_revcomp=$kmer_revcomp \
+        'BEGIN { srand(1);
+                 for (i=1; i <= 30000; i++) {
+                     seq = "";
+                     for (b=1; b <= 100; b++) seq = seq substr("ACGT", int(rand()*4)+1, 1);
+                     if (i == 5000)  seq = substr(seq, 1, 30) kmer         substr(seq, 71);
+                     if (i == 25000) seq = substr(seq, 1, 10) kmer_revcomp substr(seq, 51);
+                     printf "@rd%07d:lane1\n%s\n+\n", i, seq;
+                     for (b=1; b <= 100; b++) printf "%c", 33 + int(rand()*40);
+                     printf "\n";
+                 } }' > $kmer_fq || exit 1
+
+    local kmer_args
+    for kmer_args in "--vblock 1" "--vblock 1 --kmer-index"; do
+        test_count_genocat_lines "$kmer_fq $kmer_args" "--kmer $kmer" 8
+        test_count_genocat_lines "$kmer_fq $kmer_args" "--kmer $kmer_revcomp" 8
+        test_count_genocat_lines "$kmer_fq $kmer_args" "--kmer $kmer_absent" 0
+    done
+    rm -f $kmer_fq
 }
 
 # CRAM hg19
@@ -487,6 +572,30 @@ batch_reference()
 
     echo "multiple VCF with --REFERENCE using hg19" 
     test_standard "-mE$hg19" " " test.ALL.chr22.phase1_release_v3.20101123.snps_indels_svs.genotypes.vcf test.human2.filtered.snp.vcf
+
+    # Test --ref-region on a multi-VB FASTQ whose reads are copied from the reference, every 20 bases, alternately forward
+    # and reverse-complemented. The read names contain the position, from which we know which reads overlap the region
+    echo "FASTQ with --reference and --ref-region"
+    local region_fq=$OUTDIR/ref-region.fq
+    local region_first=100000001 region_start=100150001 region_end=100150999
+    $genocat $arg1 $GRCh38 --regions chr1:$region_first-$((region_first + 299999)) | grep -v '^chr' | tr -d '\n' | \
+        awk -v first=$region_first \
+            '{ qual = "";
+               for (b=1; b <= 100; b++) qual = qual substr("FFF:", b % 4 + 1, 1);
+               for (s=0; s + 100 <= length($0); s += 20) {
+                   seq = substr($0, s+1, 100);
+                   if ((s / 20) % 2) {
+                       rc = "";
+                       for (b=100; b >= 1; b--) rc = rc substr("TGCA", index("ACGT", substr(seq, b, 1)), 1);
+                       seq = rc;
+                   }
+                   printf "@chr1:%d\n%s\n+\n%s\n", first + s, seq, qual;
+               } }' > $region_fq || exit 1
+
+    local region_lines=`awk -F: -v start=$region_start -v end=$region_end 'NR % 4 == 1 && $2 <= end && $2 + 99 >= start' $region_fq | wc -l`
+    test_count_genocat_lines "$region_fq --vblock 1 -e $GRCh38" "-e $GRCh38 --ref-region chr1:$region_start-$region_end" $(( region_lines * 4 ))
+    test_count_genocat_lines "$region_fq --vblock 1 -e $GRCh38" "-e $GRCh38 --ref-region chr2" 0
+    rm -f $region_fq
 }
 
 batch_make_reference()
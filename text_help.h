@@ -28,7 +28,7 @@ static const char *help_genozip[] = {
     "   Phylip   phy (possibly .gz .bgz .bz2 .xz)",
     "   Generic  any other file (possibly .gz .bgz .bz2 .xz)",
     "",
-    "Note: compressing .bcf, .cram or .xz files requires bcftools, samtools or xz, respectively, to be installed",
+    "Note: compressing .bcf or .cram files requires bcftools or samtools, respectively, to be installed",
     "",
     "Examples: genozip sample.bam",
     "          genozip sample.R1.fq.gz sample.R2.fq.gz --pair --reference hg19.ref.genozip -o sample.genozip"
@@ -66,8 +66,20 @@ static const char *help_genozip[] = {
     "",
     "   -@ --threads      <number>. Specify the maximum number of threads. By default, genozip uses all the threads it needs to maximize usage of all available cores",
     "",
+    "      --jobs         <number>. When compressing many files, compress up to this number of files concurrently, each in its own process, sharing the threads between them. Each file is still compressed into its own genozip file. This is faster for many small files, for which much of the time is spent in per-file setup that uses few threads. Not available on Windows",
+    "",
+    "      --max-memory   <number>. The amount of memory, in gigabytes, that genozip should try to stay within (fractions like 0.5 are allowed). Genozip measures the memory used by each block of data as it compresses, and shrinks the blocks (see --vblock) if needed to stay within this amount. When close to this amount, genozip waits for blocks being compressed to complete before reading more data. The reference data loaded with --reference is kept in its cache files rather than in memory, and when compressing with --jobs, the amount is divided between the jobs. An error is reported only if compression cannot proceed at all within this amount. By default, memory is not limited",
+    "",
     "   -B --vblock       <number between 1 and 2048>. Set the maximum size of data (in megabytes) of the textual input (VCF, SAM, FASTQ etc) data that a thread processes at any given time. By default, Genozip sets this value dynamically based on the characateristics of the file, and it is reported in --show-stats. Smaller values will result in faster subsetting with --regions and --grep, while larger values will result in better compression. Note that memory consumption of both genozip and genounzip is linear with the vblock value used for compression",
     "",
+    "      --checkpoints  [<number of lines>]. VCF only: Store, within each vblock, the state of the decompressor every given number of lines (default: 1000). With this, genocat --regions reconstructs only the part of each vblock that might contain the requested regions, rather than the entire vblock. Effective for vblocks with a single chromosome only. This costs a little in compression",
+    "",
+    "      --codec-cache  [<filename>]. Remember the codecs that genozip selects for each type of data, so that they need not be tested again when compressing subsequent files of the same type - useful when compressing many similar files. The codecs are re-tested once in a while. The cache is stored in the given file, or by default in .genozip_codec_cache in the home directory",
+    "",
+    "      --grep-index   FASTQ only: Store, for each vblock, a compact summary of its description lines. With this, genocat --grep skips vblocks that cannot contain the requested string, without decompressing them. Most effective when grepping for read names. This costs a little in compression",
+    "",
+    "      --kmer-index   FASTQ only: Store, for each vblock, a sketch of the sequences of its reads. With this, genocat --kmer skips vblocks that cannot contain the requested sequence, without decompressing them. This costs in compression, more so for vblocks with diverse sequences",
+    "",
     "   -e --reference    <filename>.ref.genozip Use a reference file - this is a FASTA file genozipped with the --make-reference option. The same reference needs to be provided to genounzip or genocat.",    
     "                     While genozip is capabale of compressing without a reference, in the following cases providing a reference may result in better compression:",
     "                     1. FASTQ files",
@@ -209,6 +221,8 @@ static const char *help_genozip_developer[] = {
     "",
     "   ZUC  --xthreads        Use only one thread for the main PIZ/ZIP dispatcher. This doesn't affect thread use of other dispatchers",
     "",
+    "   Z    --pbwt-partitions <number between 1 and 16>. (VCF only) Split the haplotype columns of each vblock into this number of independent PBWT streams, compressed (and later decompressed) by parallel threads. Useful for files with very many samples. The compression ratio cost can be observed in the GT line of --show-stats",
+    "",
     "   ZUCL --debug-memory    Show Buffer allocations and destructions",
     "",
     "   ZUC  --debug-progress  See raw numbers that feed into the progress indicator",
@@ -257,6 +271,8 @@ static const char *help_genounzip[] = {
     "",
     "   -u --unbind[=prefix] Split a bound file back to its original components. If the '--unbind=prefix' form is used, a prefix is added to each file component. A prefix may include a directory.",
     "",
+    "      --component    <number|filename> Decompress only one component of a bound file, given by its number (starting from 1, as listed by genols) or its original file name. Only this component's data is read from the file. Absent --output, the component is written to its original file name",
+    "",
     "   -o --output       <output-filename>. Output to this filename instead of the default one",
     "",
     "   -e --reference    <filename>.ref.genozip Load a reference file prior to decompressing. Required only for files compressed with --reference",    
@@ -352,6 +368,12 @@ static const char *help_genocat[] = {
     "                     Note: Multiple -r arguments may be specified - this is equivalent to chaining their regions with a comma separator in a single argument",
     "                     Note: For FASTA files, only whole-contig regions are possible",
     "",
+    "   -R --regions-file <filename>",
+    "   VCF SAM FASTA     Show the regions listed in a BED file - tab-separated chrom, start (0-based) and end, one region per line. Example:",
+    "   GVF 23andMe                 genocat myfile.vcf.genozip -R my-regions.bed",
+    "                     Note: Any number of regions may be listed. The regions are sorted and merged, and every vblock is decompressed at most once, reconstructing all the regions it contains in a single pass",
+    "                     Note: May be combined with --regions, but not with negated regions",
+    "",
     "   -s --samples      [^]sample[,...]",
     "   VCF               Show a subset of samples (individuals). Examples:",
     "                               genocat myfile.vcf.genozip -s HG00255,HG00256    (show two samples)",
@@ -363,6 +385,14 @@ static const char *help_genocat[] = {
     "   -g --grep         <string> Show only records in which <string> is a case-sensitive substring of the description",
     "   FASTQ FASTA",
     "",
+    "      --kmer         <sequence> Show only reads whose sequence contains <sequence> (A, C, G and T only), or its reverse complement. Faster if the file was compressed with --kmer-index and <sequence> is at least 30 bases",
+    "   FASTQ",
+    "",
+    "      --ref-region   <contig>[:<start>-<end>] Show only reads that were aligned to this interval of the reference when compressing with --reference or --REFERENCE",
+    "   FASTQ",
+    "",
+    "      --component    <number|filename> Show only one component of a bound file, given by its number (starting from 1, as listed by genols) or its original file name. Only this component's data is read from the file",
+    "",
     "   --list-chroms     List the names of the chromosomes (or contigs) included in the file",
     "   VCF SAM FASTA GVF 23andMe ",
     "",
@@ -379,6 +409,9 @@ static const char *help_genocat[] = {
     "   --GT-only         Within samples, output only genotype (GT) data, dropping the other subfields",
     "   VCF",
     "",
+    "   --allele-counts   Instead of the VCF lines, output a tab-separated table with CHROM, POS, ID, REF, ALT and the AN, AC, AF (AC and AF with one value per ALT allele), and number of samples with a missing, homozygous-reference, heterozygous and homozygous-alternative genotype. These are calculated directly from the genotype data, without reconstructing the samples. Combine with --samples to count only some of the samples",
+    "   VCF",
+    "",
     "   --sequential      Output in sequential format - each sequence in a single line",
     "   FASTA",
 #if !defined _WIN32 && !defined __APPLE__ // not relevant for personal computers
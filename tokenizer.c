@@ -0,0 +1,225 @@
+// ------------------------------------------------------------------
+//   tokenizer.c
+//   Copyright (C) 2020 Divon Lan <divon@genozip.com>
+//   Please see terms and conditions in the files LICENSE.non-commercial.txt and LICENSE.commercial.txt
+
+// Read names (SAM QNAME, FASTQ DESC) usually all have the same layout within a VB - for example, Illumina's
+// "A00488:61:HMLGNDSXX:4:1101:15374:1031" - with several numeric tokens that change slowly from read to read.
+// The layout of a VB is determined by its first read name. Read names that match the layout are segged as a single
+// SNIP_SPECIAL containing the layout (all_the_same in the field's b250), numeric tokens are stored as deltas
+// from the previous read name in a local LT_INT32 array of their own context, and textual tokens go to the
+// b250 of their own context, re-using the previous word index if the token is unchanged - so most read names
+// are segged with no hash table lookups at all. Read names that don't match the layout are segged with seg_compound_field.
+
+#include "genozip.h"
+#include "tokenizer.h"
+#include "vblock.h"
+#include "context.h"
+#include "seg.h"
+#include "reconstruct.h"
+#include "endianness.h"
+#include "dict_id.h"
+#include "flags.h"
+#include "strings.h"
+#include "sam.h"
+#include "fastq.h"
+
+#define TOKENIZER_MAX_TOKENS 24
+#define TOKENIZER_MAX_NUMERIC_LEN 9 // so that values and deltas fit in int32
+
+typedef struct {
+    uint8_t num_tokens;
+    bool is_numeric[TOKENIZER_MAX_TOKENS];
+    char sep[TOKENIZER_MAX_TOKENS];               // separator after each token (0 after the last token)
+    DidIType did_i[TOKENIZER_MAX_TOKENS];
+    WordIndex prev_word_index[TOKENIZER_MAX_TOKENS]; // textual tokens: word index of the token in the previous read name
+    WordIndex special_word_index;                 // word index of the layout snip in the field's context
+} TokenizerLayout;
+
+typedef struct {
+    uint8_t num_tokens;
+    const char *start[TOKENIZER_MAX_TOKENS];
+    unsigned len[TOKENIZER_MAX_TOKENS];
+    char sep[TOKENIZER_MAX_TOKENS];
+} Tokens;
+
+static inline DictId tokenizer_dict_id (DictId field_dict_id, unsigned token_i)
+{
+    const uint8_t *id = field_dict_id.id;
+    char dict_id_str[8] = { id[0], 'A' + token_i, id[1], id[2], id[3], id[4], id[5], id[6] }; // seg_compound_field uses 0-9,a-z
+    return dict_id_make (dict_id_str, 8, DTYPE_1);
+}
+
+static inline bool tokenizer_is_sep (char c, SegCompoundArg arg)
+{
+    return (c==':' && arg.colon) || (c=='/' && arg.slash) || (c=='|' && arg.pipe) || (c=='.' && arg.dot) ||
+           ((c==' ' || c=='\t' || c==1) && arg.whitespace);
+}
+
+static inline bool tokenizer_is_numeric (const char *token, unsigned len)
+{
+    if (!len || len > TOKENIZER_MAX_NUMERIC_LEN || (token[0] == '0' && len > 1)) return false;
+
+    for (unsigned i=0; i < len; i++)
+        if (!IS_DIGIT (token[i])) return false;
+
+    return true;
+}
+
+// returns false if the field cannot be tokenized (too many tokens or an empty token)
+static bool tokenizer_tokenize (const char *field, unsigned field_len, SegCompoundArg arg, Tokens *t)
+{
+    t->num_tokens = 0;
+    const char *start = field;
+
+    for (const char *c=field, *after=field + field_len; c <= after; c++)
+        if (c == after || tokenizer_is_sep (*c, arg)) {
+            if (c == start || t->num_tokens == TOKENIZER_MAX_TOKENS) return false;
+
+            t->start[t->num_tokens] = start;
+            t->len  [t->num_tokens] = c - start;
+            t->sep  [t->num_tokens] = (c == after) ? 0 : *c;
+            t->num_tokens++;
+            start = c + 1;
+        }
+
+    return true;
+}
+
+static void tokenizer_seg_special (VBlockP vb, Context *field_ctx, TokenizerLayout *layout, unsigned add_bytes)
+{
+    // first read name of the layout - add the layout snip to the dictionary
+    if (layout->special_word_index == WORD_INDEX_NONE) {
+        char snip[2 + TOKENIZER_MAX_TOKENS * 2] = { SNIP_SPECIAL, vb->data_type == DT_FASTQ ? FASTQ_SPECIAL_READNAME : SAM_SPECIAL_READNAME };
+        unsigned snip_len = 2;
+
+        for (unsigned i=0; i < layout->num_tokens; i++) {
+            snip[snip_len++] = layout->is_numeric[i] ? 'N' : 'S';
+            if (layout->sep[i]) snip[snip_len++] = layout->sep[i];
+        }
+
+        layout->special_word_index = seg_by_ctx (vb, snip, snip_len, field_ctx, add_bytes);
+    }
+
+    // subsequent read names - same snip, no need to look it up in the hash table
+    else {
+        buf_alloc_more (vb, &field_ctx->b250, 1, vb->lines.len, uint32_t, CTX_GROWTH, "contexts->b250");
+        NEXTENT (uint32_t, field_ctx->b250) = layout->special_word_index;
+        ctx_node_vb (field_ctx, layout->special_word_index, NULL, NULL)->count++;
+        field_ctx->txt_len += add_bytes;
+    }
+}
+
+static void tokenizer_seg_token (VBlockP vb, TokenizerLayout *layout, const Tokens *t, unsigned i)
+{
+    Context *ctx = &vb->contexts[layout->did_i[i]];
+
+    // numeric token - delta from the previous read name goes to local
+    if (layout->is_numeric[i]) {
+        int64_t value;
+        str_get_int (t->start[i], t->len[i], &value);
+
+        buf_alloc_more (vb, &ctx->local, 1, vb->lines.len, int32_t, CTX_GROWTH, "contexts->local");
+        NEXTENT (uint32_t, ctx->local) = BGEN32 ((uint32_t)(int32_t)(value - ctx->last_value.i));
+        ctx->last_value.i = value;
+        return;
+    }
+
+    // textual token - same as in the previous read name
+    if (layout->prev_word_index[i] != WORD_INDEX_NONE) {
+        const char *prev; uint32_t prev_len;
+        CtxNode *node = ctx_node_vb (ctx, layout->prev_word_index[i], &prev, &prev_len);
+
+        if (prev_len == t->len[i] && !memcmp (prev, t->start[i], prev_len)) {
+            buf_alloc_more (vb, &ctx->b250, 1, vb->lines.len, uint32_t, CTX_GROWTH, "contexts->b250");
+            NEXTENT (uint32_t, ctx->b250) = layout->prev_word_index[i];
+            node->count++;
+            return;
+        }
+    }
+
+    // textual token - changed
+    layout->prev_word_index[i] = seg_by_ctx (vb, t->start[i], t->len[i], ctx, 0);
+}
+
+static TokenizerLayout *tokenizer_init_layout (VBlockP vb, Context *field_ctx, const Tokens *t)
+{
+    buf_alloc (vb, &vb->tokenizer_layout, sizeof (TokenizerLayout), 1, "tokenizer_layout");
+    vb->tokenizer_layout.len = 1;
+
+    TokenizerLayout *layout = FIRSTENT (TokenizerLayout, vb->tokenizer_layout);
+    *layout = (TokenizerLayout){ .num_tokens = t->num_tokens, .special_word_index = WORD_INDEX_NONE };
+
+    for (unsigned i=0; i < t->num_tokens; i++) {
+        Context *ctx = ctx_get_ctx (vb, tokenizer_dict_id (field_ctx->dict_id, i));
+        ctx->st_did_i = field_ctx->did_i;
+
+        layout->is_numeric[i]      = tokenizer_is_numeric (t->start[i], t->len[i]);
+        layout->sep[i]             = t->sep[i];
+        layout->did_i[i]           = ctx->did_i;
+        layout->prev_word_index[i] = WORD_INDEX_NONE;
+
+        if (layout->is_numeric[i]) {
+            ctx->ltype = LT_INT32;
+            ctx->last_value.i = 0;
+        }
+    }
+
+    return layout;
+}
+
+static bool tokenizer_is_layout (const TokenizerLayout *layout, const Tokens *t)
+{
+    if (t->num_tokens != layout->num_tokens) return false;
+
+    for (unsigned i=0; i < t->num_tokens; i++)
+        if (t->sep[i] != layout->sep[i] ||
+            (layout->is_numeric[i] && !tokenizer_is_numeric (t->start[i], t->len[i]))) return false;
+
+    return true;
+}
+
+// same arguments as seg_compound_field
+void tokenizer_seg (VBlockP vb, ContextP field_ctx, const char *field, unsigned field_len,
+                    SegCompoundArg arg, unsigned nonoptimized_len, unsigned add_for_eol)
+{
+    Tokens t;
+
+    // with --pair, read 2 names are segged as SNIP_PAIR_LOOKUP against the b250 of the compound components of read 1
+    if (flag.pair || !tokenizer_tokenize (field, field_len, arg, &t)) goto fallback;
+
+    TokenizerLayout *layout = vb->tokenizer_layout.len ? FIRSTENT (TokenizerLayout, vb->tokenizer_layout)
+                                                       : tokenizer_init_layout (vb, field_ctx, &t);
+
+    if (!tokenizer_is_layout (layout, &t)) goto fallback;
+
+    tokenizer_seg_special (vb, field_ctx, layout, (nonoptimized_len ? nonoptimized_len : field_len) + add_for_eol);
+
+    for (unsigned i=0; i < t.num_tokens; i++)
+        tokenizer_seg_token (vb, layout, &t, i);
+
+    return;
+
+fallback:
+    seg_compound_field (vb, field_ctx, field, field_len, arg, nonoptimized_len, add_for_eol);
+}
+
+// snip is the layout: for each token, N (numeric) or S (textual) followed by the separator (none after the last token)
+SPECIAL_RECONSTRUCTOR (tokenizer_piz_special_READNAME)
+{
+    for (unsigned i=0; i < snip_len; i += 2) {
+        Context *token_ctx = ctx_get_existing_ctx (vb, tokenizer_dict_id (ctx->dict_id, i/2));
+        ASSERTE (token_ctx, "vb_i=%u line_i=%u: cannot find context of token %u of %s", vb->vblock_i, vb->line_i, i/2, ctx->name);
+
+        if (snip[i] == 'N') {
+            token_ctx->last_value.i += reconstruct_from_local_int (vb, token_ctx, 0, false); // delta
+            if (reconstruct) { RECONSTRUCT_INT (token_ctx->last_value.i); }
+        }
+        else
+            reconstruct_from_ctx (vb, token_ctx->did_i, 0, reconstruct);
+
+        if (reconstruct && i+1 < snip_len) RECONSTRUCT1 (snip[i+1]);
+    }
+
+    return false; // no new value
+}
@@ -0,0 +1,19 @@
+// ------------------------------------------------------------------
+//   tokenizer.h
+//   Copyright (C) 2020 Divon Lan <divon@genozip.com>
+//   Please see terms and conditions in the files LICENSE.non-commercial.txt and LICENSE.commercial.txt
+
+#ifndef TOKENIZER_INCLUDED
+#define TOKENIZER_INCLUDED
+
+#include "genozip.h"
+#include "seg.h"
+
+// ZIP
+extern void tokenizer_seg (VBlockP vb, ContextP field_ctx, const char *field, unsigned field_len, 
+                           SegCompoundArg arg, unsigned nonoptimized_len, unsigned add_for_eol);
+
+// PIZ
+extern SPECIAL_RECONSTRUCTOR (tokenizer_piz_special_READNAME);
+
+#endif
@@ -23,6 +23,9 @@
 #include "progress.h"
 #include "codec.h"
 #include "bgzf.h"
+#include "mgzip.h"
+#include "xz.h"
+#include "pkzip.h"
 #include "mutex.h"
 #include "digest.h"
 #include "zlib/zlib.h"
@@ -102,13 +105,30 @@ static inline uint32_t txtfile_read_block_plain (VBlock *vb, uint32_t max_bytes)
 
 static inline uint32_t txtfile_read_block_gz (VBlock *vb, uint32_t max_bytes)
 {
-    uint32_t bytes_read = gzfread (AFTERENT (char, vb->txt_data), 1, max_bytes, (gzFile)txt_file->file);
+    uint32_t bytes_read = mgzip_read (txt_file, AFTERENT (char, vb->txt_data), max_bytes); // also updates disk_so_far
     vb->txt_data.len += bytes_read;
 
-    if (bytes_read)
-        txt_file->disk_so_far = gzconsumed64 ((gzFile)txt_file->file); // this is actually all the data uncompressed so far, some of it not yet read by us and still waiting in zlib's output buffer
-    else
-        txt_file->is_eof = true;
+    if (!bytes_read) txt_file->is_eof = true;
+
+    return bytes_read;
+}
+
+static inline uint32_t txtfile_read_block_xz (VBlock *vb, uint32_t max_bytes)
+{
+    uint32_t bytes_read = xz_read (txt_file, AFTERENT (char, vb->txt_data), max_bytes); // also updates disk_so_far
+    vb->txt_data.len += bytes_read;
+
+    if (!bytes_read) txt_file->is_eof = true;
+
+    return bytes_read;
+}
+
+static inline uint32_t txtfile_read_block_zip (VBlock *vb, uint32_t max_bytes)
+{
+    uint32_t bytes_read = pkzip_read (txt_file, AFTERENT (char, vb->txt_data), max_bytes); // also updates disk_so_far
+    vb->txt_data.len += bytes_read;
+
+    if (!bytes_read) txt_file->is_eof = true;
 
     return bytes_read;
 }
@@ -241,6 +261,12 @@ static uint32_t txtfile_read_block (VBlock *vb, uint32_t max_bytes,
 
     else if (txt_file->codec == CODEC_BZ2) 
         bytes_read = txtfile_read_block_bz2 (vb, max_bytes);
+
+    else if (txt_file->codec == CODEC_XZ) 
+        bytes_read = txtfile_read_block_xz (vb, max_bytes);
+
+    else if (txt_file->codec == CODEC_ZIP) 
+        bytes_read = txtfile_read_block_zip (vb, max_bytes);
     
     else 
         ABORT ("txtfile_read_block: Invalid file type %s (codec=%s)", ft_name (txt_file->type), codec_name (txt_file->codec));
@@ -404,15 +430,16 @@ void txtfile_read_vblock (VBlock *vb, bool testing_memory)
         if (!len || vb->txt_data.len >= max_memory_per_vb) {  // EOF or we have filled up the allocted memory
 
             // case: this is the 2nd file of a fastq pair - make sure it has at least as many fastq "lines" as the first file
+            uint64_t more_needed;
             if (flag.pair == PAIR_READ_2 &&  // we are reading the second file of a fastq file pair (with --pair)
-                !fastq_txtfile_have_enough_lines (vb, &passed_up_len)) { // we don't yet have all the data we need
+                !fastq_txtfile_have_enough_lines (vb, &passed_up_len, &more_needed)) { // we don't yet have all the data we need
 
                 ASSINP (len, "File %s has less FASTQ reads than its R1 counterpart", txt_name);
 
                 ASSERTE (vb->txt_data.len, "txt_data.len=0 when reading pair-2 vb=%u", vb->vblock_i);
 
-                // if we need more lines - increase memory and keep on reading
-                max_memory_per_vb *= 1.1; 
+                // if we need more lines - increase memory by the estimated amount missing and keep on reading
+                max_memory_per_vb += more_needed; 
                 buf_alloc (vb, &vb->txt_data, max_memory_per_vb, 1, "txt_data");    
             }
             else
@@ -610,10 +637,12 @@ int64_t txtfile_estimate_txt_data_size (VBlock *vb)
     bool is_no_ht_vcf = (txt_file->data_type == DT_VCF && vcf_vb_has_haplotype_data(vb));
 
     switch (txt_file->codec) {
-        // if we decomprssed gz/bz2 data directly - we extrapolate from the observed compression ratio
+        // if we decomprssed gz/bz2/xz/zip data directly - we extrapolate from the observed compression ratio
         case CODEC_GZ:
         case CODEC_BGZF:
         case CODEC_BZ2:  
+        case CODEC_XZ:
+        case CODEC_ZIP:  
             if (vb1_txt_data_comp_len) {
                 ratio = (double)vb->vb_data_size / (double)vb1_txt_data_comp_len; 
                 vb1_txt_data_comp_len = 0;
@@ -631,12 +660,8 @@ int64_t txtfile_estimate_txt_data_size (VBlock *vb)
         // the bcf is compressed as it normally is.
         case CODEC_BCF:  ratio = is_no_ht_vcf ? 55 : 8.5; break;
 
-        case CODEC_XZ:   ratio = is_no_ht_vcf ? 171 : 12.7; break;
-
         case CODEC_CRAM: ratio = 25; break;
 
-        case CODEC_ZIP:  ratio = 3; break;
-
         case CODEC_NONE: ratio = 1; break;
 
         default: ABORT ("Error in txtfile_estimate_txt_data_size: unspecified txt_file->codec=%s (%u)", codec_name (txt_file->codec), txt_file->codec);
@@ -709,12 +734,12 @@ void txtfile_genozip_to_txt_header (const SectionListEntry *sl,
     ASSERTE (!digest || BGEN32 (header->h.compressed_offset) == crypt_padded_len (sizeof(SectionHeaderTxtHeader)), 
              "invalid txt header's header size: header->h.compressed_offset=%u, expecting=%u", BGEN32 (header->h.compressed_offset), (unsigned)sizeof(SectionHeaderTxtHeader));
 
-    // 1. in unbind mode - we open the output txt file of the component
+    // 1. in unbind mode, or --component without --output - we open the output txt file of the component
     // 2. when reading a reference file - we create txt_file here (but don't actually open the physical file)
-    if (flag.unbind || flag.reading_reference) {
+    if (flag.unbind || flag.reading_reference || (flag.component && !txt_file)) {
         ASSERTE0 (!txt_file, "not expecting txt_file to be open already in unbind mode or when reading reference");
         
-        const char *filename = txtfile_piz_get_filename (header->txt_filename, flag.unbind, false);
+        const char *filename = txtfile_piz_get_filename (header->txt_filename, flag.unbind ? flag.unbind : "", false);
         txt_file = file_open (filename, WRITE, TXT_FILE, z_file->data_type);
         FREE (filename); // file_open copies the names
     }
@@ -728,7 +753,7 @@ void txtfile_genozip_to_txt_header (const SectionListEntry *sl,
     if (is_first_txt || flag.unbind) 
         z_file->num_lines = BGEN64 (header->num_lines);
 
-    if (flag.unbind) *digest = header->digest_single; // override md5 from genozip header
+    if (flag.unbind || flag.component) *digest = header->digest_single; // override md5 from genozip header
 
     // case: we need to reconstruct (or not) the BGZF following the instructions from the z_file
     if (flag.bgzf == FLAG_BGZF_BY_ZFILE) {
@@ -736,7 +761,7 @@ void txtfile_genozip_to_txt_header (const SectionListEntry *sl,
         // load the source file isize if we have it and we are attempting to reconstruct an unmodifed file identical to the source
         bool loaded = false;
         if (!flag.data_modified &&   
-            (z_file->num_components == 1 || flag.unbind))  // not concatenating multiple files
+            (z_file->num_components == 1 || flag.unbind || flag.component))  // not concatenating multiple files
             loaded = bgzf_load_isizes (sl); // also sets txt_file->bgzf_flags
 
         // case: user wants to see this section header, despite not needing BGZF data
@@ -0,0 +1,547 @@
+// ------------------------------------------------------------------
+//   txtindex.c
+//   Copyright (C) 2020 Divon Lan <divon@genozip.com>
+//   Please see terms and conditions in the files LICENSE.non-commercial.txt and LICENSE.commercial.txt
+
+// With --index, we create a BAI index for BAM output and a TBI index for BGZF-compressed VCF output while the file is
+// being written, rather than running samtools / bcftools on the file after it is closed:
+// 1. Compute thread: txtindex_piz_vb collects the chrom, coordinates and location in txt_data of each record in the VB
+// 2. I/O thread: txtindex_add_vb converts these locations to locations within the txt file, and txtindex_add_bgzf_blocks
+//    tracks the BGZF blocks written to disk - together they provide the virtual file offset of each record, which is then
+//    added to the binning and linear indices
+// 3. I/O thread: txtindex_finalize writes the index file after the txt file is closed
+// See: https://samtools.github.io/hts-specs/SAMv1.pdf section 5 and https://samtools.github.io/hts-specs/tabix.pdf
+
+#include <errno.h>
+#include "genozip.h"
+#include "txtindex.h"
+#include "buffer.h"
+#include "vblock.h"
+#include "file.h"
+#include "flags.h"
+#include "endianness.h"
+#include "bgzf.h"
+#include "sam_private.h" // for BAMAlignmentFixed
+
+#define LIDX_SHIFT   14    // linear index: 16Kbp windows
+#define PSEUDO_BIN   37450 // bin containing per-reference meta data
+#define MAX_INDEXABLE_POS (1 << 29) // BAI and TBI cannot index coordinates beyond 512Mbp (CSI is needed)
+
+// compute thread: one per record, in vb->txtindex_recs
+typedef struct {
+    int32_t tid;                     // BAM: ref_id. VCF: -1, as tids are assigned by the I/O thread
+    uint32_t chrom_index, chrom_len; // VCF: chrom name in vb->txt_data
+    PosType beg, end;                // 0-based, half-closed half-open [beg,end)
+    uint32_t txt_start, txt_end;     // location of record in vb->txt_data
+    bool unmapped;
+} TxtIndexRec;
+
+// I/O thread
+typedef struct { int32_t tid; PosType beg, end; uint64_t txt_start, txt_end; bool unmapped; } PendingRec;
+typedef struct { uint64_t txt_start, disk_start; uint32_t isize; } WrittenBlock;
+typedef struct { int32_t tid; uint32_t bin; uint64_t beg, end; } IndexChunk;
+typedef struct { int32_t tid; uint32_t window; uint64_t voff; } LinearEntry;
+typedef struct { bool exists; uint64_t off_beg, off_end, n_mapped, n_unmapped; } RefStats;
+
+static bool failed = false;
+static uint64_t txt_so_far = 0;        // txt data (uncompressed) handed to the BGZF writer so far
+static uint64_t blocks_txt_so_far = 0; // txt data in the BGZF blocks written so far
+static uint64_t disk_so_far = 0;       // size of BGZF blocks written so far
+static uint64_t disk_after_data = 0;   // disk_so_far after the last non-empty BGZF block
+static uint64_t next_block = 0;        // iterator on written_blocks
+static int32_t n_ref = 0;              // BAI: number of references in the BAM header
+static int32_t last_tid = -1;          // for verifying that the file is sorted
+static PosType last_beg = 0;
+static bool has_no_coor = false;
+static uint64_t n_no_coor = 0;         // number of unplaced reads
+static uint32_t lidx_next_window = 0;  // first linear index window of last_tid not set yet
+
+static Buffer pending        = EMPTY_BUFFER; // PendingRec: records whose virtual offset is not known yet
+static Buffer written_blocks = EMPTY_BUFFER; // WrittenBlock
+static Buffer chunks         = EMPTY_BUFFER; // IndexChunk
+static Buffer lidx           = EMPTY_BUFFER; // LinearEntry
+static Buffer refs           = EMPTY_BUFFER; // RefStats, indexed by tid
+static Buffer names          = EMPTY_BUFFER; // TBI: chrom names, nul-separated, in order of tid
+
+TxtIndexType txtindex_get_type (ConstFileP file)
+{
+    if (!flag.index_txt || flag.test || flag.to_stdout || !file || !file->name || file->codec != CODEC_BGZF)
+        return TXTINDEX_NONE;
+
+    switch (file->data_type) {
+        case DT_BAM : return TXTINDEX_BAI;
+        case DT_VCF : return TXTINDEX_TBI;
+        default     : return TXTINDEX_NONE; // other data types are indexed by an external tool - see file_index_txt
+    }
+}
+
+// standard binning scheme, see SAMv1.pdf section 5.3
+static inline uint32_t txtindex_reg2bin (PosType beg, PosType end)
+{
+    end--;
+    if (beg>>14 == end>>14) return ((1<<15)-1)/7 + (beg>>14);
+    if (beg>>17 == end>>17) return ((1<<12)-1)/7 + (beg>>17);
+    if (beg>>20 == end>>20) return ((1<<9 )-1)/7 + (beg>>20);
+    if (beg>>23 == end>>23) return ((1<<6 )-1)/7 + (beg>>23);
+    if (beg>>26 == end>>26) return ((1<<3 )-1)/7 + (beg>>26);
+    return 0;
+}
+
+// --------------------
+// Compute thread
+// --------------------
+
+static void txtindex_piz_vb_bam (VBlockP vb)
+{
+    ARRAY (const char, txt, vb->txt_data);
+
+    for (uint32_t next=0; next + sizeof (BAMAlignmentFixed) <= txt_len; ) {
+        const BAMAlignmentFixed *aln = (const BAMAlignmentFixed *)&txt[next];
+        uint32_t rec_len = sizeof (uint32_t) + LTEN32 (aln->block_size); // block_size doesn't include the block_size field itself
+
+        // reference length, according to the CIGAR ops that consume the reference: M, D, N, =, X
+        const uint32_t *cigar = (const uint32_t *)&aln->read_name[aln->l_read_name];
+        PosType ref_len = 0;
+        for (uint16_t i=0; i < LTEN16 (aln->n_cigar_op); i++) {
+            uint32_t op = LTEN32 (cigar[i]);
+            if ((1 << (op & 0xf)) & ((1<<0) | (1<<2) | (1<<3) | (1<<7) | (1<<8))) ref_len += op >> 4;
+        }
+
+        bool unmapped = LTEN16 (aln->flag) & 0x4;
+        PosType pos   = (int32_t)LTEN32 (aln->pos);
+
+        buf_alloc_more (vb, &vb->txtindex_recs, 1, vb->lines.len, TxtIndexRec, 1.5, "txtindex_recs");
+        NEXTENT (TxtIndexRec, vb->txtindex_recs) = (TxtIndexRec){
+            .tid       = (int32_t)LTEN32 (aln->ref_id),
+            .beg       = pos,
+            .end       = pos + ((ref_len && !unmapped) ? ref_len : 1), // same as htslib's bam_endpos
+            .txt_start = next,
+            .txt_end   = next + rec_len,
+            .unmapped  = unmapped
+        };
+
+        next += rec_len;
+    }
+}
+
+static void txtindex_piz_vb_vcf (VBlockP vb)
+{
+    ARRAY (const char, txt, vb->txt_data);
+
+    for (uint32_t next=0; next < txt_len; ) {
+        const char *line = &txt[next];
+        const char *after = txt + txt_len;
+        const char *eol = memchr (line, '\n', after - line);
+        uint32_t line_len = eol ? (eol - line + 1) : (after - line);
+
+        if (*line == '#') goto next_line; // shouldn't happen - header lines are not in VBs
+
+        // find the starts of the fields CHROM, POS, REF and INFO
+        const char *fields[8] = { line };
+        unsigned field_i=1;
+        for (const char *c=line; c < line + line_len && field_i < 8; c++)
+            if (*c == '\t') fields[field_i++] = c+1;
+
+        if (field_i < 8) goto next_line; // not a valid VCF line
+
+        PosType pos = strtoll (fields[1], NULL, 10);
+        uint32_t ref_len = fields[4] - fields[3] - 1;
+        PosType end = pos - 1 + ref_len;
+
+        // END in INFO overrides the REF length
+        for (const char *info = fields[7]; info < line + line_len && *info != '\t' && *info != '\n'; ) {
+            if (!memcmp (info, "END=", 4)) {
+                end = strtoll (info + 4, NULL, 10);
+                break;
+            }
+            while (info < line + line_len && *info != ';' && *info != '\t' && *info != '\n') info++;
+            if (*info == ';') info++;
+        }
+
+        buf_alloc_more (vb, &vb->txtindex_recs, 1, vb->lines.len, TxtIndexRec, 1.5, "txtindex_recs");
+        NEXTENT (TxtIndexRec, vb->txtindex_recs) = (TxtIndexRec){
+            .tid         = -1,
+            .chrom_index = next,
+            .chrom_len   = fields[1] - line - 1,
+            .beg         = pos - 1,
+            .end         = MAX (end, pos),
+            .txt_start   = next,
+            .txt_end     = next + line_len
+        };
+
+    next_line:
+        next += line_len;
+    }
+}
+
+// PIZ compute thread: collect the coordinates of the records of the VB, after it is reconstructed
+void txtindex_piz_vb (VBlockP vb)
+{
+    switch (txtindex_get_type (txt_file)) {
+        case TXTINDEX_BAI : txtindex_piz_vb_bam (vb); break;
+        case TXTINDEX_TBI : txtindex_piz_vb_vcf (vb); break;
+        default           : break;
+    }
+}
+
+// --------------------
+// I/O thread
+// --------------------
+
+static void txtindex_reset (void)
+{
+    failed = has_no_coor = false;
+    txt_so_far = blocks_txt_so_far = disk_so_far = disk_after_data = next_block = n_no_coor = 0;
+    n_ref = 0;
+    last_tid = -1;
+    last_beg = 0;
+    lidx_next_window = 0;
+
+    buf_free (&pending);
+    buf_free (&written_blocks);
+    buf_free (&chunks);
+    buf_free (&lidx);
+    buf_free (&refs);
+    buf_free (&names);
+}
+
+// TBI: get the tid of a chrom - tids are assigned by order of first appearance
+static int32_t txtindex_get_tid (const char *chrom, uint32_t chrom_len)
+{
+    // case: same chrom as previous record
+    if (last_tid >= 0) {
+        const char *last_chrom = &names.data[names.param]; // we store the index of the last chrom name in param
+        if (strlen (last_chrom) == chrom_len && !memcmp (last_chrom, chrom, chrom_len)) return last_tid;
+    }
+
+    // case: a chrom that appeared before, but not in the previous record - file is not sorted
+    for (uint64_t i=0; i < names.len; i += strlen (&names.data[i]) + 1)
+        if (strlen (&names.data[i]) == chrom_len && !memcmp (&names.data[i], chrom, chrom_len)) return -2;
+
+    // case: new chrom
+    buf_alloc_more (evb, &names, chrom_len + 1, 0, char, 2, "txtindex_names");
+    names.param = names.len;
+    buf_add (&names, chrom, chrom_len);
+    NEXTENT (char, names) = 0;
+
+    return n_ref++;
+}
+
+// BAI: get n_ref from the BAM header
+static void txtindex_add_bam_header (VBlockP vb)
+{
+    if (vb->txt_data.len < 3 * sizeof (uint32_t) || memcmp (vb->txt_data.data, "BAM\1", 4)) return;
+
+    uint32_t l_text = LTEN32 (*(uint32_t *)&vb->txt_data.data[4]);
+    if (vb->txt_data.len < 3 * sizeof (uint32_t) + l_text) return;
+
+    n_ref = (int32_t)LTEN32 (*(uint32_t *)&vb->txt_data.data[8 + l_text]);
+}
+
+static bool txtindex_verify_sorted (int32_t tid, PosType beg, PosType end)
+{
+    if (tid == -1) { // unplaced reads come last
+        has_no_coor = true;
+        return true;
+    }
+
+    if (tid == -2 || has_no_coor || tid < last_tid || (tid == last_tid && beg < last_beg)) {
+        WARN ("%s: cannot create an index for %s, because it is not sorted by coordinate", global_cmd, txt_name);
+        failed = true;
+        return false;
+    }
+
+    if (end > MAX_INDEXABLE_POS) {
+        WARN ("%s: cannot create an index for %s, because it contains positions beyond %u", global_cmd, txt_name, MAX_INDEXABLE_POS);
+        failed = true;
+        return false;
+    }
+
+    last_tid = tid;
+    last_beg = beg;
+    return true;
+}
+
+// I/O thread: called by bgzf_write_to_disk before writing a VB or the txt header
+void txtindex_add_vb (VBlockP vb)
+{
+    if (failed) return;
+
+    // case: txt header
+    if (vb == evb) {
+        if (txtindex_get_type (txt_file) == TXTINDEX_BAI && !n_ref) txtindex_add_bam_header (vb);
+        txt_so_far += vb->txt_data.len;
+        return;
+    }
+
+    buf_alloc_more (evb, &pending, vb->txtindex_recs.len, 0, PendingRec, 1.5, "txtindex_pending");
+
+    ARRAY (const TxtIndexRec, recs, vb->txtindex_recs);
+    for (uint64_t i=0; i < recs_len; i++) {
+        int32_t tid = (recs[i].tid == -1 && recs[i].chrom_len) ? txtindex_get_tid (ENT (char, vb->txt_data, recs[i].chrom_index), recs[i].chrom_len)
+                                                               : recs[i].tid;
+
+        if (!txtindex_verify_sorted (tid, recs[i].beg, recs[i].end)) return;
+
+        NEXTENT (PendingRec, pending) = (PendingRec){
+            .tid       = tid,
+            .beg       = recs[i].beg,
+            .end       = recs[i].end,
+            .txt_start = txt_so_far + recs[i].txt_start,
+            .txt_end   = txt_so_far + recs[i].txt_end,
+            .unmapped  = recs[i].unmapped
+        };
+    }
+
+    txt_so_far += vb->txt_data.len;
+}
+
+// get the virtual file offset of a location in the txt file - if the BGZF block containing it has already been written
+static bool txtindex_get_voffset (uint64_t txt_offset, bool is_final, uint64_t *voff)
+{
+    ARRAY (const WrittenBlock, bl, written_blocks);
+
+    // note: records are added in order, so we never need a block before next_block again
+    while (next_block < bl_len && bl[next_block].txt_start + bl[next_block].isize <= txt_offset) next_block++;
+
+    if (next_block < bl_len)
+        *voff = (bl[next_block].disk_start << 16) | (txt_offset - bl[next_block].txt_start);
+
+    else if (is_final) // end of the data - points to the EOF block (same as htslib's bgzf_tell after reading the last record)
+        *voff = disk_after_data << 16;
+
+    else
+        return false;
+
+    return true;
+}
+
+static void txtindex_add_rec (const PendingRec *r, uint64_t voff_beg, uint64_t voff_end)
+{
+    if (r->tid < 0) {
+        n_no_coor++;
+        return;
+    }
+
+    // per-reference data of the pseudo-bin
+    if (refs.len <= r->tid) {
+        buf_alloc (evb, &refs, (r->tid + 1) * sizeof (RefStats), 2, "txtindex_refs");
+        memset (ENT (RefStats, refs, refs.len), 0, (r->tid + 1 - refs.len) * sizeof (RefStats));
+        refs.len = r->tid + 1;
+    }
+
+    RefStats *rs = ENT (RefStats, refs, r->tid);
+    if (!rs->exists) {
+        rs->exists  = true;
+        rs->off_beg = voff_beg;
+        lidx_next_window = 0;
+    }
+    rs->off_end = voff_end;
+    if (r->unmapped) rs->n_unmapped++;
+    else             rs->n_mapped++;
+
+    // binning index: consecutive records in the same bin are merged into a single chunk
+    uint32_t bin = txtindex_reg2bin (r->beg, r->end);
+    IndexChunk *last = chunks.len ? LASTENT (IndexChunk, chunks) : NULL;
+
+    if (last && last->tid == r->tid && last->bin == bin && last->end == voff_beg)
+        last->end = voff_end;
+    else {
+        buf_alloc_more (evb, &chunks, 1, 1000, IndexChunk, 2, "txtindex_chunks");
+        NEXTENT (IndexChunk, chunks) = (IndexChunk){ .tid = r->tid, .bin = bin, .beg = voff_beg, .end = voff_end };
+    }
+
+    // linear index: each 16Kbp window gets the virtual offset of the first record overlapping it
+    uint32_t first_window = r->beg >> LIDX_SHIFT, last_window = (r->end - 1) >> LIDX_SHIFT;
+    for (uint32_t w = MAX (first_window, lidx_next_window); w <= last_window; w++) {
+        buf_alloc_more (evb, &lidx, 1, 1000, LinearEntry, 2, "txtindex_lidx");
+        NEXTENT (LinearEntry, lidx) = (LinearEntry){ .tid = r->tid, .window = w, .voff = voff_beg };
+    }
+    lidx_next_window = MAX (lidx_next_window, last_window + 1);
+}
+
+// add all pending records for which the virtual offsets of both their start and end are known
+static void txtindex_add_pending (bool is_final)
+{
+    ARRAY (const PendingRec, p, pending);
+
+    uint64_t i=0;
+    for (; i < p_len; i++) {
+        uint64_t voff_beg, voff_end;
+        if (!txtindex_get_voffset (p[i].txt_start, is_final, &voff_beg) ||
+            !txtindex_get_voffset (p[i].txt_end,   is_final, &voff_end)) break;
+
+        txtindex_add_rec (&p[i], voff_beg, voff_end);
+    }
+
+    // remove the records we added
+    if (i) {
+        memmove (pending.data, &p[i], (p_len - i) * sizeof (PendingRec));
+        pending.len -= i;
+    }
+}
+
+// I/O thread: called by bgzf_write_to_disk after writing BGZF blocks to the txt file
+void txtindex_add_bgzf_blocks (const char *data, uint64_t len)
+{
+    if (failed) return;
+
+    for (uint64_t i=0; i < len; ) {
+        uint32_t block_size = LTEN16 (*(uint16_t *)&data[i + 16]) + 1; // BSIZE field of the BGZF header is the block size - 1
+        uint32_t isize      = LTEN32 (*(uint32_t *)&data[i + block_size - 4]); // last field of the block
+
+        if (isize) {
+            buf_alloc_more (evb, &written_blocks, 1, 1000, WrittenBlock, 2, "txtindex_written_blocks");
+            NEXTENT (WrittenBlock, written_blocks) = (WrittenBlock){ .txt_start = blocks_txt_so_far, .disk_start = disk_so_far, .isize = isize };
+            disk_after_data = disk_so_far + block_size;
+        }
+
+        blocks_txt_so_far += isize;
+        disk_so_far       += block_size;
+        i                 += block_size;
+    }
+
+    txtindex_add_pending (false);
+}
+
+static void txtindex_add_data (Buffer *buf, const void *data, uint32_t len)
+{
+    buf_alloc_more (evb, buf, len, 0, char, 2, "txtindex_out");
+    buf_add (buf, data, len);
+}
+
+static inline void txtindex_add32 (Buffer *buf, uint32_t n) { n = LTEN32 (n); txtindex_add_data (buf, &n, sizeof (n)); }
+static inline void txtindex_add64 (Buffer *buf, uint64_t n) { n = LTEN64 (n); txtindex_add_data (buf, &n, sizeof (n)); }
+
+static int txtindex_sort_chunks (const void *a_, const void *b_)
+{
+    const IndexChunk *a = (const IndexChunk *)a_, *b = (const IndexChunk *)b_;
+
+    if (a->tid != b->tid) return (a->tid > b->tid) ? 1 : -1;
+    if (a->bin != b->bin) return (a->bin > b->bin) ? 1 : -1;
+    if (a->beg != b->beg) return (a->beg > b->beg) ? 1 : -1;
+    return 0;
+}
+
+// write the binning and linear indices of one reference
+static void txtindex_write_ref (Buffer *out, int32_t tid, const IndexChunk **ch, const IndexChunk *after_ch, const LinearEntry **li, const LinearEntry *after_li)
+{
+    const RefStats *rs = (tid < refs.len) ? ENT (RefStats, refs, tid) : NULL;
+
+    if (!rs || !rs->exists) {
+        txtindex_add32 (out, 0); // n_bin
+        txtindex_add32 (out, 0); // n_intv
+        return;
+    }
+
+    // merge consecutive chunks of the same bin that are adjacent or in the same BGZF block (as htslib does)
+    IndexChunk *first = (IndexChunk *)*ch, *merged = first;
+    for (IndexChunk *c = first + 1; c < after_ch && c->tid == tid; c++) {
+        if (c->bin == merged->bin && (c->beg <= merged->end || (c->beg >> 16) == (merged->end >> 16)))
+            merged->end = MAX (merged->end, c->end);
+        else
+            *(++merged) = *c;
+    }
+    const IndexChunk *after_merged = merged + 1;
+    *ch = first; while (*ch < after_ch && (*ch)->tid == tid) (*ch)++; // advance to next tid
+
+    // binning index
+    uint32_t n_bin = 1; // pseudo-bin
+    for (const IndexChunk *c = first; c < after_merged; c++)
+        if (c == first || c->bin != (c-1)->bin) n_bin++;
+
+    txtindex_add32 (out, n_bin);
+
+    for (const IndexChunk *c = first; c < after_merged; ) {
+        const IndexChunk *bin_start = c;
+        while (c < after_merged && c->bin == bin_start->bin) c++;
+
+        txtindex_add32 (out, bin_start->bin);
+        txtindex_add32 (out, c - bin_start); // n_chunk
+        for (const IndexChunk *bc = bin_start; bc < c; bc++) {
+            txtindex_add64 (out, bc->beg);
+            txtindex_add64 (out, bc->end);
+        }
+    }
+
+    txtindex_add32 (out, PSEUDO_BIN);
+    txtindex_add32 (out, 2);
+    txtindex_add64 (out, rs->off_beg);
+    txtindex_add64 (out, rs->off_end);
+    txtindex_add64 (out, rs->n_mapped);
+    txtindex_add64 (out, rs->n_unmapped);
+
+    // linear index: windows not overlapped by any record get the offset of the previous window (or first record)
+    const LinearEntry *first_li = *li;
+    while (*li < after_li && (*li)->tid == tid) (*li)++;
+    uint32_t n_intv = (*li > first_li) ? (*li)[-1].window + 1 : 0;
+
+    txtindex_add32 (out, n_intv);
+
+    uint64_t voff = rs->off_beg;
+    const LinearEntry *e = first_li;
+    for (uint32_t w=0; w < n_intv; w++) {
+        if (e < *li && e->window == w) voff = (e++)->voff;
+        txtindex_add64 (out, voff);
+    }
+}
+
+static void txtindex_write (ConstFileP file, TxtIndexType type)
+{
+    Buffer out = EMPTY_BUFFER;
+    buf_alloc (evb, &out, 1000 + chunks.len * 20 + lidx.len * 8, 1, "txtindex_out");
+
+    if (type == TXTINDEX_BAI) {
+        buf_add (&out, "BAI\1", 4);
+        n_ref = MAX (n_ref, (int32_t)refs.len); // in case the BAM header was not written
+        txtindex_add32 (&out, n_ref);
+    }
+    else {
+        buf_add (&out, "TBI\1", 4);
+        txtindex_add32 (&out, n_ref);
+        txtindex_add32 (&out, 2);   // format: VCF
+        txtindex_add32 (&out, 1);   // col_seq
+        txtindex_add32 (&out, 2);   // col_beg
+        txtindex_add32 (&out, 0);   // col_end
+        txtindex_add32 (&out, '#'); // meta
+        txtindex_add32 (&out, 0);   // skip
+        txtindex_add32 (&out, names.len);
+        txtindex_add_data (&out, names.data, names.len);
+    }
+
+    qsort (chunks.data, chunks.len, sizeof (IndexChunk), txtindex_sort_chunks);
+
+    const IndexChunk *ch = FIRSTENT (const IndexChunk, chunks);
+    const LinearEntry *li = FIRSTENT (const LinearEntry, lidx);
+    for (int32_t tid=0; tid < n_ref; tid++)
+        txtindex_write_ref (&out, tid, &ch, AFTERENT (const IndexChunk, chunks), &li, AFTERENT (const LinearEntry, lidx));
+
+    txtindex_add64 (&out, n_no_coor);
+
+    char index_filename[strlen (file->name) + 5];
+    sprintf (index_filename, "%s.%s", file->name, type == TXTINDEX_BAI ? "bai" : "tbi");
+
+    // a TBI file is BGZF-compressed, a BAI file is not
+    bool success;
+    if (type == TXTINDEX_TBI) {
+        bgzf_compress_buffer (evb, out.data, out.len);
+        success = file_put_data (index_filename, evb->compressed.data, evb->compressed.len);
+        buf_free (&evb->compressed);
+    }
+    else
+        success = file_put_data (index_filename, out.data, out.len);
+
+    ASSERTW (success, "%s: failed to write index file %s: %s", global_cmd, index_filename, strerror (errno));
+
+    buf_destroy (&out);
+}
+
+// I/O thread: called from file_close after the txt file is closed
+void txtindex_finalize (ConstFileP file)
+{
+    txtindex_add_pending (true);
+
+    if (!failed) txtindex_write (file, txtindex_get_type (file));
+
+    txtindex_reset();
+}
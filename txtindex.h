@@ -0,0 +1,23 @@
+// ------------------------------------------------------------------
+//   txtindex.h
+//   Copyright (C) 2020 Divon Lan <divon@genozip.com>
+//   Please see terms and conditions in the files LICENSE.non-commercial.txt and LICENSE.commercial.txt
+
+#ifndef TXTINDEX_INCLUDED
+#define TXTINDEX_INCLUDED
+
+#include "genozip.h"
+
+typedef enum { TXTINDEX_NONE, TXTINDEX_BAI, TXTINDEX_TBI } TxtIndexType;
+
+extern TxtIndexType txtindex_get_type (ConstFileP file);
+
+// compute thread
+extern void txtindex_piz_vb (VBlockP vb);
+
+// I/O thread
+extern void txtindex_add_vb (VBlockP vb);
+extern void txtindex_add_bgzf_blocks (const char *data, uint64_t len);
+extern void txtindex_finalize (ConstFileP file);
+
+#endif
@@ -36,7 +36,7 @@ void vb_release_vb (VBlock *vb)
     vb->z_next_header_i = 0;
     vb->num_contexts = 0;
     vb->chrom_node_index = vb->chrom_name_len = vb->seq_len = 0; 
-    vb->vb_position_txt_file = vb->line_start = 0;
+    vb->vb_position_txt_file = vb->line_start = vb->compute_nsec = 0;
     vb->num_lines_at_1_3 = vb->num_lines_at_2_3 = 0;
     vb->dont_show_curr_line = vb->has_non_agct = false;    
     vb->num_type1_subfields = vb->num_type2_subfields = 0;
@@ -49,6 +49,9 @@ void vb_release_vb (VBlock *vb)
     vb->fragment_ctx = vb->ht_matrix_ctx = vb->runs_ctx = vb->fgrc_ctx = NULL;
     vb->fragment_codec = 0;
     vb->ht_per_line = 0;
+    vb->no_checkpoints = false;
+    vb->first_rep = vb->after_rep = 0;
+    vb->bgzf_split_in_compute = false;
     memset(&vb->profile, 0, sizeof (vb->profile));
     memset(vb->dict_id_to_did_i_map, 0, sizeof(vb->dict_id_to_did_i_map));
 
@@ -64,6 +67,9 @@ void vb_release_vb (VBlock *vb)
     buf_free(&vb->section_list_buf);
     buf_free(&vb->region_ra_intersection_matrix);
     buf_free(&vb->bgzf_blocks);
+    buf_free(&vb->checkpoints);
+    buf_free(&vb->txtindex_recs);
+    buf_free(&vb->tokenizer_layout);
 
     for (unsigned i=0; i < MAX_DICTS; i++) 
         if (vb->contexts[i].dict_id.num)
@@ -71,6 +77,11 @@ void vb_release_vb (VBlock *vb)
 
     for (unsigned i=0; i < NUM_CODEC_BUFS; i++)
         buf_free (&vb->codec_bufs[i]);
+
+    for (unsigned i=0; i < MAX_PBWT_PARTITIONS; i++) {
+        buf_free (&vb->pbwt_runs[i]);
+        buf_free (&vb->pbwt_fgrc[i]);
+    }
         
     vb->in_use = false; // released the VB back into the pool - it may now be reused
 
@@ -104,6 +115,9 @@ void vb_destroy_vb (VBlockP *vb_p)
     buf_destroy (&vb->show_b250_buf);
     buf_destroy (&vb->section_list_buf);
     buf_destroy (&vb->region_ra_intersection_matrix);
+    buf_destroy (&vb->checkpoints);
+    buf_destroy (&vb->txtindex_recs);
+    buf_destroy (&vb->tokenizer_layout);
 
     for (unsigned i=0; i < MAX_DICTS; i++) 
         if (vb->contexts[i].dict_id.num)
@@ -112,6 +126,11 @@ void vb_destroy_vb (VBlockP *vb_p)
     for (unsigned i=0; i < NUM_CODEC_BUFS; i++)
         buf_destroy (&vb->codec_bufs[i]);
 
+    for (unsigned i=0; i < MAX_PBWT_PARTITIONS; i++) {
+        buf_destroy (&vb->pbwt_runs[i]);
+        buf_destroy (&vb->pbwt_fgrc[i]);
+    }
+
     // destory data_type -specific buffers
     if (vb->data_type != DT_NONE)
         DT_FUNC(vb, destroy_vb)(vb);
@@ -145,6 +164,21 @@ void vb_initialize_evb(void)
     evb->id = -1;
 }
 
+// a VB that is not part of the pool - for helper threads of a compute thread, that need their own buffers (eg for codec memory).
+// destroy with vb_destroy_vb
+VBlock *vb_get_nonpool_vb (VBlockP parent_vb)
+{
+    VBlock *vb = CALLOC (sizeof (VBlock));
+    vb->id             = parent_vb->id;
+    vb->vblock_i       = parent_vb->vblock_i;
+    vb->data_type      = DT_NONE;
+    vb->in_use         = true;
+    vb->buffer_list.vb = vb;
+    memset (vb->dict_id_to_did_i_map, 0xff, sizeof(vb->dict_id_to_did_i_map)); // DID_I_NONE
+
+    return vb;
+}
+
 // allocate an unused vb from the pool. seperate pools for zip and unzip
 VBlock *vb_get_vb (const char *task_name, uint32_t vblock_i)
 {
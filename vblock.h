@@ -39,6 +39,7 @@ typedef enum { GS_READ, GS_TEST, GS_UNCOMPRESS } GrepStages;
     /* tracking execution */\
     uint64_t vb_position_txt_file; /* position of this VB's data in the plain text file (i.e after decompression if the txt_file is compressed) */\
     int32_t vb_data_size;      /* ZIP: actual size of txt read from file ; PIZ: expected size of decompressed txt. Might be different than original if --optimize is used. */\
+    uint64_t compute_nsec;     /* ZIP: wallclock time of the compute thread processing this VB - used to adapt vblock_memory */\
     uint32_t longest_line_len; /* length of longest line of text line in this vb. calculated by seg_all_data_lines */\
     uint32_t line_i;           /* ZIP: current line in VB (0-based) being segmented PIZ: current line in txt file */\
     uint64_t line_start;       /* PIZ: position of start of line currently being reconstructed in vb->txt_data */\
@@ -67,6 +68,7 @@ typedef enum { GS_READ, GS_TEST, GS_UNCOMPRESS } GrepStages;
     /* bgzf - for handling bgzf-compressed files */ \
     void *gzip_compressor;     /* Handle into libdeflate compressor or decompressor, or zlib's z_stream. Pointer to codec_bufs[].data */ \
     Buffer bgzf_blocks;        /* ZIP: an array of BgzfBlockZip tracking the decompression of blocks into txt_data */\
+    bool bgzf_split_in_compute;/* PIZ: the first BGZF block, shared with the previous VB, is compressed by a compute thread (see bgzf_compress_split_block) */\
     \
     /* random access, chrom, pos */ \
     Buffer ra_buf;             /* ZIP only: array of RAEntry - copied to z_file at the end of each vb compression, then written as a SEC_RANDOM_ACCESS section at the end of the genozip file */\
@@ -78,6 +80,13 @@ typedef enum { GS_READ, GS_TEST, GS_UNCOMPRESS } GrepStages;
     /* regions & filters */ \
     Buffer region_ra_intersection_matrix;  /* PIZ: a byte matrix - each row represents an ra in this vb, and each column is a region specieid in the command. the cell contains 1 if this ra intersects with this region */\
     \
+    /* sub-VB positional index - see checkpoint.c */ \
+    Buffer checkpoints;        /* ZIP: checkpoint records of this VB, taken every flag.checkpoint_lines lines */ \
+    bool no_checkpoints;       /* ZIP: this VB cannot be indexed (eg it has more than one chrom) */ \
+    Buffer txtindex_recs;      /* PIZ: with --index: coordinates and location in txt_data of the records of this VB */ \
+    Buffer tokenizer_layout;   /* ZIP: layout of the read names of this VB, see tokenizer.c */ \
+    uint32_t first_rep, after_rep; /* PIZ: range of lines of the toplevel container to be reconstructed. after_rep=0 means all lines */ \
+    \
     /* crypto stuff */\
     Buffer spiced_pw;          /* used by crypt_generate_aes_key() */\
     uint8_t aes_round_key[240];/* for 256 bit aes */\
@@ -121,7 +130,8 @@ typedef enum { GS_READ, GS_TEST, GS_UNCOMPRESS } GrepStages;
     Context *ht_matrix_ctx; \
     \
     /* used by CODEC_PBWT */ \
-    Context *runs_ctx, *fgrc_ctx;
+    Context *runs_ctx, *fgrc_ctx; \
+    Buffer pbwt_runs[MAX_PBWT_PARTITIONS], pbwt_fgrc[MAX_PBWT_PARTITIONS]; /* ZIP with --pbwt-partitions: RUNS and FGRC data of each partition, before concatenation */
 
 typedef struct VBlock {
     VBLOCK_COMMON_FIELDS
@@ -130,6 +140,8 @@ typedef struct VBlock {
 extern void vb_cleanup_memory(void);
 extern VBlock *vb_get_vb (const char *task_name, uint32_t vblock_i);
 extern void vb_initialize_evb(void);
+extern VBlock *vb_get_nonpool_vb (VBlockP parent_vb);
+extern void vb_destroy_vb (VBlockP *vb_p);
 extern void vb_release_vb (VBlock *vb);
 extern void vb_destroy_all_vbs (void);
 
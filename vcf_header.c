@@ -42,6 +42,12 @@ bool vcf_inspect_txt_header (Buffer *txt_header)
         if (flag.header_one) 
             vcf_header_keep_only_last_line (&evb->txt_data);  // drop lines except last (with field and samples name)
 
+        // --allele-counts outputs a TSV (see vcf_piz_allele_counts) rather than a VCF
+        if (flag.allele_counts) {
+            evb->txt_data.len = 0;
+            buf_add_string (evb, &evb->txt_data, "#CHROM\tPOS\tID\tREF\tALT\tAN\tAC\tAF\tN_MISSING\tN_HOM_REF\tN_HET\tN_HOM_ALT\n");
+        }
+
         return true;
     }
 }
@@ -26,15 +26,113 @@ bool vcf_piz_is_skip_section (VBlockP vb, SectionType st, DictId dict_id)
         (dict_id.num == dict_id_fields[VCF_FORMAT] || dict_id.num == dict_id_fields[VCF_SAMPLES] || dict_id_is_vcf_format_sf (dict_id)))
         return true;
 
-    if (flag.gt_only && (dict_id_is_vcf_format_sf (dict_id) && dict_id.num != dict_id_FORMAT_GT))
+    // note: the haplotype data contexts are also FORMAT-type dict_ids, but they are needed to reconstruct GT
+    if ((flag.gt_only || flag.allele_counts) && (dict_id_is_vcf_format_sf (dict_id) && dict_id.num != dict_id_FORMAT_GT &&
+        dict_id.num != dict_id_FORMAT_GT_HT       && dict_id.num != dict_id_FORMAT_GT_HT_INDEX &&
+        dict_id.num != dict_id_PBWT_RUNS          && dict_id.num != dict_id_PBWT_FGRC &&
+        dict_id.num != dict_id_FORMAT_GT_SHARK_DB && dict_id.num != dict_id_FORMAT_GT_SHARK_GT && dict_id.num != dict_id_FORMAT_GT_SHARK_EX))
         return true;
 
     return false;
 }
 
+// --allele-counts: replaces the line, which is reconstructed up to and including the FORMAT field, with a TSV line 
+// containing CHROM, POS, ID, REF, ALT and counts calculated directly from the line's row in the haplotype matrix. 
+// AC and AF have one comma-separated value per ALT allele, in ALT order. the samples are not reconstructed.
+static void vcf_piz_allele_counts (VBlockVCFP vb)
+{
+    uint32_t an=0, n_missing=0, n_hom_ref=0, n_het=0, n_hom_alt=0, n_with_gt=0;
+
+    // REF and ALT are already reconstructed - count the ALT alleles
+    Context *refalt_ctx = &vb->contexts[VCF_REFALT];
+    const char *refalt = ENT (char, vb->txt_data, refalt_ctx->last_txt);
+    const char *alt = memchr (refalt, '\t', refalt_ctx->last_txt_len);
+    uint32_t alt_len = alt ? refalt_ctx->last_txt_len - (++alt - refalt) : 0;
+
+    uint32_t num_alts = (alt_len && !(alt_len == 1 && *alt == '.')) ? 1 : 0;
+    for (uint32_t i=0; i < alt_len; i++) 
+        if (alt[i] == ',') num_alts++;
+
+    uint32_t ac[MAX (num_alts, 1)];
+    memset (ac, 0, sizeof (ac));
+
+    if (vb->ht_matrix_ctx) {
+        ASSINP (vb->ht_matrix_ctx->lcodec == CODEC_PBWT, "--allele-counts is not supported for %s because it was compressed with an older version of genozip. Please re-compress it", z_name);
+
+        uint32_t num_samples = vcf_header_get_num_samples();
+        uint32_t ploidy = vb->ht_per_line / num_samples;
+        const Allele *ht = ENT (Allele, vb->ht_matrix_ctx->local, (vb->line_i - vb->first_line) * vb->ht_per_line);
+
+        for (uint32_t sample_i=0; sample_i < num_samples; sample_i++, ht += ploidy) {
+            if (!samples_am_i_included (sample_i)) continue;
+
+            uint32_t n_ht=0, n_alt=0, n_miss=0;
+            Allele first_allele=0;
+            bool all_same=true;
+
+            for (uint32_t p=0; p < ploidy; p++) {
+                if (ht[p] == '*' || ht[p] == '-') continue; // no GT in this line, or ploidy padding
+                
+                if (ht[p] == '.' || ht[p] == '%') { n_miss++; continue; } // % is a . segged by vcf_seg_FORMAT_GT
+
+                n_ht++;
+                if (ht[p] != '0') {
+                    n_alt++;
+                    uint32_t alt_i = (uint32_t)(ht[p] - '1'); // alleles are '0'+allele_index
+                    if (alt_i < num_alts) ac[alt_i]++;
+                }
+
+                if (!first_allele) first_allele = ht[p];
+                else if (ht[p] != first_allele) all_same = false;
+            }
+
+            if (!n_ht && !n_miss) continue; // this sample has no GT in this line
+
+            an += n_ht;
+            n_with_gt++;
+
+            if      (n_miss)    n_missing++;
+            else if (!n_alt)    n_hom_ref++;
+            else if (all_same)  n_hom_alt++;
+            else                n_het++;
+        }
+    }
+
+    // keep CHROM, POS, ID, REF and ALT which are at the beginning of the line, and drop the rest
+    vb->txt_data.len = refalt_ctx->last_txt + refalt_ctx->last_txt_len;
+
+    // case: none of the samples has a GT in this line - there is nothing to count, so we don't make up counts
+    if (!n_with_gt) {
+        buf_add_string ((VBlockP)vb, &vb->txt_data, "\t.\t.\t.\t.\t.\t.\t.");
+        return;
+    }
+
+    bufprintf ((VBlockP)vb, &vb->txt_data, "\t%u\t", an);
+
+    for (uint32_t alt_i=0; alt_i < num_alts; alt_i++)
+        bufprintf ((VBlockP)vb, &vb->txt_data, "%s%u", alt_i ? "," : "", ac[alt_i]);
+    
+    if (!num_alts) bufprintf ((VBlockP)vb, &vb->txt_data, "%s", ".");
+    bufprintf ((VBlockP)vb, &vb->txt_data, "%s", "\t");
+
+    for (uint32_t alt_i=0; alt_i < num_alts; alt_i++) {
+        char af_str[30] = ".";
+        if (an) sprintf (af_str, "%.6g", (double)ac[alt_i] / (double)an);
+        bufprintf ((VBlockP)vb, &vb->txt_data, "%s%s", alt_i ? "," : "", af_str);
+    }
+
+    if (!num_alts) bufprintf ((VBlockP)vb, &vb->txt_data, "%s", ".");
+    bufprintf ((VBlockP)vb, &vb->txt_data, "\t%u\t%u\t%u\t%u", n_missing, n_hom_ref, n_het, n_hom_alt);
+}
+
 CONTAINER_FILTER_FUNC (vcf_piz_filter)
 {
     if (dict_id.num == dict_id_fields[VCF_SAMPLES]) {
+        if (flag.allele_counts) { // samples are not reconstructed - instead, we output counts calculated from the haplotype matrix
+            if (item < 0 && rep == 0) vcf_piz_allele_counts ((VBlockVCFP)vb);
+            return false;
+        }
+
         if (item < 0)  // filter for repeat
             return samples_am_i_included (rep); 
 
@@ -54,7 +152,7 @@ SPECIAL_RECONSTRUCTOR (vcf_piz_special_FORMAT)
 
     bool has_GT = (snip_len>=2 && snip[0]=='G' && snip[1] == 'T' && (snip_len==2 || snip[2] == ':'));
     
-    if (reconstruct) {
+    if (reconstruct && !flag.allele_counts) { // with --allele-counts, FORMAT is replaced by the counts (in vcf_piz_allele_counts)
         if (flag.gt_only) {
             if (has_GT)
                 RECONSTRUCT ("GT\t", 3)
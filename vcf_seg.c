@@ -15,6 +15,7 @@
 #include "dict_id.h"
 #include "codec.h"
 #include "reference.h"
+#include "checkpoint.h"
 
 #define DATA_LINE(i) ENT (ZipDataLineVCF, vb->lines, i)
 
@@ -54,6 +55,9 @@ void vcf_seg_finalize (VBlockP vb_)
     if (vb->ht_matrix_ctx) 
         vcf_seg_complete_missing_lines (vb);
 
+    if (flag.checkpoint_lines) 
+        checkpoint_zip_finalize (vb_);
+
     // top level snip
     SmallContainer top_level = { 
         .repeats     = vb->lines.len,
@@ -1053,6 +1057,9 @@ const char *vcf_seg_txt_line (VBlock *vb_, const char *field_start_line, uint32_
     VBlockVCF *vb = (VBlockVCF *)vb_;
     ZipDataLineVCF *dl = DATA_LINE (vb->line_i);
     vb->ac = vb->an = vb->af = NULL;
+
+    if (flag.checkpoint_lines) 
+        checkpoint_zip_line (vb_); // snapshot the state of the contexts before segmenting this line
     vb->has_basecounts = false;
 
     const char *next_field=field_start_line, *field_start;
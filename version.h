@@ -1,2 +1,2 @@
-#define GENOZIP_CODE_VERSION "11.0.4"
-#define GENOZIP_FILE_FORMAT_VERSION 11
+#define GENOZIP_CODE_VERSION "12.0.0"
+#define GENOZIP_FILE_FORMAT_VERSION 12
@@ -0,0 +1,601 @@
+// ------------------------------------------------------------------
+//   xz.c
+//   Copyright (C) 2020 Divon Lan <divon@genozip.com>
+//   Please see terms and conditions in the files LICENSE.non-commercial.txt and LICENSE.commercial.txt
+
+// ZIP: reading a txt file compressed with xz. An xz file consists of one or more streams, each containing blocks of
+// LZMA2-compressed data. LZMA2 is a sequence of chunks, each either uncompressed or LZMA-compressed - we decode the chunks
+// here, with the LZMA decoder of lzma/LzmaDec.c. When the headers of the blocks contain their compressed and uncompressed sizes
+// (xz writes them when compressing with multiple threads), we read several complete blocks in each round, and decompress
+// them in parallel, each into its place in the output. Otherwise (eg a single-threaded xz writes a single block without
+// sizes), we decompress the block chunk by chunk (streaming). Only the LZMA2 filter is supported - the BCJ and delta filters
+// are intended for executables and binary data. Since we read with plain fread, this works with pipes too.
+
+#include <errno.h>
+#include <pthread.h>
+#include "lzma/LzmaDec.h"
+#include "libdeflate/libdeflate.h"
+#include "genozip.h"
+#include "xz.h"
+#include "file.h"
+#include "buffer.h"
+#include "vblock.h"
+#include "codec.h"
+#include "endianness.h"
+#include "strings.h"
+
+#define XZ_READ_SIZE          (4 << 20)  // compressed data read at the beginning of each round
+#define XZ_MAX_THREADS        64
+#define XZ_STREAM_OUT         (1 << 20)  // minimum output per call when streaming
+#define XZ_MAX_BLOCK_IN_MEM   (256 << 20)// larger blocks are streamed even if their sizes are known
+#define XZ_MAX_DICT_SIZE      (1536 << 20)
+#define XZ_CHUNK_MAX_HEADER   6
+#define XZ_CHUNK_MAX_PACKED   (1 << 16)
+#define XZ_CHUNK_MAX_UNPACKED (1 << 21)
+#define XZ_FOOTER_LEN         12         // also the length of the stream header
+#define XZ_UNKNOWN            ((uint64_t)-1)
+
+#define XZ_CHECK_NONE  0
+#define XZ_CHECK_CRC32 1
+#define XZ_CHECK_CRC64 4
+
+#define XZ_PAD4(x)  (((x) + 3) & ~(uint64_t)3)
+#define XZ_IN       ((const uint8_t *)xz.in.data + xz.in.param)
+#define XZ_AVAIL    (xz.in.len - xz.in.param)
+
+typedef struct {
+    uint64_t start;                 // block header, relative to the first unconsumed byte of xz.in
+    uint32_t header_len;
+    uint64_t comp_len, uncomp_len;  // of the LZMA2 data (not including block padding and check). XZ_UNKNOWN if not in the header
+    uint64_t out_offset;            // decompressed block in xz.out
+    uint32_t dict_size;
+    uint8_t check_type;             // of the stream containing this block
+    bool is_ok;                     // decompressed and verified
+} XzBlock;
+
+typedef struct {
+    VBlockP vb;                     // memory of the LZMA decoder
+    ISzAlloc alloc;
+    CLzmaDec dec;                   // dec.dic is the output of the block being decompressed
+    uint8_t need_init;              // minimum control byte of the next LZMA chunk: 0xe0 - dictionary reset, 0xc0 - new properties, 0 - none
+    uint32_t thread_i;
+} XzThread;
+
+static struct {
+    FILE *fp;
+    Buffer in;                      // compressed data read from the file. in.param is the first byte not decompressed yet
+    Buffer out;                     // decompressed data. out.param is the first byte not yet passed to the caller
+    Buffer blocks;                  // XzBlock of the current round
+    Buffer dic;                     // dictionary, when streaming a block
+    bool in_eof, in_stream, is_streaming, is_done;
+    uint8_t check_type;             // of the current stream
+    XzBlock stream_block;           // the block being streamed
+    uint64_t stream_comp_len, stream_uncomp_len; // LZMA2 data of the block being streamed, consumed and decompressed so far
+    uint64_t stream_check;          // running check of the block being streamed
+    uint64_t consumed;              // compressed bytes decompressed so far
+    double comp_ratio;              // compressed / uncompressed in the last round - to estimate disk_so_far
+    uint32_t num_threads;
+    XzThread threads[XZ_MAX_THREADS];
+} xz;
+
+// defined in lzma/LzmaDec.c, but not declared in LzmaDec.h (Lzma2Dec.c of the LZMA SDK declares it the same way)
+extern void LzmaDec_InitDicAndState (CLzmaDec *p, BoolInt initDic, BoolInt initState);
+
+static const uint8_t xz_magic[6] = { 0xfd, '7', 'z', 'X', 'Z', 0 };
+static const uint8_t xz_check_len[16] = { 0, 4, 4, 4, 8, 8, 8, 16, 16, 16, 32, 32, 32, 64, 64, 64 };
+static uint64_t crc64_table[256];
+
+static void xz_crc64_initialize (void)
+{
+    if (crc64_table[1]) return; // already initialized
+
+    for (uint32_t i=0; i < 256; i++) {
+        uint64_t crc = i;
+        for (unsigned bit=0; bit < 8; bit++)
+            crc = (crc >> 1) ^ ((crc & 1) ? 0xC96C5795D7870F42ULL : 0); // ECMA-182, reflected
+
+        crc64_table[i] = crc;
+    }
+}
+
+static uint64_t xz_crc64 (uint64_t crc, const uint8_t *data, uint64_t len)
+{
+    crc = ~crc;
+    for (uint64_t i=0; i < len; i++)
+        crc = crc64_table[(uint8_t)crc ^ data[i]] ^ (crc >> 8);
+
+    return ~crc;
+}
+
+// CRC32 and CRC64 are verified. Other check types (SHA-256 or reserved) are skipped, but not verified.
+static uint64_t xz_update_check (uint8_t check_type, uint64_t check, const void *data, uint64_t len)
+{
+    switch (check_type) {
+        case XZ_CHECK_CRC32 : return libdeflate_crc32 ((uint32_t)check, data, len);
+        case XZ_CHECK_CRC64 : return xz_crc64 (check, data, len);
+        default             : return 0;
+    }
+}
+
+static bool xz_is_check_ok (uint8_t check_type, uint64_t check, const uint8_t *stored)
+{
+    switch (check_type) {
+        case XZ_CHECK_CRC32 : { uint32_t crc32; memcpy (&crc32, stored, 4); return LTEN32 (crc32) == (uint32_t)check; }
+        case XZ_CHECK_CRC64 : { uint64_t crc64; memcpy (&crc64, stored, 8); return LTEN64 (crc64) == check; }
+        default             : return true;
+    }
+}
+
+// called by file_open_txt_read for an .xz file
+void xz_open (File *file)
+{
+    memset (&xz, 0, sizeof (xz));
+    xz.fp          = (FILE *)file->file;
+    xz.num_threads = MAX (1, MIN (global_max_threads, XZ_MAX_THREADS));
+
+    xz_crc64_initialize();
+
+    // we allocate probabilities for lc+lp=4 - the maximum of LZMA2 - so that we don't need to re-allocate when properties change
+    static const uint8_t max_props[LZMA_PROPS_SIZE] = { 4 /* lc=4 lp=0 pb=0 */, 0, 0, 1, 0 /* dictionary size - set per block */};
+
+    for (uint32_t thread_i=0; thread_i < xz.num_threads; thread_i++) {
+        XzThread *th = &xz.threads[thread_i];
+        th->thread_i = thread_i;
+        th->vb       = vb_get_nonpool_vb (evb);
+        th->alloc    = (ISzAlloc){ .Alloc = lzma_alloc, .Free = lzma_free, .vb = th->vb };
+
+        LzmaDec_Construct (&th->dec);
+        SRes res = LzmaDec_AllocateProbs (&th->dec, max_props, LZMA_PROPS_SIZE, &th->alloc);
+        ASSERTE (res == SZ_OK, "LzmaDec_AllocateProbs failed: %s", lzma_errstr (res));
+    }
+
+    buf_alloc (evb, &xz.in, XZ_READ_SIZE, 1, "xz_in");
+}
+
+void xz_close (void)
+{
+    for (uint32_t thread_i=0; thread_i < xz.num_threads; thread_i++) {
+        LzmaDec_FreeProbs (&xz.threads[thread_i].dec, &xz.threads[thread_i].alloc);
+        vb_destroy_vb (&xz.threads[thread_i].vb);
+    }
+
+    buf_destroy (&xz.in);
+    buf_destroy (&xz.out);
+    buf_destroy (&xz.blocks);
+    buf_destroy (&xz.dic);
+    xz.num_threads = 0;
+}
+
+// reads compressed data until xz.in has at least min_len unconsumed bytes, or EOF. returns true if it has.
+static bool xz_read_input (uint64_t min_len)
+{
+    if (XZ_AVAIL >= min_len) return true;
+
+    // discard consumed data
+    if (xz.in.param) {
+        memmove (xz.in.data, xz.in.data + xz.in.param, xz.in.len - xz.in.param);
+        xz.in.len  -= xz.in.param;
+        xz.in.param = 0;
+    }
+
+    if (xz.in_eof) return false;
+
+    buf_alloc (evb, &xz.in, MAX (min_len, XZ_READ_SIZE), 1, "xz_in");
+
+    while (xz.in.len < min_len) {
+        size_t bytes = fread (AFTERENT (char, xz.in), 1, xz.in.size - xz.in.len, xz.fp);
+        ASSERTE (!ferror (xz.fp), "failed to read %s: %s", txt_name, strerror (errno));
+
+        if (!bytes) {
+            xz.in_eof = true;
+            return false;
+        }
+        xz.in.len += bytes;
+    }
+
+    return true;
+}
+
+static inline void xz_assert_input (uint64_t min_len)
+{
+    ASSINP (xz_read_input (min_len), "%s: unexpected end of file - xz data is truncated", txt_name);
+}
+
+// reads a variable-length integer at XZ_IN[*i], and advances *i
+static uint64_t xz_varint (uint64_t *i)
+{
+    uint64_t value = 0;
+    for (unsigned shift=0; shift < 63; shift += 7) {
+        xz_assert_input (*i + 1);
+        uint8_t b = XZ_IN[(*i)++];
+
+        value |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) return value;
+    }
+
+    ABORTINP ("%s: invalid xz data - bad integer", txt_name);
+    return 0;
+}
+
+// parses the stream header at XZ_IN[pos]. the header was already read.
+static void xz_parse_stream_header (uint64_t pos)
+{
+    const uint8_t *h = XZ_IN + pos;
+    uint32_t crc32;
+    memcpy (&crc32, h + 8, 4);
+
+    ASSINP (!memcmp (h, xz_magic, sizeof (xz_magic)), "%s is not a valid xz file", txt_name);
+    ASSINP (!h[6] && !(h[7] & 0xf0) && libdeflate_crc32 (0, h + 6, 2) == LTEN32 (crc32),
+            "%s: invalid xz stream header - the file is either corrupt or of an unsupported xz version", txt_name);
+
+    xz.check_type = h[7];
+}
+
+// parses the block header at XZ_IN[b->start]. the header was already read.
+static void xz_parse_block_header (XzBlock *b)
+{
+    const uint8_t *h = XZ_IN + b->start;
+    uint32_t crc32;
+    memcpy (&crc32, h + b->header_len - 4, 4);
+
+    ASSINP (libdeflate_crc32 (0, h, b->header_len - 4) == LTEN32 (crc32), "%s: invalid xz data - bad block header", txt_name);
+    ASSINP (!(h[1] & 0x3c), "%s: unsupported xz block header - it was probably compressed with a newer version of xz", txt_name);
+
+    uint64_t i = b->start + 2;
+    b->comp_len   = (h[1] & 0x40) ? xz_varint (&i) : XZ_UNKNOWN;
+    b->uncomp_len = (h[1] & 0x80) ? xz_varint (&i) : XZ_UNKNOWN;
+
+    uint64_t filter_id  = xz_varint (&i);
+    uint64_t props_size = xz_varint (&i);
+    ASSINP (!(h[1] & 3) && filter_id == 0x21 && props_size == 1,
+            "%s: this xz file uses a filter other than LZMA2, which is not supported. Please decompress it with xz first", txt_name);
+
+    uint8_t dict_props = XZ_IN[i];
+    ASSINP (dict_props <= 40, "%s: invalid xz data - bad LZMA2 properties", txt_name);
+    b->dict_size = (dict_props == 40) ? 0xffffffff : ((2 | (dict_props & 1)) << (dict_props / 2 + 11));
+
+    b->check_type = xz.check_type;
+}
+
+// returns the length of the index starting at XZ_IN[pos] - we skip the index, as we don't need it
+static uint64_t xz_index_len (uint64_t pos)
+{
+    uint64_t i = pos + 1; // skip the index indicator
+    uint64_t num_records = xz_varint (&i);
+
+    for (uint64_t rec_i=0; rec_i < num_records; rec_i++) {
+        xz_varint (&i); // unpadded size
+        xz_varint (&i); // uncompressed size
+    }
+
+    return XZ_PAD4 (i - pos) + 4; // index padding + CRC32
+}
+
+// LzmaDec_UpdateWithUncompressed of the LZMA SDK (Lzma2Dec.c)
+static void xz_lzma2_copy_uncompressed (CLzmaDec *dec, const uint8_t *src, uint32_t size)
+{
+    memcpy (dec->dic + dec->dicPos, src, size);
+    dec->dicPos += size;
+
+    if (!dec->checkDicSize && dec->prop.dicSize - dec->processedPos <= size)
+        dec->checkDicSize = dec->prop.dicSize;
+
+    dec->processedPos += size;
+}
+
+// decompresses one LZMA2 chunk into th->dec.dic at th->dec.dicPos. returns the number of compressed bytes of the chunk,
+// 0 if in_len does not contain the entire chunk, or -1 if the data is corrupt. Sets *is_end if the chunk is the end marker.
+static int64_t xz_lzma2_decode_chunk (XzThread *th, const uint8_t *in, uint64_t in_len, bool *is_end)
+{
+    if (!in_len) return 0;
+
+    CLzmaDec *dec = &th->dec;
+    uint8_t control = in[0];
+
+    // end of the LZMA2 data of the block
+    if (!control) {
+        *is_end = true;
+        return 1;
+    }
+
+    // uncompressed chunk. control=1 means dictionary reset
+    if (control <= 2) {
+        if (in_len < 3) return 0;
+
+        uint32_t unpacked = ((in[1] << 8) | in[2]) + 1;
+        if (in_len < 3 + unpacked) return 0;
+
+        if (control == 1) th->need_init = 0xc0; // next LZMA chunk must set new properties
+        else if (th->need_init == 0xe0) return -1; // first chunk must reset the dictionary
+
+        if (dec->dicPos + unpacked > dec->dicBufSize) return -1;
+
+        LzmaDec_InitDicAndState (dec, control == 1, false);
+        xz_lzma2_copy_uncompressed (dec, in + 3, unpacked);
+        return 3 + unpacked;
+    }
+
+    if (control < 0x80) return -1; // invalid control byte
+
+    // LZMA chunk. bits 5-6 of control are the reset mode: 0 - none, 1 - state, 2 - state & new properties, 3 - state, properties & dictionary
+    uint32_t mode = (control >> 5) & 3;
+    uint32_t header_len = (mode >= 2) ? 6 : 5;
+    if (in_len < header_len) return 0;
+
+    uint32_t unpacked = (((uint32_t)(control & 0x1f) << 16) | (in[1] << 8) | in[2]) + 1;
+    uint32_t packed   = ((in[3] << 8) | in[4]) + 1;
+    if (in_len < header_len + packed) return 0;
+
+    if (control < th->need_init || dec->dicPos + unpacked > dec->dicBufSize) return -1;
+    th->need_init = 0;
+
+    if (mode >= 2) {
+        uint8_t props = in[5];
+        uint32_t lc = props % 9, lp = (props / 9) % 5;
+        if (props >= 9 * 5 * 5 || lc + lp > 4) return -1;
+
+        dec->prop.lc = lc;
+        dec->prop.lp = lp;
+        dec->prop.pb = props / (9 * 5);
+    }
+
+    LzmaDec_InitDicAndState (dec, mode == 3, mode > 0);
+
+    SizeT src_len = packed, dic_limit = dec->dicPos + unpacked;
+    ELzmaStatus status;
+    SRes res = LzmaDec_DecodeToDic (dec, dic_limit, in + header_len, &src_len, LZMA_FINISH_END, &status);
+
+    // a chunk ends without an end mark, exactly at the end of its compressed and uncompressed data
+    if (res != SZ_OK || status != LZMA_STATUS_MAYBE_FINISHED_WITHOUT_MARK || src_len != packed || dec->dicPos != dic_limit)
+        return -1;
+
+    return header_len + packed;
+}
+
+static bool xz_decompress_block (XzThread *th, XzBlock *b)
+{
+    const uint8_t *in = XZ_IN + b->start + b->header_len;
+    uint8_t *out = ENT (uint8_t, xz.out, b->out_offset);
+
+    th->need_init      = 0xe0;
+    th->dec.dic        = out;
+    th->dec.dicBufSize = b->uncomp_len;
+    th->dec.dicPos     = 0;
+    th->dec.prop.dicSize = b->dict_size;
+
+    bool is_end = false;
+    uint64_t i = 0;
+    while (!is_end) {
+        int64_t chunk_len = xz_lzma2_decode_chunk (th, in + i, b->comp_len - i, &is_end);
+        if (chunk_len <= 0) return false;
+        i += chunk_len;
+    }
+
+    if (i != b->comp_len || th->dec.dicPos != b->uncomp_len) return false;
+
+    uint64_t check = xz_update_check (b->check_type, 0, out, b->uncomp_len);
+    return xz_is_check_ok (b->check_type, check, XZ_IN + b->start + XZ_PAD4 (b->header_len + b->comp_len));
+}
+
+static void *xz_decompress_thread (void *arg)
+{
+    XzThread *th = (XzThread *)arg;
+    ARRAY (XzBlock, blocks, xz.blocks);
+
+    for (uint64_t i=th->thread_i; i < xz.blocks.len; i += xz.num_threads)
+        blocks[i].is_ok = xz_decompress_block (th, &blocks[i]);
+
+    return NULL;
+}
+
+// start streaming a block whose header was already consumed
+static void xz_stream_start (XzBlock *b)
+{
+    ASSINP (b->dict_size <= XZ_MAX_DICT_SIZE, "%s: the xz dictionary size (%u MB) is too large", txt_name, b->dict_size >> 20);
+
+    XzThread *th = &xz.threads[0];
+    uint64_t dict_size = (b->uncomp_len != XZ_UNKNOWN) ? MIN (b->dict_size, b->uncomp_len) : b->dict_size;
+    uint64_t dic_len   = dict_size + 2 * XZ_CHUNK_MAX_UNPACKED;
+    buf_alloc (evb, &xz.dic, dic_len, 1, "xz_dic");
+
+    th->need_init      = 0xe0;
+    th->dec.dic        = (uint8_t *)xz.dic.data;
+    th->dec.dicBufSize = dic_len;
+    th->dec.dicPos     = 0;
+    th->dec.prop.dicSize = b->dict_size;
+
+    xz.stream_block      = *b;
+    xz.stream_comp_len   = xz.stream_uncomp_len = 0;
+    xz.stream_check      = 0;
+    xz.is_streaming = true;
+}
+
+// verify the block padding and check after the last chunk of a streamed block
+static void xz_stream_end (void)
+{
+    XzBlock *b = &xz.stream_block;
+    uint64_t pad_len = XZ_PAD4 (b->header_len + xz.stream_comp_len) - (b->header_len + xz.stream_comp_len);
+    uint64_t trailer_len = pad_len + xz_check_len[b->check_type];
+
+    xz_assert_input (trailer_len);
+    ASSINP (xz_is_check_ok (b->check_type, xz.stream_check, XZ_IN + pad_len) &&
+            (b->comp_len   == XZ_UNKNOWN || b->comp_len   == xz.stream_comp_len) &&
+            (b->uncomp_len == XZ_UNKNOWN || b->uncomp_len == xz.stream_uncomp_len),
+            "%s: failed to decompress xz data - the file is corrupt", txt_name);
+
+    xz.in.param += trailer_len;
+    xz.consumed += trailer_len;
+    xz.is_streaming = false;
+}
+
+// decompress (part of) a block, chunk by chunk
+static void xz_stream (void)
+{
+    XzThread *th = &xz.threads[0];
+    CLzmaDec *dec = &th->dec;
+    XzBlock *b = &xz.stream_block;
+
+    buf_alloc (evb, &xz.out, XZ_STREAM_OUT + XZ_CHUNK_MAX_UNPACKED, 1, "xz_out");
+    xz.out.len = xz.out.param = 0;
+
+    uint64_t in_used = 0;
+    while (xz.out.len < XZ_STREAM_OUT) {
+
+        // slide the dictionary, keeping only the part that can still be referred to
+        if (dec->dicPos + XZ_CHUNK_MAX_UNPACKED > dec->dicBufSize) {
+            uint64_t keep = MIN (dec->dicPos, dec->dicBufSize - 2 * XZ_CHUNK_MAX_UNPACKED);
+            memmove (dec->dic, dec->dic + dec->dicPos - keep, keep);
+            dec->dicPos = keep;
+        }
+
+        xz_read_input (XZ_CHUNK_MAX_HEADER + XZ_CHUNK_MAX_PACKED); // might be less if at EOF
+
+        bool is_end = false;
+        SizeT dic_pos = dec->dicPos;
+        int64_t chunk_len = xz_lzma2_decode_chunk (th, XZ_IN, XZ_AVAIL, &is_end);
+
+        ASSINP (chunk_len, "%s: unexpected end of file - xz data is truncated", txt_name);
+        ASSINP (chunk_len > 0, "%s: failed to decompress xz data - the file is corrupt", txt_name);
+
+        xz.in.param  += chunk_len;
+        xz.consumed  += chunk_len;
+        xz.stream_comp_len += chunk_len;
+        in_used      += chunk_len;
+
+        uint32_t out_len = dec->dicPos - dic_pos;
+        memcpy (AFTERENT (char, xz.out), dec->dic + dic_pos, out_len);
+        xz.stream_check = xz_update_check (b->check_type, xz.stream_check, dec->dic + dic_pos, out_len);
+        xz.out.len    += out_len;
+        xz.stream_uncomp_len += out_len;
+
+        if (is_end) {
+            xz_stream_end();
+            break;
+        }
+    }
+
+    if (xz.out.len) xz.comp_ratio = (double)in_used / (double)xz.out.len;
+}
+
+// decompress up to num_threads complete blocks in parallel. Also consumes stream headers, indices and stream footers.
+static void xz_decompress_round (void)
+{
+    xz_read_input (XZ_READ_SIZE);
+    xz.blocks.len = 0;
+
+    uint64_t pos = 0; // relative to XZ_IN
+    uint64_t out_len = 0;
+
+    while (xz.blocks.len < xz.num_threads) {
+
+        // case: between streams (or at the beginning of the file) - skip stream padding and read the stream header
+        if (!xz.in_stream) {
+            if (xz.consumed + pos)
+                while (xz_read_input (pos + 1) && !XZ_IN[pos]) pos++;
+
+            // case: EOF
+            if (!xz_read_input (pos + 1)) {
+                ASSINP (xz.consumed + pos, "%s: xz file is empty", txt_name);
+                xz.is_done = true;
+                break;
+            }
+
+            xz_assert_input (pos + XZ_FOOTER_LEN);
+            xz_parse_stream_header (pos);
+            pos += XZ_FOOTER_LEN;
+            xz.in_stream = true;
+        }
+
+        xz_assert_input (pos + 1);
+
+        // case: index - marks the end of the blocks of this stream. we skip it and the stream footer that follows it
+        if (!XZ_IN[pos]) {
+            pos += xz_index_len (pos);
+            xz_assert_input (pos + XZ_FOOTER_LEN);
+            ASSINP (XZ_IN[pos+10] == 'Y' && XZ_IN[pos+11] == 'Z', "%s: invalid xz data - bad stream footer", txt_name);
+            pos += XZ_FOOTER_LEN;
+            xz.in_stream = false;
+            continue;
+        }
+
+        XzBlock b = { .start = pos, .header_len = (XZ_IN[pos] + 1) * 4 };
+        xz_assert_input (pos + b.header_len);
+        xz_parse_block_header (&b);
+
+        // case: block sizes are not known, or the block is too big to hold in memory - we stream it (after decompressing previous blocks)
+        if (b.comp_len == XZ_UNKNOWN || b.uncomp_len == XZ_UNKNOWN || b.comp_len + b.uncomp_len > XZ_MAX_BLOCK_IN_MEM) {
+            if (!xz.blocks.len) {
+                pos += b.header_len;
+                xz_stream_start (&b);
+            }
+            break;
+        }
+
+        uint64_t block_len = XZ_PAD4 (b.header_len + b.comp_len) + xz_check_len[b.check_type];
+        xz_assert_input (pos + block_len);
+
+        b.out_offset = out_len;
+        out_len += b.uncomp_len;
+        pos     += block_len;
+
+        buf_alloc_more (evb, &xz.blocks, 1, xz.num_threads, XzBlock, 1, "xz_blocks");
+        NEXTENT (XzBlock, xz.blocks) = b;
+    }
+
+    buf_alloc (evb, &xz.out, out_len, 1.1, "xz_out");
+
+    // decompress in parallel - thread 0 is the I/O thread
+    pthread_t thread_ids[XZ_MAX_THREADS];
+    uint32_t num_threads = MIN (xz.num_threads, xz.blocks.len);
+
+    for (uint32_t thread_i=1; thread_i < num_threads; thread_i++) {
+        int err = pthread_create (&thread_ids[thread_i], NULL, xz_decompress_thread, &xz.threads[thread_i]);
+        ASSERTE (!err, "failed to create thread for xz decompression: %s", strerror (err));
+    }
+
+    if (xz.blocks.len) xz_decompress_thread (&xz.threads[0]);
+
+    for (uint32_t thread_i=1; thread_i < num_threads; thread_i++)
+        pthread_join (thread_ids[thread_i], NULL);
+
+    for (uint64_t i=0; i < xz.blocks.len; i++)
+        ASSINP (ENT (XzBlock, xz.blocks, i)->is_ok, "%s: failed to decompress xz data - the file is corrupt", txt_name);
+
+    xz.out.len   = out_len;
+    xz.out.param = 0;
+    xz.in.param += pos;
+    xz.consumed += pos;
+
+    if (out_len) xz.comp_ratio = (double)pos / (double)out_len;
+}
+
+// ZIP I/O thread: returns the number of bytes read, 0 if EOF.
+uint32_t xz_read (File *file, char *data, uint32_t max_bytes)
+{
+    uint32_t bytes_read = 0;
+
+    while (bytes_read < max_bytes) {
+        if (xz.out.param == xz.out.len) {
+            if (xz.is_streaming)
+                xz_stream();
+
+            else if (xz.is_done)
+                break; // EOF
+
+            else
+                xz_decompress_round();
+
+            continue;
+        }
+
+        uint32_t len = MIN (max_bytes - bytes_read, xz.out.len - xz.out.param);
+        memcpy (&data[bytes_read], ENT (char, xz.out, xz.out.param), len);
+        xz.out.param += len;
+        bytes_read   += len;
+    }
+
+    // compressed bytes consumed, not including compressed bytes of data decompressed but not yet passed to the caller
+    file->disk_so_far = xz.consumed - (uint64_t)((double)(xz.out.len - xz.out.param) * xz.comp_ratio);
+
+    return bytes_read;
+}
@@ -0,0 +1,15 @@
+// ------------------------------------------------------------------
+//   xz.h
+//   Copyright (C) 2020 Divon Lan <divon@genozip.com>
+//   Please see terms and conditions in the files LICENSE.non-commercial.txt and LICENSE.commercial.txt
+
+#ifndef XZ_INCLUDED
+#define XZ_INCLUDED
+
+#include "genozip.h"
+
+extern void xz_open (FileP file);
+extern uint32_t xz_read (FileP file, char *data, uint32_t max_bytes);
+extern void xz_close (void);
+
+#endif
@@ -248,9 +248,13 @@ void zfile_uncompress_section (VBlock *vb,
             uncompressed_data->len = data_uncompressed_len;
         }
 
-        comp_uncompress (vb, section_header->codec, section_header->sub_codec, param,
-                         (char*)section_header + compressed_offset, data_compressed_len, 
-                         uncompressed_data, data_uncompressed_len);
+        if (expected_section_type == SEC_LOCAL && section_header->flags.ctx.chunked)
+            comp_uncompress_chunks (vb, section_header->codec, (char*)section_header + compressed_offset, data_compressed_len, 
+                                    uncompressed_data, data_uncompressed_len);
+        else
+            comp_uncompress (vb, section_header->codec, section_header->sub_codec, param,
+                             (char*)section_header + compressed_offset, data_compressed_len, 
+                             uncompressed_data, data_uncompressed_len);
     }
  
     if (flag.show_b250 && expected_section_type == SEC_B250) 
@@ -328,6 +332,7 @@ uint32_t zfile_compress_local_data (VBlock *vb, Context *ctx, uint32_t sample_si
     struct FlagsCtx flags = ctx->flags; // make a copy
     flags.paired     = ctx->pair_local;
     flags.copy_param = ctx->local_param;
+    flags.chunked    = false; // set by comp_compress if the data is large enough to be compressed in chunks
                     
     uint32_t uncompressed_len = ctx->local.len * lt_desc[ctx->ltype].width;
     
@@ -95,6 +95,145 @@ static void zip_display_compression_ratio (Dispatcher dispatcher, Digest md5, bo
     }
 }
 
+// VB size adaptation: vblock_memory, as set by the user or by zip_dynamically_set_max_memory, is the upper bound. While
+// compressing, we shrink it if needed (a) to keep the memory of all VBs in flight within --max-memory and (b) near the
+// end of the file, if compute threads are idle, so that the remaining data is spread across all threads.
+#define ADAPT_MIN_VB_NSEC 250000000ULL // don't shrink VBs to less than ~250ms of compute - per-VB overhead would dominate
+#define ADAPT_EWMA_WEIGHT 0.3          // weight of the most recent VB in the running estimates
+
+static struct {
+    uint64_t target;      // upper bound of vblock_memory 
+    double mem_per_byte;  // estimated VB buffer memory per byte of txt data 
+    double nsec_per_byte; // estimated compute time per byte of txt data 
+    unsigned max_threads; // compute threads of the current file
+    uint32_t longest_line_len; // longest line seen so far - a VB must fit at least one line
+    bool idle_threads;    // compute threads were idle when we last read a VB
+} adapt = {};
+
+static inline bool zip_adapt_is_enabled (void)
+{
+    // --pair: R2 VBs follow R1 VBs line-for-line ; --make-reference: VB size determines the reference ranges ; 
+    // FASTA with a reference or --multifasta: a VB ends only at the end of a contig, so it cannot be shrunk
+    return flag.pair == NOT_PAIRED_END && !flag.make_reference &&
+           !(z_file->data_type == DT_FASTA && (flag.reference == REF_EXTERNAL || flag.reference == REF_EXT_STORE || flag.multifasta));
+}
+
+// upper bound of vblock_memory, so that all VBs that might be in memory concurrently fit within --max-memory
+static uint64_t zip_adapt_memory_cap (void)
+{
+    if (!flag.max_memory || !adapt.mem_per_byte) return adapt.target;
+
+    // memory not related to the VBs: z_file contexts, txt_file buffers, reference etc
+    uint64_t baseline = buf_vb_memory_usage (evb) + (flag.reference != REF_NONE ? ref_memory_consumption().bytes : 0);
+    if (baseline >= flag.max_memory) return 0;
+
+    // up to one VB per compute thread, and one more being read
+    return (uint64_t)((double)(flag.max_memory - baseline) / (double)(adapt.max_threads + 1) / adapt.mem_per_byte);
+}
+
+static void zip_adapt_set_vblock_memory (uint64_t vblock_memory, const char *reason)
+{
+    // never shrink below twice the longest line seen so far, so that a VB always has room for its lines and the unconsumed data passed up
+    vblock_memory = MIN (MAX (MAX (vblock_memory, VBLOCK_MEMORY_MIN_ADAPT), 2 * (uint64_t)adapt.longest_line_len), adapt.target);
+    if (vblock_memory == flag.vblock_memory) return;
+
+    if (flag.show_memory) 
+        iprintf ("\nAdapted vblock_memory from %s to %s (%s)\n", 
+                 str_size (flag.vblock_memory).s, str_size (vblock_memory).s, reason);
+
+    flag.vblock_memory = vblock_memory;
+}
+
+// --max-memory backpressure: don't read another VB if it might exceed the budget, as long as there are VBs in flight that 
+// will release their memory when completed. If there are none, shrink the VB to what fits, and error only if nothing fits.
+static bool zip_adapt_memory_permits_read (Dispatcher dispatcher)
+{
+    if (!flag.max_memory || !adapt.mem_per_byte) return true;
+
+    uint64_t in_use = buf_get_memory_in_use();
+    if (in_use + (uint64_t)((double)flag.vblock_memory * adapt.mem_per_byte) <= flag.max_memory) return true;
+
+    if (dispatcher_get_num_running_threads (dispatcher)) return false; // wait for a running VB to complete
+
+    // no VBs in flight - memory in use will not go down by waiting
+    uint64_t available = (in_use < flag.max_memory) ? flag.max_memory - in_use : 0;
+    uint64_t fits      = (uint64_t)((double)available / adapt.mem_per_byte);
+
+    if (zip_adapt_is_enabled()) {
+        ASSINP (fits >= VBLOCK_MEMORY_MIN_ADAPT, "%s: cannot compress %s within --max-memory=%s: %s is already in use (eg by the reference), "
+                "and the smallest possible data block requires about %s more. Please run again with a larger --max-memory",
+                global_cmd, txt_name, str_size (flag.max_memory).s, str_size (in_use).s, 
+                str_size ((uint64_t)((double)VBLOCK_MEMORY_MIN_ADAPT * adapt.mem_per_byte)).s);
+
+        zip_adapt_set_vblock_memory (fits, "max-memory backpressure");
+    }
+    else
+        ASSINP (available, "%s: cannot compress %s within --max-memory=%s: %s is already in use (eg by the reference). Please run again with a larger --max-memory",
+                global_cmd, txt_name, str_size (flag.max_memory).s, str_size (in_use).s);
+
+    return true;
+}
+
+// called at the start of each file - start again from the target, capped by the memory observed so far
+static void zip_adapt_start_file (unsigned max_threads)
+{
+    adapt.max_threads   = max_threads;
+    adapt.nsec_per_byte = 0;
+    adapt.idle_threads  = false;
+
+    if (!adapt.target && flag.vblock_memory) adapt.target = flag.vblock_memory; // set by the user or a previous file
+
+    if (adapt.target && zip_adapt_is_enabled()) 
+        zip_adapt_set_vblock_memory (MIN (adapt.target, zip_adapt_memory_cap()), "start of file");
+}
+
+// I/O thread: called after each VB is compressed, to update the estimates and set the size of the next VBs to be read
+static void zip_adapt_vblock_memory (VBlockP vb)
+{
+    if (!zip_adapt_is_enabled() || !vb->vb_data_size) return;
+
+    if (!adapt.target) adapt.target = flag.vblock_memory; // vblock_memory was set without zip_dynamically_set_max_memory
+
+    adapt.longest_line_len = MAX (adapt.longest_line_len, vb->longest_line_len);
+
+    double mem_per_byte  = (double)buf_vb_memory_usage (vb) / (double)vb->vb_data_size;
+    double nsec_per_byte = (double)vb->compute_nsec / (double)vb->vb_data_size;
+
+    #define EWMA(est, new) est = (est) ? (ADAPT_EWMA_WEIGHT * (new) + (1 - ADAPT_EWMA_WEIGHT) * (est)) : (new)
+    EWMA (adapt.mem_per_byte, mem_per_byte);
+    EWMA (adapt.nsec_per_byte, nsec_per_byte);
+    #undef EWMA
+
+    uint64_t vblock_memory = adapt.target;
+    const char *reason = "target";
+
+    // (a) memory: keep all VBs in flight within --max-memory
+    uint64_t mem_cap = zip_adapt_memory_cap();
+    if (mem_cap < vblock_memory) {
+        vblock_memory = mem_cap;
+        reason = "max-memory";
+    }
+
+    // (b) parallelism: if threads are idle and the remaining data is too little to keep them all busy, spread it across 
+    // all threads, but not less than the size worth ADAPT_MIN_VB_NSEC of compute. not if the user set the VB size with --vblock.
+    uint64_t remaining = txt_file->txt_data_size_single > txt_file->txt_data_so_far_single 
+                       ? txt_file->txt_data_size_single - txt_file->txt_data_so_far_single : 0; // 0 if size is unknown (eg stdin)
+
+    if (!flag.vblock && adapt.idle_threads && remaining && remaining < vblock_memory * adapt.max_threads) {
+        uint64_t min_by_time  = (uint64_t)((double)ADAPT_MIN_VB_NSEC / adapt.nsec_per_byte);
+        uint64_t spread       = MAX (remaining / adapt.max_threads, min_by_time);
+        if (spread < vblock_memory) {
+            vblock_memory = spread;
+            reason = "idle threads";
+        }
+    }
+
+    // change gradually, as the estimates are based on past VBs
+    vblock_memory = MIN (MAX (vblock_memory, flag.vblock_memory / 2), flag.vblock_memory * 2);
+
+    zip_adapt_set_vblock_memory (vblock_memory, reason);
+}
+
 // we segment the first line of the txt file and see how many contexts were created. when then set
 // global_max_memory_per_vb to 1MB per context (subject to VBLOCK_MEMORY_MIN/MAX_DYN). rational: we need sufficient amount 
 // of data in each context for the generic codecs to work well. if compressing multiple files,
@@ -145,6 +284,11 @@ static void zip_dynamically_set_max_memory (void)
                 iprintf ("\nDyamically set vblock_memory to %u MB (num_contexts=%u num_vcf_samples=%u)\n", 
                          (unsigned)(flag.vblock_memory >> 20), vb->num_contexts, vcf_header_get_num_samples());
 
+            // use the memory of the segmented test VB as a first estimate, so that with --max-memory already the first VBs are within budget
+            adapt.target       = flag.vblock_memory;
+            adapt.mem_per_byte = (double)buf_vb_memory_usage (vb) / (double)vb->txt_data.len;
+            if (zip_adapt_is_enabled()) zip_adapt_set_vblock_memory (zip_adapt_memory_cap(), "max-memory");
+
             // on Windows and Mac - which tend to have less memory in typical configurations, warn if we need a lot
 #if defined _WIN32 || defined APPLE
             ASSERTW (flag.vblock_memory * (uint64_t)global_max_threads < (1 << 30),  // 1 GB
@@ -513,6 +657,9 @@ static void zip_write_global_area (Dispatcher dispatcher, Digest single_componen
     Buffer *dict_id_aliases_buf = dict_id_create_aliases_buf();
     if (dict_id_aliases_buf->len) zfile_compress_section_data (evb, SEC_DICT_ID_ALIASES, dict_id_aliases_buf);
 
+    // add ZSTD dictionaries, if any were trained
+    codec_zstd_compress_dicts();
+
     // if this data has random access (i.e. it has chrom and pos), compress all random access records into evb->z_data
     if (DTPZ(has_random_access)) 
         random_access_compress (&z_file->ra_buf, SEC_RANDOM_ACCESS, flag.show_index ? "Random-access index contents (result of --show-index)" : NULL);
@@ -531,6 +678,9 @@ static void zip_compress_one_vb (VBlock *vb)
 {
     START_TIMER; 
 
+    TimeSpecType start_time; // measured regardless of --show-time, for zip_adapt_vblock_memory
+    clock_gettime (CLOCK_REALTIME, &start_time);
+
     // if the txt file is compressed with BGZF, we uncompress now, in the compute thread
     if (txt_file->codec == CODEC_BGZF && flag.pair != PAIR_READ_2) 
         bgzf_uncompress_vb (vb);    // some of the blocks might already have been decompressed while reading - we decompress the remaining
@@ -589,6 +739,10 @@ static void zip_compress_one_vb (VBlock *vb)
     // compress data-type specific sections
     DT_FUNC (vb, compress)(vb);
 
+    TimeSpecType end_time;
+    clock_gettime (CLOCK_REALTIME, &end_time);
+    vb->compute_nsec = (uint64_t)(end_time.tv_sec - start_time.tv_sec) * 1000000000ULL + end_time.tv_nsec - start_time.tv_nsec;
+
     // tell dispatcher this thread is done and can be joined.
     // thread safety: this isn't protected by a mutex as it will just be false until it at some point turns to true
     // this this operation needn't be atomic, but it likely is anyway
@@ -629,9 +783,9 @@ void zip_one_file (const char *txt_basename,
                    bool z_closes_after_me) // we will finalize this z_file after writing this component
 {
     static DataType last_data_type = DT_NONE;
-    static uint32_t prev_file_first_vb_i=0, prev_file_last_vb_i=0; // used if we're binding files - the vblock_i will continue from one file to the next
+    static uint32_t prev_file_last_vb_i=0; // used if we're binding files - the vblock_i will continue from one file to the next
     
-    if (!flag.bind) prev_file_first_vb_i = prev_file_last_vb_i = 0; // reset if we're not binding
+    if (!flag.bind) prev_file_last_vb_i = 0; // reset if we're not binding
 
     // we cannot bind files of different type
     ASSINP (!flag.bind || txt_file->data_type == last_data_type || last_data_type == DT_NONE, 
@@ -645,7 +799,7 @@ void zip_one_file (const char *txt_basename,
                                              prev_file_last_vb_i, false, is_last_file, z_closes_after_me,
                                              txt_basename, PROGRESS_PERCENT, 0);
 
-    uint32_t first_vb_i = prev_file_last_vb_i + 1;
+    zip_adapt_start_file (flag.xthreads ? 1 : global_max_threads);
 
     dict_id_initialize (z_file->data_type);
 
@@ -690,20 +844,27 @@ void zip_one_file (const char *txt_basename,
             max_lines_per_vb = MAX (max_lines_per_vb, processed_vb->lines.len);
             txt_line_i += (uint32_t)processed_vb->lines.len;
 
+            // keep the sections R2 will need, so it doesn't need to re-read them from z_file
+            if (flag.pair == PAIR_READ_1 && !flag.make_reference && !flag.seg_only)
+                fastq_zip_save_pair_1_data (processed_vb);
+
             if (!flag.make_reference && !flag.seg_only)
                 zfile_output_processed_vb (processed_vb);
             
             zip_update_txt_counters (processed_vb);
 
+            zip_adapt_vblock_memory (processed_vb);
+
             z_file->num_vbs++;
             
             dispatcher_recycle_vbs (dispatcher);
         }        
         
         // PRIORITY 3: If there is no variant block available to compute or to output, but input is not exhausted yet - read one
-        else if (!next_vb && !dispatcher_is_input_exhausted (dispatcher)) {
+        else if (!next_vb && !dispatcher_is_input_exhausted (dispatcher) && zip_adapt_memory_permits_read (dispatcher)) {
 
             next_vb = dispatcher_generate_next_vb (dispatcher, 0);
+            adapt.idle_threads = has_free_thread;
 
             // if we're compressing the 2nd file in a fastq pair (with --pair) - look back at the z_file data
             // and copy the data we need for this vb. note: we need to do this before txtfile_read_vblock as
@@ -716,7 +877,7 @@ void zip_one_file (const char *txt_basename,
                 ctx_clone (next_vb); 
 
                 // returns false if their is no vb with vb_i in the previous file
-                read_txt = fastq_read_pair_1_data (next_vb, prev_file_first_vb_i, prev_file_last_vb_i); // read here, decompressed in fastq_seg_initialize
+                read_txt = fastq_zip_get_pair_1_data (next_vb); // copied here from memory, decompressed in fastq_seg_initialize
             }
 
             if (read_txt) {
@@ -771,6 +932,8 @@ void zip_one_file (const char *txt_basename,
     // write the BGZF section containing BGZF block sizes, if this txt file is compressed with BGZF
     bgzf_compress_bgzf_section();
 
+    if (flag.pair == PAIR_READ_2) fastq_zip_free_pair_1_data();
+
     // if this a non-bound file, or the last component of a bound file - write the genozip header, random access and dictionaries
 finish:
     z_file->txt_disk_so_far_bind  += (int64_t)txt_file->disk_so_far + (txt_file->codec==CODEC_BGZF)*BGZF_EOF_LEN;
@@ -790,9 +953,8 @@ finish:
     memset (&z_file->digest_ctx_single, 0, sizeof (z_file->digest_ctx_single));
 
     if (z_closes_after_me) 
-        prev_file_first_vb_i = prev_file_last_vb_i = 0; // reset statics
+        prev_file_last_vb_i = 0; // reset statics
     
-    prev_file_first_vb_i = first_vb_i;
     dispatcher_finish (&dispatcher, &prev_file_last_vb_i);
 
     DT_FUNC (txt_file, zip_finalize)();